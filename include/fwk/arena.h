@@ -0,0 +1,162 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/sys/memory.h"
+#include "fwk/sys_base.h"
+#include <atomic>
+
+namespace fwk {
+
+class Arena;
+
+namespace detail {
+	// Registry of memory ranges of all existing arenas; it allows containers to find out if
+	// their memory belongs to an arena without storing any additional data.
+	constexpr int max_arenas = 64;
+	struct ArenaSlot {
+		std::atomic<const char *> begin = nullptr, end = nullptr;
+		std::atomic<Arena *> arena = nullptr;
+	};
+	extern ArenaSlot g_arena_slots[max_arenas];
+	extern std::atomic<int> g_num_arena_slots;
+	// Range which encloses memory of all arenas; It's empty when there are no arenas
+	extern std::atomic<uintptr_t> g_arenas_begin, g_arenas_end;
+
+	Arena *findArenaSlot(const void *);
+
+	// Memory which doesn't belong to any arena is (most of the time) rejected without
+	// scanning the slots
+	inline Arena *findArena(const void *ptr) {
+		auto value = uintptr_t(ptr);
+		if(value < g_arenas_begin.load(std::memory_order_relaxed) ||
+		   value >= g_arenas_end.load(std::memory_order_relaxed))
+			return nullptr;
+		return findArenaSlot(ptr);
+	}
+}
+
+// Linear (bump-pointer) allocator for short-lived data, for example per-frame temporaries.
+// Memory is a single buffer of fixed capacity; allocation is a pointer increment, deallocation
+// does nothing (except for the last allocation, which can also be grown in place).
+// Memory is reclaimed all at once with reset() or partially with reset(Marker)
+// (all allocations made after the marker was taken are released).
+// When there is not enough space, allocate() falls back to fwk::allocate().
+//
+// Vector, PodVector & HashMap can be constructed with an arena; their storage is then allocated
+// (also when growing) in the arena. Such containers cannot be used after their memory was
+// released with reset. Vectors also have to be destroyed before that: when freed, they release
+// their memory with freeLast(), which could roll back memory of newer allocations at the same
+// offset. Number of vectors allocated in the arena is tracked & it's verified (with PASSERT)
+// that reset doesn't release memory of any vector allocated after the marker.
+// Arena isn't thread-safe, but memory from it can be accessed by any thread.
+// At most detail::max_arenas arenas can exist at the same time.
+class Arena {
+  public:
+	struct Marker {
+		size_t offset;
+		int num_vectors;
+	};
+
+	// Resets arena to the marker taken at construction
+	class Scope {
+	  public:
+		Scope(Arena &arena) : m_arena(arena), m_marker(arena.marker()) {}
+		~Scope() { m_arena.reset(m_marker); }
+
+		Scope(const Scope &) = delete;
+		void operator=(const Scope &) = delete;
+
+	  private:
+		Arena &m_arena;
+		Marker m_marker;
+	};
+
+	explicit Arena(size_t capacity);
+	~Arena();
+
+	Arena(const Arena &) = delete;
+	void operator=(const Arena &) = delete;
+
+	// Returns null if there is not enough space left
+	void *tryAllocate(size_t size, size_t alignment = default_alignment) {
+		size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+		if(offset + size > m_capacity)
+			return nullptr;
+		m_offset = offset + size;
+		m_peak_offset = m_offset > m_peak_offset ? m_offset : m_peak_offset;
+		return m_data + offset;
+	}
+
+	// Falls back to fwk::allocate if there is not enough space left;
+	// Returned memory should be freed with Arena::deallocate()
+	void *allocate(size_t size, size_t alignment = default_alignment) {
+		if(auto *ptr = tryAllocate(size, alignment))
+			return ptr;
+		return allocateFallback(size, alignment);
+	}
+
+	// Does nothing for memory which belongs to any arena; Other memory is freed with
+	// fwk::deallocate
+	static void deallocate(void *ptr, size_t alignment = default_alignment) {
+		if(!detail::findArena(ptr))
+			fwk::deallocate(ptr, alignment);
+	}
+
+	// Grows allocation in place if it's the last one in the arena and there is enough space left
+	bool tryGrowLast(const void *ptr, size_t old_size, size_t new_size) {
+		size_t offset = (const char *)ptr - m_data;
+		if(!old_size || offset + old_size != m_offset || offset + new_size > m_capacity)
+			return false;
+		m_offset = offset + new_size;
+		m_peak_offset = m_offset > m_peak_offset ? m_offset : m_peak_offset;
+		return true;
+	}
+
+	// Releases memory if it's the last allocation in the arena; Otherwise does nothing
+	void freeLast(const void *ptr, size_t size) {
+		size_t offset = (const char *)ptr - m_data;
+		if(size && offset + size == m_offset)
+			m_offset = offset;
+	}
+
+	bool contains(const void *ptr) const { return ptr >= m_data && ptr < m_data + m_capacity; }
+
+	Marker marker() const { return {m_offset, m_num_vectors}; }
+	void reset(Marker);
+	void reset() { reset(Marker{0, 0}); }
+
+	size_t capacity() const { return m_capacity; }
+	size_t usedMemory() const { return m_offset; }
+	// Maximum memory usage since construction
+	size_t peakUsedMemory() const { return m_peak_offset; }
+	// Number of allocations which didn't fit & were passed to fwk::allocate
+	long long numFallbacks() const { return m_num_fallbacks; }
+
+  private:
+	friend class BaseVector;
+	char *begin() const { return m_data; }
+	void *allocateFallback(size_t size, size_t alignment);
+
+	void *allocateVector(size_t size, size_t alignment) {
+		if(auto *ptr = tryAllocate(size, alignment)) {
+			m_num_vectors += size != 0;
+			return ptr;
+		}
+		return allocateFallback(size, alignment);
+	}
+	void freeVector(const void *ptr, size_t size) {
+		if(!size)
+			return;
+		m_num_vectors--;
+		freeLast(ptr, size);
+	}
+
+	char *m_data;
+	size_t m_offset = 0, m_peak_offset = 0, m_capacity;
+	long long m_num_fallbacks = 0;
+	int m_num_vectors = 0;
+	int m_slot = -1;
+};
+}
@@ -0,0 +1,54 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/str.h"
+
+namespace fwk {
+
+// Interned string: all atoms with the same contents share a single, immutable copy of the
+// data, which is never freed. Comparison & hashing are as cheap as for pointers, but creating
+// an atom requires a lookup in a global (thread-safe) table. Useful for names which are
+// repeated and compared a lot (node names, bone names, etc.).
+//
+// operator< compares pointers; use str() to compare contents.
+class Atom {
+  public:
+	Atom();
+	explicit Atom(Str);
+	explicit Atom(const char *str) : Atom(Str(str)) {}
+	explicit Atom(const string &str) : Atom(Str(str)) {}
+
+	// Returns none if given string hasn't been interned yet
+	static Maybe<Atom> find(Str);
+
+	int size() const { return reinterpret_cast<const int *>(m_data)[-1]; }
+	bool empty() const { return size() == 0; }
+	explicit operator bool() const { return !empty(); }
+
+	const char *c_str() const { return m_data; }
+	ZStr str() const { return {m_data, size()}; }
+	operator ZStr() const { return str(); }
+	explicit operator string() const { return string(m_data, m_data + size()); }
+
+	bool operator==(const Atom &rhs) const { return m_data == rhs.m_data; }
+	bool operator<(const Atom &rhs) const { return m_data < rhs.m_data; }
+
+	u32 hash() const {
+		u64 r = u64(m_data) * u64(0xca4bcaa75ec3f625);
+		return u32(r >> 32) + u32(r);
+	}
+
+	void operator>>(TextFormatter &) const;
+
+	// Number of different interned strings
+	static int numAtoms();
+
+  private:
+	explicit Atom(const char *data, int) : m_data(data) {}
+
+	// Size of the string is kept in front of the data
+	const char *m_data;
+};
+}
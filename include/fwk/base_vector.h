@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "fwk/arena.h"
 #include "fwk/math_base.h"
 #include "fwk/span.h"
 #include "fwk/sys/memory.h"
@@ -28,10 +29,20 @@ template <class T> int vectorInsertCapacity(int current, int min_size) {
 	return vectorInsertCapacity(current, (int)sizeof(T), min_size);
 }
 
+// Size & alignment of vector elements; Alignment is only specified (non-zero) for over-aligned
+// types, other types rely on default alignment of fwk::allocate.
+struct VectorElem {
+	template <class T> static constexpr VectorElem of() {
+		return {int(sizeof(T)), alignof(T) > default_alignment ? int(alignof(T)) : 0};
+	}
+
+	int size, alignment;
+};
+
 // This class keeps implementation of vectors which is shared among different instantiations
 // Most functions are in .cpp file to reduce code bloat (in most cases performance loss is negligible)
 //
-// TODO: VectorInfo struct keeping obj_size and pointers to functions?
+// TODO: keep pointers to functions in VectorElem?
 // TODO: better naming of functions, add some description?
 class BaseVector {
   public:
@@ -52,10 +63,10 @@ class BaseVector {
 		rhs.zero();
 	}
 
-	void initializePool(int obj_size) {
-		if(detail::t_vpool_bits) {
+	void initializePool(VectorElem elem) {
+		if(detail::t_vpool_bits && !elem.alignment) {
 			using namespace detail;
-			capacity = vpool_chunk_size / obj_size;
+			capacity = vpool_chunk_size / elem.size;
 			int bit = countTrailingZeros(t_vpool_bits);
 			t_vpool_bits &= ~(1 << bit);
 			data = t_vpool_buf + bit * vpool_chunk_size;
@@ -65,12 +76,26 @@ class BaseVector {
 		}
 	}
 
-	void alloc(int obj_size, int size, int capacity);
+	// Empty vector which points to the beginning of arena; Whenever it grows, memory will be
+	// allocated from this arena
+	void initializeArena(Arena &arena) {
+		data = arena.begin();
+		size = capacity = 0;
+	}
+
+	// If source points to arena memory, then new data will be allocated in the same arena
+	void alloc(VectorElem, int size, int capacity, const char *source = nullptr);
 
-	void free(int obj_size) {
+	void free(VectorElem elem) {
 		using namespace detail;
 		if(onVPool(data))
 			t_vpool_bits |= 1 << ((data - t_vpool_buf) / vpool_chunk_size);
+		else if(auto *arena = findArena(data))
+			arena->freeVector(data, size_t(capacity) * elem.size);
+		else if(maybeLargeAllocation(data, size_t(capacity) * elem.size))
+			fwk::deallocateLarge(data);
+		else if(elem.alignment)
+			fwk::deallocate(data, elem.alignment);
 		else
 			fwk::deallocate(data);
 	}
@@ -81,30 +106,30 @@ class BaseVector {
 		fwk::swap(capacity, rhs.capacity);
 	}
 
-	void grow(int obj_size, MoveDestroyFunc func);
-	void growPod(int obj_size);
+	void grow(VectorElem, MoveDestroyFunc func);
+	void growPod(VectorElem);
 
-	void reallocate(int, MoveDestroyFunc move_destroy_func, int new_capacity);
+	void reallocate(VectorElem, MoveDestroyFunc move_destroy_func, int new_capacity);
 	void clear(DestroyFunc destroy_func);
-	void erase(int, DestroyFunc, MoveDestroyFunc, int index, int count);
-	void resizePartial(int, DestroyFunc, MoveDestroyFunc, int new_size);
-	void insertPartial(int, MoveDestroyFunc, int offset, int count);
-	void insert(int, MoveDestroyFunc, CopyFunc, int offset, const void *, int count);
-	void assignPartial(int, DestroyFunc, int new_size);
-	void assign(int, DestroyFunc, CopyFunc, const void *, int size);
+	void erase(VectorElem, DestroyFunc, MoveDestroyFunc, int index, int count);
+	void resizePartial(VectorElem, DestroyFunc, MoveDestroyFunc, int new_size);
+	void insertPartial(VectorElem, MoveDestroyFunc, int offset, int count);
+	void insert(VectorElem, MoveDestroyFunc, CopyFunc, int offset, const void *, int count);
+	void assignPartial(VectorElem, DestroyFunc, int new_size);
+	void assign(VectorElem, DestroyFunc, CopyFunc, const void *, int size);
 
-	void reallocatePod(int, int new_capacity);
+	void reallocatePod(VectorElem, int new_capacity);
 
-	void reservePod(int, int desired_capacity);
-	void reserve(int, MoveDestroyFunc, int desired_capacity);
+	void reservePod(VectorElem, int desired_capacity);
+	void reserve(VectorElem, MoveDestroyFunc, int desired_capacity);
 
 	void clearPod() { size = 0; }
-	void erasePod(int, int index, int count);
-	void resizePodPartial(int, int new_size);
-	void insertPodPartial(int, int offset, int count);
-	void insertPod(int, int offset, const void *, int count);
-	void assignPartialPod(int, int new_size);
-	void assignPod(int, const void *, int size);
+	void erasePod(VectorElem, int index, int count);
+	void resizePodPartial(VectorElem, int new_size);
+	void insertPodPartial(VectorElem, int offset, int count);
+	void insertPod(VectorElem, int offset, const void *, int count);
+	void assignPartialPod(VectorElem, int new_size);
+	void assignPod(VectorElem, const void *, int size);
 
 	void checkIndex(int index) const {
 		if(index < 0 || index >= size)
@@ -7,12 +7,14 @@
 
 namespace fwk {
 
+// Bits are kept in 64-bit words; bits past size() in the last word are always cleared.
+// Bulk operations (count, find, logic ops) process whole words at a time.
 class BitVector {
   public:
-	typedef u32 base_type;
+	typedef u64 base_type;
 	enum {
-		base_shift = 5,
-		base_size = 32,
+		base_shift = 6,
+		base_size = 64,
 	};
 
 	struct Bit {
@@ -28,6 +30,27 @@ class BitVector {
 		int bit_index;
 	};
 
+	// Iterates over indices of set bits
+	struct SetBitIter {
+		int operator*() const { return word_idx * base_size + countTrailingZeros(bits); }
+		void operator++() {
+			bits &= bits - 1;
+			while(!bits && ++word_idx < num_words)
+				bits = words[word_idx];
+		}
+		bool operator==(const SetBitIter &rhs) const { return word_idx == rhs.word_idx; }
+
+		const base_type *words;
+		base_type bits;
+		int word_idx, num_words;
+	};
+
+	struct SetBits {
+		SetBitIter begin() const;
+		SetBitIter end() const { return {nullptr, 0, vec.baseSize(), 0}; }
+		const BitVector &vec;
+	};
+
 	explicit BitVector(int size = 0);
 	void resize(int new_size, bool value = false);
 
@@ -41,7 +64,7 @@ class BitVector {
 
 	bool operator[](int idx) const {
 		PASSERT(inRange(idx, 0, m_size));
-		return m_data[idx >> base_shift] & (1 << (idx & (base_size - 1)));
+		return m_data[idx >> base_shift] & (base_type(1) << (idx & (base_size - 1)));
 	}
 
 	Bit operator[](int idx) {
@@ -52,8 +75,58 @@ class BitVector {
 	bool any(int base_idx) const { return m_data[base_idx] != base_type(0); }
 	bool all(int base_idx) const { return m_data[base_idx] == ~base_type(0); }
 
+	// Number of set bits
+	int count() const;
+	bool any() const { return findFirst() != -1; }
+
+	// Returns -1 if there are no more set bits
+	int findFirst() const { return findNext(-1); }
+	int findNext(int idx) const;
+
+	SetBits setBits() const { return {*this}; }
+
+	// Both vectors have to be of the same size
+	void operator&=(const BitVector &);
+	void operator|=(const BitVector &);
+	void operator^=(const BitVector &);
+	// this &= ~rhs
+	void andNot(const BitVector &);
+
+	bool operator==(const BitVector &) const;
+
   protected:
+	void clearTail();
+
 	PodVector<base_type> m_data;
 	int m_size;
 };
+
+// Rank & select queries over constant BitVector; Counts of bits are precomputed for every
+// block of 512 bits, so rank is O(1) and select is O(log(size)).
+// Has to be rebuilt when bits are modified.
+class BitVectorRank {
+  public:
+	BitVectorRank(const BitVector &);
+
+	// Number of set bits in range [0; idx)
+	int rank(int idx) const;
+	// Index of set bit with given rank (0 is first); Returns -1 if there is no such bit
+	int select(int rank) const;
+
+	int count() const { return m_block_ranks[m_block_ranks.size() - 1]; }
+
+  private:
+	static constexpr int block_shift = 3, block_words = 1 << block_shift;
+
+	const BitVector &m_bits;
+	PodVector<int> m_block_ranks;
+};
+
+inline BitVector::SetBitIter BitVector::SetBits::begin() const {
+	int first = vec.findFirst();
+	if(first == -1)
+		return end();
+	int word_idx = first >> base_shift;
+	return {vec.m_data.data(), vec.m_data[word_idx], word_idx, vec.baseSize()};
+}
 }
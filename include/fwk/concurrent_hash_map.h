@@ -0,0 +1,350 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/hash_map.h"
+#include "fwk/sys/thread.h"
+#include <atomic>
+
+namespace fwk {
+
+// Hash map which can be safely accessed from multiple threads.
+//
+// Keys are distributed into shards (number of shards is a power of 2); each shard is a separate
+// open-addressing table (built on HashMap storages & policy, see hash_map.h) with its own mutex,
+// so writers only serialize when they modify the same shard.
+//
+// If both keys & values are trivially copyable, readers don't take any locks: each shard has
+// a sequence counter (seqlock) which is odd while shard is being modified; reader performs
+// a lookup optimistically and retries if sequence changed in the meantime. After a few failed
+// attempts it falls back to locking. Readers return copies of values, never references.
+// For other types readers lock the shard.
+//
+// When optimistic reads are used, tables replaced during growth are not freed immediately
+// (readers may still access them); they are kept until reclaimMemory() or destruction.
+// Total memory of retired tables is always smaller than memory of current tables.
+// Deleted buckets are cleared by rehashing the table in place.
+template <class K, class V, class Policy = None> class ConcurrentHashMap {
+  public:
+	using Key = K;
+	using Value = V;
+	using Hash = u32;
+	using PolicyInfo = detail::AccessHashMapPolicy<K, V, Policy>;
+	using Storage = typename PolicyInfo::Storage;
+	static_assert(Storage::group_size == 1, "Grouped storage is not supported");
+
+	static constexpr bool optimistic_reads =
+		std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>;
+	static constexpr int default_num_shards = 64;
+
+	explicit ConcurrentHashMap(int num_shards = default_num_shards)
+		: m_shards(new Shard[num_shards]), m_num_shards(num_shards),
+		  m_shard_mask(num_shards - 1) {
+		PASSERT(num_shards > 0 && isPowerOfTwo(num_shards));
+	}
+	~ConcurrentHashMap() {
+		for(auto &shard : shards()) {
+			if(auto *table = shard.table.load(std::memory_order_relaxed)) {
+				for(int n = 0; n < table->capacity; n++)
+					if(table->storage.isValid(n))
+						table->storage.destruct(n);
+				freeTable(table);
+			}
+		}
+		reclaimMemory();
+		delete[] m_shards;
+	}
+
+	ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+	void operator=(const ConcurrentHashMap &) = delete;
+
+	Maybe<Value> maybeFind(const Key &key) const {
+		auto hash = hashFunc(key);
+		auto &shard = m_shards[shardIndex(hash)];
+
+		if constexpr(optimistic_reads) {
+			for(int attempt = 0; attempt < max_optimistic_attempts; attempt++) {
+				u32 sequence = shard.sequence.load(std::memory_order_acquire);
+				if(sequence & 1)
+					continue;
+				auto *table = shard.table.load(std::memory_order_acquire);
+				Maybe<Value> out;
+				if(table) {
+					int idx = lookup(*table, key, hash);
+					if(idx != -1)
+						out = table->storage.value(idx);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if(shard.sequence.load(std::memory_order_relaxed) == sequence)
+					return out;
+			}
+		}
+
+		MutexLocker lock(shard.mutex);
+		auto *table = shard.table.load(std::memory_order_relaxed);
+		int idx = table ? lookup(*table, key, hash) : -1;
+		return idx == -1 ? Maybe<Value>() : table->storage.value(idx);
+	}
+	bool contains(const Key &key) const { return !!maybeFind(key); }
+
+	// Returns true if new element was inserted; Otherwise value is not modified
+	template <class... Args> bool emplace(const Key &key, Args &&...args) {
+		auto hash = hashFunc(key);
+		auto &shard = m_shards[shardIndex(hash)];
+		MutexLocker lock(shard.mutex);
+		return insert(shard, key, hash, false, std::forward<Args>(args)...);
+	}
+
+	// Returns true if new element was inserted; Otherwise value is overwritten
+	bool assign(const Key &key, const Value &value) {
+		auto hash = hashFunc(key);
+		auto &shard = m_shards[shardIndex(hash)];
+		MutexLocker lock(shard.mutex);
+		return insert(shard, key, hash, true, value);
+	}
+
+	bool erase(const Key &key) {
+		auto hash = hashFunc(key);
+		auto &shard = m_shards[shardIndex(hash)];
+		MutexLocker lock(shard.mutex);
+		auto *table = shard.table.load(std::memory_order_relaxed);
+		int idx = table ? lookup(*table, key, hash) : -1;
+		if(idx == -1)
+			return false;
+
+		beginWrite(shard);
+		table->storage.destruct(idx);
+		table->storage.markDeleted(idx);
+		shard.size.store(shard.size.load(std::memory_order_relaxed) - 1,
+						 std::memory_order_relaxed);
+		endWrite(shard);
+		return true;
+	}
+
+	void clear() {
+		for(auto &shard : shards()) {
+			MutexLocker lock(shard.mutex);
+			auto *table = shard.table.load(std::memory_order_relaxed);
+			if(!table)
+				continue;
+			beginWrite(shard);
+			for(int n = 0; n < table->capacity; n++)
+				if(!table->storage.isUnused(n)) {
+					if(!table->storage.isDeleted(n))
+						table->storage.destruct(n);
+					table->storage.markUnused(n);
+				}
+			shard.size.store(0, std::memory_order_relaxed);
+			shard.num_used = 0;
+			endWrite(shard);
+		}
+	}
+
+	// Size may be inaccurate if map is being modified concurrently
+	int size() const {
+		int out = 0;
+		for(auto &shard : shards())
+			out += shard.size.load(std::memory_order_relaxed);
+		return out;
+	}
+	bool empty() const { return size() == 0; }
+	int numShards() const { return m_num_shards; }
+
+	// Locks shards one by one; Pairs from single shard are consistent
+	vector<Pair<Key, Value>> pairs() const {
+		vector<Pair<Key, Value>> out;
+		for(auto &shard : shards()) {
+			MutexLocker lock(shard.mutex);
+			if(auto *table = shard.table.load(std::memory_order_relaxed))
+				for(int n = 0; n < table->capacity; n++)
+					if(table->storage.isValid(n))
+						out.emplace_back(table->storage.key(n), table->storage.value(n));
+		}
+		return out;
+	}
+
+	i64 usedMemory() const {
+		i64 out = 0;
+		for(auto &shard : shards()) {
+			MutexLocker lock(shard.mutex);
+			if(auto *table = shard.table.load(std::memory_order_relaxed))
+				out += i64(table->capacity) * Storage::memory_unit;
+			for(auto *table : shard.retired)
+				out += i64(table->capacity) * Storage::memory_unit;
+		}
+		return out;
+	}
+
+	// Frees tables which were replaced during growth.
+	// Can only be called when no other thread accesses the map.
+	void reclaimMemory() {
+		for(auto &shard : shards()) {
+			for(auto *table : shard.retired)
+				freeTable(table);
+			shard.retired.clear();
+		}
+	}
+
+  private:
+	static constexpr int initial_capacity = 16;
+	static constexpr int max_optimistic_attempts = 16;
+	static constexpr float load_factor = 2.0f / 3.0f;
+
+	struct Table {
+		Storage storage;
+		int capacity;
+		u32 capacity_mask;
+	};
+
+	struct alignas(64) Shard {
+		std::atomic<u32> sequence = 0;
+		std::atomic<Table *> table = nullptr;
+		std::atomic<int> size = 0;
+		int num_used = 0;
+		mutable Mutex mutex;
+		vector<Table *> retired;
+	};
+
+	static void beginWrite(Shard &shard) {
+		shard.sequence.store(shard.sequence.load(std::memory_order_relaxed) + 1,
+							 std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+	static void endWrite(Shard &shard) {
+		shard.sequence.store(shard.sequence.load(std::memory_order_relaxed) + 1,
+							 std::memory_order_release);
+	}
+
+	static Table *allocateTable(int capacity) {
+		auto *out = new Table{Storage::allocate(capacity), capacity, u32(capacity - 1)};
+		return out;
+	}
+	static void freeTable(Table *table) {
+		table->storage.deallocate();
+		delete table;
+	}
+
+	// Returns -1 if not found; Number of probes is limited, because optimistic readers may
+	// observe table in an inconsistent state.
+	static int lookup(const Table &table, const Key &key, Hash hash) {
+		u32 idx = hash & table.capacity_mask;
+		for(int num_probes = 1; num_probes <= table.capacity; num_probes++) {
+			if(table.storage.isUnused(idx))
+				return -1;
+			if(table.storage.compareKey(idx, key, hash))
+				return idx;
+			idx = (idx + num_probes) & table.capacity_mask;
+		}
+		return -1;
+	}
+
+	template <class... Args>
+	bool insert(Shard &shard, const Key &key, Hash hash, bool overwrite, Args &&...args) {
+		auto *table = shard.table.load(std::memory_order_relaxed);
+		int size = shard.size.load(std::memory_order_relaxed);
+		if(!table || shard.num_used + 1 > int(table->capacity * load_factor))
+			table = grow(shard, table);
+
+		u32 idx = hash & table->capacity_mask;
+		int free_idx = -1;
+		for(int num_probes = 1; !table->storage.isUnused(idx); num_probes++) {
+			if(table->storage.compareKey(idx, key, hash)) {
+				if(overwrite) {
+					beginWrite(shard);
+					table->storage.value(idx) = Value{std::forward<Args>(args)...};
+					endWrite(shard);
+				}
+				return false;
+			}
+			if(free_idx == -1 && table->storage.isDeleted(idx))
+				free_idx = idx;
+			idx = (idx + num_probes) & table->capacity_mask;
+		}
+
+		beginWrite(shard);
+		if(free_idx != -1)
+			idx = free_idx;
+		else
+			shard.num_used++;
+		table->storage.construct(idx, hash, key, std::forward<Args>(args)...);
+		shard.size.store(size + 1, std::memory_order_relaxed);
+		endWrite(shard);
+		return true;
+	}
+
+	// Old table is retired (if optimistic reads are enabled) or freed. If capacity doesn't
+	// change, then table is rehashed in place (getting rid of deleted buckets).
+	Table *grow(Shard &shard, Table *old_table) {
+		int size = shard.size.load(std::memory_order_relaxed);
+		int new_capacity = old_table ? old_table->capacity : initial_capacity;
+		while(size + 1 > int(new_capacity * load_factor) / 2)
+			new_capacity *= 2;
+
+		auto *new_table = allocateTable(new_capacity);
+		if(old_table) {
+			auto &old_storage = old_table->storage;
+			for(int n = 0; n < old_table->capacity; n++) {
+				if(!old_storage.isValid(n))
+					continue;
+				Hash hash = hashFunc(old_storage.key(n));
+				u32 idx = hash & new_table->capacity_mask;
+				for(int num_probes = 1; !new_table->storage.isUnused(idx); num_probes++)
+					idx = (idx + num_probes) & new_table->capacity_mask;
+				new_table->storage.construct(idx, hash, old_storage.key(n), old_storage.value(n));
+			}
+		}
+
+		if(old_table && new_capacity == old_table->capacity) {
+			auto &old_storage = old_table->storage, &new_storage = new_table->storage;
+			beginWrite(shard);
+			for(int n = 0; n < new_capacity; n++) {
+				if(old_storage.isValid(n))
+					old_storage.destruct(n);
+				old_storage.markUnused(n);
+				if(new_storage.isValid(n)) {
+					old_storage.construct(n, hashFunc(new_storage.key(n)), new_storage.key(n),
+										  new_storage.value(n));
+					new_storage.destruct(n);
+				}
+			}
+			shard.num_used = size;
+			endWrite(shard);
+			freeTable(new_table);
+			return old_table;
+		}
+
+		beginWrite(shard);
+		shard.table.store(new_table, std::memory_order_release);
+		shard.num_used = size;
+		endWrite(shard);
+
+		if(old_table) {
+			for(int n = 0; n < old_table->capacity; n++)
+				if(old_table->storage.isValid(n))
+					old_table->storage.destruct(n);
+			if constexpr(optimistic_reads)
+				shard.retired.emplace_back(old_table);
+			else
+				freeTable(old_table);
+		}
+		return new_table;
+	}
+
+	Span<Shard> shards() const { return {m_shards, m_num_shards}; }
+	int shardIndex(Hash hash) const { return ((hash * 0x9e3779b1u) >> 16) & m_shard_mask; }
+
+	static Hash hashFunc(const Key &key) {
+		Hash out;
+		if constexpr(PolicyInfo::has_hash)
+			out = Policy::hash(key);
+		else
+			out = hash<Hash>(key);
+		return out & 0x7FFFFFFFu;
+	}
+
+	Shard *m_shards;
+	int m_num_shards;
+	u32 m_shard_mask;
+};
+}
@@ -0,0 +1,97 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/slab_allocator.h"
+#include "fwk/sys/thread.h"
+#include <atomic>
+
+namespace fwk {
+
+// Thread-safe front-end of SlabAllocator.
+//
+// Each thread keeps a small cache of chunks for every chunk level; most chunk allocations and
+// deallocations are handled by this cache without any synchronization. Empty caches are refilled
+// in batches under a lock. Freed chunks which don't fit in the cache of the freeing thread are
+// returned to their group without locking: each group has atomic bit-masks of pending frees,
+// which are taken back (under the lock) during refills of given level.
+// Slab allocations (bigger than SlabAllocator::maxChunkSize()) always take the lock.
+//
+// Threads are assigned cache slots (at most max_thread_slots at the same time); slots of finished
+// threads are reused by new threads together with their cached chunks. Threads without a slot
+// always take the lock.
+class ConcurrentSlabAllocator {
+  public:
+	using Identifier = SlabAllocator::Identifier;
+	using Allocation = SlabAllocator::Allocation;
+	using ZoneAllocator = SlabAllocator::ZoneAllocator;
+
+	static constexpr int max_thread_slots = 256;
+	static constexpr int cache_size = 32;
+
+	ConcurrentSlabAllocator(u64 default_zone_size = SlabAllocator::min_zone_size * 4);
+	ConcurrentSlabAllocator(u64 default_zone_size, ZoneAllocator);
+	~ConcurrentSlabAllocator();
+
+	ConcurrentSlabAllocator(const ConcurrentSlabAllocator &) = delete;
+	void operator=(const ConcurrentSlabAllocator &) = delete;
+
+	// May return invalid identifier, in this case allocation failed
+	Pair<Identifier, Allocation> alloc(u64 size);
+	void free(Identifier);
+
+	// Returns all cached & pending chunks to the SlabAllocator.
+	// No other thread can use the allocator during this call.
+	void flush();
+
+	// Backend can only be accessed when no other thread is using the allocator;
+	// Call flush() first to make its state (stats, garbage collection) up to date.
+	SlabAllocator &backend() { return m_slabs; }
+	const SlabAllocator &backend() const { return m_slabs; }
+
+  private:
+	static constexpr int num_chunk_levels = SlabAllocator::num_chunk_levels;
+	static constexpr int max_group_words = SlabAllocator::max_chunks_per_group / 64;
+	static constexpr int group_page_size = 256;
+	static constexpr int num_group_pages = SlabAllocator::max_chunk_groups / group_page_size;
+
+	struct GroupInfo {
+		std::atomic<u64> pending_chunks[max_group_words];
+		u64 offset;
+		uint zone_id;
+	};
+
+	// Pages are allocated when groups are first used and kept until destruction
+	struct GroupPage {
+		GroupInfo groups[group_page_size];
+		std::atomic<u64> pending_groups[group_page_size / 64];
+	};
+
+	struct Level {
+		std::atomic<GroupPage *> pages[num_group_pages];
+		std::atomic<u64> pending_pages[num_group_pages / 64];
+	};
+
+	struct ThreadCache {
+		struct Level {
+			int count = 0;
+			Identifier chunks[cache_size];
+		};
+		Level levels[num_chunk_levels];
+	};
+
+	ThreadCache *threadCache();
+	GroupInfo &groupInfo(Identifier) const;
+	Allocation allocation(Identifier) const;
+	void publish(Identifier, const Allocation &);
+	bool refill(ThreadCache &, int level_id);
+	void freePending(Identifier);
+	void takePending(int level_id, ThreadCache::Level *);
+
+	Mutex m_mutex;
+	SlabAllocator m_slabs;
+	Level m_levels[num_chunk_levels];
+	std::atomic<ThreadCache *> m_caches[max_thread_slots];
+};
+}
@@ -180,7 +180,7 @@ class TextFormatter {
 	}
 
 	template <c_span TSpan, class T = SpanBase<TSpan>>
-		requires(is_formattible<T>)
+		requires(is_formattible<T> && !is_right_formattible<TSpan>)
 	TextFormatter &operator<<(const TSpan &span) {
 		detail::TFFunc func = [](TextFormatter &fmt, unsigned long long ptr) {
 			const T &ref = *(const T *)ptr;
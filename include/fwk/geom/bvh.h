@@ -0,0 +1,87 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/geom_base.h"
+#include "fwk/gfx_base.h"
+#include "fwk/math/box.h"
+#include "fwk/math/triangle.h"
+#include "fwk/vector.h"
+
+namespace fwk {
+
+struct BvhConfig {
+	int max_leaf_size = 4;
+	int num_bins = 16;
+	// Cost of visiting a node relative to cost of intersecting a primitive
+	float traversal_cost = 1.0f;
+};
+
+struct BvhHit {
+	float param; // position on the segment: from + dir() * param
+	int index;	 // index of primitive
+};
+
+// Bounding volume hierarchy over 3D primitives (triangles or boxes).
+//
+// Build is top-down; every node is split with SAH (surface area heuristic) evaluated on bins
+// along all 3 axes. Nodes take 32 bytes; children of a node are kept next to each other,
+// and parents always come before their children.
+//
+// BVH can be refitted: topology is kept & only bounding boxes are updated (for example for
+// animated meshes; triangles can be obtained with Mesh::tris(anim_data)). It's much faster
+// than a rebuild, but quality degrades if primitives move a lot in relation to each other.
+//
+// Segment queries are only available in BVHs built from triangles; their results are the same
+// as in Segment::isectParam(const Triangle &).
+class Bvh {
+  public:
+	struct Node {
+		bool isLeaf() const { return count > 0; }
+
+		FBox bbox;
+		int first; // leaf: first primitive (in leaf order); inner node: first child
+		int count; // number of primitives; 0 for inner nodes
+	};
+	static_assert(sizeof(Node) == 32);
+
+	Bvh() = default;
+	Bvh(CSpan<FBox>, BvhConfig = {});
+	Bvh(CSpan<Triangle3F>, BvhConfig = {});
+	Bvh(const Mesh &, BvhConfig = {});
+
+	// Number and order of primitives have to be the same as during build
+	void refit(CSpan<FBox>);
+	void refit(CSpan<Triangle3F>);
+
+	// Closest intersection with a triangle; Returns none if there is no intersection
+	Maybe<BvhHit> closestHit(const Segment3F &) const;
+	// Returns true as soon as any intersection is found
+	bool anyHit(const Segment3F &) const;
+	// Indices of primitives whose bounding boxes overlap (or touch) given box
+	vector<int> overlapping(const FBox &) const;
+
+	CSpan<Node> nodes() const { return m_nodes; }
+	// Indices of primitives in leaf order
+	CSpan<int> primIndices() const { return m_prim_indices; }
+	int size() const { return m_prim_indices.size(); }
+	bool empty() const { return m_prim_indices.empty(); }
+	bool hasTriangles() const { return !m_tris.empty() || empty(); }
+	FBox boundingBox() const { return m_nodes ? m_nodes[0].bbox : FBox(); }
+	int depth() const;
+
+	i64 usedMemory() const;
+
+  private:
+	struct Builder;
+	void refitNodes();
+	template <bool any_hit> Maybe<BvhHit> traverse(const Segment3F &) const;
+
+	vector<Node> m_nodes;
+	vector<int> m_prim_indices;
+	// Both are kept in leaf order
+	vector<FBox> m_boxes;
+	vector<Triangle3F> m_tris;
+};
+}
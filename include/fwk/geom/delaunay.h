@@ -3,7 +3,9 @@
 
 #pragma once
 
+#include "fwk/array.h"
 #include "fwk/geom_base.h"
+#include "fwk/vector.h"
 
 namespace fwk {
 
@@ -22,8 +24,22 @@ static constexpr int delaunay_integral_resolution = 512 * 1024 * 1024;
 template <class T> double delaunayIntegralScale(CSpan<T>);
 
 vector<VertexIdPair> delaunay(SparseSpan<int2>);
+// Computed with delaunayTriangulation()
 template <c_float_vec<2> T> Ex<vector<VertexIdPair>> delaunay(CSpan<T>);
 
+struct DelaunayTriangulation {
+	vector<VertexIdPair> edges;
+	// Indices of vertices in CCW order
+	vector<array<int, 3>> tris;
+};
+
+// Incremental (Bowyer-Watson) triangulation which doesn't need Voronoi diagram.
+// Points are inserted in the order of Hilbert curve; all predicates are computed exactly.
+// Duplicated points are ignored. If all points are collinear, only edges will be returned.
+// Coordinates cannot be greater than delaunay_integral_resolution.
+DelaunayTriangulation delaunayTriangulation(CSpan<int2>);
+template <c_float_vec<2> T> Ex<DelaunayTriangulation> delaunayTriangulation(CSpan<T>);
+
 // Warning: you have to be careful with this function:
 // Voronoi removes degenerate edges, which may cause
 // delaunay triangulation to miss some triangles in the end
@@ -29,6 +29,7 @@ template <class T> class GeomGraph : public Graph {
 	using VecD = MakeVec<double, dim<T>>;
 	using IPoint = MakeVec<int, dim<T>>;
 	using Grid = SegmentGrid<Vec2>;
+	using KdTree = fwk::KdTree<T>;
 	using Triangle = fwk::Triangle<Base<T>, dim<T>>;
 	using PointMap = HashMap<Point, int>;
 
@@ -141,6 +142,9 @@ template <class T> class GeomGraph : public Graph {
 
 	Axes2D m_flat_axes = Axes2D::xz; // TODO: xy ?
 	Grid makeGrid() const;
+	// Index for nearest-vertex, radius & box queries (findVertex only finds exact points);
+	// Indices returned from its queries are vertex ids
+	KdTree makeKdTree() const;
 
 	Vec2 flatPoint(VertexId) const;
 	Segment2 flatSegment(EdgeId) const;
@@ -0,0 +1,71 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/geom_base.h"
+#include "fwk/math/box.h"
+#include "fwk/maybe.h"
+#include "fwk/sparse_span.h"
+#include "fwk/vector.h"
+
+namespace fwk {
+
+// Spatial index of 2D or 3D points (static; it has to be rebuilt when points change).
+//
+// Nodes are split at the median along the longest axis of their bounding box, so depth of the
+// tree is always logarithmic. Points are kept in leaves (in tree order), together with their
+// indices in source span; all queries return those indices.
+//
+// Distances are computed on promoted types for integer vectors, so there are no overflows.
+template <class T> class KdTree {
+  public:
+	static_assert(is_vec<T, 2> || is_vec<T, 3>);
+	using Point = T;
+	using Scalar = fwk::Scalar<T>;
+	// Type of squared distances
+	using DistSq = PromoteIntegral<Scalar>;
+	using Box = fwk::Box<T>;
+
+	struct Node {
+		bool isLeaf() const { return axis == -1; }
+
+		Scalar split;
+		int axis; // -1 for leaves
+		int first; // leaf: first point; inner node: first child (second child is next)
+		int count; // number of points in leaf
+	};
+
+	KdTree() = default;
+	explicit KdTree(SparseSpan<T>, int max_leaf_size = 8);
+
+	// Closest point which is closer than max_dist; In case of ties, lower index is returned
+	Maybe<int> closest(const Point &, Maybe<Scalar> max_dist = none,
+					   Maybe<int> ignore = none) const;
+	// Up to k closest points which are closer than max_dist; sorted by distance (then by index)
+	vector<int> kClosest(const Point &, int k, Maybe<Scalar> max_dist = none) const;
+	// Points which are not further than radius; order is unspecified
+	vector<int> withinRadius(const Point &, Scalar radius) const;
+	// Points inside given box (or on its border); order is unspecified
+	vector<int> inside(const Box &) const;
+
+	CSpan<Node> nodes() const { return m_nodes; }
+	// Points & their source indices in tree order
+	CSpan<Point> points() const { return m_points; }
+	CSpan<int> indices() const { return m_indices; }
+
+	int size() const { return m_points.size(); }
+	bool empty() const { return m_points.empty(); }
+	int depth() const;
+
+	i64 usedMemory() const;
+
+  private:
+	struct Builder;
+	static constexpr int max_stack_size = 80;
+
+	vector<Node> m_nodes;
+	vector<Point> m_points;
+	vector<int> m_indices;
+};
+}
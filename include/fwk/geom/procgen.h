@@ -26,6 +26,23 @@ vector<float2> circularCurve(float scale, float step);
 
 template <c_vec<2> T> vector<T> randomPoints(Random &random, Box<T> rect, double min_dist);
 
+// Rejection test for Poisson-disk sampling on a grid with cells of size min_dist / sqrt(2);
+// each cell keeps at most one point (empty cells keep infinite points). Returns true if point
+// (which lies in given cell) is at least min_dist away from points in all cells which may
+// contain a closer point (5x5 neighbourhood without corners).
+template <c_vec<2> T>
+bool poissonDiskTest(CSpan<T> cell_points, int2 grid_size, int2 cell, const T &point,
+					 double min_dist_sq) {
+	for(int y = max(cell.y - 2, 0); y <= min(cell.y + 2, grid_size.y - 1); y++)
+		for(int x = max(cell.x - 2, 0); x <= min(cell.x + 2, grid_size.x - 1); x++) {
+			if(std::abs(x - cell.x) == 2 && std::abs(y - cell.y) == 2)
+				continue;
+			if(distanceSq(cell_points[x + y * grid_size.x], point) < min_dist_sq)
+				return false;
+		}
+	return true;
+}
+
 // beta: 0: white noise, 2: brownian noise, ...
 vector<double> generateNoise(double beta, int num_points, int seed);
 Ex<vector<Triangle3F>> generateRandomPatch(vector<float3>, u32 seed, float density,
@@ -38,9 +38,27 @@ struct SquareBorder {
 	friend struct Iter;
 };
 
+struct SegmentGridConfig {
+	// Number of free index slots reserved in each cell; they make incremental updates cheaper
+	int cell_slack = 0;
+	// Large grids are built in parallel with JobSystem::instance() (if it exists)
+	bool parallel = true;
+};
+
 // Groups segments and points into cells; stores indices only
 // It's designed for evenly distributed sets of segments where
 // each of them span over small number of cells
+//
+// Indices of each cell are kept in a single array (vertices first, then edges), with some free
+// slots at the end. Build is a counting sort of cell indices; for big inputs it's performed in
+// parallel (results are the same as with serial build).
+//
+// Grid can be updated incrementally: elements can be inserted & removed one by one. Grid refers to
+// source spans; If source containers change (get reallocated), updated spans have to be passed
+// with setSources(). Elements have to be removed before they are modified or removed from sources.
+// When a cell runs out of free slots, it's moved to the end of index array with doubled capacity;
+// Indices are compacted when more than half of them is unused. If an inserted element lies
+// outside of the grid, whole grid is rebuilt (only with elements which were already inserted).
 template <class T> class SegmentGrid {
   public:
 	static_assert(is_vec<T, 2>, "");
@@ -62,9 +80,9 @@ template <class T> class SegmentGrid {
 	// - zwraca identyfikatory + parametry przecięć
 	// - zwraca iterator?
 
-	SegmentGrid(SparseSpan<Pair<VertexId>>, SparseSpan<Point>);
+	SegmentGrid(SparseSpan<Pair<VertexId>>, SparseSpan<Point>, SegmentGridConfig = {});
 	SegmentGrid(SparseSpan<Pair<VertexId>>, PodVector<Point> points, CSpan<bool> point_valids,
-				int num_points);
+				int num_points, SegmentGridConfig = {});
 	SegmentGrid() = default;
 
 	// Zamiast tych funkcji ma jedynie funkcje dostępu do komórek i
@@ -78,6 +96,7 @@ template <class T> class SegmentGrid {
 		// TODO: naming: points/nodes etc.
 		int num_verts = 0, num_edges = 0;
 		int first_index = 0;
+		int capacity = 0;
 
 		// TODO: precompute these and use in algos
 		//char next_x = 0, next_y = 0;
@@ -103,7 +122,7 @@ template <class T> class SegmentGrid {
 
 	CSpan<VertexId> cellVerts(int2 cell_id) const {
 		auto &cell = m_cells[index(cell_id)];
-		auto *ptr = &m_cell_indices[cell.first_index];
+		auto *ptr = m_cell_indices.data() + cell.first_index;
 		return span(ptr, cell.num_verts).template reinterpret<VertexId>();
 	}
 	CSpan<EdgeId> cellEdges(int2 cell_id) const {
@@ -136,8 +155,29 @@ template <class T> class SegmentGrid {
 	auto begin() const { return m_grid.begin(); }
 	auto end() const { return m_grid.end(); }
 
+	// Spans have to contain all elements which are currently in the grid
+	void setSources(SparseSpan<Pair<VertexId>>, SparseSpan<Point>);
+
+	// Elements have to be valid in source spans; inserted elements cannot be already in the grid
+	void insert(VertexId);
+	void insert(EdgeId);
+	void remove(VertexId);
+	void remove(EdgeId);
+
+	// Number of index slots which don't belong to any cell
+	int numUnusedIndices() const { return m_num_unused_indices; }
+	const SegmentGridConfig &config() const { return m_config; }
+
   private:
 	void initialize(SparseSpan<Pair<VertexId>>, SparseSpan<Point>);
+	// vert_ids & edge_ids have to be sorted
+	void build(CSpan<int> vert_ids, CSpan<int> edge_ids);
+	void rebuild(Maybe<VertexId> new_vert, Maybe<EdgeId> new_edge);
+	template <class Func> void edgeCells(EdgeId, const Func &) const;
+
+	void addIndex(int cell_idx, VertexId::Base value, bool is_vert);
+	void removeIndex(int cell_idx, VertexId::Base value, bool is_vert);
+	void compact();
 
 	static RGrid bestGrid(SparseSpan<T>, int num_edges);
 
@@ -153,5 +193,7 @@ template <class T> class SegmentGrid {
 	SparseSpan<Pair<VertexId>> m_edges;
 	SparseSpan<Point> m_points;
 	PodVector<Point> m_points_buffer;
+	SegmentGridConfig m_config;
+	int m_num_unused_indices = 0;
 };
 }
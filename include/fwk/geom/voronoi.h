@@ -4,6 +4,7 @@
 #pragma once
 
 #include "fwk/geom/geom_graph.h"
+#include "fwk/geom/kd_tree.h"
 
 namespace fwk {
 
@@ -50,9 +51,27 @@ class Voronoi {
 	vector<EdgeId> arcSegments(EdgeId) const;
 	vector<EdgeId> cellArcs(CellId) const;
 
+	// Tests all cells; For many queries use VoronoiCellIndex
 	Maybe<CellId> findClosestCell(double2) const;
 
 	GeomGraph<double2> graph;
 	vector<Cell> cells;
 };
+
+// Index for closest cell queries; Results are the same as in Voronoi::findClosestCell().
+// Cells generated by vertices are found with a KdTree, cells generated by edges are tested
+// one by one. Voronoi is referenced: it has to outlive the index and its graph & cells
+// cannot be modified in the meantime.
+class VoronoiCellIndex {
+  public:
+	explicit VoronoiCellIndex(const Voronoi &);
+
+	Maybe<CellId> findClosestCell(double2) const;
+
+  private:
+	const Voronoi &m_voronoi;
+	KdTree<double2> m_vert_sites;
+	vector<CellId> m_vert_site_cells;
+	vector<CellId> m_edge_site_cells;
+};
 }
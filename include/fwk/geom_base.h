@@ -65,6 +65,7 @@ class Voronoi;
 
 template <c_vec<2> T, c_integral_vec<2> IT = int2> class RegularGrid;
 template <class T> class SegmentGrid;
+template <class T> class KdTree;
 
 using Contour2F = Contour<float2>;
 using Contour3F = Contour<float3>;
@@ -65,12 +65,14 @@ class Mesh {
 
 	using TriIndices = MeshIndices::TriIndices;
 	vector<Triangle3F> tris() const;
+	vector<Triangle3F> tris(const AnimatedData &) const;
 	vector<TriIndices> trisIndices() const;
 	vector<ColoredTriangle> coloredTris(CSpan<IColor>) const;
 
 	vector<Mesh> split(int max_vertices) const;
 	static Mesh merge(vector<Mesh>);
 
+	// Every triangle is tested; For many queries over the same mesh use Bvh (geom/bvh.h)
 	float intersect(const Segment3<float> &) const;
 	float intersect(const Segment3<float> &, const AnimatedData &) const;
 
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "fwk/atom.h"
 #include "fwk/gfx_base.h"
 #include "fwk/math/affine_trans.h"
 #include "fwk/vector.h"
@@ -59,7 +60,7 @@ class ModelAnim {
 	// TODO: information about whether its looped or not
 	vector<Channel> m_channels;
 	vector<float> m_shared_time_track;
-	vector<string> m_node_names;
+	vector<Atom> m_node_names;
 	float m_length;
 };
 }
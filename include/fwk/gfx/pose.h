@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "fwk/atom.h"
 #include "fwk/math/matrix4.h"
 #include "fwk/vector.h"
 
@@ -10,15 +11,18 @@ namespace fwk {
 
 struct Pose {
   public:
-	using NameMap = vector<Pair<string, int>>;
+	// Sorted by atoms (not alphabetically), so that names can be found without comparing strings
+	using NameMap = vector<Pair<Atom, int>>;
 
 	Pose(vector<Matrix4> transforms = {}, NameMap = {});
+	Pose(vector<Matrix4> transforms, CSpan<Atom> names);
 	Pose(vector<Matrix4> transforms, const vector<string> &names);
 
 	auto size() const { return m_transforms.size(); }
 	const auto &transforms() const { return m_transforms; }
 	const NameMap &nameMap() const { return m_name_map; }
 
+	vector<int> mapNames(CSpan<Atom>) const;
 	vector<int> mapNames(const vector<string> &) const;
 	vector<Matrix4> mapTransforms(const vector<int> &mapping) const;
 
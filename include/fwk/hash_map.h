@@ -12,7 +12,7 @@ namespace fwk {
 // fwk::HashMap evolved from rdestl::hash_map by Maciej Sinilo (Copyright 2007)
 // Licensed under MIT license
 
-enum class HashMapStorage { paired, separated, paired_with_hashes, automatic };
+enum class HashMapStorage { paired, separated, paired_with_hashes, grouped, automatic };
 
 namespace detail {
 
@@ -20,7 +20,8 @@ namespace detail {
 	using DefaultHashMapStorage = If<intrusive_hash_type<K>, HashMapStoragePaired<K, V>,
 									 HashMapStoragePairedWithHashes<K, V>>;
 
-	template <class K, class V, class P> struct AccessHashMapPolicy {
+	template <class K, class V, class P>
+	struct AccessHashMapPolicy : public AccessHashPolicy<K, P> {
 		FWK_SFINAE_TEST(has_storage, P, U::storage());
 		static constexpr auto storage = []() {
 			if constexpr(has_storage)
@@ -31,9 +32,6 @@ namespace detail {
 		FWK_SFINAE_TYPE(Storage_, P, DECLVAL(typename U::Storage));
 		using Storage = If<is_same<Storage_, InvalidType>, DefaultHashMapStorage<K, V>, Storage_>;
 
-		FWK_SFINAE_TYPE(HashResult, P, U::hash(DECLVAL(const K &)));
-		static constexpr bool has_hash = is_convertible<HashResult, u32>;
-
 		FWK_SFINAE_TYPE(DefaultValueResult, P, U::defaultValue());
 		static constexpr bool has_default_value = is_same<DefaultValueResult, V>;
 	};
@@ -46,11 +44,18 @@ namespace detail {
 // - Storage type (one of HashMapStorage*<K,V>)
 // - hash function (Policy::hash(const Key&)
 // - default value function (Policy::defaultValue())
+// - probing scheme (Policy::probing(), see HashMapProbing)
+// - is_transparent flag (static constexpr bool); If it's true, then find, contains, erase,
+//   maybeFind & operator[] accept any type T for which Policy::hash(T) and Key == T are valid
+//   (for example: Str for string keys, see StrHashPolicy). Key is constructed from T only
+//   when new element is inserted.
+//
+// With quadratic probing hash table will accumulate deleted markers over time and grow even
+// if size stays constant. Robin hood probing doesn't have this problem, but erase is a bit more
+// costly and it invalidates iterators.
 //
 // TODO: sharing code betwee HashMap & HashSet
 // TODO: ability to declare HashMap<K, V> without defining K & V
-// TODO: use robin hood hash? With time hash table will accumulate deleted hashes and grow
-//       or maybe some other method to clear deleted nodes with time?
 // TODO: use HashMap<> together with SparseVector<> for big objects?
 // TODO: two rehashes: one with move, one with copy
 template <class K, class V, class Policy> class HashMap {
@@ -68,10 +73,22 @@ template <class K, class V, class Policy> class HashMap {
 			PolicyInfo::storage;
 	static constexpr bool keeps_hashes = storage == ST::paired_with_hashes;
 	static constexpr bool keeps_pairs = storage != ST::separated;
-
-	using Storage = If<storage == ST::paired, HashMapStoragePaired<K, V>,
-					   If<storage == ST::separated, HashMapStorageSeparated<K, V>,
-						  HashMapStoragePairedWithHashes<K, V>>>;
+	static constexpr auto probing = PolicyInfo::probing;
+	static constexpr bool robin_hood = probing == HashMapProbing::robin_hood;
+	template <class T>
+	static constexpr bool transparent_key = PolicyInfo::template transparent_key<T>;
+
+	using Storage =
+		If<storage == ST::paired, HashMapStoragePaired<K, V>,
+		   If<storage == ST::separated, HashMapStorageSeparated<K, V>,
+			  If<storage == ST::grouped, HashMapStorageGrouped<K, V>,
+				 HashMapStoragePairedWithHashes<K, V>>>>;
+
+	// With grouped storage quadratic probing is performed on groups of buckets instead
+	static constexpr int group_size = Storage::group_size;
+	static constexpr bool group_probing = group_size > 1;
+	static_assert(!(group_probing && robin_hood),
+				  "Robin hood probing is not supported with grouped storage");
 
 	template <bool is_const> class TIter {
 	  public:
@@ -120,6 +137,9 @@ template <class K, class V, class Policy> class HashMap {
 
 	HashMap() {}
 	explicit HashMap(int min_reserve) { reserve(min_reserve); }
+	// Storage will be allocated from given arena (see arena.h); Such map cannot be used
+	// after arena memory was released with reset
+	explicit HashMap(Arena &arena, int min_reserve = 0) : m_arena(&arena) { reserve(min_reserve); }
 	HashMap(const HashMap &rhs) { *this = rhs; }
 	HashMap(HashMap &&rhs) { *this = std::move(rhs); }
 	~HashMap() { deleteNodes(); }
@@ -148,6 +168,13 @@ template <class K, class V, class Policy> class HashMap {
 	ConstIter end() const { return {this, m_capacity}; }
 
 	Value &operator[](const Key &key) {
+		if constexpr(robin_hood) {
+			int idx = lookup(key);
+			if(idx != m_capacity)
+				return m_storage.value(idx);
+			return emplace(key, defaultValue()).first.value();
+		}
+
 		auto hash = hashFunc(key);
 		int idx = findForInsert(key, hash);
 		if(idx == m_capacity || !m_storage.isValid(idx))
@@ -155,6 +182,15 @@ template <class K, class V, class Policy> class HashMap {
 		return m_storage.value(idx);
 	}
 
+	template <class T>
+		requires(transparent_key<T>)
+	Value &operator[](const T &key) {
+		int idx = lookup(key);
+		if(idx != m_capacity)
+			return m_storage.value(idx);
+		return emplace(Key(key), defaultValue()).first.value();
+	}
+
 	void operator=(const HashMap &rhs) {
 		if(&rhs == this)
 			return;
@@ -162,7 +198,7 @@ template <class K, class V, class Policy> class HashMap {
 		clear();
 		if(m_capacity < rhs.m_capacity) {
 			deleteNodes();
-			m_storage = Storage::allocate(rhs.m_capacity);
+			m_storage = Storage::allocate(rhs.m_capacity, m_arena);
 			m_capacity = rhs.m_capacity;
 			m_capacity_mask = m_capacity - 1;
 		}
@@ -177,6 +213,7 @@ template <class K, class V, class Policy> class HashMap {
 		memcpy((void *)this, (void *)&rhs, sizeof(HashMap));
 		memset((void *)&rhs, 0, sizeof(HashMap));
 		rhs.m_load_factor = m_load_factor;
+		rhs.m_arena = m_arena;
 	}
 
 	void swap(HashMap &rhs) {
@@ -189,6 +226,7 @@ template <class K, class V, class Policy> class HashMap {
 		fwk::swap(m_used_limit, rhs.m_used_limit);
 		fwk::swap(m_num_used, rhs.m_num_used);
 		fwk::swap(m_load_factor, rhs.m_load_factor);
+		fwk::swap(m_arena, rhs.m_arena);
 	}
 
 	auto emplace(const KeyValue &pair) { return emplace(pair.key, pair.value); }
@@ -197,26 +235,49 @@ template <class K, class V, class Policy> class HashMap {
 	template <class... Args> Pair<Iter, bool> emplace(const Key &key, Args &&...args) {
 		if(m_num_used >= m_used_limit)
 			grow();
-
-		auto hash = hashFunc(key);
-		int idx = findForInsert(key, hash);
-		if(m_storage.isValid(idx))
-			return {{this, idx}, false};
-		if(m_storage.isUnused(idx))
-			++m_num_used;
-		m_storage.construct(idx, hash, key, std::forward<Args>(args)...);
-		++m_size;
-		PASSERT(m_num_used >= m_size);
-		return {{this, idx}, true};
+		return emplaceHashed(key, hashFunc(key), std::forward<Args>(args)...);
 	}
 
-	bool erase(const Key &key) {
-		auto idx = lookup(key);
-		if(idx != m_capacity && m_storage.isValid(idx)) {
-			eraseNode(idx);
-			return true;
+	// Replaces contents of the map with given pairs. Table is resized at most once and buckets
+	// for each batch of keys are prefetched before inserting. If some key is repeated, then
+	// its first occurrence is kept (just like with emplace).
+	void build(CSpan<Pair<Key, Value>> pairs) {
+		clear();
+		int new_capacity = max(m_capacity, initial_capacity);
+		while(int(new_capacity * m_load_factor) < pairs.size())
+			new_capacity *= 2;
+		if(new_capacity > m_capacity)
+			grow(new_capacity);
+
+		Hash hashes[batch_size];
+		for(int start = 0; start < pairs.size(); start += batch_size) {
+			auto batch = pairs.subSpan(start, min(start + batch_size, pairs.size()));
+			for(int n = 0; n < batch.size(); n++) {
+				hashes[n] = hashFunc(batch[n].first);
+				m_storage.prefetch(hashes[n] & m_capacity_mask);
+			}
+			for(int n = 0; n < batch.size(); n++)
+				emplaceHashed(batch[n].first, hashes[n], batch[n].second);
 		}
-		return false;
+	}
+
+	// Finds multiple keys at once; out[i] will point to keys[i] (or end() if it's missing).
+	// Keys are hashed and their buckets prefetched in batches, which hides memory latency when
+	// map doesn't fit in cache.
+	void findMany(CSpan<Key> keys, Span<Iter> out) {
+		PASSERT(keys.size() == out.size());
+		lookupMany(keys, [&](int n, int idx) { out[n] = Iter{this, idx}; });
+	}
+	void findMany(CSpan<Key> keys, Span<ConstIter> out) const {
+		PASSERT(keys.size() == out.size());
+		lookupMany(keys, [&](int n, int idx) { out[n] = ConstIter{this, idx}; });
+	}
+
+	bool erase(const Key &key) { return eraseKey(key); }
+	template <class T>
+		requires(transparent_key<T>)
+	bool erase(const T &key) {
+		return eraseKey(key);
 	}
 
 	void erase(Iter it) {
@@ -228,6 +289,32 @@ template <class K, class V, class Policy> class HashMap {
 	void erase(Iter from, Iter to) {
 		PASSERT(valid(from) && valid(to));
 
+		if constexpr(robin_hood) {
+			// Removing whole range first, then moving back elements from the cluster
+			// which follows it (in order); each one goes to first free bucket after its home
+			if(from.idx >= to.idx)
+				return;
+			for(int idx = from.idx; idx < to.idx; idx++)
+				if(m_storage.isValid(idx)) {
+					m_storage.destruct(idx);
+					m_storage.markUnused(idx);
+					--m_size;
+				}
+			m_num_used = m_size;
+
+			const u32 mask = m_capacity_mask;
+			for(u32 idx = to.idx & mask; m_storage.isValid(idx); idx = (idx + 1) & mask) {
+				u32 new_idx = slotHash(m_storage, idx) & mask;
+				while(new_idx != idx && !m_storage.isUnused(new_idx))
+					new_idx = (new_idx + 1) & mask;
+				if(new_idx != idx) {
+					m_storage.relocate(idx, new_idx);
+					m_storage.markUnused(idx);
+				}
+			}
+			return;
+		}
+
 		auto idx = from.idx;
 		while(idx != to.idx) {
 			if(m_storage.isValid(idx))
@@ -238,10 +325,29 @@ template <class K, class V, class Policy> class HashMap {
 
 	Iter find(const Key &key) { return {this, lookup(key)}; }
 	ConstIter find(const Key &key) const { return {this, lookup(key)}; }
+	template <class T>
+		requires(transparent_key<T>)
+	Iter find(const T &key) {
+		return {this, lookup(key)};
+	}
+	template <class T>
+		requires(transparent_key<T>)
+	ConstIter find(const T &key) const {
+		return {this, lookup(key)};
+	}
 
-	Maybe<Value> maybeFind(const Key &key) const {
-		auto idx = lookup(key);
-		return idx == m_capacity ? Maybe<Value>() : m_storage.value(idx);
+	bool contains(const Key &key) const { return lookup(key) != m_capacity; }
+	template <class T>
+		requires(transparent_key<T>)
+	bool contains(const T &key) const {
+		return lookup(key) != m_capacity;
+	}
+
+	Maybe<Value> maybeFind(const Key &key) const { return maybeFindKey(key); }
+	template <class T>
+		requires(transparent_key<T>)
+	Maybe<Value> maybeFind(const T &key) const {
+		return maybeFindKey(key);
 	}
 
 	void clear() {
@@ -317,11 +423,13 @@ template <class K, class V, class Policy> class HashMap {
   private:
 	static constexpr int initial_capacity = 64; // TODO: too big
 	static_assert(isPowerOfTwo(initial_capacity));
+	// Number of keys hashed & prefetched at once in build() & findMany()
+	static constexpr int batch_size = 16;
 
 	void grow() { grow(m_capacity == 0 ? initial_capacity : m_capacity * 2); }
 	void grow(int new_capacity) {
 		PASSERT(isPowerOfTwo(new_capacity));
-		auto new_storage = Storage::allocate(new_capacity);
+		auto new_storage = Storage::allocate(new_capacity, m_arena);
 
 		rehash(new_capacity, new_storage, m_capacity, m_storage, true);
 		m_storage.deallocate();
@@ -334,6 +442,43 @@ template <class K, class V, class Policy> class HashMap {
 		PASSERT(m_num_used < m_capacity);
 	}
 
+	template <class T> bool eraseKey(const T &key) {
+		auto idx = lookup(key);
+		if(idx != m_capacity && m_storage.isValid(idx)) {
+			eraseNode(idx);
+			return true;
+		}
+		return false;
+	}
+
+	template <class... Args>
+	Pair<Iter, bool> emplaceHashed(const Key &key, Hash hash, Args &&...args) {
+		if constexpr(robin_hood) {
+			auto [idx, found] = findForInsertRH(key, hash);
+			if(found)
+				return {{this, idx}, false};
+			m_storage.construct(idx, hash, key, std::forward<Args>(args)...);
+			++m_num_used;
+			++m_size;
+			return {{this, idx}, true};
+		}
+
+		int idx = findForInsert(key, hash);
+		if(m_storage.isValid(idx))
+			return {{this, idx}, false};
+		if(m_storage.isUnused(idx))
+			++m_num_used;
+		m_storage.construct(idx, hash, key, std::forward<Args>(args)...);
+		++m_size;
+		PASSERT(m_num_used >= m_size);
+		return {{this, idx}, true};
+	}
+
+	template <class T> Maybe<Value> maybeFindKey(const T &key) const {
+		auto idx = lookup(key);
+		return idx == m_capacity ? Maybe<Value>() : m_storage.value(idx);
+	}
+
 	static Value defaultValue() {
 		if constexpr(PolicyInfo::has_default_value)
 			return Policy::defaultValue();
@@ -355,6 +500,9 @@ template <class K, class V, class Policy> class HashMap {
 	}
 
 	int findForInsert(const Key &key, Hash hash) {
+		if constexpr(group_probing)
+			return findForInsertGrouped(key, hash);
+
 		int idx = hash & m_capacity_mask;
 		if(m_storage.compareKey(idx, key, hash))
 			return idx;
@@ -377,8 +525,14 @@ template <class K, class V, class Policy> class HashMap {
 		return free_idx != -1 ? free_idx : idx;
 	}
 
-	int lookup(const Key &key) const {
-		auto hash = hashFunc(key);
+	template <class T> int lookup(const T &key) const { return lookup(key, hashFunc(key)); }
+
+	template <class T> int lookup(const T &key, Hash hash) const {
+		if constexpr(robin_hood)
+			return lookupRH(key, hash);
+		if constexpr(group_probing)
+			return lookupGrouped(key, hash);
+
 		unsigned idx = hash & m_capacity_mask;
 		if(m_storage.compareKey(idx, key, hash))
 			return idx;
@@ -395,6 +549,19 @@ template <class K, class V, class Policy> class HashMap {
 		return m_capacity;
 	}
 
+	template <class Func> void lookupMany(CSpan<Key> keys, const Func &func) const {
+		Hash hashes[batch_size];
+		for(int start = 0; start < keys.size(); start += batch_size) {
+			auto batch = keys.subSpan(start, min(start + batch_size, keys.size()));
+			for(int n = 0; n < batch.size(); n++) {
+				hashes[n] = hashFunc(batch[n]);
+				m_storage.prefetch(hashes[n] & m_capacity_mask);
+			}
+			for(int n = 0; n < batch.size(); n++)
+				func(start + n, lookup(batch[n], hashes[n]));
+		}
+	}
+
 	void rehash(int new_capacity, Storage &new_storage, int capacity, Storage &old_storage,
 				bool destruct_original) {
 		const u32 mask = new_capacity - 1;
@@ -406,11 +573,17 @@ template <class K, class V, class Policy> class HashMap {
 				else
 					hash = hashFunc(old_storage.key(idx));
 
-				u32 i = hash & mask;
-
-				int num_probes = 1;
-				while(!new_storage.isUnused(i))
-					i = (i + num_probes++) & mask;
+				u32 i;
+				if constexpr(robin_hood)
+					i = makeRoomRH(new_storage, mask, hash);
+				else if constexpr(group_probing)
+					i = findUnusedGrouped(new_storage, mask, hash);
+				else {
+					i = hash & mask;
+					int num_probes = 1;
+					while(!new_storage.isUnused(i))
+						i = (i + num_probes++) & mask;
+				}
 				new_storage.construct(i, hash, old_storage.key(idx), old_storage.value(idx));
 				if(destruct_original)
 					old_storage.destruct(idx);
@@ -429,17 +602,173 @@ template <class K, class V, class Policy> class HashMap {
 	void eraseNode(int idx) {
 		PASSERT(m_storage.isValid(idx));
 		m_storage.destruct(idx);
-		m_storage.markDeleted(idx);
 		--m_size;
+
+		if constexpr(robin_hood) {
+			// Backward shift deletion
+			u32 next = (idx + 1) & m_capacity_mask;
+			while(m_storage.isValid(next) && distanceRH(m_storage, m_capacity_mask, next) > 0) {
+				m_storage.relocate(next, idx);
+				idx = next;
+				next = (next + 1) & m_capacity_mask;
+			}
+			m_storage.markUnused(idx);
+			--m_num_used;
+		} else {
+			m_storage.markDeleted(idx);
+		}
+	}
+
+	// ---------------------------------------------------------------------------------------
+	// Group probing: quadratic probing on groups of buckets. Home group is the one containing
+	// bucket (hash & capacity_mask). Matching buckets within group are found with bit masks
+	// returned by storage. Only used when group_probing is true.
+
+	template <class T> int lookupGrouped(const T &key, Hash hash) const {
+		if(m_capacity == 0)
+			return m_capacity;
+
+		// Guarantees loop termination.
+		PASSERT(m_num_used < m_capacity);
+
+		const u32 group_mask = m_capacity_mask / group_size;
+		u32 group = (hash & m_capacity_mask) / group_size;
+		auto control = Storage::control(hash);
+		for(int num_probes = 1;; num_probes++) {
+			u32 matches = m_storage.matchGroup(group, control);
+			while(matches) {
+				int idx = group * group_size + countTrailingZeros(matches);
+				if(m_storage.key(idx) == key)
+					return idx;
+				matches &= matches - 1;
+			}
+			if(m_storage.matchUnused(group))
+				return m_capacity;
+			group = (group + num_probes) & group_mask;
+		}
+	}
+
+	int findForInsertGrouped(const Key &key, Hash hash) {
+		if(m_capacity == 0)
+			return m_capacity;
+
+		// Guarantees loop termination.
+		PASSERT(m_num_used < m_capacity);
+
+		const u32 group_mask = m_capacity_mask / group_size;
+		u32 group = (hash & m_capacity_mask) / group_size;
+		auto control = Storage::control(hash);
+		int free_idx = -1;
+		for(int num_probes = 1;; num_probes++) {
+			u32 matches = m_storage.matchGroup(group, control);
+			while(matches) {
+				int idx = group * group_size + countTrailingZeros(matches);
+				if(m_storage.key(idx) == key)
+					return idx;
+				matches &= matches - 1;
+			}
+			if(free_idx == -1) {
+				if(u32 free = m_storage.matchFree(group))
+					free_idx = group * group_size + countTrailingZeros(free);
+			}
+			if(m_storage.matchUnused(group))
+				return free_idx;
+			group = (group + num_probes) & group_mask;
+		}
+	}
+
+	static u32 findUnusedGrouped(const Storage &storage, u32 mask, Hash hash) {
+		const u32 group_mask = mask / group_size;
+		u32 group = (hash & mask) / group_size;
+		for(int num_probes = 1;; num_probes++) {
+			if(u32 unused = storage.matchUnused(group))
+				return group * group_size + countTrailingZeros(unused);
+			group = (group + num_probes) & group_mask;
+		}
+	}
+
+	// ---------------------------------------------------------------------------------------
+	// Robin hood probing: linear probing in which elements in each cluster are ordered by their
+	// distance from home bucket. Thanks to this, lookup can stop early and elements can be
+	// shifted back on erase. Only used when robin_hood is true.
+
+	Hash slotHash(const Storage &storage, int idx) const {
+		if constexpr(keeps_hashes)
+			return storage.hashes[idx];
+		else
+			return hashFunc(storage.key(idx));
+	}
+
+	int distanceRH(const Storage &storage, u32 mask, int idx) const {
+		return (idx - slotHash(storage, idx)) & mask;
+	}
+
+	template <class T> int lookupRH(const T &key, Hash hash) const {
+		u32 idx = hash & m_capacity_mask;
+		for(int dist = 0;; dist++) {
+			if(m_storage.isUnused(idx))
+				return m_capacity;
+			if(m_storage.compareKey(idx, key, hash))
+				return idx;
+			if(distanceRH(m_storage, m_capacity_mask, idx) < dist)
+				return m_capacity;
+			idx = (idx + 1) & m_capacity_mask;
+		}
+	}
+
+	// Moves cluster starting at idx one position forward (up to first unused bucket)
+	static void shiftForwardRH(Storage &storage, u32 mask, u32 idx) {
+		u32 last = idx;
+		while(!storage.isUnused(last))
+			last = (last + 1) & mask;
+		while(last != idx) {
+			u32 prev = (last - 1) & mask;
+			storage.relocate(prev, last);
+			last = prev;
+		}
+		storage.markUnused(idx);
+	}
+
+	// Returns index of unused bucket where new element with given hash can be constructed
+	// Key cannot be present in the storage
+	u32 makeRoomRH(Storage &storage, u32 mask, Hash hash) const {
+		u32 idx = hash & mask;
+		for(int dist = 0;; dist++) {
+			if(storage.isUnused(idx))
+				return idx;
+			if(distanceRH(storage, mask, idx) < dist) {
+				shiftForwardRH(storage, mask, idx);
+				return idx;
+			}
+			idx = (idx + 1) & mask;
+		}
+	}
+
+	Pair<int, bool> findForInsertRH(const Key &key, Hash hash) {
+		// Guarantees loop termination.
+		PASSERT(m_num_used < m_capacity);
+
+		u32 idx = hash & m_capacity_mask;
+		for(int dist = 0;; dist++) {
+			if(m_storage.isUnused(idx))
+				return {idx, false};
+			if(m_storage.compareKey(idx, key, hash))
+				return {idx, true};
+			if(distanceRH(m_storage, m_capacity_mask, idx) < dist) {
+				shiftForwardRH(m_storage, m_capacity_mask, idx);
+				return {idx, false};
+			}
+			idx = (idx + 1) & m_capacity_mask;
+		}
 	}
 
-	Hash hashFunc(const Key &key) const {
-		if constexpr(PolicyInfo::has_hash)
-			return Policy::hash(key);
-		else if constexpr(keeps_hashes)
-			return hash<Hash>(key) & 0x7FFFFFFFu;
+	template <class T> Hash hashFunc(const T &key) const {
+		Hash out;
+		if constexpr(PolicyInfo::has_hash || transparent_key<T>)
+			out = Policy::hash(key);
 		else
-			return hash<Hash>(key);
+			out = hash<Hash>(key);
+		return keeps_hashes ? out & 0x7FFFFFFFu : out;
 	}
 
 	Storage m_storage;
@@ -447,5 +776,6 @@ template <class K, class V, class Policy> class HashMap {
 	int m_num_used = 0, m_used_limit = 0;
 	float m_load_factor = 2.0f / 3.0f;
 	u32 m_capacity_mask = 0;
+	Arena *m_arena = nullptr;
 };
 }
@@ -3,20 +3,27 @@
 
 #pragma once
 
+#include "fwk/hash_map_storage.h"
 #include "fwk/span.h"
 
 namespace fwk {
 
 struct HashMapStats {
 	template <class K, class V, class P>
-	HashMapStats(const HashMap<K, V, P> &hash_map) : HashMapStats(hash_map.hashes()) {
+	HashMapStats(const HashMap<K, V, P> &hash_map)
+		: HashMapStats(hash_map.hashes(), hash_map.probing, hash_map.group_size) {
 		used_memory = hash_map.usedMemory();
 	}
-	template <class K> HashMapStats(const HashSet<K> &hash_set) : HashMapStats(hash_set.hashes()) {
+	template <class K, class P>
+	HashMapStats(const HashSet<K, P> &hash_set)
+		: HashMapStats(hash_set.hashes(), hash_set.probing) {
 		used_memory = hash_set.usedMemory();
 	}
 
-	HashMapStats(CSpan<u32> hashes);
+	// group_size > 1 means that quadratic probing is performed on groups of buckets;
+	// In this case hit search lengths are computed in groups
+	HashMapStats(CSpan<u32> hashes, HashMapProbing = HashMapProbing::quadratic,
+				 int group_size = 1);
 	HashMapStats();
 
 	void print(bool print_occupancy_map) const;
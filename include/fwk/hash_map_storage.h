@@ -3,11 +3,62 @@
 
 #pragma once
 
+#include "fwk/arena.h"
 #include "fwk/sys/memory.h"
 #include "fwk/sys_base.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace fwk {
 
+// Probing scheme used by HashMap & HashSet:
+// - quadratic:  variant of quadratic probing (visits all keys); erased elements are replaced with
+//               deleted markers, which are only cleared when table is rehashed
+// - robin_hood: linear probing where elements which are further from their home bucket
+//               take precedence; erase shifts following elements back so no deleted markers
+//               are ever created. Erasing an element invalidates iterators.
+enum class HashMapProbing { quadratic, robin_hood };
+
+namespace detail {
+	// Storages are allocated from arena (if given) and freed with Arena::deallocate
+	inline void *allocStorage(Arena *arena, size_t size) {
+		return arena ? arena->allocate(size) : fwk::allocate(size);
+	}
+
+	// Policy properties common for HashMap & HashSet
+	template <class K, class P> struct AccessHashPolicy {
+		FWK_SFINAE_TEST(has_probing, P, U::probing());
+		static constexpr auto probing = []() {
+			if constexpr(has_probing)
+				return P::probing();
+			return HashMapProbing::quadratic;
+		}();
+
+		FWK_SFINAE_TYPE(HashResult, P, U::hash(DECLVAL(const K &)));
+		static constexpr bool has_hash = is_convertible<HashResult, u32>;
+
+		FWK_SFINAE_TEST(has_is_transparent, P, U::is_transparent);
+		static constexpr bool is_transparent = []() {
+			if constexpr(has_is_transparent)
+				return bool(P::is_transparent);
+			return false;
+		}();
+
+		// Can T be used instead of K in lookups? It's up to the policy to make sure that
+		// hashes of T & K are equal if they compare equal.
+		template <class T>
+		static constexpr bool transparent_key =
+			is_transparent && !is_same<T, K> && equality_comparable<K, T> &&
+			requires(const T &value) {
+				{ P::hash(value) } -> is_convertible<u32>;
+			};
+	};
+}
+
 // Checks wheter type can hold intrusive hash info
 template <class T>
 static constexpr bool intrusive_hash_type =
@@ -30,6 +81,7 @@ template <class Key, class Value> struct HashMapStoragePaired {
 				  "Keys when constructed with special values should be trivially destructible");
 
 	static constexpr bool keeps_hashes = false, keeps_pairs = true;
+	static constexpr int group_size = 1;
 	static constexpr auto memory_unit = sizeof(KeyValue);
 
 	FWK_ALWAYS_INLINE auto &keyValue(int idx) const { return key_values[idx]; }
@@ -38,7 +90,10 @@ template <class Key, class Value> struct HashMapStoragePaired {
 	FWK_ALWAYS_INLINE Value &value(int idx) { return key_values[idx].value; }
 	FWK_ALWAYS_INLINE const Value &value(int idx) const { return key_values[idx].value; }
 
-	bool compareKey(int idx, const Key &key, u32 hash) const { return key_values[idx].key == key; }
+	template <class T> bool compareKey(int idx, const T &key, u32 hash) const {
+		return key_values[idx].key == key;
+	}
+	void prefetch(int idx) const { FWK_PREFETCH(key_values + idx); }
 	bool isDeleted(int idx) const { return key_values[idx].key.holds(Intrusive::DeletedHash()); }
 	bool isUnused(int idx) const { return key_values[idx].key.holds(Intrusive::UnusedHash()); }
 	bool isValid(int idx) const { return !isDeleted(idx) && !isUnused(idx); }
@@ -48,6 +103,13 @@ template <class Key, class Value> struct HashMapStoragePaired {
 	}
 
 	void destruct(int idx) { key_values[idx].~KeyValue(); }
+	// Moves element from src to (uninitialized) dst; src has to be marked afterwards
+	void relocate(int src, int dst) {
+		auto &kv = key_values[src];
+		new((Key *)&key_values[dst])
+			KeyValue{std::move(const_cast<Key &>(kv.key)), std::move(kv.value)};
+		kv.~KeyValue();
+	}
 	FWK_ALWAYS_INLINE void markDeleted(int idx) {
 		new((Key *)&key_values[idx].key) Key(Intrusive::DeletedHash());
 	}
@@ -55,9 +117,9 @@ template <class Key, class Value> struct HashMapStoragePaired {
 		new((Key *)&key_values[idx].key) Key(Intrusive::UnusedHash());
 	}
 
-	static HashMapStoragePaired allocate(int new_capacity) {
+	static HashMapStoragePaired allocate(int new_capacity, Arena *arena = nullptr) {
 		auto *new_key_values =
-			static_cast<KeyValue *>(fwk::allocate(new_capacity * sizeof(KeyValue)));
+			static_cast<KeyValue *>(detail::allocStorage(arena, new_capacity * sizeof(KeyValue)));
 		for(int n = 0; n < new_capacity; n++)
 			new((Key *)&new_key_values[n].key) Key(Intrusive::UnusedHash());
 		return {new_key_values};
@@ -65,7 +127,7 @@ template <class Key, class Value> struct HashMapStoragePaired {
 
 	void deallocate() {
 		if((KeyValue_ *)key_values != &s_empty_node)
-			fwk::deallocate(key_values);
+			Arena::deallocate(key_values);
 	}
 
 	struct KeyValue_ {
@@ -91,6 +153,7 @@ template <class Key, class Value> struct HashMapStorageSeparated {
 				  "Keys when constructed with special values should be trivially destructible");
 
 	static constexpr bool keeps_hashes = false, keeps_pairs = false;
+	static constexpr int group_size = 1;
 	static constexpr auto memory_unit = sizeof(Key) + sizeof(Value);
 
 	KeyValue keyValue(int idx) const { return {keys[idx], values[idx]}; }
@@ -98,7 +161,10 @@ template <class Key, class Value> struct HashMapStorageSeparated {
 	FWK_ALWAYS_INLINE Value &value(int idx) { return values[idx]; }
 	FWK_ALWAYS_INLINE const Value &value(int idx) const { return values[idx]; }
 
-	bool compareKey(int idx, const Key &key, u32 hash) const { return keys[idx] == key; }
+	template <class T> bool compareKey(int idx, const T &key, u32 hash) const {
+		return keys[idx] == key;
+	}
+	void prefetch(int idx) const { FWK_PREFETCH(keys + idx); }
 	bool isDeleted(int idx) const { return keys[idx].holds(Intrusive::DeletedHash()); }
 	bool isUnused(int idx) const { return keys[idx].holds(Intrusive::UnusedHash()); }
 	bool isValid(int idx) const { return !isDeleted(idx) && !isUnused(idx); }
@@ -109,21 +175,27 @@ template <class Key, class Value> struct HashMapStorageSeparated {
 	}
 
 	void destruct(int idx) { keys[idx].~Key(), values[idx].~Value(); }
+	void relocate(int src, int dst) {
+		new(&keys[dst]) Key(std::move(keys[src]));
+		new(&values[dst]) Value(std::move(values[src]));
+		destruct(src);
+	}
 	FWK_ALWAYS_INLINE void markDeleted(int idx) { new(&keys[idx]) Key(Intrusive::DeletedHash()); }
 	FWK_ALWAYS_INLINE void markUnused(int idx) { new(&keys[idx]) Key(Intrusive::UnusedHash()); }
 
-	static HashMapStorageSeparated allocate(int new_capacity) {
-		auto *new_keys = static_cast<Key *>(fwk::allocate(new_capacity * sizeof(Key)));
+	static HashMapStorageSeparated allocate(int new_capacity, Arena *arena = nullptr) {
+		auto *new_keys =
+			static_cast<Key *>(detail::allocStorage(arena, new_capacity * sizeof(Key)));
 		for(int n = 0; n < new_capacity; n++)
 			new(&new_keys[n]) Key(Intrusive::UnusedHash());
-		auto *new_values = (Value *)fwk::allocate(new_capacity * sizeof(Value));
+		auto *new_values = (Value *)detail::allocStorage(arena, new_capacity * sizeof(Value));
 		return {new_keys, new_values};
 	}
 
 	void deallocate() {
 		if(keys != &s_empty_node)
-			fwk::deallocate(keys);
-		fwk::deallocate(values);
+			Arena::deallocate(keys);
+		Arena::deallocate(values);
 	}
 	static inline Key s_empty_node{Intrusive::UnusedHash()};
 	Key *keys = &s_empty_node;
@@ -135,6 +207,7 @@ template <class Key, class Value> struct HashMapStorageSeparated {
 template <class Key, class Value> struct HashMapStoragePairedWithHashes {
 	using KeyValue = fwk::KeyValue<const Key, Value>;
 	static constexpr bool keeps_hashes = true, keeps_pairs = true;
+	static constexpr int group_size = 1;
 	static constexpr auto memory_unit = sizeof(u32) + sizeof(KeyValue);
 
 	FWK_ALWAYS_INLINE auto &keyValue(int idx) const { return key_values[idx]; }
@@ -143,25 +216,31 @@ template <class Key, class Value> struct HashMapStoragePairedWithHashes {
 	FWK_ALWAYS_INLINE Value &value(int idx) { return key_values[idx].value; }
 	FWK_ALWAYS_INLINE const Value &value(int idx) const { return key_values[idx].value; }
 
-	bool compareKey(int idx, const Key &key, u32 hash) const {
+	template <class T> bool compareKey(int idx, const T &key, u32 hash) const {
 		return hashes[idx] == hash && key_values[idx].key == key;
 	}
+	void prefetch(int idx) const {
+		FWK_PREFETCH(hashes + idx);
+		FWK_PREFETCH(key_values + idx);
+	}
 	FWK_ALWAYS_INLINE bool isDeleted(int idx) const { return hashes[idx] == deleted_hash; }
 	FWK_ALWAYS_INLINE bool isUnused(int idx) const { return hashes[idx] == unused_hash; }
 	FWK_ALWAYS_INLINE bool isValid(int idx) const { return hashes[idx] < deleted_hash; }
 
-	static HashMapStoragePairedWithHashes allocate(int new_capacity) {
-		u32 *new_hashes = static_cast<u32 *>(fwk::allocate(new_capacity * sizeof(u32)));
+	static HashMapStoragePairedWithHashes allocate(int new_capacity, Arena *arena = nullptr) {
+		u32 *new_hashes =
+			static_cast<u32 *>(detail::allocStorage(arena, new_capacity * sizeof(u32)));
 		for(int n = 0; n < new_capacity; n++)
 			new_hashes[n] = unused_hash;
-		auto *new_key_values = (KeyValue *)fwk::allocate(new_capacity * sizeof(KeyValue));
+		auto *new_key_values =
+			(KeyValue *)detail::allocStorage(arena, new_capacity * sizeof(KeyValue));
 		return {new_hashes, new_key_values};
 	}
 
 	void deallocate() {
 		if(hashes != &s_empty_node)
-			fwk::deallocate(hashes);
-		fwk::deallocate(key_values);
+			Arena::deallocate(hashes);
+		Arena::deallocate(key_values);
 	}
 
 	template <class... Args> void construct(int idx, u32 hash, const Key &key, Args &&...args) {
@@ -170,6 +249,13 @@ template <class Key, class Value> struct HashMapStoragePairedWithHashes {
 	}
 
 	void destruct(int idx) { key_values[idx].~KeyValue(); }
+	void relocate(int src, int dst) {
+		auto &kv = key_values[src];
+		new((Key *)&key_values[dst])
+			KeyValue{std::move(const_cast<Key &>(kv.key)), std::move(kv.value)};
+		kv.~KeyValue();
+		hashes[dst] = hashes[src];
+	}
 	FWK_ALWAYS_INLINE void markDeleted(int idx) { hashes[idx] = deleted_hash; }
 	FWK_ALWAYS_INLINE void markUnused(int idx) { hashes[idx] = unused_hash; }
 
@@ -180,4 +266,104 @@ template <class Key, class Value> struct HashMapStoragePairedWithHashes {
 	u32 *hashes = &s_empty_node;
 	KeyValue *key_values = nullptr;
 };
+
+// HashMap storage where keys and values are together and additionally there is a separate
+// array of 1-byte control values (similar to swiss tables). Control value keeps top 7 bits of
+// the hash (or unused / deleted marker). Buckets are grouped by 16 and HashMap probes whole
+// groups at once: control values of a group are compared with single SSE2 / NEON instruction.
+// Should be used when keys are big and lookups dominate. Capacity has to be a multiple of 16.
+template <class Key, class Value> struct HashMapStorageGrouped {
+	using KeyValue = fwk::KeyValue<const Key, Value>;
+	static constexpr bool keeps_hashes = false, keeps_pairs = true;
+	static constexpr int group_size = 16;
+	static constexpr auto memory_unit = sizeof(u8) + sizeof(KeyValue);
+
+	FWK_ALWAYS_INLINE auto &keyValue(int idx) const { return key_values[idx]; }
+	FWK_ALWAYS_INLINE auto &keyValue(int idx) { return key_values[idx]; }
+	FWK_ALWAYS_INLINE const Key &key(int idx) const { return key_values[idx].key; }
+	FWK_ALWAYS_INLINE Value &value(int idx) { return key_values[idx].value; }
+	FWK_ALWAYS_INLINE const Value &value(int idx) const { return key_values[idx].value; }
+
+	static FWK_ALWAYS_INLINE u8 control(u32 hash) { return u8(hash >> 25); }
+
+	template <class T> bool compareKey(int idx, const T &key, u32 hash) const {
+		return controls[idx] == control(hash) && key_values[idx].key == key;
+	}
+	void prefetch(int idx) const {
+		FWK_PREFETCH(controls + idx);
+		FWK_PREFETCH(key_values + idx);
+	}
+	FWK_ALWAYS_INLINE bool isDeleted(int idx) const { return controls[idx] == deleted_control; }
+	FWK_ALWAYS_INLINE bool isUnused(int idx) const { return controls[idx] == unused_control; }
+	FWK_ALWAYS_INLINE bool isValid(int idx) const { return controls[idx] < 0x80; }
+
+	// Returns bit mask of buckets in given group with matching control values
+	FWK_ALWAYS_INLINE u32 matchGroup(int group, u8 value) const {
+		const u8 *ptr = controls + group * group_size;
+#if defined(__SSE2__)
+		auto group_ctrls = _mm_loadu_si128((const __m128i *)ptr);
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(group_ctrls, _mm_set1_epi8(char(value))));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		static constexpr uint8x16_t bits = {1, 2, 4, 8, 16, 32, 64, 128,
+											1, 2, 4, 8, 16, 32, 64, 128};
+		auto matches = vandq_u8(vceqq_u8(vld1q_u8(ptr), vdupq_n_u8(value)), bits);
+		return u32(vaddv_u8(vget_low_u8(matches))) | (u32(vaddv_u8(vget_high_u8(matches))) << 8);
+#else
+		u32 out = 0;
+		for(int n = 0; n < group_size; n++)
+			out |= u32(ptr[n] == value) << n;
+		return out;
+#endif
+	}
+	FWK_ALWAYS_INLINE u32 matchUnused(int group) const { return matchGroup(group, unused_control); }
+	// Returns bit mask of buckets in given group which are unused or deleted
+	FWK_ALWAYS_INLINE u32 matchFree(int group) const {
+		const u8 *ptr = controls + group * group_size;
+#if defined(__SSE2__)
+		return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ptr));
+#else
+		return matchGroup(group, unused_control) | matchGroup(group, deleted_control);
+#endif
+	}
+
+	static HashMapStorageGrouped allocate(int new_capacity, Arena *arena = nullptr) {
+		PASSERT(new_capacity % group_size == 0);
+		u8 *new_controls = static_cast<u8 *>(detail::allocStorage(arena, new_capacity));
+		memset(new_controls, unused_control, new_capacity);
+		auto *new_key_values =
+			(KeyValue *)detail::allocStorage(arena, new_capacity * sizeof(KeyValue));
+		return {new_controls, new_key_values};
+	}
+
+	void deallocate() {
+		if(controls != s_empty_group)
+			Arena::deallocate(controls);
+		Arena::deallocate(key_values);
+	}
+
+	template <class... Args> void construct(int idx, u32 hash, const Key &key, Args &&...args) {
+		new((Key *)&key_values[idx]) KeyValue{key, Value{std::forward<Args>(args)...}};
+		controls[idx] = control(hash);
+	}
+
+	void destruct(int idx) { key_values[idx].~KeyValue(); }
+	void relocate(int src, int dst) {
+		auto &kv = key_values[src];
+		new((Key *)&key_values[dst])
+			KeyValue{std::move(const_cast<Key &>(kv.key)), std::move(kv.value)};
+		kv.~KeyValue();
+		controls[dst] = controls[src];
+	}
+	FWK_ALWAYS_INLINE void markDeleted(int idx) { controls[idx] = deleted_control; }
+	FWK_ALWAYS_INLINE void markUnused(int idx) { controls[idx] = unused_control; }
+
+	static constexpr u8 unused_control = 0x80;
+	static constexpr u8 deleted_control = 0xfe;
+
+	alignas(16) static inline u8 s_empty_group[group_size] = {
+		0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+		0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80};
+	u8 *controls = s_empty_group;
+	KeyValue *key_values = nullptr;
+};
 }
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "fwk/hash_map_storage.h"
 #include "fwk/math/hash.h"
 #include "fwk/sys/memory.h"
 
@@ -11,10 +12,17 @@ namespace fwk {
 // Original source: hash_map.h from RDE STL by Maciej Sinilo (Copyright 2007)
 // Licensed under MIT license
 // Improved & adapted for libfwk by Krzysztof Jakubowski
-template <typename TKey> class HashSet {
+//
+// Policy can specify probing scheme, hash function & transparent lookups (see HashMap).
+template <typename TKey, class Policy> class HashSet {
   public:
 	using Hash = u32;
 	using Key = TKey;
+	using PolicyInfo = detail::AccessHashPolicy<TKey, Policy>;
+	static constexpr auto probing = PolicyInfo::probing;
+	static constexpr bool robin_hood = probing == HashMapProbing::robin_hood;
+	template <class T>
+	static constexpr bool transparent_key = PolicyInfo::template transparent_key<T>;
 
 	template <bool is_const> struct TIter {
 		template <bool to_const>
@@ -73,6 +81,11 @@ template <typename TKey> class HashSet {
 	ConstIter end() const { return {this, m_capacity}; }
 
 	bool contains(const Key &key) const { return !!find(key); }
+	template <class T>
+		requires(transparent_key<T>)
+	bool contains(const T &key) const {
+		return lookup(key) != m_capacity;
+	}
 
 	void operator=(const HashSet &rhs) {
 		if(&rhs == this)
@@ -117,6 +130,17 @@ template <typename TKey> class HashSet {
 			grow();
 
 		auto hash = hashFunc(key);
+		if constexpr(robin_hood) {
+			auto [idx, found] = findForInsertRH(key, hash);
+			if(found)
+				return {{this, idx}, false};
+			new(&m_keys[idx]) Key{key};
+			m_hashes[idx] = hash;
+			++m_num_used;
+			++m_size;
+			return {{this, idx}, true};
+		}
+
 		int idx = findForInsert(key, hash);
 		if(m_hashes[idx] < deleted_hash)
 			return {{this, idx}, false};
@@ -129,13 +153,11 @@ template <typename TKey> class HashSet {
 		return {{this, idx}, true};
 	}
 
-	bool erase(const Key &key) {
-		auto idx = lookup(key);
-		if(idx != m_capacity && m_hashes[idx] < deleted_hash) {
-			eraseNode(idx);
-			return true;
-		}
-		return false;
+	bool erase(const Key &key) { return eraseKey(key); }
+	template <class T>
+		requires(transparent_key<T>)
+	bool erase(const T &key) {
+		return eraseKey(key);
 	}
 
 	void erase(Iter it) {
@@ -147,6 +169,30 @@ template <typename TKey> class HashSet {
 	void erase(Iter from, Iter to) {
 		PASSERT(valid(from) && valid(to));
 
+		if constexpr(robin_hood) {
+			// Removing whole range first, then moving back elements from the cluster
+			// which follows it (in order); each one goes to first free bucket after its home
+			if(from.idx >= to.idx)
+				return;
+			for(int idx = from.idx; idx < to.idx; idx++)
+				if(m_hashes[idx] < deleted_hash) {
+					m_keys[idx].~Key();
+					m_hashes[idx] = unused_hash;
+					--m_size;
+				}
+			m_num_used = m_size;
+
+			const u32 mask = m_capacity_mask;
+			for(u32 idx = to.idx & mask; m_hashes[idx] < deleted_hash; idx = (idx + 1) & mask) {
+				u32 new_idx = m_hashes[idx] & mask;
+				while(new_idx != idx && m_hashes[new_idx] != unused_hash)
+					new_idx = (new_idx + 1) & mask;
+				if(new_idx != idx)
+					relocate(m_hashes, m_keys, idx, new_idx);
+			}
+			return;
+		}
+
 		auto idx = from.idx;
 		while(idx != to.idx) {
 			if(m_hashes[idx] < deleted_hash)
@@ -157,6 +203,16 @@ template <typename TKey> class HashSet {
 
 	Iter find(const Key &key) { return {this, lookup(key)}; }
 	ConstIter find(const Key &key) const { return {this, lookup(key)}; }
+	template <class T>
+		requires(transparent_key<T>)
+	Iter find(const T &key) {
+		return {this, lookup(key)};
+	}
+	template <class T>
+		requires(transparent_key<T>)
+	ConstIter find(const T &key) const {
+		return {this, lookup(key)};
+	}
 
 	void clear() {
 		for(int n = 0; n < m_capacity; n++) {
@@ -221,6 +277,15 @@ template <typename TKey> class HashSet {
 		PASSERT(m_num_used < m_capacity);
 	}
 
+	template <class T> bool eraseKey(const T &key) {
+		auto idx = lookup(key);
+		if(idx != m_capacity && m_hashes[idx] < deleted_hash) {
+			eraseNode(idx);
+			return true;
+		}
+		return false;
+	}
+
 	Pair<Iter, bool> emplaceAt(const Key &v, int idx, Hash hash) {
 		if(idx == m_capacity || m_num_used >= m_used_limit)
 			return emplace(v);
@@ -257,8 +322,11 @@ template <typename TKey> class HashSet {
 		return free_idx != -1 ? free_idx : idx;
 	}
 
-	int lookup(const Key &key) const {
+	template <class T> int lookup(const T &key) const {
 		auto hash = hashFunc(key);
+		if constexpr(robin_hood)
+			return lookupRH(key, hash);
+
 		unsigned idx = hash & m_capacity_mask;
 		if(m_hashes[idx] == hash && m_keys[idx] == key)
 			return idx;
@@ -281,11 +349,15 @@ template <typename TKey> class HashSet {
 		for(int idx = 0; idx < capacity; idx++) {
 			if(hashes[idx] < deleted_hash) {
 				const Hash hash = hashes[idx];
-				u32 i = hash & mask;
-
-				int num_probes = 1;
-				while(new_hashes[i] != unused_hash)
-					i = (i + num_probes++) & mask;
+				u32 i;
+				if constexpr(robin_hood)
+					i = makeRoomRH(new_hashes, new_keys, mask, hash);
+				else {
+					i = hash & mask;
+					int num_probes = 1;
+					while(new_hashes[i] != unused_hash)
+						i = (i + num_probes++) & mask;
+				}
 				new(&new_keys[i]) Key(keys[idx]);
 				new_hashes[i] = hash;
 				if(destruct_original)
@@ -314,11 +386,100 @@ template <typename TKey> class HashSet {
 	void eraseNode(int idx) {
 		PASSERT(m_hashes[idx] < deleted_hash);
 		m_keys[idx].~Key();
-		m_hashes[idx] = deleted_hash;
 		--m_size;
+
+		if constexpr(robin_hood) {
+			// Backward shift deletion
+			u32 next = (idx + 1) & m_capacity_mask;
+			while(m_hashes[next] < deleted_hash && ((next - m_hashes[next]) & m_capacity_mask)) {
+				relocate(m_hashes, m_keys, next, idx);
+				idx = next;
+				next = (next + 1) & m_capacity_mask;
+			}
+			m_hashes[idx] = unused_hash;
+			--m_num_used;
+		} else {
+			m_hashes[idx] = deleted_hash;
+		}
+	}
+
+	// ---------------------------------------------------------------------------------------
+	// Robin hood probing; See HashMap for details.
+
+	// Moves key from src to dst; src is marked as unused
+	static void relocate(Hash *hashes, Key *keys, u32 src, u32 dst) {
+		new(&keys[dst]) Key(std::move(keys[src]));
+		keys[src].~Key();
+		hashes[dst] = hashes[src];
+		hashes[src] = unused_hash;
+	}
+
+	template <class T> int lookupRH(const T &key, Hash hash) const {
+		u32 idx = hash & m_capacity_mask;
+		for(u32 dist = 0;; dist++) {
+			if(m_hashes[idx] == unused_hash)
+				return m_capacity;
+			if(m_hashes[idx] == hash && m_keys[idx] == key)
+				return idx;
+			if(((idx - m_hashes[idx]) & m_capacity_mask) < dist)
+				return m_capacity;
+			idx = (idx + 1) & m_capacity_mask;
+		}
 	}
 
-	Hash hashFunc(const Key &key) const { return hash<Hash>(key) & 0x7FFFFFFFu; }
+	// Moves cluster starting at idx one position forward (up to first unused bucket)
+	static void shiftForwardRH(Hash *hashes, Key *keys, u32 mask, u32 idx) {
+		u32 last = idx;
+		while(hashes[last] != unused_hash)
+			last = (last + 1) & mask;
+		while(last != idx) {
+			u32 prev = (last - 1) & mask;
+			relocate(hashes, keys, prev, last);
+			last = prev;
+		}
+	}
+
+	// Returns index of unused bucket where new key with given hash can be constructed
+	// Key cannot be present in the set
+	static u32 makeRoomRH(Hash *hashes, Key *keys, u32 mask, Hash hash) {
+		u32 idx = hash & mask;
+		for(u32 dist = 0;; dist++) {
+			if(hashes[idx] == unused_hash)
+				return idx;
+			if(((idx - hashes[idx]) & mask) < dist) {
+				shiftForwardRH(hashes, keys, mask, idx);
+				return idx;
+			}
+			idx = (idx + 1) & mask;
+		}
+	}
+
+	Pair<int, bool> findForInsertRH(const Key &key, Hash hash) {
+		// Guarantees loop termination.
+		PASSERT(m_num_used < m_capacity);
+
+		u32 idx = hash & m_capacity_mask;
+		for(u32 dist = 0;; dist++) {
+			if(m_hashes[idx] == unused_hash)
+				return {idx, false};
+			if(m_hashes[idx] == hash && m_keys[idx] == key)
+				return {idx, true};
+			if(((idx - m_hashes[idx]) & m_capacity_mask) < dist) {
+				shiftForwardRH(m_hashes, m_keys, m_capacity_mask, idx);
+				return {idx, false};
+			}
+			idx = (idx + 1) & m_capacity_mask;
+		}
+	}
+
+	template <class T> Hash hashFunc(const T &key) const {
+		Hash out;
+		if constexpr(PolicyInfo::has_hash || transparent_key<T>)
+			out = Policy::hash(key);
+		else
+			out = hash<Hash>(key);
+		return out & 0x7FFFFFFFu;
+	}
 
 	static inline Hash s_empty_node = unused_hash;
 	Hash *m_hashes = &s_empty_node;
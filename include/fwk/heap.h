@@ -8,36 +8,54 @@
 
 namespace fwk {
 
-template <class T> class Heap {
+// Indexed d-ary min-heap; Each element is identified by a key index in range <0; max_keys).
+// update() & decreaseKey() take O(log(n)) time. Wider nodes (4 by default) make the heap
+// shallower & more cache friendly; extractMin is a bit slower, but decreaseKey (which is
+// usually called more often, e.g. in Dijkstra) is faster.
+template <class T, int arity = 4> class Heap {
   public:
 	static_assert(std::is_trivially_destructible_v<T> && std::is_trivially_copyable_v<T>);
+	static_assert(arity >= 2);
 
 	Heap(int max_keys) : m_heap(max_keys), m_indices(max_keys), m_size(0) {
 		for(auto &i : m_indices)
 			i = -1;
 	}
+	// Builds heap in O(n) time; Value of n-th key is values[n]
+	Heap(CSpan<T> values) : m_heap(values.size()), m_indices(values.size()), m_size(0) {
+		for(int n : intRange(values))
+			m_heap[n] = {values[n], n};
+		m_size = values.size();
+		if(m_size > 1)
+			for(int n = parent(m_size - 1); n >= 0; n--)
+				siftDown(n, m_heap[n]);
+		for(int n = 0; n < m_size; n++)
+			updateIndex(n);
+	}
 
 	int maxSize() const { return (int)m_heap.size(); }
 	int size() const { return m_size; }
 	bool empty() const { return m_size == 0; }
+	bool contains(int key_idx) const { return m_indices[key_idx] != -1; }
+
+	const Pair<T, int> &min() const {
+		DASSERT(m_size > 0);
+		return m_heap[0];
+	}
 
 	Pair<T, int> extractMin() {
 		DASSERT(m_size > 0);
 		auto min = m_heap[0];
 		m_indices[min.second] = -1;
-		if(m_size > 1) {
-			m_heap[0] = m_heap[--m_size];
-			updateIndex(0);
-			heapify(0);
-		} else
-			m_size = 0;
+		if(--m_size > 0)
+			siftDown(0, m_heap[m_size]);
 		return min;
 	}
 
 	void insert(int key_idx, T value) {
 		DASSERT(key_idx >= 0 && key_idx < maxSize());
 		DASSERT(m_indices[key_idx] == -1);
-		update(key_idx, value);
+		siftUp(m_size++, {value, key_idx});
 	}
 
 	T value(int key_idx) const {
@@ -46,34 +64,32 @@ template <class T> class Heap {
 		return m_heap[m_indices[key_idx]].first;
 	}
 
-	// TODO: this sux, fix it
+	// Inserts key if it's not present
 	void update(int key_idx, T value) {
 		DASSERT(key_idx >= 0 && key_idx < maxSize());
-
 		int pos = m_indices[key_idx];
-		if(pos == -1) {
-			pos = m_size++;
-			m_heap[pos].first = value;
-		}
-
-		if(value > m_heap[pos].first) {
-			m_heap[pos].first = value;
-			heapify(pos);
-			return;
-		}
+		if(pos == -1)
+			insert(key_idx, value);
+		else if(value < m_heap[pos].first)
+			siftUp(pos, {value, key_idx});
+		else
+			siftDown(pos, {value, key_idx});
+	}
 
-		while(pos > 0 && value < m_heap[pos / 2].first) {
-			m_heap[pos] = m_heap[pos / 2];
-			updateIndex(pos);
-			pos = pos / 2;
-		}
-		m_heap[pos] = {value, key_idx};
-		updateIndex(pos);
+	// New value cannot be greater than current value
+	void decreaseKey(int key_idx, T value) {
+		DASSERT(contains(key_idx));
+		int pos = m_indices[key_idx];
+		DASSERT(!(m_heap[pos].first < value));
+		siftUp(pos, {value, key_idx});
 	}
 
 	bool invariant() const {
 		for(int n = 1; n < m_size; n++)
-			if(less(n, n / 2))
+			if(less(n, parent(n)))
+				return false;
+		for(int n = 0; n < m_size; n++)
+			if(m_indices[m_heap[n].second] != n)
 				return false;
 		return true;
 	}
@@ -82,26 +98,113 @@ template <class T> class Heap {
 	int index(int vidx) const { return m_indices[vidx]; }
 
   private:
+	static int parent(int pos) { return (pos - 1) / arity; }
+	static int firstChild(int pos) { return pos * arity + 1; }
+
 	bool less(int a, int b) const { return m_heap[a].first < m_heap[b].first; }
 	void updateIndex(int pos) { m_indices[m_heap[pos].second] = pos; }
-	void heapify(int pos) {
-		int l = pos * 2;
-		int r = pos * 2 + 1;
-
-		int smallest = l < m_size && less(l, pos) ? l : pos;
-		if(r < m_size && less(r, smallest))
-			smallest = r;
-		if(smallest != pos) {
-			swap(m_heap[pos], m_heap[smallest]);
+
+	// Moves elements down the tree until a place for elem is found
+	void siftUp(int pos, Pair<T, int> elem) {
+		while(pos > 0) {
+			int ppos = parent(pos);
+			if(!(elem.first < m_heap[ppos].first))
+				break;
+			m_heap[pos] = m_heap[ppos];
+			updateIndex(pos);
+			pos = ppos;
+		}
+		m_heap[pos] = elem;
+		updateIndex(pos);
+	}
+
+	// Moves smallest children up the tree until a place for elem is found
+	void siftDown(int pos, Pair<T, int> elem) {
+		while(true) {
+			int first = firstChild(pos);
+			if(first >= m_size)
+				break;
+			int last = fwk::min(first + arity, m_size), smallest = first;
+			for(int child = first + 1; child < last; child++)
+				if(less(child, smallest))
+					smallest = child;
+			if(!(m_heap[smallest].first < elem.first))
+				break;
+			m_heap[pos] = m_heap[smallest];
 			updateIndex(pos);
-			updateIndex(smallest);
-			heapify(smallest);
+			pos = smallest;
 		}
+		m_heap[pos] = elem;
+		updateIndex(pos);
 	}
 
-	PodVector<pair<T, int>> m_heap;
+	PodVector<Pair<T, int>> m_heap;
 	PodVector<int> m_indices;
 	int m_size;
 };
 
+// Radix heap for monotone integer keys: key of inserted element cannot be smaller than the
+// key of the last extracted element (which is true for example in Dijkstra's algorithm with
+// integer weights). Elements are kept in buckets by the highest bit which differs from the
+// last extracted key; both insert & extractMin take amortized O(1) time (plus O(bits) when
+// buckets have to be redistributed).
+//
+// It's not indexed: instead of decreasing key, element should be inserted once again
+// (and outdated elements skipped after extraction).
+template <class Key, class Value = int>
+	requires(is_one_of<Key, u32, u64>)
+class RadixHeap {
+  public:
+	static constexpr int num_buckets = sizeof(Key) * 8 + 1;
+
+	int size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	Key lastKey() const { return m_last; }
+
+	void insert(Key key, Value value) {
+		DASSERT(key >= m_last);
+		m_buckets[bucketIndex(key)].emplace_back(key, value);
+		m_size++;
+	}
+
+	Pair<Key, Value> extractMin() {
+		DASSERT(m_size > 0);
+		if(m_buckets[0].empty()) {
+			int idx = 1;
+			while(m_buckets[idx].empty())
+				idx++;
+
+			auto &bucket = m_buckets[idx];
+			Key new_last = bucket[0].first;
+			for(auto &elem : bucket)
+				new_last = fwk::min(new_last, elem.first);
+			m_last = new_last;
+			// All elements go to lower buckets
+			for(auto &elem : bucket)
+				m_buckets[bucketIndex(elem.first)].emplace_back(elem);
+			bucket.clear();
+		}
+
+		m_size--;
+		auto out = m_buckets[0].back();
+		m_buckets[0].pop_back();
+		return out;
+	}
+
+	void clear() {
+		for(auto &bucket : m_buckets)
+			bucket.clear();
+		m_size = 0;
+		m_last = 0;
+	}
+
+  private:
+	int bucketIndex(Key key) const {
+		return key == m_last ? 0 : sizeof(Key) * 8 - countLeadingZeros(Key(key ^ m_last));
+	}
+
+	vector<Pair<Key, Value>> m_buckets[num_buckets];
+	int m_size = 0;
+	Key m_last = 0;
+};
 }
@@ -0,0 +1,399 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/base_vector.h"
+
+namespace fwk {
+
+// Growth policy for huge buffers: vectors grow 2x until they reach 64 MB, then by 1.5x;
+// Capacity of vectors bigger than 2 MB is rounded up to 2 MB (huge page size).
+i64 largeVectorGrowCapacity(i64 current, int obj_size);
+i64 largeVectorInsertCapacity(i64 current, int obj_size, i64 min_size);
+
+// Counterpart of BaseVector with 64-bit size & capacity.
+// Pools and arenas are not supported (they're meant for small vectors).
+// Big buffers use large allocations (see LargeAllocConfig), just like in BaseVector.
+class LargeBaseVector {
+  public:
+	using MoveDestroyFunc = void (*)(void *, void *, i64);
+	using DestroyFunc = void (*)(void *, i64);
+	using CopyFunc = void (*)(void *, const void *, i64);
+
+	~LargeBaseVector() {} // Manual free is required
+
+	void zero() {
+		data = nullptr;
+		size = capacity = 0;
+	}
+	void moveConstruct(LargeBaseVector &&rhs) {
+		data = rhs.data;
+		size = rhs.size;
+		capacity = rhs.capacity;
+		rhs.zero();
+	}
+
+	void alloc(VectorElem, i64 size, i64 capacity);
+	void free(VectorElem elem) {
+		if(maybeLargeAllocation(data, size_t(capacity) * elem.size))
+			fwk::deallocateLarge(data);
+		else if(elem.alignment)
+			fwk::deallocate(data, elem.alignment);
+		else
+			fwk::deallocate(data);
+	}
+
+	void swap(LargeBaseVector &rhs) {
+		fwk::swap(data, rhs.data);
+		fwk::swap(size, rhs.size);
+		fwk::swap(capacity, rhs.capacity);
+	}
+
+	void grow(VectorElem, MoveDestroyFunc func);
+	void growPod(VectorElem);
+
+	void reallocate(VectorElem, MoveDestroyFunc move_destroy_func, i64 new_capacity);
+	void clear(DestroyFunc destroy_func);
+	void erase(VectorElem, DestroyFunc, MoveDestroyFunc, i64 index, i64 count);
+	void resizePartial(VectorElem, DestroyFunc, MoveDestroyFunc, i64 new_size);
+	void insertPartial(VectorElem, MoveDestroyFunc, i64 offset, i64 count);
+	void assignPartial(VectorElem, DestroyFunc, i64 new_size);
+
+	void reallocatePod(VectorElem, i64 new_capacity);
+
+	void reservePod(VectorElem, i64 desired_capacity);
+	void reserve(VectorElem, MoveDestroyFunc, i64 desired_capacity);
+
+	void erasePod(VectorElem, i64 index, i64 count);
+	void resizePodPartial(VectorElem, i64 new_size);
+	void insertPodPartial(VectorElem, i64 offset, i64 count);
+	void assignPartialPod(VectorElem, i64 new_size);
+
+	void checkIndex(i64 index) const {
+		if(index < 0 || index >= size)
+			invalidIndex(index);
+	}
+	void checkNotEmpty() const {
+		if(size == 0)
+			invalidEmpty();
+	}
+
+	[[noreturn]] void invalidIndex(i64 index) const;
+	[[noreturn]] void invalidEmpty() const;
+
+	i64 size, capacity;
+	char *data;
+};
+
+// Vector which can keep more than 2^31 elements; Interface is similar to Vector, but indices
+// & sizes are 64-bit. It's not a span (c_span); it can be converted to LargeSpan or (if it's
+// small enough) to Span.
+template <class T> class LargeVector {
+  public:
+	using value_type = T;
+	using size_type = i64;
+
+	LargeVector() { m_base.zero(); }
+	~LargeVector() {
+		destroy(m_base.data, m_base.size);
+		m_base.free(elem);
+	}
+
+	explicit LargeVector(i64 size, const T &default_value = T()) {
+		m_base.alloc(elem, size, size);
+		for(i64 idx = 0; idx < size; idx++)
+			new(data() + idx) T(default_value);
+	}
+	LargeVector(CLargeSpan<T> span) : LargeVector() { assign(span.begin(), span.end()); }
+	LargeVector(CSpan<T> span) : LargeVector(CLargeSpan<T>(span)) {}
+	LargeVector(std::initializer_list<T> il) : LargeVector() { assign(il.begin(), il.end()); }
+	LargeVector(const LargeVector &rhs) : LargeVector() { assign(rhs.begin(), rhs.end()); }
+	LargeVector(LargeVector &&rhs) { m_base.moveConstruct(std::move(rhs.m_base)); }
+
+	void operator=(const LargeVector &rhs) {
+		if(this != &rhs)
+			assign(rhs.begin(), rhs.end());
+	}
+	void operator=(LargeVector &&rhs) {
+		if(this == &rhs)
+			return;
+		m_base.swap(rhs.m_base);
+		rhs.clear();
+	}
+
+	void assign(const T *first, const T *last) {
+		if(trivial)
+			m_base.assignPartialPod(elem, last - first);
+		else
+			m_base.assignPartial(elem, &LargeVector::destroy, last - first);
+		copy(data(), first, last - first);
+	}
+
+	void swap(LargeVector &rhs) { m_base.swap(rhs.m_base); }
+
+	bool inRange(i64 idx) const { return idx >= 0 && idx < m_base.size; }
+	const T *data() const { return reinterpret_cast<const T *>(m_base.data); }
+	T *data() { return reinterpret_cast<T *>(m_base.data); }
+
+	T &operator[](i64 idx) {
+		IF_PARANOID(m_base.checkIndex(idx));
+		return data()[idx];
+	}
+	const T &operator[](i64 idx) const {
+		IF_PARANOID(m_base.checkIndex(idx));
+		return data()[idx];
+	}
+
+	const T &front() const {
+		IF_PARANOID(m_base.checkNotEmpty());
+		return data()[0];
+	}
+	T &front() {
+		IF_PARANOID(m_base.checkNotEmpty());
+		return data()[0];
+	}
+	const T &back() const {
+		IF_PARANOID(m_base.checkNotEmpty());
+		return data()[m_base.size - 1];
+	}
+	T &back() {
+		IF_PARANOID(m_base.checkNotEmpty());
+		return data()[m_base.size - 1];
+	}
+
+	i64 size() const { return m_base.size; }
+	i64 capacity() const { return m_base.capacity; }
+	i64 usedMemory() const { return m_base.capacity * (i64)sizeof(T); }
+
+	bool empty() const { return m_base.size == 0; }
+	explicit operator bool() const { return m_base.size > 0; }
+
+	void clear() { m_base.clear(&LargeVector::destroy); }
+	void free() {
+		LargeVector empty;
+		m_base.swap(empty.m_base);
+	}
+
+	void reserve(i64 new_capacity) {
+		if(trivial)
+			m_base.reservePod(elem, new_capacity);
+		else
+			m_base.reserve(elem, &LargeVector::moveAndDestroy, new_capacity);
+	}
+
+	void resize(i64 new_size, T default_value) {
+		i64 index = m_base.size;
+		resizePrelude(new_size);
+		while(index < new_size)
+			new(data() + index++) T(default_value);
+	}
+	void resize(i64 new_size) {
+		i64 index = m_base.size;
+		resizePrelude(new_size);
+		while(index < new_size)
+			new(data() + index++) T();
+	}
+	void shrink(i64 new_size) {
+		PASSERT(m_base.size >= new_size);
+		resizePrelude(new_size);
+	}
+
+	template <class... Args> T &emplace_back(Args &&...args) INST_EXCEPT {
+		if(m_base.size == m_base.capacity) {
+			if(trivial)
+				m_base.growPod(elem);
+			else
+				m_base.grow(elem, &LargeVector::moveAndDestroy);
+		}
+		T *back = new(end()) T{std::forward<Args>(args)...};
+		m_base.size++;
+		return *back;
+	}
+	void push_back(const T &rhs) { emplace_back(rhs); }
+	void push_back(T &&rhs) { emplace_back(std::move(rhs)); }
+
+	void pop_back() {
+		IF_PARANOID(m_base.checkNotEmpty());
+		back().~T();
+		m_base.size--;
+	}
+
+	void erase(const T *a, const T *b) {
+		if(trivial)
+			m_base.erasePod(elem, a - begin(), b - a);
+		else
+			m_base.erase(elem, &LargeVector::destroy, &LargeVector::moveAndDestroy, a - begin(),
+						 b - a);
+	}
+	void erase(const T *it) { erase(it, it + 1); }
+
+	T *insert(const T *pos, const T *first, const T *last) {
+		i64 offset = pos - begin();
+		if(trivial)
+			m_base.insertPodPartial(elem, offset, last - first);
+		else
+			m_base.insertPartial(elem, &LargeVector::moveAndDestroyBackwards, offset, last - first);
+		copy(data() + offset, first, last - first);
+		return begin() + offset;
+	}
+	T *insert(const T *pos, const T &value) { return insert(pos, &value, (&value) + 1); }
+
+	T *begin() { return data(); }
+	T *end() { return data() + m_base.size; }
+	const T *begin() const { return data(); }
+	const T *end() const { return data() + m_base.size; }
+
+	operator LargeSpan<T>() { return {data(), m_base.size}; }
+	operator CLargeSpan<T>() const { return {data(), m_base.size}; }
+
+	// Regular span of given range; it cannot be longer than 2^31 - 1 elements
+	Span<T> span(i64 start, i64 end) { return LargeSpan<T>(*this).span(start, end); }
+	CSpan<T> span(i64 start, i64 end) const { return CLargeSpan<T>(*this).span(start, end); }
+
+	template <class U = T>
+		requires(equality_comparable<U, U>)
+	bool operator==(const LargeVector &rhs) const {
+		return size() == rhs.size() && std::equal(begin(), end(), rhs.begin(), rhs.end());
+	}
+
+  private:
+	static constexpr bool trivial = std::is_trivially_move_constructible<T>::value &&
+									std::is_trivially_copy_constructible<T>::value &&
+									std::is_trivially_destructible<T>::value;
+	static constexpr VectorElem elem = VectorElem::of<T>();
+
+	void resizePrelude(i64 new_size) {
+		if(trivial)
+			m_base.resizePodPartial(elem, new_size);
+		else
+			m_base.resizePartial(elem, &LargeVector::destroy, &LargeVector::moveAndDestroy,
+								 new_size);
+	}
+
+	static void copy(void *vdst, const void *vsrc, i64 count) {
+		if constexpr(trivial) {
+			if(count > 0)
+				memcpy(vdst, vsrc, size_t(count) * sizeof(T));
+		} else {
+			const T *FWK_RESTRICT src = (T *)vsrc;
+			T *FWK_RESTRICT dst = (T *)vdst;
+			for(i64 n = 0; n < count; n++)
+				new(dst + n) T(src[n]);
+		}
+	}
+	static void moveAndDestroy(void *vdst, void *vsrc, i64 count) {
+		T *FWK_RESTRICT src = (T *)vsrc;
+		T *FWK_RESTRICT dst = (T *)vdst;
+		for(i64 n = 0; n < count; n++) {
+			new(dst + n) T(std::move(src[n]));
+			src[n].~T();
+		}
+	}
+	static void moveAndDestroyBackwards(void *vdst, void *vsrc, i64 count) {
+		T *FWK_RESTRICT src = (T *)vsrc;
+		T *FWK_RESTRICT dst = (T *)vdst;
+		for(i64 n = count - 1; n >= 0; n--) {
+			new(dst + n) T(std::move(src[n]));
+			src[n].~T();
+		}
+	}
+	static void destroy(void *vsrc, i64 count) {
+		T *src = (T *)vsrc;
+		for(i64 n = 0; n < count; n++)
+			src[n].~T();
+	}
+
+	LargeBaseVector m_base;
+};
+
+// Counterpart of PodVector with 64-bit size & capacity; Data is not initialized.
+template <class T> class LargePodVector {
+  public:
+	LargePodVector() { m_base.zero(); }
+	explicit LargePodVector(i64 size) {
+		m_base.zero();
+		m_base.resizePodPartial(elem, size);
+	}
+	LargePodVector(CLargeSpan<T> span) : LargePodVector(span.size()) {
+		if(span)
+			memcpy(data(), span.data(), size_t(span.size()) * sizeof(T));
+	}
+	LargePodVector(CSpan<T> span) : LargePodVector(CLargeSpan<T>(span)) {}
+	LargePodVector(const LargePodVector &rhs) : LargePodVector(CLargeSpan<T>(rhs)) {}
+	LargePodVector(LargePodVector &&rhs) { m_base.moveConstruct(std::move(rhs.m_base)); }
+	~LargePodVector() { m_base.free(elem); }
+
+	void operator=(const LargePodVector &rhs) {
+		if(&rhs == this)
+			return;
+		resize(rhs.m_base.size);
+		if(rhs)
+			memcpy(data(), rhs.data(), size_t(rhs.size()) * sizeof(T));
+	}
+	void operator=(LargePodVector &&rhs) {
+		if(&rhs == this)
+			return;
+		m_base.swap(rhs.m_base);
+		rhs.free();
+	}
+
+	void resize(i64 new_size) { m_base.resizePodPartial(elem, new_size); }
+	void shrink(i64 new_size) { m_base.resizePodPartial(elem, new_size); }
+	void reserve(i64 new_capacity) { m_base.reservePod(elem, new_capacity); }
+
+	void swap(LargePodVector &rhs) { m_base.swap(rhs.m_base); }
+
+	void clear() { m_base.size = 0; }
+	void free() {
+		LargePodVector empty;
+		m_base.swap(empty.m_base);
+	}
+
+	// Appends uninitialized element
+	T &emplace_back() {
+		if(m_base.size == m_base.capacity)
+			m_base.growPod(elem);
+		return data()[m_base.size++];
+	}
+	void push_back(const T &value) { emplace_back() = value; }
+
+	bool inRange(i64 idx) const { return idx >= 0 && idx < m_base.size; }
+
+	const T *data() const { return reinterpret_cast<const T *>(m_base.data); }
+	T *data() { return reinterpret_cast<T *>(m_base.data); }
+
+	T *begin() { return data(); }
+	T *end() { return data() + m_base.size; }
+	const T *begin() const { return data(); }
+	const T *end() const { return data() + m_base.size; }
+
+	T &operator[](i64 idx) {
+		IF_PARANOID(m_base.checkIndex(idx));
+		return data()[idx];
+	}
+	const T &operator[](i64 idx) const {
+		IF_PARANOID(m_base.checkIndex(idx));
+		return data()[idx];
+	}
+
+	i64 size() const { return m_base.size; }
+	i64 capacity() const { return m_base.capacity; }
+	i64 usedMemory() const { return m_base.capacity * (i64)sizeof(T); }
+
+	bool empty() const { return m_base.size == 0; }
+	explicit operator bool() const { return m_base.size > 0; }
+
+	operator LargeSpan<T>() { return {data(), m_base.size}; }
+	operator CLargeSpan<T>() const { return {data(), m_base.size}; }
+
+	// Regular span of given range; it cannot be longer than 2^31 - 1 elements
+	Span<T> span(i64 start, i64 end) { return LargeSpan<T>(*this).span(start, end); }
+	CSpan<T> span(i64 start, i64 end) const { return CLargeSpan<T>(*this).span(start, end); }
+
+  private:
+	static constexpr VectorElem elem = VectorElem::of<T>();
+
+	LargeBaseVector m_base;
+};
+}
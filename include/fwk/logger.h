@@ -19,6 +19,6 @@ class Logger {
 	bool keyPresent(Str) const;
 
   private:
-	HashMap<string, int> m_keys;
+	HashMap<string, int, StrHashPolicy> m_keys;
 };
 }
@@ -7,6 +7,10 @@
 
 namespace fwk {
 
+// Ray-triangle tests treat triangles with smaller determinant as parallel to the ray;
+// Also used by packet kernels (ray_packet.h), so that their results are the same.
+static constexpr RealConstant<NumberType::rational> ray_isect_epsilon = 0.000000001;
+
 #define ENABLE_IF_SIZE(n) template <class U = Vec, EnableInDimension<U, n>...>
 
 template <class T, int N> class Ray {
@@ -0,0 +1,74 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/array.h"
+#include "fwk/math/isect_param.h"
+#include "fwk/math_base.h"
+#include "fwk/span.h"
+
+namespace fwk {
+
+// Packets keep N (4 or 8) rays, triangles or boxes in SoA layout, so that they can be tested
+// with SIMD instructions: either N rays against a single primitive or a single ray against
+// N primitives. Results are the same as in scalar Ray::isectParam() functions
+// (as long as compiler doesn't fuse multiplies & adds in scalar code).
+//
+// SSE is used for 4-wide operations and AVX for 8-wide operations (if enabled during
+// compilation; otherwise 8-wide packets are processed as two 4-wide halves).
+// Without SSE plain scalar code is used.
+//
+// Packets can be created from fewer than N elements; remaining lanes are filled with copies
+// of the last element.
+
+template <int N> struct RayPacket {
+	static_assert(N == 4 || N == 8);
+	static constexpr int size = N;
+
+	RayPacket(CSpan<Ray3F>);
+	RayPacket() = default;
+
+	alignas(32) float origin[3][N];
+	alignas(32) float dir[3][N];
+	alignas(32) float inv_dir[3][N];
+};
+
+template <int N> struct TrianglePacket {
+	static_assert(N == 4 || N == 8);
+	static constexpr int size = N;
+
+	TrianglePacket(CSpan<Triangle3F>);
+	TrianglePacket() = default;
+
+	// Edges are computed just like in Ray::isectParam: v[1] - v[0] & v[2] - v[0]
+	alignas(32) float v0[3][N];
+	alignas(32) float edge1[3][N];
+	alignas(32) float edge2[3][N];
+};
+
+template <int N> struct BoxPacket {
+	static_assert(N == 4 || N == 8);
+	static constexpr int size = N;
+
+	BoxPacket(CSpan<FBox>);
+	BoxPacket() = default;
+
+	alignas(32) float min[3][N];
+	alignas(32) float max[3][N];
+};
+
+using RayPacket4 = RayPacket<4>;
+using RayPacket8 = RayPacket<8>;
+using TrianglePacket4 = TrianglePacket<4>;
+using TrianglePacket8 = TrianglePacket<8>;
+using BoxPacket4 = BoxPacket<4>;
+using BoxPacket8 = BoxPacket<8>;
+
+template <int N> using PacketIsectParams = array<IsectParam<float>, N>;
+
+template <int N> PacketIsectParams<N> isectParam(const RayPacket<N> &, const Triangle3F &);
+template <int N> PacketIsectParams<N> isectParam(const RayPacket<N> &, const FBox &);
+template <int N> PacketIsectParams<N> isectParam(const Ray3F &, const TrianglePacket<N> &);
+template <int N> PacketIsectParams<N> isectParam(const Ray3F &, const BoxPacket<N> &);
+}
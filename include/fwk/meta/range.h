@@ -38,10 +38,13 @@ namespace detail {
 		FWK_SFINAE_TYPE(SizeType, T, DECLVAL(U &).size())
 
 		using RInfo = RangeInfo<T>;
+		// Containers with 64-bit sizes (LargeSpan, LargeVector) are not treated as spans
+		static constexpr bool large = is_same<SizeType, i64>;
 		static constexpr bool data_mode =
-			std::is_pointer<DataType>::value && is_convertible<SizeType, int>;
+			std::is_pointer<DataType>::value && is_convertible<SizeType, int> && !large;
 		static constexpr bool value =
-			data_mode || (RInfo::value && std::is_pointer<typename RInfo::BeginItType>::value);
+			data_mode ||
+			(!large && RInfo::value && std::is_pointer<typename RInfo::BeginItType>::value);
 		using Base = If<data_mode, RemovePointer<DataType>, typename RInfo::BaseType>;
 
 		using MaybeInfo = If<value, Info<Base>, NotASpan>;
@@ -0,0 +1,264 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/algorithm.h"
+#include "fwk/pod_vector.h"
+#include "fwk/sys/job_system.h"
+
+namespace fwk {
+
+// Parallel versions of some of the algorithms from algorithm.h. They use JobSystem::instance();
+// if it doesn't exist, they are executed serially on the calling thread.
+//
+// Ranges are split into chunks of grain elements; If grain <= 0 then it's selected automatically
+// (~4 chunks per thread, but not less than parallel_min_grain elements).
+
+inline constexpr int parallel_min_grain = 4096;
+
+namespace detail {
+	inline int parallelGrain(int size, int grain) {
+		if(grain > 0)
+			return grain;
+		auto *jobs = JobSystem::instance();
+		int num_threads = jobs ? jobs->numThreads() : 1;
+		return max(parallel_min_grain, size / (num_threads * 4));
+	}
+
+	// func(int chunk_id, int begin, int end)
+	template <class Func> void forEachChunk(int size, int grain, const Func &func) {
+		auto *jobs = JobSystem::instance();
+		if(!jobs || size <= grain) {
+			for(int begin = 0; begin < size; begin += grain)
+				func(begin / grain, begin, min(begin + grain, size));
+			return;
+		}
+		jobs->parallelChunks(intRange(size), grain,
+							 [&](int begin, int end) { func(begin / grain, begin, end); });
+	}
+
+	// Returns number of elements taken from a, when first 'index' elements of the merged
+	// sequence are taken (elements from a go first when equal)
+	template <class T, class Cmp>
+	int mergeCoRank(int index, CSpan<T> a, CSpan<T> b, const Cmp &cmp) {
+		int lo = max(0, index - b.size()), hi = min(index, a.size());
+		while(lo < hi) {
+			int mid = (lo + hi) / 2;
+			if(!cmp(b[index - mid - 1], a[mid]))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	template <class T> auto radixKey(T value) {
+		using UT = std::make_unsigned_t<T>;
+		UT key = UT(value);
+		if constexpr(std::is_signed_v<T>)
+			key ^= UT(1) << (sizeof(T) * 8 - 1);
+		return key;
+	}
+}
+
+// Stable LSD radix sort (8 bits per pass) of integer values
+template <class T>
+	requires(is_integral<T>)
+void parallelRadixSort(Span<T> span, int grain = 0) {
+	int size = span.size();
+	if(size <= 1)
+		return;
+	grain = detail::parallelGrain(size, grain);
+	int num_chunks = (size + grain - 1) / grain;
+
+	PodVector<T> temp(size);
+	PodVector<int> offsets(num_chunks * 256);
+	T *src = span.data(), *dst = temp.data();
+
+	for(int shift = 0; shift < int(sizeof(T) * 8); shift += 8) {
+		fill(offsets, 0);
+		detail::forEachChunk(size, grain, [&](int chunk_id, int begin, int end) {
+			int *counts = &offsets[chunk_id * 256];
+			for(int n = begin; n < end; n++)
+				counts[(detail::radixKey(src[n]) >> shift) & 255]++;
+		});
+
+		int offset = 0;
+		for(int digit = 0; digit < 256; digit++)
+			for(int chunk = 0; chunk < num_chunks; chunk++) {
+				int count = offsets[chunk * 256 + digit];
+				offsets[chunk * 256 + digit] = offset;
+				offset += count;
+			}
+
+		// All values have the same digit: nothing to do in this pass
+		int first_digit = (detail::radixKey(src[0]) >> shift) & 255;
+		int next_offset = first_digit == 255 ? size : offsets[first_digit + 1];
+		if(offsets[first_digit] == 0 && next_offset == size)
+			continue;
+
+		detail::forEachChunk(size, grain, [&](int chunk_id, int begin, int end) {
+			int *chunk_offsets = &offsets[chunk_id * 256];
+			for(int n = begin; n < end; n++)
+				dst[chunk_offsets[(detail::radixKey(src[n]) >> shift) & 255]++] = src[n];
+		});
+		swap(src, dst);
+	}
+
+	if(src != span.data())
+		detail::forEachChunk(size, grain, [&](int, int begin, int end) {
+			std::copy(src + begin, src + end, span.data() + begin);
+		});
+}
+
+// Not stable. Chunks are sorted independently & then merged in log2(num_chunks) passes;
+// Each merge pass is split evenly between threads.
+template <class T, class Cmp = LessCompare>
+void parallelMergeSort(Span<T> span, const Cmp &cmp = {}, int grain = 0) {
+	int size = span.size();
+	grain = detail::parallelGrain(size, grain);
+	if(size <= grain) {
+		std::sort(span.begin(), span.end(), cmp);
+		return;
+	}
+
+	detail::forEachChunk(size, grain, [&](int, int begin, int end) {
+		std::sort(span.data() + begin, span.data() + end, cmp);
+	});
+
+	vector<T> temp(size);
+	T *src = span.data(), *dst = temp.data();
+	// Widths are 64-bit, so that they don't overflow for spans with more than 2^30 elements
+	for(i64 width = grain; width < size; width *= 2) {
+		detail::forEachChunk(size, grain, [&](int, int begin, int end) {
+			while(begin < end) {
+				// Merging runs [pair_begin, mid) & [mid, pair_end) into the same range of dst
+				int pair_begin = int(begin / (width * 2) * (width * 2));
+				int mid = int(min(pair_begin + width, i64(size)));
+				int pair_end = int(min(mid + width, i64(size)));
+				int part_end = min(end, pair_end);
+
+				CSpan<T> a(src + pair_begin, src + mid), b(src + mid, src + pair_end);
+				int a_begin = detail::mergeCoRank(begin - pair_begin, a, b, cmp);
+				int a_end = detail::mergeCoRank(part_end - pair_begin, a, b, cmp);
+				int b_begin = begin - pair_begin - a_begin, b_end = part_end - pair_begin - a_end;
+				std::merge(std::make_move_iterator(src + pair_begin + a_begin),
+						   std::make_move_iterator(src + pair_begin + a_end),
+						   std::make_move_iterator(src + mid + b_begin),
+						   std::make_move_iterator(src + mid + b_end), dst + begin, cmp);
+				begin = part_end;
+			}
+		});
+		swap(src, dst);
+	}
+
+	if(src != span.data())
+		detail::forEachChunk(size, grain, [&](int, int begin, int end) {
+			std::move(src + begin, src + end, span.data() + begin);
+		});
+}
+
+// Uses radix sort for integers (when sorted in ascending order), merge sort for everything else
+template <class TSpan, class T = SpanBase<TSpan>, class Cmp = LessCompare>
+	requires(!is_const<T>)
+void parallelSort(TSpan &span, const Cmp &cmp = {}, int grain = 0) {
+	if constexpr(is_integral<T> && is_same<Cmp, LessCompare>)
+		parallelRadixSort(Span<T>(span), grain);
+	else
+		parallelMergeSort(Span<T>(span), cmp, grain);
+}
+
+template <c_span TSpan, class Func, class T = SpanBase<TSpan>>
+auto parallelTransform(const TSpan &span, const Func &func, int grain = 0) {
+	using Value = decltype(func(std::declval<const T &>()));
+	static_assert(!std::is_void<Value>::value, "Func must return some value");
+	CSpan<T> input = cspan(span);
+	vector<Value> out(input.size());
+	detail::forEachChunk(input.size(), detail::parallelGrain(input.size(), grain),
+						 [&](int, int begin, int end) {
+							 for(int n = begin; n < end; n++)
+								 out[n] = func(input[n]);
+						 });
+	return out;
+}
+
+// func(T, T) -> T has to be associative; elements are converted to T.
+// Each chunk is reduced separately, partial results are combined in order.
+template <c_span TSpan, class T, class Func, class TBase = SpanBase<TSpan>>
+T parallelReduce(const TSpan &span, T value, const Func &func, int grain = 0) {
+	CSpan<TBase> input = cspan(span);
+	int size = input.size();
+	if(size == 0)
+		return value;
+	grain = detail::parallelGrain(size, grain);
+
+	int num_chunks = (size + grain - 1) / grain;
+	vector<T> partials(num_chunks);
+	detail::forEachChunk(size, grain, [&](int chunk_id, int begin, int end) {
+		T partial = input[begin];
+		for(int n = begin + 1; n < end; n++)
+			partial = func(partial, input[n]);
+		partials[chunk_id] = std::move(partial);
+	});
+	for(auto &partial : partials)
+		value = func(value, partial);
+	return value;
+}
+
+template <c_span TSpan, class TBase = RemoveConst<SpanBase<TSpan>>, class T = TBase>
+T parallelAccumulate(const TSpan &span, T value = T(), int grain = 0) {
+	return parallelReduce(
+		span, value, [](const T &a, const auto &b) { return a + b; }, grain);
+}
+
+template <c_span TSpan, class Pred = IdentityFunc, class T = SpanBase<TSpan>>
+int parallelCountIf(const TSpan &span, const Pred &pred = {}, int grain = 0) {
+	CSpan<T> input = cspan(span);
+	int size = input.size();
+	grain = detail::parallelGrain(size, grain);
+	std::atomic<int> out = 0;
+	detail::forEachChunk(size, grain, [&](int, int begin, int end) {
+		int count = 0;
+		for(int n = begin; n < end; n++)
+			if(pred(input[n]))
+				count++;
+		out.fetch_add(count, std::memory_order_relaxed);
+	});
+	return out;
+}
+
+// Stable; Predicate is evaluated only once for each element. Matching elements are counted
+// in each chunk, chunk offsets are computed with a prefix sum & then elements are copied.
+template <c_span TSpan, class Pred = IdentityFunc, class T = RemoveConst<SpanBase<TSpan>>>
+vector<T> parallelFilter(const TSpan &span, const Pred &pred = {}, int grain = 0) {
+	CSpan<T> input = cspan(span);
+	int size = input.size();
+	grain = detail::parallelGrain(size, grain);
+	int num_chunks = (size + grain - 1) / grain;
+
+	PodVector<bool> selected(size);
+	PodVector<int> offsets(num_chunks + 1);
+	detail::forEachChunk(size, grain, [&](int chunk_id, int begin, int end) {
+		int count = 0;
+		for(int n = begin; n < end; n++) {
+			selected[n] = pred(input[n]);
+			count += selected[n] ? 1 : 0;
+		}
+		offsets[chunk_id + 1] = count;
+	});
+
+	offsets[0] = 0;
+	for(int n = 0; n < num_chunks; n++)
+		offsets[n + 1] += offsets[n];
+
+	vector<T> out(offsets[num_chunks]);
+	detail::forEachChunk(size, grain, [&](int chunk_id, int begin, int end) {
+		int offset = offsets[chunk_id];
+		for(int n = begin; n < end; n++)
+			if(selected[n])
+				out[offset++] = input[n];
+	});
+	return out;
+}
+}
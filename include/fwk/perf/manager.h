@@ -9,8 +9,13 @@
 
 namespace perf {
 
+// Frames from all threads are passed to the Manager through a bounded lock-free queue;
+// they are converted to execution samples by the thread which calls getNewFrames().
+// If that thread doesn't keep up, new frames are dropped (submitting threads never block).
 class Manager {
   public:
+	static constexpr int max_pending_frames = 1024;
+
 	// TODO: limit nr of frames
 	Manager();
 	~Manager();
@@ -20,10 +25,12 @@ class Manager {
 
 	static Manager *instance() { return s_instance; }
 
-	// Thread-safe
+	// Thread-safe, lock-free
 	static void addFrame(int frame_id, double begin, double end, CSpan<PSample>,
 						 double cpu_time_scale);
 	void getNewFrames();
+	// Number of frames which were dropped because queue was full
+	int numDroppedFrames() const;
 
 	ExecTree &execTree() { return *m_tree.get(); }
 	CSpan<Frame> frames() const { return m_frames; }
@@ -32,8 +39,11 @@ class Manager {
 	void limitMemory(i64 max_mem, int min_frames = 120);
 
   private:
+	struct FrameQueue;
+
 	vector<Frame> m_frames;
 	Dynamic<ExecTree> m_tree;
+	Dynamic<FrameQueue> m_queue;
 	static Manager *s_instance;
 };
 }
@@ -17,14 +17,16 @@ namespace fwk {
 template <class T> class PodVector {
   public:
 	PodVector() { m_base.zero(); }
+	// Memory will be allocated from given arena (if there is enough space left)
+	explicit PodVector(Arena &arena) { m_base.initializeArena(arena); }
 	explicit PodVector(int size) {
 		m_base.zero();
-		m_base.resizePodPartial(sizeof(T), size);
+		m_base.resizePodPartial(elem, size);
 	}
 	PodVector(CSpan<T> span) : PodVector(span.size()) { copy(data(), span); }
 	PodVector(const PodVector &rhs) : PodVector(CSpan<T>(rhs)) {}
 	PodVector(PodVector &&rhs) { m_base.moveConstruct(std::move(rhs.m_base)); }
-	~PodVector() { m_base.free(sizeof(T)); }
+	~PodVector() { m_base.free(elem); }
 
 	void operator=(const PodVector &rhs) {
 		if(&rhs == this)
@@ -39,10 +41,10 @@ template <class T> class PodVector {
 		rhs.free();
 	}
 
-	void resize(int new_size) { m_base.resizePodPartial(sizeof(T), new_size); }
-	void shrink(int new_size) { m_base.resizePodPartial(sizeof(T), new_size); }
+	void resize(int new_size) { m_base.resizePodPartial(elem, new_size); }
+	void shrink(int new_size) { m_base.resizePodPartial(elem, new_size); }
 
-	void reserve(int new_capacity) { m_base.reservePod(sizeof(T), new_capacity); }
+	void reserve(int new_capacity) { m_base.reservePod(elem, new_capacity); }
 
 	void swap(PodVector &rhs) { m_base.swap(rhs.m_base); }
 	void unsafeSwap(Vector<T> &rhs) { m_base.swap(rhs.m_base); }
@@ -85,6 +87,8 @@ template <class T> class PodVector {
 	template <class U> PodVector<U> reinterpret() {
 		static_assert(compatibleSizes(sizeof(T), sizeof(U)),
 					  "Incompatible sizes; are you sure, you want to do this cast?");
+		static_assert(VectorElem::of<T>().alignment == VectorElem::of<U>().alignment,
+					  "Over-aligned vectors can only be cast to vectors with the same alignment");
 
 		m_base.size = (int)(size_t(m_base.size) * sizeof(T) / sizeof(U));
 		m_base.capacity = (int)(size_t(m_base.capacity) * sizeof(T) / sizeof(U));
@@ -93,6 +97,8 @@ template <class T> class PodVector {
 	}
 
   private:
+	static constexpr VectorElem elem = VectorElem::of<T>();
+
 	BaseVector m_base;
 };
 }
@@ -23,12 +23,20 @@ namespace fwk {
 // When allocating memory, the size will be rounded up to >= chunk size; This will cause
 // small (12.5%) internal fragmentation
 //
+// Chunk groups which became empty & zones which don't contain any allocations are kept until
+// collectGarbage() is called (so that constant alloc/free of a single element won't constantly
+// allocate and free whole groups). Zone indices of freed zones may later be reused.
+//
+// Defragmentation is done in 3 steps:
+// - planDefragmentation() allocates new places for chunks & slabs from sparsely used groups
+//   and zones; returned relocations specify where the data should be moved
+// - user copies the data, updates references & frees source allocations
+// - collectGarbage() frees emptied groups and returns emptied zones to the ZoneAllocator
+//
 // TODO: zone_size should be a multiple of slab_size, not min_zone_size
 // TODO: remove slab groups, just rename to bits_64 or something
-// TODO: free chunk groups should be reclaimed ASAP?
 // TODO: review docs
 // TODO: option to control chunk alignment
-// TODO: functions for defragmentation/garbage collection
 class SlabAllocator {
   public:
 	static constexpr u64 slab_size = 256 * 1024;
@@ -63,14 +71,23 @@ class SlabAllocator {
 	struct ZoneAllocator {
 		// Zone allocator should return 0 if allocation failed
 		using Func = u64 (*)(u64 requested_size, uint zone_index, void *);
+		// Called when an empty zone is released in collectGarbage()
+		using FreeFunc = void (*)(uint zone_index, void *);
 		Func func;
 		void *param = nullptr;
+		FreeFunc free_func = nullptr;
 	};
 
 	struct Zone {
+		// Released zones have no slabs
+		bool isFreed() const { return num_slabs == 0; }
+
 		u64 empty_groups, full_groups, groups_mask;
 		int num_slabs, num_free_slabs, num_slab_groups;
 		vector<u64> groups;
+		// For each slab: number of slabs in slab allocation which starts at it (or 0)
+		vector<u16> slab_allocs;
+		bool is_draining = false;
 	};
 
 	struct Identifier {
@@ -110,6 +127,27 @@ class SlabAllocator {
 		u64 size = 0;
 	};
 
+	// Data from src should be moved to dst; After that src should be freed
+	struct Relocation {
+		Identifier src_ident, dst_ident;
+		Allocation src, dst;
+	};
+
+	struct Stats {
+		// Fraction of zone memory which isn't used by any allocation
+		double fragmentation() const {
+			return zone_memory ? 1.0 - double(used_memory) / double(zone_memory) : 0.0;
+		}
+
+		u64 zone_memory = 0;
+		// Memory in allocated slabs (also in chunk groups)
+		u64 slab_memory = 0;
+		// Memory in live chunk & slab allocations
+		u64 used_memory = 0;
+		int num_zones = 0, num_empty_zones = 0;
+		int num_chunk_groups = 0, num_empty_chunk_groups = 0;
+	};
+
 	SlabAllocator(u64 default_zone_size = min_zone_size * 4);
 	SlabAllocator(u64 default_zone_size, ZoneAllocator);
 	~SlabAllocator();
@@ -125,21 +163,36 @@ class SlabAllocator {
 	Pair<Identifier, Allocation> alloc(u64 size);
 	void free(Identifier);
 
+	// Frees empty chunk groups & releases empty zones; Returns amount of released zone memory
+	u64 collectGarbage();
+
+	// Allocates new places for data from sparsely used zones & chunk groups; New allocations
+	// won't be placed in those zones and groups and no new zones will be allocated.
+	// Planning stops after relocating at least max_bytes.
+	vector<Relocation> planDefragmentation(u64 max_bytes = ~0ull);
+
+	Stats stats() const;
+
 	void testSlabs();
 	void visualizeSlabs() const;
 	Ex<void> verifySlabs() const;
-	// TODO: stats functions
 
   private:
 	struct ChunkGroup {
-		u16 zone_id, slab_offset;
-		int num_free_chunks;
-		ListNode node;
+		// Freed groups are kept, so that identifiers of other groups stay valid
+		bool isFreed() const { return num_free_chunks < 0; }
+
+		u16 zone_id = 0, slab_offset = 0;
+		int num_free_chunks = 0;
+		ListNode node = {};
+		// Draining groups are not used for new allocations
+		bool is_draining = false;
 	};
 
 	struct ChunkLevel {
 		vector<ChunkGroup> groups;
 		vector<u64> chunks;
+		vector<int> freed_groups;
 
 		List not_full_groups;
 		uint chunk_size;
@@ -152,10 +205,13 @@ class SlabAllocator {
 	void fillSlabs(int zone_id, int offset, int num_slabs);
 	void clearSlabs(int zone_id, int offset, int num_slabs);
 	Pair<int, int> allocSlabs(int num_slabs);
+	int allocNewZone(u64 zone_size);
+	void drainGroup(int level_id, int group_id);
 
 	ZoneAllocator m_zone_allocator;
 	vector<Zone> m_zones;
 	ChunkLevel m_levels[num_chunk_levels];
 	u64 m_default_zone_size;
+	bool m_disable_zone_alloc = false;
 };
 }
@@ -0,0 +1,145 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/str.h"
+#include "fwk/sys/memory.h"
+
+namespace fwk {
+
+namespace detail {
+	// Allocates buffer for new_capacity characters and copies data & appended string into it;
+	// Kept out of line, so that only the fast path of SmallString is inlined
+	char *smallStringRealloc(const char *data, int size, Str append, int new_capacity);
+}
+
+// Null-terminated string which keeps up to inline_capacity characters in place; longer strings
+// are allocated on the heap. With default capacity it has the same size as std::string
+// (32 bytes), but it keeps a few more characters in place.
+// It converts to Str & ZStr without copying.
+template <int inline_capacity> class SmallString {
+  public:
+	static_assert(inline_capacity >= 7);
+
+	SmallString() : m_size(0), m_capacity(0) { m_small[0] = 0; }
+	SmallString(Str str) : SmallString() { assign(str); }
+	SmallString(const char *str) : SmallString(Str(str)) {}
+	SmallString(const string &str) : SmallString(Str(str)) {}
+	SmallString(const SmallString &rhs) : SmallString(Str(rhs)) {}
+	SmallString(SmallString &&rhs) : m_size(rhs.m_size), m_capacity(rhs.m_capacity) {
+		if(rhs.isSmall()) {
+			memcpy(m_small, rhs.m_small, m_size + 1);
+		} else {
+			m_big = rhs.m_big;
+			rhs.m_capacity = 0;
+		}
+		rhs.m_size = 0;
+		rhs.m_small[0] = 0;
+	}
+	~SmallString() {
+		if(!isSmall())
+			deallocate(m_big);
+	}
+
+	void operator=(const SmallString &rhs) {
+		if(&rhs != this)
+			assign(rhs);
+	}
+	void operator=(SmallString &&rhs) {
+		if(&rhs == this)
+			return;
+		this->~SmallString();
+		new(this) SmallString(std::move(rhs));
+	}
+	void operator=(Str str) { assign(str); }
+	void operator=(const char *str) { assign(str); }
+	void operator=(const string &str) { assign(str); }
+
+	void assign(Str str) {
+		PASSERT(str.end() <= data() || str.begin() > data() + m_size);
+		m_size = 0;
+		append(str);
+	}
+
+	// str may point into this string
+	void append(Str str) {
+		int new_size = m_size + str.size();
+		if(new_size > capacity()) {
+			reallocate(max(new_size, capacity() * 2), str);
+			return;
+		}
+		char *ptr = data();
+		memcpy(ptr + m_size, str.data(), str.size());
+		ptr[new_size] = 0;
+		m_size = new_size;
+	}
+	void operator+=(Str str) { append(str); }
+	void operator+=(char c) { append(Str(&c, 1)); }
+
+	void reserve(int new_capacity) {
+		if(new_capacity > capacity())
+			reallocate(new_capacity);
+	}
+	void clear() {
+		m_size = 0;
+		data()[0] = 0;
+	}
+
+	int size() const { return m_size; }
+	int capacity() const { return isSmall() ? inline_capacity : m_capacity; }
+	bool empty() const { return m_size == 0; }
+	explicit operator bool() const { return m_size > 0; }
+	// Returns true if data is kept in place
+	bool isSmall() const { return m_capacity == 0; }
+
+	const char *data() const { return isSmall() ? m_small : bigData(); }
+	char *data() { return isSmall() ? m_small : bigData(); }
+	const char *c_str() const { return data(); }
+	const char *begin() const { return data(); }
+	const char *end() const { return data() + m_size; }
+
+	char operator[](int idx) const {
+		PASSERT(idx >= 0 && idx < m_size);
+		return data()[idx];
+	}
+
+	ZStr str() const { return {data(), m_size}; }
+	operator ZStr() const { return {data(), m_size}; }
+	explicit operator string() const { return string(data(), data() + m_size); }
+
+	bool operator==(Str rhs) const { return str() == rhs; }
+	bool operator<(Str rhs) const { return str() < rhs; }
+	bool operator==(const SmallString &rhs) const { return str() == rhs.str(); }
+	bool operator<(const SmallString &rhs) const { return str() < rhs.str(); }
+
+	unsigned hash() const { return str().hash(); }
+	template <class TF = TextFormatter> void operator>>(TF &out) const { out << str(); }
+
+  private:
+	// Heap data is never null; Without this hint GCC warns about copying from "" (which Str
+	// uses in place of null) in paths that can't happen
+	char *bigData() const {
+		FWK_ASSUME(m_big);
+		return m_big;
+	}
+
+	// Appended string is copied before old data is freed (it may point into it)
+	void reallocate(int new_capacity, Str append = {}) {
+		char *new_data = detail::smallStringRealloc(data(), m_size, append, new_capacity);
+		if(!isSmall())
+			deallocate(m_big);
+		m_big = new_data;
+		m_capacity = new_capacity;
+		m_size += append.size();
+	}
+
+	int m_size;
+	int m_capacity; // 0 for small strings
+	union {
+		char *m_big;
+		char m_small[inline_capacity + 1];
+	};
+};
+
+}
@@ -137,6 +137,68 @@ template <class T, int min_size /*= 0*/> class Span {
 
 template <class T, int min_size = 0> using CSpan = Span<const T, min_size>;
 
+// Span with 64-bit size; Useful for buffers bigger than 2^31 elements (see LargeVector).
+// It's not a regular span (c_span): most of the code which works on spans uses int indices.
+template <class T> class LargeSpan {
+  public:
+	using value_type = RemoveConst<T>;
+	static constexpr bool is_const = fwk::is_const<T>;
+
+	LargeSpan() : m_data(nullptr), m_size(0) {}
+	LargeSpan(T *data, i64 size) : m_data(data), m_size(size) {
+		DASSERT(m_size >= 0 && (m_data || m_size == 0));
+	}
+	LargeSpan(T *begin, T *end) : LargeSpan(begin, end - begin) {}
+
+	template <class U, int min_size>
+		requires(is_same<RemoveConst<U>, value_type> && (is_const || !fwk::is_const<U>))
+	LargeSpan(Span<U, min_size> span) : m_data(span.data()), m_size(span.size()) {}
+	template <c_span TSpan>
+		requires(is_same<SpanBase<TSpan>, T>)
+	LargeSpan(TSpan &rhs) : LargeSpan(Span<T>(rhs)) {}
+	template <c_span TSpan>
+		requires(is_same<SpanBase<TSpan>, value_type> && is_const)
+	LargeSpan(const TSpan &rhs) : LargeSpan(Span<T>(rhs)) {}
+
+	template <class U = T>
+		requires(fwk::is_const<U>)
+	LargeSpan(const LargeSpan<value_type> &rhs) : m_data(rhs.data()), m_size(rhs.size()) {}
+
+	T *begin() const { return m_data; }
+	T *end() const { return m_data + m_size; }
+
+	T *data() const { return m_data; }
+	i64 size() const { return m_size; }
+	bool inRange(i64 idx) const { return idx >= 0 && idx < m_size; }
+
+	bool empty() const { return m_size == 0; }
+	explicit operator bool() const { return m_size > 0; }
+
+	T &operator[](i64 idx) const {
+		IF_PARANOID(PASSERT(inRange(idx)));
+		return m_data[idx];
+	}
+
+	LargeSpan subSpan(i64 start) const { return subSpan(start, m_size); }
+	LargeSpan subSpan(i64 start, i64 end) const {
+		DASSERT(start >= 0 && start <= end);
+		DASSERT(end <= m_size);
+		return {m_data + start, end - start};
+	}
+
+	// Regular span of given range; it cannot be longer than 2^31 - 1 elements
+	Span<T> span(i64 start, i64 end) const {
+		DASSERT(start >= 0 && start <= end && end <= m_size);
+		DASSERT(end - start <= 0x7fffffff);
+		return {m_data + start, int(end - start)};
+	}
+	Span<T> span() const { return span(0, m_size); }
+
+  private:
+	T *m_data;
+	i64 m_size;
+};
+
 template <c_span TSpan, class T = SpanBase<TSpan>> Span<T> span(TSpan &span) {
 	return Span<T>(span);
 }
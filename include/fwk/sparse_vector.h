@@ -18,16 +18,22 @@ namespace detail {
 // but there may be holes between valid elements.
 // Spread defines range for element indices.
 //
+// By default validity of each element is kept in a separate bool. If packed_valids is true,
+// then it's kept in a bit mask instead (see PackedSparseVector): it uses 8x less memory
+// and iteration over sparse arrays is faster (64 elements are tested at once; dense arrays
+// are iterated a bit slower), but valids() are not available (and such vectors cannot be
+// converted to SparseSpan). compact() can be used to remove the holes.
+// Iteration over bool valids skips 8 invalid elements at a time.
+//
 // TODO(opt): use sentinel at end-index ? problem: valids would have to be hidden
 //            because they would lie about after-last element?
-// TODO(opt): using bits instead of booleans probably doesn't make sense; Iteration would
-//            be slower in the general case (only in very sparse arrays it would improve perf
-//            but then in such case it would be better to compact such an array)
-template <class T> class SparseVector {
+template <class T, bool packed_valids> class SparseVector {
 	union Element;
 #define LIST_ACCESSOR [&](int idx) -> ListNode & { return m_elements[idx].node; }
 
   public:
+	static constexpr bool is_packed = packed_valids;
+
 	static constexpr int initial_size = 8;
 	// TODO: use special list node with same alignment as T?
 	static constexpr bool compatible_alignment = alignof(T) == alignof(Element);
@@ -40,7 +46,7 @@ template <class T> class SparseVector {
 	SparseVector() {}
 	~SparseVector() {
 		for(int n = 0; n < m_elements.size(); n++)
-			m_elements[n].free(m_valids[n]);
+			m_elements[n].free(isValid(n));
 	}
 
 	SparseVector(const SparseVector &rhs)
@@ -48,7 +54,7 @@ template <class T> class SparseVector {
 		  m_spread(rhs.m_spread) {
 		m_elements.resize(rhs.m_elements.size());
 		for(int n = 0; n < m_spread; n++)
-			new(&m_elements[n]) Element(rhs.m_elements[n], m_valids[n]);
+			new(&m_elements[n]) Element(rhs.m_elements[n], isValid(n));
 	}
 
 	SparseVector(SparseVector &&rhs)
@@ -59,8 +65,9 @@ template <class T> class SparseVector {
 		rhs.m_spread = 0;
 	}
 
-	SparseVector(vector<T> &&vec)
-		: m_valids(vec.size(), true), m_size(vec.size()), m_spread(vec.size()) {
+	SparseVector(vector<T> &&vec) : m_size(vec.size()), m_spread(vec.size()) {
+		resizeValids(vec.size());
+		fillValids(vec.size());
 		if constexpr(sizeof(T) == sizeof(Element)) {
 			auto temp = vec.template reinterpret<Element>();
 			m_elements.unsafeSwap(temp);
@@ -102,13 +109,15 @@ template <class T> class SparseVector {
 
 	int size() const { return m_size; }
 	int capacity() const { return m_elements.size(); }
-	i64 usedMemory() const { return capacity() * ((i64)sizeof(T) + 1); }
+	i64 usedMemory() const {
+		return capacity() * (i64)sizeof(T) + m_valids.size() * (i64)sizeof(m_valids[0]);
+	}
 	bool empty() const { return m_size == 0; }
 	explicit operator bool() const { return m_size > 0; }
 
 	void clear() {
 		for(int n = 0; n < m_elements.size(); n++)
-			m_elements[n].free(m_valids[n]);
+			m_elements[n].free(isValid(n));
 		m_elements.clear();
 		m_valids.clear();
 		m_free_list = List();
@@ -117,12 +126,12 @@ template <class T> class SparseVector {
 	}
 
 	void reserve(int size) { reallocate(insertCapacity(size)); }
-	bool valid(int index) const { return index >= 0 && index < m_spread && m_valids[index]; }
+	bool valid(int index) const { return index >= 0 && index < m_spread && isValid(index); }
 
 	template <class... Args> int emplace(Args &&...args) {
 		int index = alloc();
 		new(&m_elements[index].value) T{std::forward<Args>(args)...};
-		m_valids[index] = true;
+		setValid(index);
 		m_size++;
 		return index;
 	}
@@ -142,7 +151,7 @@ template <class T> class SparseVector {
 
 		listRemove(LIST_ACCESSOR, m_free_list, index);
 		new(&m_elements[index].value) T{std::forward<Args>(args)...};
-		m_valids[index] = true;
+		setValid(index);
 		m_size++;
 	}
 
@@ -151,30 +160,56 @@ template <class T> class SparseVector {
 		DASSERT(valid(index));
 		m_elements[index].free(true);
 		m_elements[index].node = ListNode();
-		m_valids[index] = false;
+		clearValid(index);
 		listInsert(LIST_ACCESSOR, m_free_list, index);
 		m_size--;
 	}
 
-	int firstIndex() const {
-		int idx = 0;
-		while(idx < m_spread && !m_valids[idx])
-			idx++;
-		return idx;
-	}
+	int firstIndex() const { return nextIndex(-1); }
 	int lastIndex() const {
 		if(m_size == 0)
 			return m_spread;
-		int idx = m_spread - 1;
-		while(idx >= 0 && !m_valids[idx])
-			--idx;
-		return idx;
+		if constexpr(packed_valids) {
+			for(int word = (m_spread - 1) >> 6; word >= 0; word--)
+				if(m_valids[word])
+					return word * 64 + 63 - countLeadingZeros(m_valids[word]);
+			return -1;
+		} else {
+			int idx = m_spread - 1;
+			while(idx >= 0 && !m_valids[idx])
+				--idx;
+			return idx;
+		}
 	}
 	int nextIndex(int idx) const {
 		idx++;
-		while(idx < m_spread && !m_valids[idx])
-			idx++;
-		return idx; // TODO: clamp to spread ?
+		if constexpr(packed_valids) {
+			if(idx >= m_spread)
+				return m_spread;
+			// Bits past spread are always cleared
+			int word = idx >> 6, num_words = (m_spread + 63) >> 6;
+			u64 bits = m_valids[word] & (~u64(0) << (idx & 63));
+			while(!bits) {
+				if(++word == num_words)
+					return m_spread;
+				bits = m_valids[word];
+			}
+			return word * 64 + countTrailingZeros(bits);
+		} else {
+			if(idx < m_spread && m_valids[idx])
+				return idx;
+			// Testing 8 bools at once (assuming little-endian byte order)
+			while(idx + 8 <= m_spread) {
+				u64 bytes;
+				memcpy(&bytes, &m_valids[idx], sizeof(bytes));
+				if(bytes)
+					return idx + countTrailingZeros(bytes) / 8;
+				idx += 8;
+			}
+			while(idx < m_spread && !m_valids[idx])
+				idx++;
+			return idx; // TODO: clamp to spread ?
+		}
 	}
 
 	int spread() const { return m_spread; }
@@ -232,19 +267,51 @@ template <class T> class SparseVector {
 
 		int min_index = min(m_spread, rhs.m_spread);
 		for(int n = 0; n < min_index; n++) {
-			bool is_valid = m_valids[n];
-			if(is_valid != rhs.m_valids[n])
+			bool is_valid = isValid(n);
+			if(is_valid != rhs.isValid(n))
 				return is_valid ? 1 : -1;
 			if(is_valid && !(m_elements[n].value == rhs.m_elements[n].value))
 				return m_elements[n].value < rhs.m_elements[n].value ? -1 : 1;
 		}
 		for(int n = min_index; n < m_spread; n++)
-			if(m_valids[n])
+			if(isValid(n))
 				return 1;
 		return 0;
 	}
 
-	CSpan<bool> valids() const { return m_valids; }
+	// Moves all elements to the front, preserving their order; free list is cleared.
+	// Returns mapping from old indices to new ones (-1 for invalid indices).
+	vector<int> compact() {
+		vector<int> mapping(m_spread, -1);
+		int new_idx = 0;
+		for(int idx = firstIndex(); idx < m_spread; idx = nextIndex(idx), new_idx++) {
+			mapping[idx] = new_idx;
+			if(idx != new_idx) {
+				new(&m_elements[new_idx].value) T(std::move(m_elements[idx].value));
+				m_elements[idx].free(true);
+			}
+		}
+		DASSERT(new_idx == m_size);
+
+		for(auto &valid : m_valids)
+			valid = 0;
+		fillValids(m_size);
+		m_free_list = List();
+		m_spread = m_size;
+		return mapping;
+	}
+
+	CSpan<bool> valids() const
+		requires(!packed_valids)
+	{
+		return m_valids;
+	}
+	// Bit n is set if element n is valid
+	CSpan<u64> validBits() const
+		requires(packed_valids)
+	{
+		return m_valids;
+	}
 
 	int growCapacity() const {
 		int capacity = m_elements.size();
@@ -260,16 +327,53 @@ template <class T> class SparseVector {
 		auto *ptr = reinterpret_cast<const Element *>(&object);
 		PASSERT("Invalid alignment" && u64(ptr) % alignof(Element) == 0);
 		auto idx = spanMemberIndex(m_elements, *ptr);
-		PASSERT(m_valids[idx]);
+		PASSERT(isValid(idx));
 		return idx;
 	}
 
   private:
 	void checkIndex(int idx) const {
-		if(!m_valids[idx])
+		if(!isValid(idx))
 			detail::invalidIndexSparse(idx, m_spread);
 	}
 
+	bool isValid(int idx) const {
+		if constexpr(packed_valids)
+			return (m_valids[idx >> 6] >> (idx & 63)) & 1;
+		else
+			return m_valids[idx];
+	}
+	void setValid(int idx) {
+		if constexpr(packed_valids)
+			m_valids[idx >> 6] |= u64(1) << (idx & 63);
+		else
+			m_valids[idx] = true;
+	}
+	void clearValid(int idx) {
+		if constexpr(packed_valids)
+			m_valids[idx >> 6] &= ~(u64(1) << (idx & 63));
+		else
+			m_valids[idx] = false;
+	}
+	void resizeValids(int capacity) {
+		if constexpr(packed_valids)
+			m_valids.resize((capacity + 63) / 64, 0);
+		else
+			m_valids.resize(capacity, false);
+	}
+	// Marks first count elements as valid
+	void fillValids(int count) {
+		if constexpr(packed_valids) {
+			for(int word = 0; word < count / 64; word++)
+				m_valids[word] = ~u64(0);
+			if(count & 63)
+				m_valids[count / 64] |= (u64(1) << (count & 63)) - 1;
+		} else {
+			for(int n = 0; n < count; n++)
+				m_valids[n] = true;
+		}
+	}
+
 	union Element {
 		Element() {}
 		Element(const Element &rhs, bool is_init) {
@@ -299,10 +403,10 @@ template <class T> class SparseVector {
 		if(new_capacity <= capacity())
 			return;
 		PodVector<Element> new_elems(new_capacity);
-		m_valids.resize(new_capacity);
+		resizeValids(new_capacity);
 		for(int n = 0; n < m_elements.size(); n++) {
-			new(&new_elems[n]) Element(std::move(m_elements[n]), m_valids[n]);
-			m_elements[n].free(m_valids[n]);
+			new(&new_elems[n]) Element(std::move(m_elements[n]), isValid(n));
+			m_elements[n].free(isValid(n));
 		}
 		m_elements.swap(new_elems);
 	}
@@ -323,7 +427,7 @@ template <class T> class SparseVector {
 #undef LIST_ACCESSOR
 
 	PodVector<Element> m_elements;
-	vector<bool> m_valids;
+	vector<If<packed_valids, u64, bool>> m_valids;
 	// TODO: skip list instead of valid list?
 	List m_free_list;
 	int m_size = 0;
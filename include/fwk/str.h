@@ -113,6 +113,16 @@ class ZStr : public Str {
 	const char *c_str() const { return m_data; }
 };
 
+// HashMap / HashSet policy for string keys; Allows lookups with Str, ZStr & const char*
+// without constructing temporary strings. Str::hash() is mixed, because its low bits are weak.
+struct StrHashPolicy {
+	static constexpr bool is_transparent = true;
+	static u32 hash(Str str) {
+		u64 r = str.hash() * u64(0xca4bcaa75ec3f625);
+		return u32(r >> 32) + u32(r);
+	}
+};
+
 vector<Str> tokenize(Str, char c = ' ');
 
 // Can handle both LF & CRLF line endings
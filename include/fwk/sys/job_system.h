@@ -0,0 +1,159 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/dynamic.h"
+#include "fwk/index_range.h"
+#include "fwk/sys/thread.h"
+#include "fwk/vector.h"
+#include <atomic>
+
+namespace fwk {
+
+class JobCounter;
+
+namespace detail {
+	struct Job {
+		void (*func)(Job *); // Runs & destroys the job
+		JobCounter *counter;
+	};
+	template <class Func> struct FuncJob : public Job {
+		FuncJob(Func func, JobCounter *counter)
+			: Job{[](Job *job) {
+					  auto *self = static_cast<FuncJob *>(job);
+					  self->func();
+					  delete self;
+				  },
+				  counter},
+			  func(std::move(func)) {}
+		Func func;
+	};
+}
+
+// Number of unfinished jobs; Jobs which depend on a counter are started after it drops to 0.
+// Counter has to exist until all of its jobs (and dependent jobs) are finished.
+class JobCounter {
+  public:
+	JobCounter() = default;
+	JobCounter(const JobCounter &) = delete;
+	void operator=(const JobCounter &) = delete;
+
+	int count() const { return m_count.load(std::memory_order_acquire); }
+	bool done() const { return count() == 0; }
+
+  private:
+	friend class JobSystem;
+	std::atomic<int> m_count = 0;
+	mutable Mutex m_mutex;
+	vector<detail::Job *> m_dependent_jobs;
+};
+
+struct JobSystemConfig {
+	// -1: hardwareConcurrency() - 1
+	int num_workers = -1;
+	// Creates perf::ThreadContext for each worker thread
+	bool perf_contexts = false;
+};
+
+// Work-stealing thread pool.
+//
+// Each worker thread has its own job deque (Chase-Lev): worker pushes & pops jobs at one end,
+// other threads steal from the other end. Thread which created the JobSystem also has a deque;
+// jobs from other threads are passed through a shared queue. Idle workers sleep until new jobs
+// are submitted. Threads which wait for jobs (wait, parallelFor) execute other jobs meanwhile,
+// so waiting from within jobs is fine.
+//
+// With FWK_THREADS_DISABLED there are no workers and jobs are executed immediately.
+//
+// Worker threads can have their own perf::ThreadContext (JobSystemConfig::perf_contexts);
+// in this case every job is measured in a separate scope and perf::Manager has to exist.
+// Worker frames are advanced with nextFrame().
+//
+// There can be only one JobSystem at a time; it's accessible through instance().
+class JobSystem {
+  public:
+	JobSystem(JobSystemConfig = {});
+	~JobSystem();
+
+	JobSystem(const JobSystem &) = delete;
+	void operator=(const JobSystem &) = delete;
+
+	static JobSystem *instance() { return s_instance; }
+
+	int numWorkers() const { return m_num_workers; }
+	// Number of threads which execute jobs (workers + calling thread)
+	int numThreads() const { return m_num_workers + 1; }
+
+	// If counter is given, it will be incremented now & decremented when job is finished.
+	// If dependency is given, job will be started when dependency counter drops to 0.
+	template <class Func>
+	void run(Func func, JobCounter *counter = nullptr, JobCounter *dependency = nullptr) {
+		if(counter)
+			counter->m_count.fetch_add(1, std::memory_order_relaxed);
+		submit(new detail::FuncJob<Func>(std::move(func), counter), dependency);
+	}
+
+	// Executes other jobs until counter drops to 0
+	void wait(const JobCounter &);
+
+	// Range is split into chunks of grain elements; if grain <= 0, it's selected automatically.
+	// func(int index) is called for every element.
+	template <class Func> void parallelFor(SimpleIndexRange<int> range, int grain, Func &&func) {
+		parallelChunks(range, grain, [&](int begin, int end) {
+			for(int n = begin; n < end; n++)
+				func(n);
+		});
+	}
+
+	// func(int begin, int end) is called for each chunk
+	template <class Func>
+	void parallelChunks(SimpleIndexRange<int> range, int grain, const Func &func) {
+		int size = range.size();
+		if(size <= 0)
+			return;
+		int begin = range[0];
+		grain = grainSize(size, grain);
+		int num_chunks = (size + grain - 1) / grain;
+		if(num_chunks == 1) {
+			func(begin, begin + size);
+			return;
+		}
+
+		std::atomic<int> next_chunk = 0;
+		auto process = [&]() {
+			int chunk;
+			while((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < num_chunks) {
+				int chunk_begin = begin + chunk * grain;
+				func(chunk_begin, chunk_begin + min(grain, size - chunk * grain));
+			}
+		};
+
+		JobCounter counter;
+		int num_helpers = min(num_chunks, numThreads()) - 1;
+		for(int n = 0; n < num_helpers; n++)
+			run(process, &counter);
+		process();
+		wait(counter);
+	}
+
+	// Default grain: range is split into ~4 chunks per thread
+	int grainSize(int size, int grain = 0) const {
+		if(grain > 0)
+			return grain;
+		return max(1, size / (numThreads() * 4));
+	}
+
+	// Advances perf frames of worker threads
+	void nextFrame();
+
+  private:
+	void submit(detail::Job *, JobCounter *dependency);
+
+	static inline JobSystem *s_instance = nullptr;
+
+	struct Impl;
+	Dynamic<Impl> m_impl;
+	int m_num_workers = 0;
+};
+}
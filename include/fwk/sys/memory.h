@@ -3,16 +3,83 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <limits>
 
 namespace fwk {
 
+// Alignment of memory returned by allocate(size) (and by default operator new)
+constexpr size_t default_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
 // Either returns valid pointer or fails on FWK_FATAL
-// Default new[] and delete[] operators also use these functions.
+// Default new[] and delete[] operators (also aligned versions) use these functions.
+// Memory allocated with alignment has to be freed with the same alignment.
 void *allocate(size_t size);
 void *allocate(size_t size, size_t alignment);
 void deallocate(void *);
+void deallocate(void *, size_t alignment);
+
+// Statistics of thread-caching pool allocator which handles small allocations in allocate().
+// Pool allocator is enabled with FWK_POOL_ALLOCATOR CMake option. Counters are gathered from
+// all threads without synchronization, so they may be slightly out of date.
+// To measure allocations in given part of code, compute difference of stats taken before & after.
+struct PoolAllocatorStats {
+	static constexpr int max_size_classes = 32;
+
+	struct SizeClass {
+		long long numLive() const { return num_allocations - num_deallocations; }
+
+		int block_size = 0;
+		long long num_allocations = 0, num_deallocations = 0;
+		long long num_pages = 0;
+	};
+
+	PoolAllocatorStats operator-(const PoolAllocatorStats &) const;
+	void print() const;
+
+	SizeClass size_classes[max_size_classes];
+	int num_size_classes = 0;
+	int page_size = 0;
+	int num_thread_caches = 0;
+	// Allocations which were too big for the pool (handled by malloc)
+	long long num_large_allocations = 0;
+};
+
+bool poolAllocatorEnabled();
+PoolAllocatorStats poolAllocatorStats();
+
+// Large allocations are mapped directly from the system (mmap); they can be resized in place
+// (mremap) without copying & can use transparent huge pages. Vectors use them for buffers
+// bigger than min_size (only on Linux; on other platforms regular allocations are used).
+// Number of live large allocations is limited; when the limit is reached, vectors fall back
+// to regular allocations.
+struct LargeAllocConfig {
+	size_t min_size = size_t(16) << 20;
+	bool huge_pages = false;
+};
+
+// Should be called before any large allocations are made
+void setLargeAllocConfig(const LargeAllocConfig &);
+LargeAllocConfig largeAllocConfig();
+
+// Returns null if large allocation is not possible (also when size < min_size)
+void *allocateLarge(size_t size);
+// Returns null if allocation cannot be resized (ptr is still valid in this case)
+void *reallocateLarge(void *ptr, size_t new_size);
+void deallocateLarge(void *ptr);
+bool isLargeAllocation(const void *ptr);
+
+namespace detail {
+	// Smallest min_size ever used; bigger buffers may be large allocations.
+	// It's read (relaxed) whenever a vector is freed, on any thread.
+	extern std::atomic<size_t> g_large_alloc_threshold;
+}
+
+inline bool maybeLargeAllocation(const void *ptr, size_t size) {
+	return size >= detail::g_large_alloc_threshold.load(std::memory_order_relaxed) &&
+		   isLargeAllocation(ptr);
+}
 
 class SimpleAllocatorBase {
   public:
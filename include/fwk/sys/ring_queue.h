@@ -0,0 +1,259 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+#include "fwk/maybe.h"
+#include "fwk/sys/memory.h"
+#include "fwk/sys/thread.h"
+#include <atomic>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace fwk {
+
+namespace detail {
+	static constexpr int queue_cache_line = 64;
+
+	inline int queueCapacity(int min_capacity) {
+		PASSERT(min_capacity > 0 && min_capacity <= (1 << 30));
+		int capacity = 1;
+		while(capacity < min_capacity)
+			capacity *= 2;
+		return capacity;
+	}
+
+	// Called in a loop by blocking operations: spins for a while, then yields
+	inline void queueBackoff(int &num_tries) {
+#ifdef FWK_THREADS_DISABLED
+		FWK_FATAL("Blocking queue operation would never finish (threads are disabled)");
+#else
+		if(num_tries++ < 64) {
+#if defined(__SSE2__)
+			_mm_pause();
+#endif
+		} else {
+			std::this_thread::yield();
+		}
+#endif
+	}
+}
+
+// Bounded lock-free queue with single producer & single consumer (Lamport's ring buffer).
+//
+// Capacity is rounded up to a power of 2. Producer & consumer indices are kept in separate
+// cache lines; each side also keeps a cached copy of the other side's index, so shared
+// cache lines are only touched when the queue looks full (or empty).
+//
+// try* functions never block; push() & pop() spin & yield until they succeed.
+template <class T> class SpscQueue {
+  public:
+	explicit SpscQueue(int min_capacity) : m_mask(detail::queueCapacity(min_capacity) - 1) {
+		m_slots = (T *)allocate(sizeof(T) * (m_mask + 1), alignof(T));
+	}
+	~SpscQueue() {
+		while(tryPop())
+			;
+		deallocate(m_slots, alignof(T));
+	}
+
+	SpscQueue(const SpscQueue &) = delete;
+	void operator=(const SpscQueue &) = delete;
+
+	// Producer side; Arguments are not consumed if queue is full
+	template <class... Args> bool tryEmplace(Args &&...args) {
+		u64 tail = m_tail.load(std::memory_order_relaxed);
+		if(tail - m_cached_head > m_mask) {
+			m_cached_head = m_head.load(std::memory_order_acquire);
+			if(tail - m_cached_head > m_mask)
+				return false;
+		}
+		new(&m_slots[tail & m_mask]) T(std::forward<Args>(args)...);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+	bool tryPush(T &&value) { return tryEmplace(std::move(value)); }
+	bool tryPush(const T &value) { return tryEmplace(value); }
+
+	void push(T value) {
+		for(int num_tries = 0; !tryEmplace(std::move(value));)
+			detail::queueBackoff(num_tries);
+	}
+
+	// Consumer side
+	bool tryPop(T &out) {
+		u64 head = m_head.load(std::memory_order_relaxed);
+		if(head == m_cached_tail) {
+			m_cached_tail = m_tail.load(std::memory_order_acquire);
+			if(head == m_cached_tail)
+				return false;
+		}
+		T &slot = m_slots[head & m_mask];
+		out = std::move(slot);
+		slot.~T();
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+	Maybe<T> tryPop() {
+		Maybe<T> out;
+		u64 head = m_head.load(std::memory_order_relaxed);
+		if(head == m_cached_tail) {
+			m_cached_tail = m_tail.load(std::memory_order_acquire);
+			if(head == m_cached_tail)
+				return out;
+		}
+		T &slot = m_slots[head & m_mask];
+		out = std::move(slot);
+		slot.~T();
+		m_head.store(head + 1, std::memory_order_release);
+		return out;
+	}
+
+	T pop() {
+		for(int num_tries = 0;; detail::queueBackoff(num_tries))
+			if(auto out = tryPop())
+				return std::move(*out);
+	}
+
+	int capacity() const { return int(m_mask + 1); }
+	// Approximate if other thread modifies the queue at the same time
+	int size() const {
+		u64 head = m_head.load(std::memory_order_acquire);
+		u64 tail = m_tail.load(std::memory_order_acquire);
+		return tail > head ? int(tail - head) : 0;
+	}
+	bool empty() const { return size() == 0; }
+
+  private:
+	alignas(detail::queue_cache_line) std::atomic<u64> m_head = 0;
+	u64 m_cached_tail = 0; // Used by consumer
+	alignas(detail::queue_cache_line) std::atomic<u64> m_tail = 0;
+	u64 m_cached_head = 0; // Used by producer
+	alignas(detail::queue_cache_line) T *m_slots;
+	const u64 m_mask;
+};
+
+// Bounded lock-free queue with multiple producers & multiple consumers (Vyukov's algorithm).
+//
+// Each slot has a sequence number which tells whether it's ready to be written or read
+// in the current round. Producers (and consumers) claim slots by advancing shared index with
+// a CAS; there is no other contention between threads, as long as the queue isn't
+// full (or empty). Elements pushed by a single producer are popped in the same order.
+//
+// try* functions never block; push() & pop() spin & yield until they succeed.
+template <class T> class MpmcQueue {
+  public:
+	explicit MpmcQueue(int min_capacity) : m_mask(detail::queueCapacity(min_capacity) - 1) {
+		m_slots = (Slot *)allocate(sizeof(Slot) * (m_mask + 1), alignof(Slot));
+		for(u64 n = 0; n <= m_mask; n++)
+			new(&m_slots[n].sequence) std::atomic<u64>(n);
+	}
+	~MpmcQueue() {
+		while(tryPop())
+			;
+		deallocate(m_slots, alignof(Slot));
+	}
+
+	MpmcQueue(const MpmcQueue &) = delete;
+	void operator=(const MpmcQueue &) = delete;
+
+	// Arguments are not consumed if queue is full
+	template <class... Args> bool tryEmplace(Args &&...args) {
+		u64 pos = m_tail.load(std::memory_order_relaxed);
+		Slot *slot;
+		while(true) {
+			slot = &m_slots[pos & m_mask];
+			i64 diff = i64(slot->sequence.load(std::memory_order_acquire) - pos);
+			if(diff == 0) {
+				if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if(diff < 0) {
+				return false;
+			} else {
+				pos = m_tail.load(std::memory_order_relaxed);
+			}
+		}
+		new(slot->value()) T(std::forward<Args>(args)...);
+		slot->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+	bool tryPush(T &&value) { return tryEmplace(std::move(value)); }
+	bool tryPush(const T &value) { return tryEmplace(value); }
+
+	void push(T value) {
+		for(int num_tries = 0; !tryEmplace(std::move(value));)
+			detail::queueBackoff(num_tries);
+	}
+
+	bool tryPop(T &out) {
+		Slot *slot = claimFront();
+		if(!slot)
+			return false;
+		out = std::move(*slot->value());
+		release(slot);
+		return true;
+	}
+	Maybe<T> tryPop() {
+		Maybe<T> out;
+		if(Slot *slot = claimFront()) {
+			out = std::move(*slot->value());
+			release(slot);
+		}
+		return out;
+	}
+
+	T pop() {
+		for(int num_tries = 0;; detail::queueBackoff(num_tries))
+			if(auto out = tryPop())
+				return std::move(*out);
+	}
+
+	int capacity() const { return int(m_mask + 1); }
+	// Approximate if other threads modify the queue at the same time
+	int size() const {
+		u64 head = m_head.load(std::memory_order_acquire);
+		u64 tail = m_tail.load(std::memory_order_acquire);
+		return tail > head ? int(min(tail - head, m_mask + 1)) : 0;
+	}
+	bool empty() const { return size() == 0; }
+
+  private:
+	struct Slot {
+		T *value() { return reinterpret_cast<T *>(data); }
+
+		std::atomic<u64> sequence;
+		alignas(T) char data[sizeof(T)];
+	};
+
+	// Returns slot with value which can be moved out; nullptr if queue is empty
+	Slot *claimFront() {
+		u64 pos = m_head.load(std::memory_order_relaxed);
+		while(true) {
+			Slot *slot = &m_slots[pos & m_mask];
+			i64 diff = i64(slot->sequence.load(std::memory_order_acquire) - (pos + 1));
+			if(diff == 0) {
+				if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					return slot;
+			} else if(diff < 0) {
+				return nullptr;
+			} else {
+				pos = m_head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Makes slot available for producers in the next round
+	void release(Slot *slot) {
+		u64 seq = slot->sequence.load(std::memory_order_relaxed);
+		slot->value()->~T();
+		slot->sequence.store(seq + m_mask, std::memory_order_release);
+	}
+
+	alignas(detail::queue_cache_line) std::atomic<u64> m_head = 0;
+	alignas(detail::queue_cache_line) std::atomic<u64> m_tail = 0;
+	alignas(detail::queue_cache_line) Slot *m_slots;
+	const u64 m_mask;
+};
+}
@@ -15,15 +15,24 @@
 #include "fwk/meta/operator.h"
 
 #ifdef FWK_PLATFORM_MSVC
+#include <xmmintrin.h>
 #define FWK_NO_INLINE __declspec(noinline)
 #define FWK_ALWAYS_INLINE __forceinline
 #define FWK_RESTRICT __restrict
 #define FWK_THREAD_LOCAL __declspec(thread)
+#define FWK_PREFETCH(ptr) _mm_prefetch((const char *)(ptr), _MM_HINT_T0)
+#define FWK_ASSUME(expr) __assume(expr)
 #else
 #define FWK_NO_INLINE __attribute__((noinline))
 #define FWK_ALWAYS_INLINE inline __attribute__((always_inline))
 #define FWK_RESTRICT __restrict__
 #define FWK_THREAD_LOCAL __thread
+#define FWK_PREFETCH(ptr) __builtin_prefetch(ptr)
+#define FWK_ASSUME(expr)                                                                           \
+	do {                                                                                           \
+		if(!(expr))                                                                                \
+			__builtin_unreachable();                                                               \
+	} while(0)
 #endif
 
 // Exception-related attributes (supported only when compiling on clang):
@@ -252,10 +261,14 @@ using FileStream = TStream<BaseFileStream>;
 class GzipStream;
 class FilePath;
 
+class Arena;
 class BaseVector;
 template <class T> class PodVector;
 template <class T> class Vector;
-template <class T> class SparseVector;
+template <class T, bool packed_valids = false> class SparseVector;
+template <class T> using PackedSparseVector = SparseVector<T, true>;
+template <class T> class LargeVector;
+template <class T> class LargePodVector;
 template <class T, int> class SmallVector;
 template <class T, int> class StaticVector;
 template <class T> using vector = Vector<T>;
@@ -274,6 +287,8 @@ template <class T> using MaybeCRef = MaybeRef<const T>;
 
 class Str;
 class ZStr;
+class Atom;
+template <int inline_capacity = 23> class SmallString;
 
 class CXmlNode;
 class XmlNode;
@@ -288,7 +303,7 @@ class InputState;
 class Gui;
 
 template <class Key, class Value, class Policy = None> class HashMap;
-template <class Key> class HashSet;
+template <class Key, class Policy = None> class HashSet;
 template <class T> class Dynamic;
 
 class Any;
@@ -296,13 +311,17 @@ class AnyConfig;
 
 class Gui;
 
-template <class T> inline constexpr int type_size<SparseVector<T>> = sizeof(void *) == 8 ? 48 : 40;
+template <class T, bool packed>
+inline constexpr int type_size<SparseVector<T, packed>> = sizeof(void *) == 8 ? 48 : 40;
 template <class Key, class Value, class Policy>
-inline constexpr int type_size<HashMap<Key, Value, Policy>> = sizeof(void *) == 4 ? 32 : 40;
-template <class Key> inline constexpr int type_size<HashSet<Key>> = sizeof(void *) == 4 ? 28 : 32;
+inline constexpr int type_size<HashMap<Key, Value, Policy>> = sizeof(void *) == 4 ? 36 : 48;
+template <class Key, class Policy>
+inline constexpr int type_size<HashSet<Key, Policy>> = sizeof(void *) == 4 ? 28 : 32;
 template <> inline constexpr int type_size<Any> = sizeof(void *) * 2;
 
 template <class T, int min_size = 0> class Span;
+template <class T> class LargeSpan;
+template <class T> using CLargeSpan = LargeSpan<const T>;
 template <class T> class SparseSpan;
 
 template <class TFunc> struct Cleanup {
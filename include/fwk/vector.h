@@ -17,6 +17,11 @@ constexpr PoolAllocTag pool_alloc;
 // - Pooled allocation support (4KB per thread); Pool-allocated vectors should be destroyed
 //   on the same thread on which they were created, otherwise pools will be wasted and give no
 //   performance gain
+// - Arena allocation support (see arena.h); Arena-allocated vectors cannot be used after
+//   their memory was released with Arena::reset
+// - over-aligned types (alignof(T) > default_alignment) are allocated with proper alignment
+// - big buffers are mapped directly from the system & can grow without copying
+//   (see LargeAllocConfig in sys/memory.h)
 template <class T> class Vector {
   public:
 	using value_type = T;
@@ -25,28 +30,31 @@ template <class T> class Vector {
 	template <class IT>
 	static constexpr bool is_input_iter = is_forward_iter<IT> && is_constructible<T, IterBase<IT>>;
 
-	explicit Vector(PoolAllocTag) { m_base.initializePool(sizeof(T)); }
+	explicit Vector(PoolAllocTag) { m_base.initializePool(elem); }
+	// Memory will be allocated from given arena (if there is enough space left)
+	explicit Vector(Arena &arena) { m_base.initializeArena(arena); }
 	Vector() { m_base.zero(); }
 
 	~Vector() {
 		destroy(m_base.data, m_base.size);
-		m_base.free(sizeof(T));
+		m_base.free(elem);
 	}
 	Vector(const Vector &rhs) : Vector() { assign(rhs.begin(), rhs.end()); }
 	Vector(Vector &&rhs) { m_base.moveConstruct(std::move(rhs.m_base)); }
 
 	explicit Vector(PoolAllocTag, int size, const T &default_value = T()) {
-		if(detail::t_vpool_bits && size <= int(detail::vpool_chunk_size / sizeof(T))) {
-			m_base.initializePool(sizeof(T));
+		if(detail::t_vpool_bits && !elem.alignment &&
+		   size <= int(detail::vpool_chunk_size / sizeof(T))) {
+			m_base.initializePool(elem);
 			m_base.size = size;
 		} else
-			m_base.alloc(sizeof(T), size, size);
+			m_base.alloc(elem, size, size);
 
 		for(int idx = 0; idx < size; idx++)
 			new(((T *)m_base.data) + idx) T(default_value);
 	}
 	explicit Vector(int size, const T &default_value = T()) {
-		m_base.alloc(sizeof(T), size, size);
+		m_base.alloc(elem, size, size);
 		for(int idx = 0; idx < size; idx++)
 			new(((T *)m_base.data) + idx) T(default_value);
 	}
@@ -68,9 +76,9 @@ template <class T> class Vector {
 		requires(is_input_iter<IT>)
 	void assign(IT first, IT last) {
 		if(trivial_destruction)
-			m_base.assignPartialPod(sizeof(T), fwk::distance(first, last));
+			m_base.assignPartialPod(elem, fwk::distance(first, last));
 		else
-			m_base.assignPartial(sizeof(T), &Vector::destroy, fwk::distance(first, last));
+			m_base.assignPartial(elem, &Vector::destroy, fwk::distance(first, last));
 		int offset = 0;
 		while(!(first == last)) {
 			new(data() + offset++) T(*first);
@@ -80,9 +88,9 @@ template <class T> class Vector {
 
 	void assign(const T *first, const T *last) {
 		if(trivial_copy_constr && trivial_destruction)
-			m_base.assignPod(sizeof(T), first, last - first);
+			m_base.assignPod(elem, first, last - first);
 		else
-			m_base.assign(sizeof(T), &Vector::destroy, &Vector::copy, first, last - first);
+			m_base.assign(elem, &Vector::destroy, &Vector::copy, first, last - first);
 	}
 	void assign(std::initializer_list<T> il) { assign(il.begin(), il.end()); }
 	void assign(int size, const T &value) {
@@ -150,9 +158,9 @@ template <class T> class Vector {
 
 	void reserve(int new_capacity) {
 		if(trivial_move_constr && trivial_destruction)
-			m_base.reservePod(sizeof(T), new_capacity);
+			m_base.reservePod(elem, new_capacity);
 		else
-			m_base.reserve(sizeof(T), &Vector::moveAndDestroy, new_capacity);
+			m_base.reserve(elem, &Vector::moveAndDestroy, new_capacity);
 	}
 
 	void resize(int new_size, T default_value) {
@@ -175,9 +183,9 @@ template <class T> class Vector {
 	template <class... Args> T &emplace_back(Args &&...args) INST_EXCEPT {
 		if(m_base.size == m_base.capacity) {
 			if(trivial_move_constr && trivial_destruction)
-				m_base.growPod(sizeof(T));
+				m_base.growPod(elem);
 			else
-				m_base.grow(sizeof(T), &Vector::moveAndDestroy);
+				m_base.grow(elem, &Vector::moveAndDestroy);
 		}
 		new(end()) T{std::forward<Args>(args)...};
 		T &back = (reinterpret_cast<T *>(m_base.data))[m_base.size];
@@ -189,9 +197,9 @@ template <class T> class Vector {
 
 	void erase(const T *it) {
 		if(trivial_move_constr && trivial_destruction)
-			m_base.erasePod(sizeof(T), it - begin(), 1);
+			m_base.erasePod(elem, it - begin(), 1);
 		else
-			m_base.erase(sizeof(T), &Vector::destroy, &Vector::moveAndDestroy, it - begin(), 1);
+			m_base.erase(elem, &Vector::destroy, &Vector::moveAndDestroy, it - begin(), 1);
 	}
 	void pop_back() {
 		IF_PARANOID(m_base.checkNotEmpty());
@@ -201,9 +209,9 @@ template <class T> class Vector {
 
 	void erase(const T *a, const T *b) {
 		if(trivial_move_constr && trivial_destruction)
-			m_base.erasePod(sizeof(T), a - begin(), b - a);
+			m_base.erasePod(elem, a - begin(), b - a);
 		else
-			m_base.erase(sizeof(T), &Vector::destroy, &Vector::moveAndDestroy, a - begin(), b - a);
+			m_base.erase(elem, &Vector::destroy, &Vector::moveAndDestroy, a - begin(), b - a);
 	}
 
 	T *insert(const T *pos, const T &value) { return insert(pos, &value, (&value) + 1); }
@@ -213,9 +221,9 @@ template <class T> class Vector {
 	T *insert(const T *pos, IT first, IT last) {
 		int offset = pos - begin();
 		if(trivial_move_constr && trivial_destruction)
-			m_base.insertPodPartial(sizeof(T), offset, fwk::distance(first, last));
+			m_base.insertPodPartial(elem, offset, fwk::distance(first, last));
 		else
-			m_base.insertPartial(sizeof(T), &Vector::moveAndDestroyBackwards, offset,
+			m_base.insertPartial(elem, &Vector::moveAndDestroyBackwards, offset,
 								 fwk::distance(first, last));
 		int toffset = offset;
 		while(!(first == last)) {
@@ -238,9 +246,9 @@ template <class T> class Vector {
 
 		int offset = pos - begin();
 		if(trivial_move_constr && trivial_destruction && trivial_copy_constr)
-			m_base.insertPod(sizeof(T), offset, first, last - first);
+			m_base.insertPod(elem, offset, first, last - first);
 		else
-			m_base.insert(sizeof(T), &Vector::moveAndDestroyBackwards, &Vector::copy, offset, first,
+			m_base.insert(elem, &Vector::moveAndDestroyBackwards, &Vector::copy, offset, first,
 						  last - first);
 		return begin() + offset;
 	}
@@ -274,6 +282,8 @@ template <class T> class Vector {
 	template <class U> Vector<U> reinterpret() {
 		static_assert(compatibleSizes(sizeof(T), sizeof(U)),
 					  "Incompatible sizes; are you sure, you want to do this cast?");
+		static_assert(VectorElem::of<T>().alignment == VectorElem::of<U>().alignment,
+					  "Over-aligned vectors can only be cast to vectors with the same alignment");
 
 		m_base.size = (int)(size_t(m_base.size) * sizeof(T) / sizeof(U));
 		m_base.capacity = (int)(size_t(m_base.capacity) * sizeof(T) / sizeof(U));
@@ -285,12 +295,13 @@ template <class T> class Vector {
 	static constexpr bool trivial_move_constr = std::is_trivially_move_constructible<T>::value,
 						  trivial_copy_constr = std::is_trivially_copy_constructible<T>::value,
 						  trivial_destruction = std::is_trivially_destructible<T>::value;
+	static constexpr VectorElem elem = VectorElem::of<T>();
 
 	void resizePrelude(int new_size) {
 		if(trivial_move_constr && trivial_destruction && trivial_copy_constr)
-			m_base.resizePodPartial(sizeof(T), new_size);
+			m_base.resizePodPartial(elem, new_size);
 		else
-			m_base.resizePartial(sizeof(T), &Vector::destroy, &Vector::moveAndDestroy, new_size);
+			m_base.resizePartial(elem, &Vector::destroy, &Vector::moveAndDestroy, new_size);
 	}
 
 	static void copy(void *vdst, const void *vsrc, int count) {
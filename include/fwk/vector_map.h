@@ -7,107 +7,241 @@
 
 namespace fwk {
 
-// Map based on sorted vector (flat structure, linear insertion time)
+// Map based on sorted vectors (flat structure, linear insertion time).
+// Keys & values are kept in separate arrays, so searching touches only the keys.
+// Lookups use branchless binary search; last steps for arithmetic keys are performed with
+// a linear scan, which can be vectorized. It's best suited for maps which are built once
+// (with insertMany or from vector of pairs) and then queried a lot.
 //
-// TODO: Does it really make sense to use it? Why not use unordered_map?
-// When searching for values, it seems to be faster
 // TODO: rename to OrderedVector or something ?
 template <class Key, class Value> class VectorMap {
   public:
 	using Pair = pair<Key, Value>;
-	using const_iterator = typename vector<Pair>::const_iterator;
-	using iterator = typename vector<Pair>::iterator;
+
+	template <bool is_const> class TIter {
+	  public:
+		using MapPtr = If<is_const, const VectorMap *, VectorMap *>;
+		using Ref = pair<const Key &, If<is_const, const Value, Value> &>;
+
+		template <bool to_const>
+			requires(!is_const && to_const)
+		operator TIter<to_const>() const {
+			return {map, idx};
+		}
+
+		Ref operator*() const { return {key(), value()}; }
+		auto operator->() const {
+			struct Proxy {
+				Ref ref;
+				auto *operator->() const { return &ref; }
+			};
+			return Proxy{**this};
+		}
+
+		const Key &key() const { return PASSERT(idx < map->size()), map->m_keys[idx]; }
+		auto &value() const { return PASSERT(idx < map->size()), map->m_values[idx]; }
+
+		void operator++() { idx++; }
+		bool operator==(const TIter &rhs) const { return idx == rhs.idx; }
+		int operator-(const TIter &rhs) const { return idx - rhs.idx; }
+
+		MapPtr map;
+		int idx;
+	};
+
+	using iterator = TIter<false>;
+	using const_iterator = TIter<true>;
 
 	// TODO: better name (strongly ordered or smth)
-	static bool isSortedAndUnique(CSpan<Pair> range) {
-		for(int n = 1; n < range.size(); n++)
-			if(!(range[n - 1].first < range[n].first))
+	static bool isSortedAndUnique(CSpan<Key> keys) {
+		for(int n = 1; n < keys.size(); n++)
+			if(!(keys[n - 1] < keys[n]))
 				return false;
 		return true;
 	}
 
 	VectorMap() = default;
-	VectorMap(vector<Pair> elements) : m_container(std::move(elements)) {
-		DASSERT(isSortedAndUnique(m_container));
+	// Elements have to be sorted & unique
+	VectorMap(vector<Pair> elements) {
+		m_keys.reserve(elements.size());
+		m_values.reserve(elements.size());
+		for(auto &elem : elements) {
+			m_keys.emplace_back(std::move(elem.first));
+			m_values.emplace_back(std::move(elem.second));
+		}
+		DASSERT(isSortedAndUnique(m_keys));
 	}
 
-	struct Compare {
-		bool operator()(const Pair &lhs, const Pair &rhs) const { return lhs.first < rhs.first; }
-		bool operator()(const Pair &lhs, const Key &key) const { return lhs.first < key; }
-		bool operator()(const Key &key, const Pair &rhs) const { return key < rhs.first; }
-	};
-
-	int size() const { return (int)m_container.size(); }
-	auto begin() const { return m_container.begin(); }
-	auto end() const { return m_container.end(); }
-	auto begin() { return m_container.begin(); }
-	auto end() { return m_container.end(); }
+	int size() const { return m_keys.size(); }
+	auto begin() const { return const_iterator{this, 0}; }
+	auto end() const { return const_iterator{this, size()}; }
+	auto begin() { return iterator{this, 0}; }
+	auto end() { return iterator{this, size()}; }
 
 	explicit operator bool() const { return !empty(); }
-	bool empty() const { return m_container.empty(); }
-
-	auto lower_bound(const Key &key) const {
-		return std::lower_bound(begin(), end(), key, Compare());
+	bool empty() const { return m_keys.empty(); }
+
+	CSpan<Key> keys() const { return m_keys; }
+	CSpan<Value> values() const { return m_values; }
+	Span<Value> values() { return m_values; }
+
+	// Index of first key which is not less than given key
+	int lowerBoundIndex(const Key &key) const {
+		const Key *base = m_keys.data();
+		int count = m_keys.size();
+		if(count == 0)
+			return 0;
+
+		constexpr int linear_size = std::is_arithmetic_v<Key> ? 8 : 1;
+		while(count > linear_size) {
+			int half = count / 2;
+			base = base[half] < key ? base + half : base;
+			count -= half;
+		}
+
+		int out = base - m_keys.data();
+		if constexpr(std::is_arithmetic_v<Key>) {
+			for(int n = 0; n < count; n++)
+				out += base[n] < key ? 1 : 0;
+			return out;
+		} else {
+			return out + (*base < key ? 1 : 0);
+		}
 	}
-	auto upper_bound(const Key &key) const {
-		return std::upper_bound(begin(), end(), key, Compare());
+	// Returns -1 if key is not present
+	int findIndex(const Key &key) const {
+		int idx = lowerBoundIndex(key);
+		return idx < size() && !(key < m_keys[idx]) ? idx : -1;
 	}
-	auto lower_bound(const Key &key) { return std::lower_bound(begin(), end(), key, Compare()); }
-	auto upper_bound(const Key &key) { return std::upper_bound(begin(), end(), key, Compare()); }
+
+	auto lower_bound(const Key &key) const { return const_iterator{this, lowerBoundIndex(key)}; }
+	auto lower_bound(const Key &key) { return iterator{this, lowerBoundIndex(key)}; }
+	auto upper_bound(const Key &key) const { return const_iterator{this, upperBoundIndex(key)}; }
+	auto upper_bound(const Key &key) { return iterator{this, upperBoundIndex(key)}; }
 
 	auto find(const Key &key) {
-		auto it = lower_bound(key);
-		return it == end() || !Compare()(key, *it) ? it : end();
+		int idx = findIndex(key);
+		return idx == -1 ? end() : iterator{this, idx};
 	}
 	auto find(const Key &key) const {
-		auto it = lower_bound(key);
-		return it == end() || !Compare()(key, *it) ? it : end();
+		int idx = findIndex(key);
+		return idx == -1 ? end() : const_iterator{this, idx};
 	}
 
 	Maybe<Value> maybeFind(const Key &key) const {
-		auto it = find(key);
-		return it == end() ? none : Maybe<Value>(it->second);
+		int idx = findIndex(key);
+		return idx == -1 ? none : Maybe<Value>(m_values[idx]);
 	}
 	Value find(const Key &key, Value when_not_found) const {
-		auto it = find(key);
-		return it == end() ? when_not_found : it->second;
+		int idx = findIndex(key);
+		return idx == -1 ? when_not_found : m_values[idx];
 	}
 
 	pair<iterator, bool> insert(Pair &&pair) {
-		auto it = lower_bound(pair.first);
-		if(it == end() || Compare()(pair.first, *it))
-			return {m_container.insert(it, std::move(pair)), true};
-		return {it, false};
+		int idx = lowerBoundIndex(pair.first);
+		if(idx < size() && !(pair.first < m_keys[idx]))
+			return {iterator{this, idx}, false};
+		m_keys.insert(m_keys.begin() + idx, std::move(pair.first));
+		m_values.insert(m_values.begin() + idx, std::move(pair.second));
+		return {iterator{this, idx}, true};
+	}
+
+	// Inserts k elements in O(n + k * log(n + k)) time (instead of O(n * k)).
+	// Batch is sorted & then merged with existing elements. Just like with insert,
+	// existing elements are not replaced; if some key is repeated, its first occurrence is used.
+	void insertMany(CSpan<Pair> pairs) {
+		vector<int> order(pairs.size());
+		for(int n = 0; n < order.size(); n++)
+			order[n] = n;
+		std::stable_sort(order.begin(), order.end(),
+						 [&](int a, int b) { return pairs[a].first < pairs[b].first; });
+
+		int num_new = 0;
+		for(int n = 0; n < order.size(); n++) {
+			auto &key = pairs[order[n]].first;
+			if(num_new > 0 && !(pairs[order[num_new - 1]].first < key))
+				continue;
+			if(findIndex(key) == -1)
+				order[num_new++] = order[n];
+		}
+		if(num_new == 0)
+			return;
+
+		// Merging from the back, so that every element is moved only once
+		int src = size() - 1, dst = size() + num_new - 1;
+		m_keys.resize(size() + num_new);
+		m_values.resize(m_keys.size());
+		for(int n = num_new - 1; n >= 0; dst--) {
+			auto &pair = pairs[order[n]];
+			if(src >= 0 && pair.first < m_keys[src]) {
+				m_keys[dst] = std::move(m_keys[src]);
+				m_values[dst] = std::move(m_values[src]);
+				src--;
+			} else {
+				m_keys[dst] = pair.first;
+				m_values[dst] = pair.second;
+				n--;
+			}
+		}
 	}
 
 	void erase(const Key &key) {
-		auto it = lower_bound(key);
-		if(it != end())
-			m_container.erase(it);
+		int idx = findIndex(key);
+		if(idx != -1)
+			eraseIndex(idx);
 	}
 
-	void erase(const_iterator it) { m_container.erase(it); }
-	void clear() { m_container.clear(); }
+	void erase(const_iterator it) { eraseIndex(it.idx); }
+	void clear() {
+		m_keys.clear();
+		m_values.clear();
+	}
 
-	void reserve(int size) { m_container.reserve(size); }
+	void reserve(int size) {
+		m_keys.reserve(size);
+		m_values.reserve(size);
+	}
 
+	// Predicate is called with pair of references to key & value
 	template <class Predicate> void erase_if(Predicate pred) {
-		auto new_end = std::remove_if(m_container.begin(), m_container.end(), pred);
-		m_container.erase(new_end, m_container.end());
+		int new_size = 0;
+		for(int n = 0; n < size(); n++) {
+			if(pred(pair<const Key &, const Value &>(m_keys[n], m_values[n])))
+				continue;
+			if(n != new_size) {
+				m_keys[new_size] = std::move(m_keys[n]);
+				m_values[new_size] = std::move(m_values[n]);
+			}
+			new_size++;
+		}
+		m_keys.resize(new_size);
+		m_values.resize(new_size);
 	}
 
 	Value &operator[](const Key &key) {
-		auto it = lower_bound(key);
-		if(it == end() || Compare()(key, *it))
-			it = m_container.insert(it, {key, Value()});
-		return m_container[it - begin()].second;
+		int idx = lowerBoundIndex(key);
+		if(idx == size() || key < m_keys[idx]) {
+			m_keys.insert(m_keys.begin() + idx, key);
+			m_values.insert(m_values.begin() + idx, Value());
+		}
+		return m_values[idx];
 	}
 
-	Pair &atIndex(int index) { return m_container[index]; }
-	const Pair &atIndex(int index) const { return m_container[index]; }
+	auto atIndex(int index) { return *iterator{this, index}; }
+	auto atIndex(int index) const { return *const_iterator{this, index}; }
 
   private:
-	vector<Pair> m_container;
+	int upperBoundIndex(const Key &key) const {
+		return std::upper_bound(m_keys.begin(), m_keys.end(), key) - m_keys.begin();
+	}
+
+	void eraseIndex(int idx) {
+		m_keys.erase(m_keys.begin() + idx);
+		m_values.erase(m_values.begin() + idx);
+	}
+
+	vector<Key> m_keys;
+	vector<Value> m_values;
 };
 
 template <class T1, class T2> pair<T2, T1> invertPair(const pair<T1, T2> &p) {
@@ -52,6 +52,10 @@ class VulkanMemoryManager {
 	Span<char> writeAccessMemory(const VMemoryBlock &);
 	void flushMappedRanges();
 
+	// Frees empty slab groups & zones; Returns amount of released device memory
+	// Blocks which are still in use (also deferred frees) will be kept
+	u64 releaseUnusedMemory();
+
 	void setLogging(VMemoryDomains, VMemoryBlockTypes);
 
 	void validate() const;
@@ -66,6 +70,7 @@ class VulkanMemoryManager {
   private:
 	void shrunkMappings();
 	static u64 slabAlloc(u64, uint, void *);
+	static void slabFree(uint, void *);
 	void log(ZStr action, VMemoryBlockId);
 
 	struct DeviceMemory {
@@ -0,0 +1,99 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/arena.h"
+
+#include "fwk/sys/thread.h"
+
+namespace fwk {
+
+namespace detail {
+	ArenaSlot g_arena_slots[max_arenas];
+	std::atomic<int> g_num_arena_slots = 0;
+	std::atomic<uintptr_t> g_arenas_begin = 0, g_arenas_end = 0;
+	static Mutex s_arena_mutex;
+
+	Arena *findArenaSlot(const void *ptr) {
+		int num_slots = g_num_arena_slots.load(std::memory_order_acquire);
+		for(int n = 0; n < num_slots; n++) {
+			auto &slot = g_arena_slots[n];
+			if(ptr >= slot.begin.load(std::memory_order_relaxed) &&
+			   ptr < slot.end.load(std::memory_order_relaxed))
+				return slot.arena.load(std::memory_order_relaxed);
+		}
+		return nullptr;
+	}
+
+	// Has to be called with s_arena_mutex locked
+	static void updateArenasRange() {
+		uintptr_t begin = ~uintptr_t(0), end = 0;
+		int num_slots = g_num_arena_slots.load(std::memory_order_relaxed);
+		for(int n = 0; n < num_slots; n++) {
+			auto &slot = g_arena_slots[n];
+			if(!slot.arena.load(std::memory_order_relaxed))
+				continue;
+			begin = min(begin, uintptr_t(slot.begin.load(std::memory_order_relaxed)));
+			end = max(end, uintptr_t(slot.end.load(std::memory_order_relaxed)));
+		}
+		if(begin >= end)
+			begin = end = 0;
+		g_arenas_begin.store(begin, std::memory_order_relaxed);
+		g_arenas_end.store(end, std::memory_order_relaxed);
+	}
+}
+
+static constexpr size_t arena_alignment = 64;
+
+Arena::Arena(size_t capacity) : m_capacity(capacity) {
+	using namespace detail;
+	PASSERT(capacity > 0);
+	m_data = (char *)fwk::allocate(capacity, arena_alignment);
+
+	MutexLocker lock(s_arena_mutex);
+	int num_slots = g_num_arena_slots.load(std::memory_order_relaxed);
+	for(int n = 0; n < num_slots; n++)
+		if(!g_arena_slots[n].arena.load(std::memory_order_relaxed)) {
+			m_slot = n;
+			break;
+		}
+	if(m_slot == -1) {
+		if(num_slots == max_arenas)
+			FWK_FATAL("Too many arenas (max: %d)", max_arenas);
+		m_slot = num_slots;
+	}
+
+	auto &slot = g_arena_slots[m_slot];
+	slot.arena.store(this, std::memory_order_relaxed);
+	slot.begin.store(m_data, std::memory_order_relaxed);
+	slot.end.store(m_data + capacity, std::memory_order_relaxed);
+	if(m_slot == num_slots)
+		g_num_arena_slots.store(num_slots + 1, std::memory_order_release);
+	updateArenasRange();
+}
+
+Arena::~Arena() {
+	using namespace detail;
+	{
+		MutexLocker lock(s_arena_mutex);
+		auto &slot = g_arena_slots[m_slot];
+		slot.begin.store(nullptr, std::memory_order_relaxed);
+		slot.end.store(nullptr, std::memory_order_relaxed);
+		slot.arena.store(nullptr, std::memory_order_relaxed);
+		updateArenasRange();
+	}
+	fwk::deallocate(m_data, arena_alignment);
+}
+
+void Arena::reset(Marker marker) {
+	PASSERT(m_num_vectors <= marker.num_vectors &&
+			"All vectors allocated after the marker have to be destroyed before reset");
+	// Offset may already be lower if last allocations were freed
+	if(marker.offset < m_offset)
+		m_offset = marker.offset;
+}
+
+void *Arena::allocateFallback(size_t size, size_t alignment) {
+	m_num_fallbacks++;
+	return fwk::allocate(size, alignment);
+}
+}
@@ -0,0 +1,88 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/atom.h"
+
+#include "fwk/format.h"
+#include "fwk/hash_map.h"
+#include "fwk/maybe.h"
+#include "fwk/sys/memory.h"
+#include "fwk/sys/thread.h"
+
+namespace fwk {
+
+namespace {
+	// Strings are kept in big blocks, which are never freed
+	constexpr int block_size = 64 * 1024;
+
+	struct AtomTable {
+		const char *store(Str str) {
+			int num_bytes = (sizeof(int) + str.size() + 1 + alignof(int) - 1) & ~(alignof(int) - 1);
+			char *ptr;
+			if(num_bytes > block_size / 4) {
+				ptr = (char *)allocate(num_bytes);
+			} else {
+				if(block_used + num_bytes > block_size) {
+					block = (char *)allocate(block_size);
+					block_used = 0;
+				}
+				ptr = block + block_used;
+				block_used += num_bytes;
+			}
+			int size = str.size();
+			memcpy(ptr, &size, sizeof(size));
+			memcpy(ptr + sizeof(int), str.data(), str.size());
+			ptr[sizeof(int) + str.size()] = 0;
+			return ptr + sizeof(int);
+		}
+
+		Mutex mutex;
+		HashMap<Str, const char *, StrHashPolicy> map;
+		char *block = nullptr;
+		int block_used = block_size;
+	};
+
+	AtomTable &atomTable() {
+		static AtomTable *table = new AtomTable;
+		return *table;
+	}
+
+	alignas(int) const char empty_atom[sizeof(int) + 1] = {};
+}
+
+Atom::Atom() : m_data(empty_atom + sizeof(int)) {}
+
+Atom::Atom(Str str) : Atom() {
+	if(str.empty())
+		return;
+	auto &table = atomTable();
+	MutexLocker lock(table.mutex);
+	auto it = table.map.find(str);
+	if(it == table.map.end()) {
+		const char *data = table.store(str);
+		table.map.emplace(Str(data, str.size()), data);
+		m_data = data;
+	} else {
+		m_data = it->value;
+	}
+}
+
+Maybe<Atom> Atom::find(Str str) {
+	if(str.empty())
+		return Atom();
+	auto &table = atomTable();
+	MutexLocker lock(table.mutex);
+	auto it = table.map.find(str);
+	if(it == table.map.end())
+		return none;
+	return Atom(it->value, 0);
+}
+
+void Atom::operator>>(TextFormatter &out) const { out << str(); }
+
+int Atom::numAtoms() {
+	auto &table = atomTable();
+	MutexLocker lock(table.mutex);
+	return table.map.size();
+}
+}
@@ -26,77 +26,109 @@ int vectorInsertCapacity(int capacity, int obj_size, int min_size) {
 	return cap > min_size ? cap : min_size;
 }
 
-void BaseVector::alloc(int obj_size, int size_, int capacity_) {
+void BaseVector::alloc(VectorElem elem, int size_, int capacity_, const char *source) {
 	size = size_;
 	capacity = capacity_;
-	data = (char *)fwk::allocate(size_t(capacity) * obj_size);
+	size_t num_bytes = size_t(capacity) * elem.size;
+	if(auto *arena = source ? detail::findArena(source) : nullptr) {
+		size_t alignment = elem.alignment ? elem.alignment : default_alignment;
+		data = (char *)arena->allocateVector(num_bytes, alignment);
+		return;
+	}
+	if(num_bytes >= detail::g_large_alloc_threshold.load(std::memory_order_relaxed))
+		if((data = (char *)allocateLarge(num_bytes)))
+			return;
+	data = (char *)(elem.alignment ? fwk::allocate(num_bytes, elem.alignment)
+								   : fwk::allocate(num_bytes));
+}
+
+// Vectors which are last allocated in their arena can grow without moving
+static bool growInArena(BaseVector &vec, VectorElem elem, int new_capacity) {
+	auto *arena = detail::findArena(vec.data);
+	if(!arena || !arena->tryGrowLast(vec.data, size_t(vec.capacity) * elem.size,
+									 size_t(new_capacity) * elem.size))
+		return false;
+	vec.capacity = new_capacity;
+	return true;
+}
+
+// Big buffers of trivially movable elements can grow in place with mremap
+static bool growLarge(BaseVector &vec, VectorElem elem, int new_capacity) {
+	if(!maybeLargeAllocation(vec.data, size_t(vec.capacity) * elem.size))
+		return false;
+	auto *new_data = (char *)reallocateLarge(vec.data, size_t(new_capacity) * elem.size);
+	if(!new_data)
+		return false;
+	vec.data = new_data;
+	vec.capacity = new_capacity;
+	return true;
 }
 
-void BaseVector::grow(int obj_size, MoveDestroyFunc func) {
-	reallocate(obj_size, func, vectorGrowCapacity(capacity, obj_size));
+void BaseVector::grow(VectorElem elem, MoveDestroyFunc func) {
+	reallocate(elem, func, vectorGrowCapacity(capacity, elem.size));
 }
-void BaseVector::growPod(int obj_size) {
-	reallocatePod(obj_size, vectorGrowCapacity(capacity, obj_size));
+void BaseVector::growPod(VectorElem elem) {
+	reallocatePod(elem, vectorGrowCapacity(capacity, elem.size));
 }
 
-void BaseVector::reallocate(int obj_size, MoveDestroyFunc move_destroy_func, int new_capacity) {
-	if(new_capacity <= capacity)
+void BaseVector::reallocate(VectorElem elem, MoveDestroyFunc move_destroy_func, int new_capacity) {
+	if(new_capacity <= capacity || growInArena(*this, elem, new_capacity))
 		return;
 
 	BaseVector temp;
-	temp.alloc(obj_size, size, new_capacity);
+	temp.alloc(elem, size, new_capacity, data);
 	move_destroy_func(temp.data, data, size);
 	swap(temp);
-	temp.free(obj_size);
+	temp.free(elem);
 }
 
-void BaseVector::resizePartial(int obj_size, DestroyFunc destroy_func,
+void BaseVector::resizePartial(VectorElem elem, DestroyFunc destroy_func,
 							   MoveDestroyFunc move_destroy_func, int new_size) {
 	PASSERT(new_size >= 0);
 	if(new_size > capacity)
-		reallocate(obj_size, move_destroy_func, vectorInsertCapacity(capacity, obj_size, new_size));
+		reallocate(elem, move_destroy_func, vectorInsertCapacity(capacity, elem.size, new_size));
 
 	if(size > new_size)
-		destroy_func(data + size_t(obj_size) * new_size, size - new_size);
+		destroy_func(data + size_t(elem.size) * new_size, size - new_size);
 	size = new_size;
 }
 
-void BaseVector::assignPartial(int obj_size, DestroyFunc destroy_func, int new_size) {
+void BaseVector::assignPartial(VectorElem elem, DestroyFunc destroy_func, int new_size) {
 	clear(destroy_func);
 	if(new_size > capacity) {
 		BaseVector temp;
-		temp.alloc(obj_size, new_size, vectorInsertCapacity(capacity, obj_size, new_size));
+		temp.alloc(elem, new_size, vectorInsertCapacity(capacity, elem.size, new_size), data);
 		swap(temp);
-		temp.free(obj_size);
+		temp.free(elem);
 		return;
 	}
 	size = new_size;
 }
 
-void BaseVector::assign(int obj_size, DestroyFunc destroy_func, CopyFunc copy_func, const void *ptr,
-						int new_size) {
-	assignPartial(obj_size, destroy_func, new_size);
+void BaseVector::assign(VectorElem elem, DestroyFunc destroy_func, CopyFunc copy_func,
+						const void *ptr, int new_size) {
+	assignPartial(elem, destroy_func, new_size);
 	copy_func(data, ptr, size);
 }
 
-void BaseVector::insertPartial(int obj_size, MoveDestroyFunc move_destroy_func, int index,
+void BaseVector::insertPartial(VectorElem elem, MoveDestroyFunc move_destroy_func, int index,
 							   int count) {
 	DASSERT(index >= 0 && index <= size);
 	int new_size = size + count;
 	if(new_size > capacity)
-		reallocate(obj_size, move_destroy_func, vectorInsertCapacity(capacity, obj_size, new_size));
+		reallocate(elem, move_destroy_func, vectorInsertCapacity(capacity, elem.size, new_size));
 
 	int move_count = size - index;
 	if(move_count > 0)
-		move_destroy_func(data + size_t(obj_size) * (index + count),
-						  data + size_t(obj_size) * index, move_count);
+		move_destroy_func(data + size_t(elem.size) * (index + count),
+						  data + size_t(elem.size) * index, move_count);
 	size = new_size;
 }
 
-void BaseVector::insert(int obj_size, MoveDestroyFunc move_destroy_func, CopyFunc copy_func,
+void BaseVector::insert(VectorElem elem, MoveDestroyFunc move_destroy_func, CopyFunc copy_func,
 						int index, const void *ptr, int count) {
-	insertPartial(obj_size, move_destroy_func, index, count);
-	copy_func(data + size_t(obj_size) * index, ptr, count);
+	insertPartial(elem, move_destroy_func, index, count);
+	copy_func(data + size_t(elem.size) * index, ptr, count);
 }
 
 void BaseVector::clear(DestroyFunc destroy_func) {
@@ -104,7 +136,7 @@ void BaseVector::clear(DestroyFunc destroy_func) {
 	size = 0;
 }
 
-void BaseVector::erase(int obj_size, DestroyFunc destroy_func, MoveDestroyFunc move_destroy_func,
+void BaseVector::erase(VectorElem elem, DestroyFunc destroy_func, MoveDestroyFunc move_destroy_func,
 					   int index, int count) {
 	DASSERT(index >= 0 && count >= 0 && index + count <= size);
 	if(!count)
@@ -113,86 +145,87 @@ void BaseVector::erase(int obj_size, DestroyFunc destroy_func, MoveDestroyFunc m
 	int move_start = index + count;
 	int move_count = size - move_start;
 
-	destroy_func(data + size_t(obj_size) * index, count);
-	move_destroy_func(data + size_t(obj_size) * index, data + size_t(obj_size) * (index + count),
+	destroy_func(data + size_t(elem.size) * index, count);
+	move_destroy_func(data + size_t(elem.size) * index, data + size_t(elem.size) * (index + count),
 					  move_count);
 	size -= count;
 }
 
-void BaseVector::reallocatePod(int obj_size, int new_capacity) {
-	if(new_capacity <= capacity)
+void BaseVector::reallocatePod(VectorElem elem, int new_capacity) {
+	if(new_capacity <= capacity || growInArena(*this, elem, new_capacity) ||
+	   growLarge(*this, elem, new_capacity))
 		return;
 
 	BaseVector temp;
-	temp.alloc(obj_size, size, new_capacity);
-	memcpy(temp.data, data, size_t(obj_size) * size);
+	temp.alloc(elem, size, new_capacity, data);
+	memcpy(temp.data, data, size_t(elem.size) * size);
 	swap(temp);
-	temp.free(obj_size);
+	temp.free(elem);
 }
 
-void BaseVector::reservePod(int obj_size, int desired_capacity) {
+void BaseVector::reservePod(VectorElem elem, int desired_capacity) {
 	if(desired_capacity > capacity) {
-		int new_capacity = vectorInsertCapacity(capacity, obj_size, desired_capacity);
-		reallocatePod(obj_size, new_capacity);
+		int new_capacity = vectorInsertCapacity(capacity, elem.size, desired_capacity);
+		reallocatePod(elem, new_capacity);
 	}
 }
 
-void BaseVector::reserve(int obj_size, MoveDestroyFunc func, int desired_capacity) {
+void BaseVector::reserve(VectorElem elem, MoveDestroyFunc func, int desired_capacity) {
 	if(desired_capacity > capacity) {
-		int new_capacity = vectorInsertCapacity(capacity, obj_size, desired_capacity);
-		reallocate(obj_size, func, new_capacity);
+		int new_capacity = vectorInsertCapacity(capacity, elem.size, desired_capacity);
+		reallocate(elem, func, new_capacity);
 	}
 }
 
-void BaseVector::resizePodPartial(int obj_size, int new_size) {
+void BaseVector::resizePodPartial(VectorElem elem, int new_size) {
 	PASSERT(new_size >= 0);
 	if(new_size > capacity)
-		reallocatePod(obj_size, vectorInsertCapacity(capacity, obj_size, new_size));
+		reallocatePod(elem, vectorInsertCapacity(capacity, elem.size, new_size));
 	size = new_size;
 }
 
-void BaseVector::assignPartialPod(int obj_size, int new_size) {
+void BaseVector::assignPartialPod(VectorElem elem, int new_size) {
 	clearPod();
 	if(new_size > capacity) {
 		BaseVector temp;
-		temp.alloc(obj_size, new_size, vectorInsertCapacity(capacity, obj_size, new_size));
+		temp.alloc(elem, new_size, vectorInsertCapacity(capacity, elem.size, new_size), data);
 		swap(temp);
-		temp.free(obj_size);
+		temp.free(elem);
 		return;
 	}
 	size = new_size;
 }
 
-void BaseVector::assignPod(int obj_size, const void *ptr, int new_size) {
-	assignPartialPod(obj_size, new_size);
-	memcpy(data, ptr, size_t(obj_size) * size);
+void BaseVector::assignPod(VectorElem elem, const void *ptr, int new_size) {
+	assignPartialPod(elem, new_size);
+	memcpy(data, ptr, size_t(elem.size) * size);
 }
 
-void BaseVector::insertPodPartial(int obj_size, int index, int count) {
+void BaseVector::insertPodPartial(VectorElem elem, int index, int count) {
 	DASSERT(index >= 0 && index <= size);
 	int new_size = size + count;
 	if(new_size > capacity)
-		reallocatePod(obj_size, vectorInsertCapacity(capacity, obj_size, new_size));
+		reallocatePod(elem, vectorInsertCapacity(capacity, elem.size, new_size));
 
 	int move_count = size - index;
 	if(move_count > 0)
-		memmove(data + size_t(obj_size) * (index + count), data + size_t(obj_size) * index,
-				size_t(obj_size) * move_count);
+		memmove(data + size_t(elem.size) * (index + count), data + size_t(elem.size) * index,
+				size_t(elem.size) * move_count);
 	size = new_size;
 }
 
-void BaseVector::insertPod(int obj_size, int index, const void *ptr, int count) {
-	insertPodPartial(obj_size, index, count);
-	memcpy(data + size_t(obj_size) * index, ptr, size_t(obj_size) * count);
+void BaseVector::insertPod(VectorElem elem, int index, const void *ptr, int count) {
+	insertPodPartial(elem, index, count);
+	memcpy(data + size_t(elem.size) * index, ptr, size_t(elem.size) * count);
 }
 
-void BaseVector::erasePod(int obj_size, int index, int count) {
+void BaseVector::erasePod(VectorElem elem, int index, int count) {
 	DASSERT(index >= 0 && count >= 0 && index + count <= size);
 	int move_start = index + count;
 	int move_count = size - move_start;
 	if(move_count > 0)
-		memmove(data + size_t(obj_size) * index, data + size_t(obj_size) * (index + count),
-				size_t(obj_size) * move_count);
+		memmove(data + size_t(elem.size) * index, data + size_t(elem.size) * (index + count),
+				size_t(elem.size) * move_count);
 	size -= count;
 }
 
@@ -3,21 +3,167 @@
 
 #include "fwk/bit_vector.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace fwk {
 
-BitVector::BitVector(int size) : m_data((size + base_size - 1) / base_size), m_size(size) {}
+BitVector::BitVector(int size) : m_data((size + base_size - 1) / base_size), m_size(size) {
+	fill(false);
+}
 
 void BitVector::resize(int new_size, bool value) {
-	PodVector<u32> new_data(new_size);
-	memcpy(new_data.data(), m_data.data(), sizeof(base_type) * min(new_size, m_data.size()));
-	if(new_data.size() > m_data.size())
-		memset(new_data.data() + m_data.size(), value ? 0xff : 0,
-			   (new_data.size() - m_data.size()) * sizeof(base_type));
+	PodVector<base_type> new_data((new_size + base_size - 1) / base_size);
+	int num_copied = min(new_data.size(), m_data.size());
+	memcpy(new_data.data(), m_data.data(), sizeof(base_type) * num_copied);
+	if(new_data.size() > num_copied)
+		memset(new_data.data() + num_copied, value ? 0xff : 0,
+			   (new_data.size() - num_copied) * sizeof(base_type));
+	if(value && m_size % base_size && new_size > m_size)
+		new_data[m_size >> base_shift] |= ~base_type(0) << (m_size % base_size);
 	m_data.swap(new_data);
 	m_size = new_size;
+	clearTail();
 }
 
 void BitVector::fill(bool value) {
 	memset(m_data.data(), value ? 0xff : 0, m_data.size() * sizeof(base_type));
+	clearTail();
+}
+
+void BitVector::clearTail() {
+	if(m_size % base_size)
+		m_data[m_data.size() - 1] &= (base_type(1) << (m_size % base_size)) - 1;
+}
+
+#if defined(__AVX2__)
+// Counting bits in each nibble with a lookup table (Mula's algorithm)
+static int countBitsAvx2(const u64 *words, int num_words, int &num_counted) {
+	const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1,
+											1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low_mask = _mm256_set1_epi8(0x0f);
+	__m256i total = _mm256_setzero_si256();
+
+	int n = 0;
+	while(n + 4 <= num_words) {
+		// Byte counters can hold up to 31 iterations (8 bits each)
+		int end = min(num_words & ~3, n + 31 * 4);
+		__m256i local = _mm256_setzero_si256();
+		for(; n < end; n += 4) {
+			__m256i vec = _mm256_loadu_si256((const __m256i *)(words + n));
+			__m256i lo = _mm256_and_si256(vec, low_mask);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(vec, 4), low_mask);
+			local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, lo));
+			local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, hi));
+		}
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+	}
+
+	num_counted = n;
+	return int(_mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) +
+			   _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3));
+}
+#endif
+
+int BitVector::count() const {
+	int out = 0, n = 0;
+#if defined(__AVX2__)
+	out = countBitsAvx2(m_data.data(), m_data.size(), n);
+#endif
+	for(; n < m_data.size(); n++)
+		out += countBits(m_data[n]);
+	return out;
+}
+
+int BitVector::findNext(int idx) const {
+	idx++;
+	if(idx >= m_size)
+		return -1;
+	int word_idx = idx >> base_shift;
+	base_type bits = m_data[word_idx] & (~base_type(0) << (idx & (base_size - 1)));
+	while(!bits) {
+		if(++word_idx == m_data.size())
+			return -1;
+		bits = m_data[word_idx];
+	}
+	return word_idx * base_size + countTrailingZeros(bits);
+}
+
+// Simple loops are vectorized by the compiler
+#define BIT_VECTOR_OP(expr)                                                                       \
+	PASSERT(m_size == rhs.m_size);                                                                \
+	base_type *dst = m_data.data();                                                               \
+	const base_type *src = rhs.m_data.data();                                                     \
+	for(int n = 0, count = m_data.size(); n < count; n++)                                         \
+		dst[n] = expr;
+
+void BitVector::operator&=(const BitVector &rhs) { BIT_VECTOR_OP(dst[n] & src[n]) }
+void BitVector::operator|=(const BitVector &rhs) { BIT_VECTOR_OP(dst[n] | src[n]) }
+void BitVector::operator^=(const BitVector &rhs) { BIT_VECTOR_OP(dst[n] ^ src[n]) }
+void BitVector::andNot(const BitVector &rhs) { BIT_VECTOR_OP(dst[n] & ~src[n]) }
+
+#undef BIT_VECTOR_OP
+
+bool BitVector::operator==(const BitVector &rhs) const {
+	return m_size == rhs.m_size &&
+		   memcmp(m_data.data(), rhs.m_data.data(), m_data.size() * sizeof(base_type)) == 0;
+}
+
+BitVectorRank::BitVectorRank(const BitVector &bits) : m_bits(bits) {
+	auto &words = bits.data();
+	int num_blocks = (words.size() + block_words - 1) >> block_shift;
+	m_block_ranks.resize(num_blocks + 1);
+	int rank = 0;
+	for(int block = 0; block < num_blocks; block++) {
+		m_block_ranks[block] = rank;
+		int end = min(words.size(), (block + 1) * block_words);
+		for(int n = block * block_words; n < end; n++)
+			rank += countBits(words[n]);
+	}
+	m_block_ranks[num_blocks] = rank;
+}
+
+int BitVectorRank::rank(int idx) const {
+	PASSERT(idx >= 0 && idx <= m_bits.size());
+	auto &words = m_bits.data();
+	int word_idx = idx >> BitVector::base_shift;
+	int out = m_block_ranks[word_idx >> block_shift];
+	for(int n = word_idx & ~(block_words - 1); n < word_idx; n++)
+		out += countBits(words[n]);
+	if(int bit = idx & (BitVector::base_size - 1))
+		out += countBits(words[word_idx] & ((u64(1) << bit) - 1));
+	return out;
+}
+
+int BitVectorRank::select(int rank) const {
+	if(rank < 0 || rank >= count())
+		return -1;
+
+	// Last block which starts with rank <= given rank
+	int lo = 0, hi = m_block_ranks.size() - 1;
+	while(hi - lo > 1) {
+		int mid = (lo + hi) / 2;
+		if(m_block_ranks[mid] <= rank)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	auto &words = m_bits.data();
+	rank -= m_block_ranks[lo];
+	int word_idx = lo << block_shift;
+	while(true) {
+		int word_count = countBits(words[word_idx]);
+		if(rank < word_count)
+			break;
+		rank -= word_count;
+		word_idx++;
+	}
+
+	u64 word = words[word_idx];
+	for(; rank > 0; rank--)
+		word &= word - 1;
+	return word_idx * BitVector::base_size + countTrailingZeros(word);
 }
 }
@@ -0,0 +1,228 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/concurrent_slab_allocator.h"
+
+#include "fwk/sys/assert.h"
+
+namespace fwk {
+
+namespace {
+	// Cache slots are shared by all allocators; each living thread has a different slot
+	Mutex s_slot_mutex;
+	vector<int> s_free_slots;
+	int s_num_slots = 0;
+
+	struct ThreadSlot {
+		~ThreadSlot() {
+			if(index >= 0) {
+				MutexLocker lock(s_slot_mutex);
+				s_free_slots.emplace_back(index);
+			}
+		}
+		// -1: not acquired yet; -2: no slots available
+		int index = -1;
+	};
+	thread_local ThreadSlot t_slot;
+
+	FWK_NO_INLINE int acquireSlot() {
+		MutexLocker lock(s_slot_mutex);
+		if(s_free_slots) {
+			t_slot.index = s_free_slots.back();
+			s_free_slots.pop_back();
+		} else {
+			t_slot.index =
+				s_num_slots < ConcurrentSlabAllocator::max_thread_slots ? s_num_slots++ : -2;
+		}
+		return t_slot.index;
+	}
+
+	constexpr int findFirstBit(u64 bits) { return __builtin_ctzll(bits); }
+}
+
+ConcurrentSlabAllocator::ConcurrentSlabAllocator(u64 default_zone_size)
+	: m_slabs(default_zone_size) {}
+ConcurrentSlabAllocator::ConcurrentSlabAllocator(u64 default_zone_size, ZoneAllocator zone_alloc)
+	: m_slabs(default_zone_size, zone_alloc) {}
+
+ConcurrentSlabAllocator::~ConcurrentSlabAllocator() {
+	for(auto &cache : m_caches)
+		delete cache.load(std::memory_order_acquire);
+	for(auto &level : m_levels)
+		for(auto &page : level.pages)
+			delete page.load(std::memory_order_acquire);
+}
+
+auto ConcurrentSlabAllocator::threadCache() -> ThreadCache * {
+	int slot = t_slot.index;
+	if(slot == -1)
+		slot = acquireSlot();
+	if(slot < 0)
+		return nullptr;
+
+	// Only the thread which owns the slot creates its cache
+	auto *cache = m_caches[slot].load(std::memory_order_relaxed);
+	if(!cache) {
+		cache = new ThreadCache;
+		m_caches[slot].store(cache, std::memory_order_release);
+	}
+	return cache;
+}
+
+auto ConcurrentSlabAllocator::groupInfo(Identifier ident) const -> GroupInfo & {
+	int group_id = ident.chunkGroupId();
+	auto &level = m_levels[ident.chunkLevelId()];
+	auto *page = level.pages[group_id / group_page_size].load(std::memory_order_acquire);
+	PASSERT(page);
+	return page->groups[group_id % group_page_size];
+}
+
+auto ConcurrentSlabAllocator::allocation(Identifier ident) const -> Allocation {
+	auto &info = groupInfo(ident);
+	u64 chunk_size = SlabAllocator::chunkSize(ident.chunkLevelId());
+	return {info.zone_id, info.offset + chunk_size * ident.chunkId(), chunk_size};
+}
+
+// Has to be called under the lock for every chunk returned by the backend
+void ConcurrentSlabAllocator::publish(Identifier ident, const Allocation &alloc) {
+	int group_id = ident.chunkGroupId();
+	auto &page_ref = m_levels[ident.chunkLevelId()].pages[group_id / group_page_size];
+	auto *page = page_ref.load(std::memory_order_relaxed);
+	if(!page) {
+		page = new GroupPage;
+		page_ref.store(page, std::memory_order_release);
+	}
+	auto &info = page->groups[group_id % group_page_size];
+	info.offset = alloc.offset - alloc.size * ident.chunkId();
+	info.zone_id = alloc.zone_id;
+}
+
+auto ConcurrentSlabAllocator::alloc(u64 size) -> Pair<Identifier, Allocation> {
+	if(size > SlabAllocator::maxChunkSize()) {
+		MutexLocker lock(m_mutex);
+		return m_slabs.alloc(size);
+	}
+
+	int level_id = SlabAllocator::findBestChunkLevel(size);
+	auto *cache = threadCache();
+	if(!cache) {
+		MutexLocker lock(m_mutex);
+		auto result = m_slabs.alloc(size);
+		if(result.first.isValid())
+			publish(result.first, result.second);
+		return result;
+	}
+
+	auto &level_cache = cache->levels[level_id];
+	if(!level_cache.count && !refill(*cache, level_id))
+		return {};
+	auto ident = level_cache.chunks[--level_cache.count];
+	return {ident, allocation(ident)};
+}
+
+void ConcurrentSlabAllocator::free(Identifier ident) {
+	if(ident.isSlabAlloc()) {
+		MutexLocker lock(m_mutex);
+		m_slabs.free(ident);
+		return;
+	}
+
+	if(auto *cache = threadCache()) {
+		auto &level_cache = cache->levels[ident.chunkLevelId()];
+		if(level_cache.count < cache_size) {
+			level_cache.chunks[level_cache.count++] = ident;
+			return;
+		}
+	}
+	freePending(ident);
+}
+
+// Pending bits are organized hierarchically (level -> page -> group -> chunk); a higher-level
+// bit is set when a lower-level word was empty, so every pending chunk can be reached.
+// Consumers clear higher-level bits before lower-level ones.
+void ConcurrentSlabAllocator::freePending(Identifier ident) {
+	int group_id = ident.chunkGroupId(), chunk_id = ident.chunkId();
+	int page_id = group_id / group_page_size, page_group_id = group_id % group_page_size;
+	auto &level = m_levels[ident.chunkLevelId()];
+	auto *page = level.pages[page_id].load(std::memory_order_acquire);
+	auto &info = page->groups[page_group_id];
+
+	auto &chunk_word = info.pending_chunks[chunk_id >> 6];
+	if(chunk_word.fetch_or(1ull << (chunk_id & 63), std::memory_order_release))
+		return;
+	auto &group_word = page->pending_groups[page_group_id >> 6];
+	if(group_word.fetch_or(1ull << (page_group_id & 63), std::memory_order_release))
+		return;
+	level.pending_pages[page_id >> 6].fetch_or(1ull << (page_id & 63), std::memory_order_release);
+}
+
+// Has to be called under the lock; Chunks which don't fit in the cache (or all of them, if
+// cache is null) are freed in the backend
+void ConcurrentSlabAllocator::takePending(int level_id, ThreadCache::Level *level_cache) {
+	auto &level = m_levels[level_id];
+	for(int pw = 0; pw < num_group_pages / 64; pw++) {
+		u64 page_bits = level.pending_pages[pw].exchange(0, std::memory_order_acquire);
+		while(page_bits) {
+			int page_id = (pw << 6) + findFirstBit(page_bits);
+			page_bits &= page_bits - 1;
+			auto *page = level.pages[page_id].load(std::memory_order_relaxed);
+
+			for(int gw = 0; gw < group_page_size / 64; gw++) {
+				u64 group_bits = page->pending_groups[gw].exchange(0, std::memory_order_acquire);
+				while(group_bits) {
+					int page_group_id = (gw << 6) + findFirstBit(group_bits);
+					group_bits &= group_bits - 1;
+					auto &info = page->groups[page_group_id];
+					int group_id = page_id * group_page_size + page_group_id;
+
+					for(int cw = 0; cw < max_group_words; cw++) {
+						u64 chunk_bits =
+							info.pending_chunks[cw].exchange(0, std::memory_order_acquire);
+						while(chunk_bits) {
+							int chunk_id = (cw << 6) + findFirstBit(chunk_bits);
+							chunk_bits &= chunk_bits - 1;
+							Identifier ident(chunk_id, group_id, level_id, 0);
+							if(level_cache && level_cache->count < cache_size)
+								level_cache->chunks[level_cache->count++] = ident;
+							else
+								m_slabs.free(ident);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+FWK_NO_INLINE bool ConcurrentSlabAllocator::refill(ThreadCache &cache, int level_id) {
+	MutexLocker lock(m_mutex);
+	auto &level_cache = cache.levels[level_id];
+	takePending(level_id, &level_cache);
+
+	u64 chunk_size = SlabAllocator::chunkSize(level_id);
+	while(level_cache.count < cache_size / 2) {
+		auto [ident, alloc] = m_slabs.alloc(chunk_size);
+		if(!ident.isValid())
+			break;
+		publish(ident, alloc);
+		level_cache.chunks[level_cache.count++] = ident;
+	}
+	return level_cache.count > 0;
+}
+
+void ConcurrentSlabAllocator::flush() {
+	MutexLocker lock(m_mutex);
+	for(auto &cache_ref : m_caches) {
+		auto *cache = cache_ref.load(std::memory_order_acquire);
+		if(!cache)
+			continue;
+		for(auto &level_cache : cache->levels) {
+			for(int n = 0; n < level_cache.count; n++)
+				m_slabs.free(level_cache.chunks[n]);
+			level_cache.count = 0;
+		}
+	}
+	for(int l = 0; l < num_chunk_levels; l++)
+		takePending(l, nullptr);
+}
+}
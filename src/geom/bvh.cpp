@@ -0,0 +1,336 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/geom/bvh.h"
+
+#include "fwk/gfx/mesh.h"
+#include "fwk/math/segment.h"
+
+namespace fwk {
+
+// SAH splits are used up to this depth; deeper nodes are split in the middle, so
+// depth of the tree (and size of traversal stack) is always limited
+static constexpr int max_sah_depth = 64;
+static constexpr int max_stack_size = max_sah_depth + 32 + 1;
+
+namespace {
+	// Box which may be empty (min > max)
+	struct Bounds {
+		Bounds() : min(inf), max(-inf) {}
+
+		void include(const FBox &box) {
+			min = vmin(min, box.min());
+			max = vmax(max, box.max());
+		}
+		void include(const float3 &point) {
+			min = vmin(min, point);
+			max = vmax(max, point);
+		}
+		void include(const Bounds &rhs) {
+			min = vmin(min, rhs.min);
+			max = vmax(max, rhs.max);
+		}
+
+		float surfaceArea() const {
+			if(!(min.x <= max.x))
+				return 0.0f;
+			float3 size = max - min;
+			return (size.x * size.y + size.y * size.z + size.x * size.z) * 2.0f;
+		}
+
+		float3 min, max;
+	};
+
+	struct Bin {
+		Bounds bounds;
+		int count = 0;
+	};
+
+	bool touches(const FBox &lhs, const FBox &rhs) {
+		return lhs.min(0) <= rhs.max(0) && rhs.min(0) <= lhs.max(0) && lhs.min(1) <= rhs.max(1) &&
+			   rhs.min(1) <= lhs.max(1) && lhs.min(2) <= rhs.max(2) && rhs.min(2) <= lhs.max(2);
+	}
+}
+
+struct Bvh::Builder {
+	Builder(Bvh &bvh, CSpan<FBox> boxes, const BvhConfig &config)
+		: bvh(bvh), boxes(boxes), config(config), bins(config.num_bins),
+		  right_costs(config.num_bins) {
+		DASSERT(config.max_leaf_size >= 1 && config.num_bins >= 2);
+		centers.reserve(boxes.size());
+		for(auto &box : boxes)
+			centers.emplace_back(box.center());
+		bvh.m_prim_indices.resize(boxes.size());
+		for(int n = 0; n < boxes.size(); n++)
+			bvh.m_prim_indices[n] = n;
+	}
+
+	struct Split {
+		float cost = inf;
+		int axis = -1, bin = 0;
+	};
+
+	// Finds best split with binned SAH; Returns axis = -1 if centroids cannot be separated
+	Split findSplit(int begin, int end, const Bounds &cbounds, float area) {
+		auto &indices = bvh.m_prim_indices;
+		int num_bins = bins.size();
+		Split best;
+
+		for(int axis = 0; axis < 3; axis++) {
+			float extent = cbounds.max[axis] - cbounds.min[axis];
+			if(!(extent > 0.0f))
+				continue;
+			float scale = float(num_bins) / extent;
+			for(auto &bin : bins)
+				bin = {};
+			for(int n = begin; n < end; n++) {
+				int idx = indices[n];
+				auto &bin = bins[binIndex(centers[idx][axis], cbounds.min[axis], scale)];
+				bin.bounds.include(boxes[idx]);
+				bin.count++;
+			}
+
+			// right_costs[b]: SAH cost of bins [b, num_bins) (without normalization)
+			Bounds right;
+			int right_count = 0;
+			for(int b = num_bins - 1; b > 0; b--) {
+				right.include(bins[b].bounds);
+				right_count += bins[b].count;
+				right_costs[b] = right.surfaceArea() * right_count;
+			}
+
+			Bounds left;
+			int left_count = 0;
+			for(int b = 1; b < num_bins; b++) {
+				left.include(bins[b - 1].bounds);
+				left_count += bins[b - 1].count;
+				if(left_count == 0 || left_count == end - begin)
+					continue;
+				float cost = config.traversal_cost +
+							 (left.surfaceArea() * left_count + right_costs[b]) / area;
+				if(cost < best.cost)
+					best = {cost, axis, b};
+			}
+		}
+		return best;
+	}
+
+	int binIndex(float value, float min, float scale) const {
+		return clamp(int((value - min) * scale), 0, bins.size() - 1);
+	}
+
+	// Node at node_idx has to be allocated
+	void build(int node_idx, int begin, int end, int depth) {
+		auto &indices = bvh.m_prim_indices;
+		Bounds bounds, cbounds;
+		for(int n = begin; n < end; n++) {
+			bounds.include(boxes[indices[n]]);
+			cbounds.include(centers[indices[n]]);
+		}
+
+		int count = end - begin;
+		bvh.m_nodes[node_idx] = {FBox(bounds.min, bounds.max), begin, count};
+		if(count == 1)
+			return;
+
+		float area = bounds.surfaceArea();
+		Split split;
+		if(depth < max_sah_depth && area > 0.0f)
+			split = findSplit(begin, end, cbounds, area);
+		if(count <= config.max_leaf_size && float(count) <= split.cost)
+			return;
+
+		int mid = begin;
+		if(split.axis != -1) {
+			int axis = split.axis;
+			float scale = float(bins.size()) / (cbounds.max[axis] - cbounds.min[axis]);
+			auto *it = std::partition(indices.data() + begin, indices.data() + end, [&](int idx) {
+				return binIndex(centers[idx][axis], cbounds.min[axis], scale) < split.bin;
+			});
+			mid = it - indices.data();
+		}
+		if(mid == begin || mid == end) {
+			// Median split along the longest axis
+			int axis = 0;
+			float3 extent = cbounds.max - cbounds.min;
+			for(int a = 1; a < 3; a++)
+				if(extent[a] > extent[axis])
+					axis = a;
+			mid = (begin + end) / 2;
+			std::nth_element(indices.data() + begin, indices.data() + mid, indices.data() + end,
+							 [&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+		}
+
+		int first_child = bvh.m_nodes.size();
+		bvh.m_nodes[node_idx].first = first_child;
+		bvh.m_nodes[node_idx].count = 0;
+		bvh.m_nodes.resize(first_child + 2);
+		build(first_child, begin, mid, depth + 1);
+		build(first_child + 1, mid, end, depth + 1);
+	}
+
+	Bvh &bvh;
+	CSpan<FBox> boxes;
+	const BvhConfig &config;
+	vector<Bin> bins;
+	vector<float> right_costs;
+	vector<float3> centers;
+};
+
+Bvh::Bvh(CSpan<FBox> boxes, BvhConfig config) {
+	if(boxes.empty())
+		return;
+	m_nodes.reserve(max(1, boxes.size() / config.max_leaf_size) * 2);
+	m_nodes.resize(1);
+	Builder(*this, boxes, config).build(0, 0, boxes.size(), 0);
+	m_boxes = transform(m_prim_indices, [&](int idx) { return boxes[idx]; });
+}
+
+Bvh::Bvh(CSpan<Triangle3F> tris, BvhConfig config)
+	: Bvh(transform(tris, [](const Triangle3F &tri) { return enclose(tri); }), config) {
+	m_tris = transform(m_prim_indices, [&](int idx) { return tris[idx]; });
+}
+
+Bvh::Bvh(const Mesh &mesh, BvhConfig config) : Bvh(mesh.tris(), config) {}
+
+void Bvh::refit(CSpan<FBox> boxes) {
+	DASSERT(boxes.size() == size());
+	for(int n = 0; n < m_boxes.size(); n++)
+		m_boxes[n] = boxes[m_prim_indices[n]];
+	refitNodes();
+}
+
+void Bvh::refit(CSpan<Triangle3F> tris) {
+	DASSERT(tris.size() == size());
+	if(m_tris.size() != tris.size())
+		m_tris.resize(tris.size());
+	for(int n = 0; n < m_boxes.size(); n++) {
+		m_tris[n] = tris[m_prim_indices[n]];
+		m_boxes[n] = enclose(m_tris[n]);
+	}
+	refitNodes();
+}
+
+// Children always come after their parents
+void Bvh::refitNodes() {
+	for(int n = m_nodes.size() - 1; n >= 0; n--) {
+		auto &node = m_nodes[n];
+		Bounds bounds;
+		if(node.isLeaf()) {
+			for(int i = node.first; i < node.first + node.count; i++)
+				bounds.include(m_boxes[i]);
+		} else {
+			bounds.include(m_nodes[node.first].bbox);
+			bounds.include(m_nodes[node.first + 1].bbox);
+		}
+		node.bbox = {bounds.min, bounds.max};
+	}
+}
+
+template <bool any_hit> Maybe<BvhHit> Bvh::traverse(const Segment3F &segment) const {
+	DASSERT(hasTriangles());
+	if(m_nodes.empty())
+		return none;
+
+	float3 origin = segment.from, dir = segment.dir(), inv_dir;
+	// Zero components are replaced, so that there are no NaNs in slab tests
+	for(int n = 0; n < 3; n++)
+		inv_dir[n] = 1.0f / (dir[n] == 0.0f ? 1e-30f : dir[n]);
+
+	BvhHit best{inf, -1};
+	float max_param = 1.0f;
+	// Returns entry parameter; inf if box isn't hit before max_param
+	auto isectBox = [&](const FBox &box) {
+		float3 t1 = (box.min() - origin) * inv_dir, t2 = (box.max() - origin) * inv_dir;
+		float3 tmin = vmin(t1, t2), tmax = vmax(t1, t2);
+		float enter = max(max(tmin.x, tmin.y), max(tmin.z, 0.0f));
+		// Exit is slightly enlarged, so that rounding errors don't cull any hits
+		float exit = min(min(tmax.x, tmax.y), tmax.z) * 1.0000004f;
+		return enter <= min(exit, max_param) ? enter : float(inf);
+	};
+
+	int stack[max_stack_size], stack_size = 0;
+	if(isectBox(m_nodes[0].bbox) == inf)
+		return none;
+	stack[stack_size++] = 0;
+
+	while(stack_size > 0) {
+		auto &node = m_nodes[stack[--stack_size]];
+		if(node.isLeaf()) {
+			for(int n = node.first; n < node.first + node.count; n++) {
+				float param = segment.isectParam(m_tris[n]).first.closest();
+				if(param < best.param) {
+					best = {param, m_prim_indices[n]};
+					max_param = param;
+					if constexpr(any_hit)
+						return best;
+				}
+			}
+			continue;
+		}
+
+		// Closer child is visited first
+		int child0 = node.first, child1 = node.first + 1;
+		float dist0 = isectBox(m_nodes[child0].bbox), dist1 = isectBox(m_nodes[child1].bbox);
+		if(dist1 < dist0) {
+			swap(dist0, dist1);
+			swap(child0, child1);
+		}
+		if(dist1 != inf)
+			stack[stack_size++] = child1;
+		if(dist0 != inf)
+			stack[stack_size++] = child0;
+		PASSERT(stack_size <= max_stack_size);
+	}
+
+	if(best.index == -1)
+		return none;
+	return best;
+}
+
+Maybe<BvhHit> Bvh::closestHit(const Segment3F &segment) const { return traverse<false>(segment); }
+bool Bvh::anyHit(const Segment3F &segment) const { return !!traverse<true>(segment); }
+
+vector<int> Bvh::overlapping(const FBox &box) const {
+	vector<int> out;
+	if(m_nodes.empty())
+		return out;
+
+	int stack[max_stack_size], stack_size = 0;
+	stack[stack_size++] = 0;
+	while(stack_size > 0) {
+		auto &node = m_nodes[stack[--stack_size]];
+		if(!touches(node.bbox, box))
+			continue;
+		if(node.isLeaf()) {
+			for(int n = node.first; n < node.first + node.count; n++)
+				if(touches(m_boxes[n], box))
+					out.emplace_back(m_prim_indices[n]);
+		} else {
+			stack[stack_size++] = node.first + 1;
+			stack[stack_size++] = node.first;
+		}
+	}
+	return out;
+}
+
+int Bvh::depth() const {
+	if(m_nodes.empty())
+		return 0;
+	// Children come after parents, so depths can be computed in a single pass
+	vector<int> depths(m_nodes.size(), 1);
+	int out = 1;
+	for(int n = 0; n < m_nodes.size(); n++) {
+		auto &node = m_nodes[n];
+		if(!node.isLeaf())
+			depths[node.first] = depths[node.first + 1] = depths[n] + 1;
+		out = max(out, depths[n]);
+	}
+	return out;
+}
+
+i64 Bvh::usedMemory() const {
+	return m_nodes.usedMemory() + m_prim_indices.usedMemory() + m_boxes.usedMemory() +
+		   m_tris.usedMemory();
+}
+}
@@ -48,9 +48,8 @@ vector<VertexIdPair> delaunay(const Voronoi &voronoi) {
 vector<VertexIdPair> delaunay(SparseSpan<int2> points) { return Voronoi::delaunay(points); }
 
 template <c_float_vec<2> T> Ex<vector<VertexIdPair>> delaunay(CSpan<T> points) {
-	auto scale = delaunayIntegralScale(points);
-	auto ipoints = EX_PASS(toIntegral(points, scale));
-	return Voronoi::delaunay(ipoints);
+	auto result = EX_PASS(delaunayTriangulation(points));
+	return std::move(result.edges);
 }
 
 bool isPositiveConvexQuad(CSpan<int2, 4> corners) {
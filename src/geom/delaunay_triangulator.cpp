@@ -0,0 +1,338 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/geom/delaunay.h"
+
+#include "fwk/algorithm.h"
+#include "fwk/index_range.h"
+#include "fwk/math/box.h"
+#include "fwk/math/qint.h"
+#include "fwk/sys/assert.h"
+#include "fwk/vector.h"
+
+namespace fwk {
+
+namespace {
+	// Position of a point on Hilbert curve covering [0; 2^16)^2
+	u32 hilbertIndex(u32 x, u32 y) {
+		u32 out = 0;
+		for(u32 s = 1u << 15; s > 0; s >>= 1) {
+			u32 rx = (x & s) > 0, ry = (y & s) > 0;
+			out += s * s * ((3 * rx) ^ ry);
+			if(ry == 0) {
+				if(rx == 1) {
+					x = s - 1 - x;
+					y = s - 1 - y;
+				}
+				swap(x, y);
+			}
+		}
+		return out;
+	}
+
+	llint orient(const int2 &a, const int2 &b, const int2 &c) {
+		return cross<llint2>(b - a, c - a);
+	}
+}
+
+// Bowyer-Watson triangulator (see: Shewchuk, "Lecture Notes on Delaunay Mesh Generation").
+//
+// Convex hull is closed with ghost triangles: each of them contains a single hull edge and
+// a ghost vertex at infinity; thanks to them, points outside of the hull are handled just like
+// the points inside. Circumcircle of a ghost triangle is the open half-plane on the outer side
+// of its edge, together with the open segment of the edge.
+class DelaunayTriangulator {
+  public:
+	static constexpr int ghost = -1;
+
+	// Vertices are in CCW order; n[i] is the neighbour across edge (v[i], v[i + 1]).
+	// In ghost triangles the ghost vertex is always the last one.
+	struct Tri {
+		bool isGhost() const { return v[2] == ghost; }
+
+		int v[3];
+		int n[3];
+	};
+
+	DelaunayTriangulator(CSpan<int2> points) : m_points(points) {
+		for(auto &pt : points)
+			DASSERT(max(std::abs(pt.x), std::abs(pt.y)) <= delaunay_integral_resolution);
+	}
+
+	void run() {
+		auto order = insertionOrder();
+		if(!initialize(order))
+			return;
+		m_stamps.resize(m_tris.size(), -1);
+		for(int idx : order)
+			if(idx != m_init[0] && idx != m_init[1] && idx != m_init[2])
+				insert(idx);
+	}
+
+	DelaunayTriangulation extract() const {
+		DelaunayTriangulation out;
+		if(m_tris.empty()) {
+			out.edges = m_collinear_edges;
+			return out;
+		}
+
+		int num_dead = m_free_list.size();
+		int num_ghosts = 0;
+		for(int t : intRange(m_tris))
+			num_ghosts += m_stamps[t] != dead_stamp && m_tris[t].isGhost();
+		int num_solid = m_tris.size() - num_dead - num_ghosts;
+		// Euler: E = 3 * T_solid / 2 + hull_edges / 2
+		out.tris.reserve(num_solid);
+		out.edges.reserve((num_solid * 3 + num_ghosts) / 2);
+
+		for(int t : intRange(m_tris)) {
+			if(m_stamps[t] == dead_stamp)
+				continue;
+			auto &tri = m_tris[t];
+			if(!tri.isGhost())
+				out.tris.push_back({tri.v[0], tri.v[1], tri.v[2]});
+			for(int i : intRange(tri.isGhost() ? 1 : 3)) {
+				int v0 = tri.v[i], v1 = tri.v[i == 2 ? 0 : i + 1];
+				if(v0 < v1)
+					out.edges.emplace_back(VertexId(v0), VertexId(v1));
+			}
+		}
+		return out;
+	}
+
+  private:
+	static constexpr int dead_stamp = -2;
+
+	vector<int> insertionOrder() const {
+		auto bbox = enclose(m_points);
+		auto size = vmax(bbox.size(), int2(1, 1));
+		// Points are sorted by position on Hilbert curve; this way consecutive points are
+		// close to each other & point location is fast
+		vector<Pair<u32, int>> keys(m_points.size());
+		for(int n : intRange(m_points)) {
+			auto pos = llint2(m_points[n] - bbox.min()) * 65535;
+			u32 x = u32(pos.x / size.x), y = u32(pos.y / size.y);
+			keys[n] = {hilbertIndex(x, y), n};
+		}
+		std::sort(keys.begin(), keys.end());
+		return transform(keys, [](auto &pair) { return pair.second; });
+	}
+
+	// Creates first solid triangle (with 3 ghosts) from first 3 non-collinear points.
+	// If there are no such points, only edges between collinear points are generated.
+	bool initialize(CSpan<int> order) {
+		if(order.size() < 2)
+			return false;
+
+		int first = order[0], second = -1, third = -1;
+		for(int idx : order) {
+			if(second == -1) {
+				if(m_points[idx] != m_points[first])
+					second = idx;
+			} else if(orient(m_points[first], m_points[second], m_points[idx]) != 0) {
+				third = idx;
+				break;
+			}
+		}
+
+		if(third == -1) {
+			if(second != -1)
+				initCollinear(order);
+			return false;
+		}
+
+		if(orient(m_points[first], m_points[second], m_points[third]) < 0)
+			swap(second, third);
+		int a = first, b = second, c = third;
+		m_init = {a, b, c};
+		m_tris.reserve(m_points.size() * 2 + 2);
+		m_tris.push_back({{a, b, c}, {1, 2, 3}});
+		m_tris.push_back({{b, a, ghost}, {0, 3, 2}});
+		m_tris.push_back({{c, b, ghost}, {0, 1, 3}});
+		m_tris.push_back({{a, c, ghost}, {0, 2, 1}});
+		m_last = 0;
+		return true;
+	}
+
+	void initCollinear(CSpan<int> order) {
+		// Ties are broken by index, so that from duplicated points the one with lowest
+		// index is kept (just like in the general case)
+		vector<int> sorted = order;
+		std::sort(sorted.begin(), sorted.end(), [&](int a, int b) {
+			return Pair(m_points[a], a) < Pair(m_points[b], b);
+		});
+		int prev = sorted[0];
+		for(int n = 1; n < sorted.size(); n++) {
+			int cur = sorted[n];
+			if(m_points[prev] == m_points[cur])
+				continue;
+			m_collinear_edges.emplace_back(VertexId(min(prev, cur)), VertexId(max(prev, cur)));
+			prev = cur;
+		}
+	}
+
+	int2 point(int idx) const { return m_points[idx]; }
+
+	// Is point inside circumcircle of given triangle?
+	bool conflicts(const Tri &tri, const int2 &p) const {
+		if(tri.isGhost()) {
+			auto a = point(tri.v[0]), b = point(tri.v[1]);
+			auto side = orient(a, b, p);
+			if(side != 0)
+				return side > 0;
+			// Strictly between a & b
+			return dot<llint2>(a - p, b - p) < 0;
+		}
+		return insideCircumcircle(point(tri.v[0]), point(tri.v[1]), point(tri.v[2]), p);
+	}
+
+	// Visibility walk; Returns triangle whose circumcircle contains p or -1 if p is a duplicate
+	int locate(const int2 &p) const {
+		int cur = m_last, step = 0;
+		while(true) {
+			auto &tri = m_tris[cur];
+			if(tri.isGhost()) {
+				if(conflicts(tri, p))
+					return cur;
+				cur = tri.n[0];
+				continue;
+			}
+
+			int next = -1;
+			// Starting edge is rotated, so that the walk cannot get stuck in a cycle
+			for(int j = 0; j < 3; j++) {
+				int i = (j + step) % 3;
+				if(orient(point(tri.v[i]), point(tri.v[i == 2 ? 0 : i + 1]), p) < 0) {
+					next = tri.n[i];
+					break;
+				}
+			}
+			step++;
+			if(next == -1) {
+				for(int v : tri.v)
+					if(point(v) == p)
+						return -1;
+				return cur;
+			}
+			cur = next;
+		}
+	}
+
+	int allocTri() {
+		if(m_free_list) {
+			int out = m_free_list.back();
+			m_free_list.pop_back();
+			return out;
+		}
+		m_tris.emplace_back();
+		m_stamps.emplace_back(-1);
+		return m_tris.size() - 1;
+	}
+
+	void insert(int idx) {
+		auto p = point(idx);
+		int seed = locate(p);
+		if(seed == -1)
+			return;
+
+		// Finding all triangles in conflict with p (they form a star-shaped cavity)
+		m_cavity.clear();
+		m_boundary.clear();
+		m_cavity.emplace_back(seed);
+		m_stamps[seed] = idx;
+		for(int n = 0; n < m_cavity.size(); n++) {
+			int t = m_cavity[n];
+			for(int i = 0; i < 3; i++) {
+				int nb = m_tris[t].n[i];
+				if(m_stamps[nb] == idx)
+					continue;
+				if(conflicts(m_tris[nb], p)) {
+					m_stamps[nb] = idx;
+					m_cavity.emplace_back(nb);
+				} else {
+					auto &tri = m_tris[t];
+					m_boundary.emplace_back(tri.v[i], tri.v[i == 2 ? 0 : i + 1], nb);
+				}
+			}
+		}
+
+		for(int t : m_cavity) {
+			m_stamps[t] = dead_stamp;
+			m_free_list.emplace_back(t);
+		}
+
+		// Cavity is re-triangulated with triangles (v0, v1, p) created for each boundary edge
+		m_new_tris.clear();
+		for(auto [v0, v1, outer] : m_boundary) {
+			int t = allocTri();
+			m_stamps[t] = -1;
+			auto &tri = m_tris[t];
+			if(v0 == ghost)
+				tri = {{v1, idx, ghost}, {-1, -1, outer}};
+			else if(v1 == ghost)
+				tri = {{idx, v0, ghost}, {-1, outer, -1}};
+			else
+				tri = {{v0, v1, idx}, {outer, -1, -1}};
+
+			auto &otri = m_tris[outer];
+			otri.n[edgeStartingAt(otri, v1)] = t;
+			m_new_tris.emplace_back(v0, t);
+		}
+
+		// Linking new triangles with each other: triangle starting at v1 is the neighbour
+		// across edge (v1, p)
+		for(auto [v0, t] : m_new_tris) {
+			auto &tri = m_tris[t];
+			int edge = edgeStartingAt(tri, idx);
+			int v1 = tri.v[edge == 0 ? 2 : edge - 1];
+			int nb = -1;
+			for(auto [nv0, nt] : m_new_tris)
+				if(nv0 == v1) {
+					nb = nt;
+					break;
+				}
+			DASSERT(nb != -1);
+			tri.n[edge == 0 ? 2 : edge - 1] = nb;
+			m_tris[nb].n[edgeStartingAt(m_tris[nb], idx)] = t;
+		}
+
+		m_last = m_new_tris[0].second;
+	}
+
+	static int edgeStartingAt(const Tri &tri, int vertex) {
+		return tri.v[0] == vertex ? 0 : tri.v[1] == vertex ? 1 : 2;
+	}
+
+	CSpan<int2> m_points;
+	vector<Tri> m_tris;
+	// Last insertion which visited given triangle; dead_stamp for free triangles
+	vector<int> m_stamps;
+	vector<int> m_free_list;
+	vector<VertexIdPair> m_collinear_edges;
+	array<int, 3> m_init = {-1, -1, -1};
+	int m_last = 0;
+
+	// Temporary data used during insertion
+	struct BoundaryEdge {
+		int v0, v1, outer;
+	};
+	vector<int> m_cavity;
+	vector<BoundaryEdge> m_boundary;
+	vector<Pair<int>> m_new_tris;
+};
+
+DelaunayTriangulation delaunayTriangulation(CSpan<int2> points) {
+	DelaunayTriangulator triangulator(points);
+	triangulator.run();
+	return triangulator.extract();
+}
+
+template <c_float_vec<2> T> Ex<DelaunayTriangulation> delaunayTriangulation(CSpan<T> points) {
+	auto scale = delaunayIntegralScale(points);
+	auto ipoints = EX_PASS(toIntegral(points, scale));
+	return delaunayTriangulation(ipoints);
+}
+
+template Ex<DelaunayTriangulation> delaunayTriangulation(CSpan<float2>);
+template Ex<DelaunayTriangulation> delaunayTriangulation(CSpan<double2>);
+}
@@ -3,6 +3,8 @@
 
 #include "fwk/geom/geom_graph.h"
 
+#include "fwk/geom/kd_tree.h"
+#include "fwk/geom/procgen.h"
 #include "fwk/geom/segment_grid.h"
 #include "fwk/math/direction.h"
 #include "fwk/math/random.h"
@@ -350,6 +352,8 @@ template <class T> auto GeomGraph<T>::makeGrid() const -> Grid {
 	}
 }
 
+template <class T> auto GeomGraph<T>::makeKdTree() const -> KdTree { return KdTree(points()); }
+
 // TODO: computation in 3D or pass Axes2D?
 template <class T> vector<EdgeId> GeomGraph<T>::findIntersectors() const {
 	vector<EdgeId> out;
@@ -451,10 +455,7 @@ vector<double2> GeomGraph<T>::randomPoints(Random &random, double min_dist,
 		auto pt = ugrid.toWorld(pos) + random.sampleBox(double2(0), double2(1)) * ugrid.cellSize();
 
 		int idx = pos.x + pos.y * ugrid.width();
-		int indices[4] = {idx - 1, idx - ugrid.width(), idx - ugrid.width() - 1,
-						  idx - ugrid.width() + 1};
-
-		if(allOf(indices, [&](int idx) { return distanceSq(points[idx], pt) >= min_dist_sq; }))
+		if(poissonDiskTest<double2>(points, ugrid.size(), pos, pt, min_dist_sq))
 			if(!grid.closestEdge(Vec2(pt), min_dist)) {
 				points[idx] = pt;
 				out.emplace_back(pt);
@@ -377,7 +377,7 @@ Graph Graph::minimumSpanningTree(CSpan<T> edge_weights, bool as_undirected) cons
 		return {};
 
 	vector<EdgeId> out;
-	Heap<T> heap(numVerts());
+	Heap<T> heap(vertsSpread());
 
 	vector<bool> processed(vertsSpread(), false);
 	vector<Maybe<VertexId>> pi(vertsSpread());
@@ -413,7 +413,7 @@ Graph Graph::minimumSpanningTree(CSpan<T> edge_weights, bool as_undirected) cons
 }
 
 Graph Graph::shortestPathTree(CSpan<VertexId> sources, CSpan<double> weights) const {
-	Heap<double> heap(numVerts());
+	Heap<double> heap(vertsSpread());
 	vector<double> keys(vertsSpread(), inf);
 
 	if(!weights.empty()) {
@@ -422,11 +422,12 @@ Graph Graph::shortestPathTree(CSpan<VertexId> sources, CSpan<double> weights) co
 			DASSERT_GE(weights[eid], 0.0);
 	}
 
-	for(auto src_id : sources)
+	// Only reached vertices are kept in the heap
+	for(auto src_id : sources) {
 		keys[src_id] = 0.0;
-	for(auto node_id : vertexIds())
-		heap.insert(node_id, keys[node_id]);
-	vector<bool> visited(numVerts(), false);
+		heap.update(src_id, 0.0);
+	}
+	vector<bool> visited(vertsSpread(), false);
 
 	vector<Maybe<VertexId>> out(vertsSpread());
 
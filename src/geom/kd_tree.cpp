@@ -0,0 +1,284 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/geom/kd_tree.h"
+
+#include <limits>
+
+namespace fwk {
+
+namespace {
+	template <class DistSq, class Scalar> DistSq squared(const Maybe<Scalar> &dist) {
+		if(!dist) {
+			if constexpr(is_fpt<DistSq>)
+				return std::numeric_limits<DistSq>::infinity();
+			else
+				return std::numeric_limits<DistSq>::max();
+		}
+		return DistSq(*dist) * DistSq(*dist);
+	}
+}
+
+template <class T> struct KdTree<T>::Builder {
+	Builder(KdTree &tree, CSpan<T> points, int max_leaf_size)
+		: tree(tree), points(points), max_leaf_size(max_leaf_size) {
+		DASSERT(max_leaf_size >= 1);
+	}
+
+	// Node at node_idx has to be allocated
+	void build(int node_idx, int begin, int end) {
+		auto &order = tree.m_indices;
+		T bmin = points[order[begin]], bmax = bmin;
+		for(int n = begin + 1; n < end; n++) {
+			bmin = vmin(bmin, points[order[n]]);
+			bmax = vmax(bmax, points[order[n]]);
+		}
+
+		int axis = 0;
+		DistSq max_extent = DistSq(bmax[0]) - DistSq(bmin[0]);
+		for(int a = 1; a < dim<T>; a++) {
+			DistSq extent = DistSq(bmax[a]) - DistSq(bmin[a]);
+			if(extent > max_extent) {
+				max_extent = extent;
+				axis = a;
+			}
+		}
+
+		int count = end - begin;
+		if(count <= max_leaf_size || max_extent == DistSq(0)) {
+			tree.m_nodes[node_idx] = {Scalar(0), -1, begin, count};
+			return;
+		}
+
+		int mid = (begin + end) / 2;
+		std::nth_element(&order[begin], &order[mid], &order[begin] + count,
+						 [&](int a, int b) { return points[a][axis] < points[b][axis]; });
+
+		int first_child = tree.m_nodes.size();
+		tree.m_nodes[node_idx] = {points[order[mid]][axis], axis, first_child, 0};
+		tree.m_nodes.resize(first_child + 2);
+		build(first_child, begin, mid);
+		build(first_child + 1, mid, end);
+	}
+
+	KdTree &tree;
+	CSpan<T> points;
+	int max_leaf_size;
+};
+
+template <class T> KdTree<T>::KdTree(SparseSpan<T> points, int max_leaf_size) {
+	if(points.empty())
+		return;
+
+	// Source points are gathered into a dense array first; m_indices is used as a permutation
+	vector<T> dense_points;
+	vector<int> source_indices;
+	dense_points.reserve(points.size());
+	source_indices.reserve(points.size());
+	for(auto idx : points.indices()) {
+		dense_points.emplace_back(points[idx]);
+		source_indices.emplace_back(idx);
+	}
+
+	m_indices.resize(dense_points.size());
+	for(int n = 0; n < m_indices.size(); n++)
+		m_indices[n] = n;
+	m_nodes.reserve(max(1, dense_points.size() / max_leaf_size) * 2 + 1);
+	m_nodes.resize(1);
+	Builder(*this, dense_points, max_leaf_size).build(0, 0, dense_points.size());
+
+	m_points.resize(dense_points.size());
+	for(int n = 0; n < m_indices.size(); n++) {
+		m_points[n] = dense_points[m_indices[n]];
+		m_indices[n] = source_indices[m_indices[n]];
+	}
+}
+
+template <class T>
+Maybe<int> KdTree<T>::closest(const Point &point, Maybe<Scalar> max_dist,
+							  Maybe<int> ignore) const {
+	using PPoint = PromoteIntegral<T>;
+	if(m_nodes.empty())
+		return none;
+
+	DistSq best_dist = squared<DistSq>(max_dist);
+	int best_idx = -1;
+
+	// Nodes are visited together with lower bounds of their distance
+	Pair<int, DistSq> stack[max_stack_size];
+	int stack_size = 0;
+	stack[stack_size++] = {0, DistSq(0)};
+
+	while(stack_size > 0) {
+		auto [node_idx, node_dist] = stack[--stack_size];
+		// Nodes at the same distance are visited as well, so that ties are resolved properly
+		if(node_dist > best_dist)
+			continue;
+		auto &node = m_nodes[node_idx];
+
+		if(node.isLeaf()) {
+			for(int n = node.first; n < node.first + node.count; n++) {
+				int idx = m_indices[n];
+				if(idx == ignore)
+					continue;
+				auto dist = distanceSq<PPoint>(point, m_points[n]);
+				if(dist < best_dist || (dist == best_dist && idx < best_idx)) {
+					best_dist = dist;
+					best_idx = idx;
+				}
+			}
+			continue;
+		}
+
+		DistSq diff = DistSq(point[node.axis]) - DistSq(node.split);
+		int near_idx = node.first + (diff >= DistSq(0)), far_idx = node.first + (diff < DistSq(0));
+		stack[stack_size++] = {far_idx, max(node_dist, diff * diff)};
+		stack[stack_size++] = {near_idx, node_dist};
+		PASSERT(stack_size <= max_stack_size);
+	}
+
+	if(best_idx == -1)
+		return none;
+	return best_idx;
+}
+
+template <class T>
+vector<int> KdTree<T>::kClosest(const Point &point, int k, Maybe<Scalar> max_dist) const {
+	using PPoint = PromoteIntegral<T>;
+	DASSERT(k >= 0);
+	if(m_nodes.empty() || k == 0)
+		return {};
+
+	// Max-heap of k best (distance, index) pairs
+	vector<Pair<DistSq, int>> heap;
+	heap.reserve(k);
+	DistSq max_dist_sq = squared<DistSq>(max_dist);
+	auto limit = [&] { return heap.size() == k ? heap.front().first : max_dist_sq; };
+
+	Pair<int, DistSq> stack[max_stack_size];
+	int stack_size = 0;
+	stack[stack_size++] = {0, DistSq(0)};
+
+	while(stack_size > 0) {
+		auto [node_idx, node_dist] = stack[--stack_size];
+		if(node_dist > limit())
+			continue;
+		auto &node = m_nodes[node_idx];
+
+		if(node.isLeaf()) {
+			for(int n = node.first; n < node.first + node.count; n++) {
+				Pair<DistSq, int> elem(distanceSq<PPoint>(point, m_points[n]), m_indices[n]);
+				if(heap.size() < k) {
+					if(elem.first < max_dist_sq) {
+						heap.emplace_back(elem);
+						std::push_heap(heap.begin(), heap.end());
+					}
+				} else if(elem < heap.front()) {
+					std::pop_heap(heap.begin(), heap.end());
+					heap.back() = elem;
+					std::push_heap(heap.begin(), heap.end());
+				}
+			}
+			continue;
+		}
+
+		DistSq diff = DistSq(point[node.axis]) - DistSq(node.split);
+		int near_idx = node.first + (diff >= DistSq(0)), far_idx = node.first + (diff < DistSq(0));
+		stack[stack_size++] = {far_idx, max(node_dist, diff * diff)};
+		stack[stack_size++] = {near_idx, node_dist};
+		PASSERT(stack_size <= max_stack_size);
+	}
+
+	std::sort_heap(heap.begin(), heap.end());
+	return transform(heap, [](auto &pair) { return pair.second; });
+}
+
+template <class T> vector<int> KdTree<T>::withinRadius(const Point &point, Scalar radius) const {
+	using PPoint = PromoteIntegral<T>;
+	vector<int> out;
+	if(m_nodes.empty())
+		return out;
+
+	DistSq radius_sq = squared<DistSq>(Maybe<Scalar>(radius));
+	Pair<int, DistSq> stack[max_stack_size];
+	int stack_size = 0;
+	stack[stack_size++] = {0, DistSq(0)};
+
+	while(stack_size > 0) {
+		auto [node_idx, node_dist] = stack[--stack_size];
+		if(node_dist > radius_sq)
+			continue;
+		auto &node = m_nodes[node_idx];
+
+		if(node.isLeaf()) {
+			for(int n = node.first; n < node.first + node.count; n++)
+				if(distanceSq<PPoint>(point, m_points[n]) <= radius_sq)
+					out.emplace_back(m_indices[n]);
+			continue;
+		}
+
+		DistSq diff = DistSq(point[node.axis]) - DistSq(node.split);
+		int near_idx = node.first + (diff >= DistSq(0)), far_idx = node.first + (diff < DistSq(0));
+		stack[stack_size++] = {far_idx, max(node_dist, diff * diff)};
+		stack[stack_size++] = {near_idx, node_dist};
+		PASSERT(stack_size <= max_stack_size);
+	}
+	return out;
+}
+
+template <class T> vector<int> KdTree<T>::inside(const Box &box) const {
+	vector<int> out;
+	if(m_nodes.empty())
+		return out;
+
+	int stack[max_stack_size], stack_size = 0;
+	stack[stack_size++] = 0;
+	while(stack_size > 0) {
+		auto &node = m_nodes[stack[--stack_size]];
+		if(node.isLeaf()) {
+			for(int n = node.first; n < node.first + node.count; n++) {
+				auto &point = m_points[n];
+				bool is_inside = true;
+				for(int a = 0; a < dim<T>; a++)
+					is_inside &= point[a] >= box.min(a) && point[a] <= box.max(a);
+				if(is_inside)
+					out.emplace_back(m_indices[n]);
+			}
+			continue;
+		}
+
+		if(box.max(node.axis) >= node.split)
+			stack[stack_size++] = node.first + 1;
+		if(box.min(node.axis) <= node.split)
+			stack[stack_size++] = node.first;
+		PASSERT(stack_size <= max_stack_size);
+	}
+	return out;
+}
+
+template <class T> int KdTree<T>::depth() const {
+	if(m_nodes.empty())
+		return 0;
+	// Children come after parents, so depths can be computed in a single pass
+	vector<int> depths(m_nodes.size(), 1);
+	int out = 1;
+	for(int n = 0; n < m_nodes.size(); n++) {
+		auto &node = m_nodes[n];
+		if(!node.isLeaf())
+			depths[node.first] = depths[node.first + 1] = depths[n] + 1;
+		out = max(out, depths[n]);
+	}
+	return out;
+}
+
+template <class T> i64 KdTree<T>::usedMemory() const {
+	return m_nodes.usedMemory() + m_points.usedMemory() + m_indices.usedMemory();
+}
+
+template class KdTree<int2>;
+template class KdTree<float2>;
+template class KdTree<double2>;
+template class KdTree<int3>;
+template class KdTree<float3>;
+template class KdTree<double3>;
+}
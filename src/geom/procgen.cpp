@@ -53,10 +53,7 @@ template <c_vec<2> T> vector<T> randomPoints(Random &random, Box<T> rect, double
 		auto pt = ugrid.toWorld(pos) + random.sampleBox(T(), T(1, 1)) * ugrid.cellSize();
 
 		int idx = pos.x + pos.y * ugrid.width();
-		int indices[4] = {idx - 1, idx - ugrid.width(), idx - ugrid.width() - 1,
-						  idx - ugrid.width() + 1};
-
-		if(allOf(indices, [&](int idx) { return distanceSq(points[idx], pt) >= min_dist_sq; })) {
+		if(poissonDiskTest<T>(points, ugrid.size(), pos, pt, min_dist_sq)) {
 			points[idx] = pt;
 			out.emplace_back(pt);
 		}
@@ -5,7 +5,9 @@
 
 #include "fwk/index_range.h"
 #include "fwk/math/box_iter.h"
+#include "fwk/parallel_algorithm.h"
 #include "fwk/sparse_span.h"
+#include <atomic>
 
 namespace fwk {
 SquareBorder::SquareBorder(IRect rect, int2 center, int radius) {
@@ -101,82 +103,264 @@ template <class T> auto SegmentGrid<T>::bestGrid(SparseSpan<T> points, int num_e
 	return {rect, cell_size, 1};
 }
 
+template <class T>
+template <class Func>
+void SegmentGrid<T>::edgeCells(EdgeId eid, const Func &func) const {
+	auto &edge = m_edges[eid];
+	Segment seg(m_points[edge.first], m_points[edge.second]);
+	auto cell_rect = toCell(enclose(seg));
+	bool single_cell = cell_rect.width() == 1 || cell_rect.height() == 1;
+
+	for(auto cell_pos : cells(cell_rect)) {
+		auto cidx = index(cell_pos);
+		PASSERT(cidx >= 0 && cidx < m_cells.size());
+		if(single_cell || seg.testIsect(m_grid.toWorldRect(cell_pos)))
+			func(int(cidx));
+	}
+}
+
 template <class T>
 void SegmentGrid<T>::initialize(SparseSpan<Pair<VertexId>> edges, SparseSpan<Point> points) {
-	m_grid = bestGrid(points, edges.size());
 	m_edges = edges;
 	m_points = points;
-	m_cells.resize(m_grid.width() * m_grid.height());
-	for(auto pt : points)
-		m_cells[index(toCell(pt))].num_verts++;
-
-	vector<int> seg_cell_indices;
-	PodVector<int> seg_cell_offsets(edges.spread()), seg_cell_counts(edges.spread());
-	seg_cell_indices.reserve(edges.size() * 2);
-
-	for(auto eid : edges.indices()) {
-		auto &edge = edges[eid];
-		Segment seg(points[edge.first], points[edge.second]);
-		auto cell_rect = toCell(enclose(seg));
-		bool single_cell = cell_rect.width() == 1 || cell_rect.height() == 1;
-		seg_cell_offsets[eid] = seg_cell_indices.size();
-
-		for(auto cell_pos : cells(cell_rect)) {
-			auto cidx = index(cell_pos);
-			PASSERT(cidx >= 0 && cidx < m_cells.size());
-			auto &cell = m_cells[cidx];
-
-			if(single_cell || seg.testIsect(m_grid.toWorldRect(cell_pos))) {
-				seg_cell_indices.emplace_back(cidx);
-				cell.num_edges++;
+	PodVector<int> vert_ids(points.size()), edge_ids(edges.size());
+	int count = 0;
+	for(auto id : points.indices())
+		vert_ids[count++] = id;
+	count = 0;
+	for(auto id : edges.indices())
+		edge_ids[count++] = id;
+	build(vert_ids, edge_ids);
+}
+
+// Counting sort of cell indices. Elements are split into chunks which are processed in
+// parallel; Counters are incremented atomically, so order of indices within cells has to
+// be fixed at the end.
+template <class T> void SegmentGrid<T>::build(CSpan<int> vert_ids, CSpan<int> edge_ids) {
+	m_grid = bestGrid(m_points, m_edges.size());
+	int num_cells = m_grid.width() * m_grid.height();
+	m_cells.clear();
+	m_cells.resize(num_cells);
+	m_num_unused_indices = 0;
+
+	int num_verts = vert_ids.size(), num_elems = num_verts + edge_ids.size();
+	auto *jobs = JobSystem::instance();
+	bool is_parallel = m_config.parallel && jobs && jobs->numThreads() > 1 &&
+					   num_elems >= parallel_min_grain * 2;
+	int grain = is_parallel ? detail::parallelGrain(num_elems, 0) : max(num_elems, 1);
+	int num_chunks = (num_elems + grain - 1) / grain;
+	auto increment = [is_parallel](int &value) {
+		return is_parallel ? std::atomic_ref<int>(value).fetch_add(1, std::memory_order_relaxed)
+						   : value++;
+	};
+
+	// Vertices: cell indices; Edges: number of cells & cell indices (kept in chunks)
+	PodVector<int> vert_cells(num_verts), edge_counts(edge_ids.size());
+	vector<vector<int>> chunk_cells(num_chunks);
+	detail::forEachChunk(num_elems, grain, [&](int chunk_id, int begin, int end) {
+		auto &ccells = chunk_cells[chunk_id];
+		for(int n = begin; n < end; n++) {
+			if(n < num_verts) {
+				int cidx = index(toCell(m_points[vert_ids[n]]));
+				PASSERT(cidx >= 0 && cidx < m_cells.size());
+				vert_cells[n] = cidx;
+				increment(m_cells[cidx].num_verts);
+			} else {
+				int prev_count = ccells.size();
+				edgeCells(EdgeId(edge_ids[n - num_verts]), [&](int cidx) {
+					ccells.emplace_back(cidx);
+					increment(m_cells[cidx].num_edges);
+				});
+				edge_counts[n - num_verts] = ccells.size() - prev_count;
 			}
 		}
-
-		seg_cell_counts[eid] = seg_cell_indices.size() - seg_cell_offsets[eid];
-	}
+	});
 
 	int cur_index = 0;
 	for(auto &cell : m_cells) {
 		cell.first_index = cur_index;
-		cur_index += cell.num_verts + cell.num_edges;
-		cell.num_verts = 0;
-		cell.num_edges = 0;
-	}
-
-	m_cell_indices.resize(cur_index + points.size() + 1);
-	for(auto id : points.indices()) {
-		auto &cell = m_cells[index(toCell(points[id]))];
-		int idx = cell.first_index + cell.num_verts++;
-		m_cell_indices[idx] = id;
+		cell.capacity = cell.num_verts + cell.num_edges + m_config.cell_slack;
+		cur_index += cell.capacity;
 	}
-
-	for(auto eid : edges.indices()) {
-		int first = seg_cell_offsets[eid];
-		for(int n : intRange(seg_cell_counts[eid])) {
-			int cidx = seg_cell_indices[first + n];
-			auto &cell = m_cells[cidx];
-			int idx = cell.first_index + int(cell.num_verts) + cell.num_edges++;
-			m_cell_indices[idx] = eid;
+	m_cell_indices.resize(cur_index);
+
+	PodVector<int> vert_offsets(num_cells), edge_offsets(num_cells);
+	fill(vert_offsets, 0);
+	fill(edge_offsets, 0);
+	detail::forEachChunk(num_elems, grain, [&](int chunk_id, int begin, int end) {
+		const int *ccells = chunk_cells[chunk_id].data();
+		for(int n = begin; n < end; n++) {
+			if(n < num_verts) {
+				int cidx = vert_cells[n];
+				int idx = m_cells[cidx].first_index + increment(vert_offsets[cidx]);
+				m_cell_indices[idx] = vert_ids[n];
+			} else {
+				int eid = edge_ids[n - num_verts];
+				for(int i = edge_counts[n - num_verts]; i > 0; i--) {
+					int cidx = *ccells++;
+					auto &cell = m_cells[cidx];
+					int idx = cell.first_index + cell.num_verts + increment(edge_offsets[cidx]);
+					m_cell_indices[idx] = eid;
+				}
+			}
 		}
+	});
+
+	if(is_parallel) {
+		int cell_grain = detail::parallelGrain(num_cells, 0);
+		detail::forEachChunk(num_cells, cell_grain, [&](int, int begin, int end) {
+			for(int n = begin; n < end; n++) {
+				auto &cell = m_cells[n];
+				auto *ptr = m_cell_indices.data() + cell.first_index;
+				std::sort(ptr, ptr + cell.num_verts);
+				std::sort(ptr + cell.num_verts, ptr + cell.num_verts + cell.num_edges);
+			}
+		});
 	}
 
-	//	print("points:% segs:% cells:% (%) insts:%\n", points.size(), edges.size(), m_cells.size(),
+	//	print("points:% segs:% cells:% (%) insts:%\n", num_verts, edge_ids.size(), m_cells.size(),
 	//			 size(), m_cell_indices.size());
 }
 
+// Grid is rebuilt with all elements which are currently in cells & new elements
 template <class T>
-SegmentGrid<T>::SegmentGrid(SparseSpan<Pair<VertexId>> edges, SparseSpan<Point> points) {
+void SegmentGrid<T>::rebuild(Maybe<VertexId> new_vert, Maybe<EdgeId> new_edge) {
+	vector<int> vert_ids, edge_ids;
+	for(auto &cell : m_cells) {
+		auto *ptr = m_cell_indices.data() + cell.first_index;
+		insertBack(vert_ids, span(ptr, cell.num_verts).template reinterpret<int>());
+		insertBack(edge_ids, span(ptr + cell.num_verts, cell.num_edges).template reinterpret<int>());
+	}
+	if(new_vert)
+		vert_ids.emplace_back(*new_vert);
+	if(new_edge)
+		edge_ids.emplace_back(*new_edge);
+	makeSorted(vert_ids);
+	makeSortedUnique(edge_ids);
+	build(vert_ids, edge_ids);
+}
+
+template <class T>
+SegmentGrid<T>::SegmentGrid(SparseSpan<Pair<VertexId>> edges, SparseSpan<Point> points,
+							SegmentGridConfig config)
+	: m_config(config) {
+	DASSERT(config.cell_slack >= 0);
 	initialize(edges, points);
 }
 
 template <class T>
 SegmentGrid<T>::SegmentGrid(SparseSpan<Pair<VertexId>> edges, PodVector<Point> points,
-							CSpan<bool> valids, int psize)
-	: m_points_buffer(std::move(points)) {
+							CSpan<bool> valids, int psize, SegmentGridConfig config)
+	: m_points_buffer(std::move(points)), m_config(config) {
+	DASSERT(config.cell_slack >= 0);
 	SparseSpan<Point> pspan(m_points_buffer.data(), valids, psize);
 	initialize(edges, pspan);
 }
 
+template <class T>
+void SegmentGrid<T>::setSources(SparseSpan<Pair<VertexId>> edges, SparseSpan<Point> points) {
+	m_edges = edges;
+	m_points = points;
+}
+
+template <class T> void SegmentGrid<T>::insert(VertexId id) {
+	DASSERT(m_points.valid(id));
+	auto cell_pos = toCell(m_points[id]);
+	if(!inRange(cell_pos))
+		return rebuild(id, none);
+	addIndex(index(cell_pos), id, true);
+}
+
+template <class T> void SegmentGrid<T>::insert(EdgeId id) {
+	DASSERT(m_edges.valid(id));
+	auto [v1, v2] = m_edges[id];
+	if(!inRange(toCell(m_points[v1])) || !inRange(toCell(m_points[v2])))
+		return rebuild(none, id);
+	edgeCells(id, [&](int cidx) { addIndex(cidx, id, false); });
+}
+
+template <class T> void SegmentGrid<T>::remove(VertexId id) {
+	DASSERT(m_points.valid(id));
+	removeIndex(index(toCell(m_points[id])), id, true);
+}
+
+template <class T> void SegmentGrid<T>::remove(EdgeId id) {
+	DASSERT(m_edges.valid(id));
+	edgeCells(id, [&](int cidx) { removeIndex(cidx, id, false); });
+}
+
+// Vertices are kept before edges; if a vertex is inserted, first edge is moved to the end
+template <class T>
+void SegmentGrid<T>::addIndex(int cell_idx, VertexId::Base value, bool is_vert) {
+	auto &cell = m_cells[cell_idx];
+	int count = cell.num_verts + cell.num_edges;
+	if(count == cell.capacity) {
+		int new_capacity = max(4, cell.capacity * 2);
+		int new_first = m_cell_indices.size();
+		m_cell_indices.resize(new_first + new_capacity);
+		copy(span(m_cell_indices.data() + new_first, count),
+			 span(m_cell_indices.data() + cell.first_index, count));
+		m_num_unused_indices += cell.capacity;
+		cell.first_index = new_first;
+		cell.capacity = new_capacity;
+	}
+
+	auto *ptr = m_cell_indices.data() + cell.first_index;
+	if(is_vert) {
+		ptr[count] = ptr[cell.num_verts];
+		ptr[cell.num_verts++] = value;
+	} else {
+		ptr[count] = value;
+		cell.num_edges++;
+	}
+
+	if(m_num_unused_indices > m_cell_indices.size() / 2)
+		compact();
+}
+
+template <class T>
+void SegmentGrid<T>::removeIndex(int cell_idx, VertexId::Base value, bool is_vert) {
+	auto &cell = m_cells[cell_idx];
+	auto *ptr = m_cell_indices.data() + cell.first_index;
+	int last = cell.num_verts + cell.num_edges - 1;
+
+	if(is_vert) {
+		int pos = 0;
+		while(pos < cell.num_verts && ptr[pos] != value)
+			pos++;
+		DASSERT(pos < cell.num_verts);
+		ptr[pos] = ptr[cell.num_verts - 1];
+		ptr[cell.num_verts - 1] = ptr[last];
+		cell.num_verts--;
+	} else {
+		int pos = cell.num_verts;
+		while(pos <= last && ptr[pos] != value)
+			pos++;
+		DASSERT(pos <= last);
+		ptr[pos] = ptr[last];
+		cell.num_edges--;
+	}
+}
+
+template <class T> void SegmentGrid<T>::compact() {
+	int total = 0;
+	for(auto &cell : m_cells)
+		total += cell.num_verts + cell.num_edges + m_config.cell_slack;
+
+	vector<VertexId::Base> new_indices(total);
+	int cur_index = 0;
+	for(auto &cell : m_cells) {
+		int count = cell.num_verts + cell.num_edges;
+		copy(span(new_indices.data() + cur_index, count),
+			 span(m_cell_indices.data() + cell.first_index, count));
+		cell.first_index = cur_index;
+		cell.capacity = count + m_config.cell_slack;
+		cur_index += cell.capacity;
+	}
+	m_cell_indices.swap(new_indices);
+	m_num_unused_indices = 0;
+}
+
 template <class T> vector<int2> SegmentGrid<T>::traceSlow(const Segment &seg) const {
 	vector<int2> out;
 
@@ -375,6 +559,7 @@ template <class T>
 Maybe<EdgeId> SegmentGrid<T>::closestEdge(const Point &point, Scalar min_dist) const {
 	auto cell_pos = vclamp(toCell(point), int2(0, 0), size() - int2(1, 1));
 	using Dist = decltype(Segment().distanceSq(Point()));
+	using PScalar = PromoteIntegral<Scalar>;
 	Dist min_dist_sq = Dist(min_dist) * min_dist;
 	Pair<Dist, Maybe<EdgeId>> closest = {min_dist_sq, none};
 
@@ -388,14 +573,14 @@ Maybe<EdgeId> SegmentGrid<T>::closestEdge(const Point &point, Scalar min_dist) c
 
 	// TODO: small static hashmap for visited segments?
 	for(int radius : intRange(1, max_radius)) {
-		Scalar cur_dist_sq = inf;
+		auto cur_dist_sq = std::numeric_limits<PScalar>::max();
 
 		SquareBorder square(m_grid.cellRect(), cell_pos, radius);
 		for(auto sq_pos : square) {
-			auto cell_dist_sq = m_grid.toWorldRect(sq_pos).distanceSq(point);
+			PScalar cell_dist_sq = m_grid.toWorldRect(sq_pos).distanceSq(point);
 			cur_dist_sq = min(cur_dist_sq, cell_dist_sq);
 
-			if(cell_dist_sq < min_dist)
+			if(Dist(cell_dist_sq) < closest.first)
 				for(auto eid : cellEdges(sq_pos))
 					if(closest.second != eid) {
 						auto [v1, v2] = m_edges[eid];
@@ -405,7 +590,7 @@ Maybe<EdgeId> SegmentGrid<T>::closestEdge(const Point &point, Scalar min_dist) c
 		}
 
 		//	print("radius:% min:% cur:% found:%\n", radius, min_dist, cur_dist, closest);
-		if(cur_dist_sq > min_dist)
+		if(Dist(cur_dist_sq) >= closest.first)
 			break;
 	}
 
@@ -433,11 +618,11 @@ Maybe<VertexId> SegmentGrid<T>::closestVertex(const Point &point, Scalar min_dis
 	// TODO: small static hashmap for visited segments?
 
 	for(int radius : intRange(1, max_radius)) {
-		Scalar cur_dist_sq = inf;
+		auto cur_dist_sq = std::numeric_limits<PScalar>::max();
 
 		SquareBorder square(m_grid.cellRect(), cell_pos, radius);
 		for(auto sq_pos : square) {
-			auto cell_dist_sq = m_grid.toWorldRect(sq_pos).distanceSq(point);
+			PScalar cell_dist_sq = m_grid.toWorldRect(sq_pos).distanceSq(point);
 			cur_dist_sq = min(cur_dist_sq, cell_dist_sq);
 
 			if(cell_dist_sq >= closest.first)
@@ -451,7 +636,7 @@ Maybe<VertexId> SegmentGrid<T>::closestVertex(const Point &point, Scalar min_dis
 		}
 
 		//	print("radius:% min:% cur:% found:%\n", radius, min_dist, cur_dist, closest);
-		if(cur_dist_sq > min_dist_sq)
+		if(cur_dist_sq >= closest.first)
 			break;
 	}
 
@@ -15,11 +15,11 @@ namespace fwk {
 
 Voronoi::Voronoi(GeomGraph<double2> graph, vector<Cell> cells)
 	: graph(std::move(graph)), cells(std::move(cells)) {
-	for(auto &cell : cells) {
-		if(EdgeId *eid = cell)
-			DASSERT(graph.valid(*eid));
-		else if(VertexId *vid = cell)
-			DASSERT(graph.valid(*vid));
+	for(auto &cell : this->cells) {
+		if(const EdgeId *eid = cell)
+			DASSERT(this->graph.valid(*eid));
+		else if(const VertexId *vid = cell)
+			DASSERT(this->graph.valid(*vid));
 	}
 	// TODO: validate labels?
 	// TODO: verify arcs
@@ -77,6 +77,43 @@ Maybe<CellId> Voronoi::findClosestCell(double2 pos) const {
 	return out;
 }
 
+VoronoiCellIndex::VoronoiCellIndex(const Voronoi &voronoi) : m_voronoi(voronoi) {
+	vector<double2> site_points;
+	for(auto cell_id : indexRange<CellId>(voronoi.cells)) {
+		auto &cell = voronoi.cells[cell_id];
+		if(cell.is<EdgeId>()) {
+			m_edge_site_cells.emplace_back(cell_id);
+		} else if(const VertexId *vid = cell) {
+			site_points.emplace_back(voronoi.graph(*vid));
+			m_vert_site_cells.emplace_back(cell_id);
+		}
+	}
+	m_vert_sites = KdTree<double2>(site_points);
+}
+
+Maybe<CellId> VoronoiCellIndex::findClosestCell(double2 pos) const {
+	auto &graph = m_voronoi.graph;
+	auto &cells = m_voronoi.cells;
+	Maybe<CellId> out;
+	double min_dist = inf;
+
+	// In case of equal distances, cells generated by vertices are preferred
+	if(auto idx = m_vert_sites.closest(pos)) {
+		out = m_vert_site_cells[*idx];
+		const VertexId *vid = cells[*out];
+		min_dist = distanceSq(pos, graph(*vid));
+	}
+	for(auto cell_id : m_edge_site_cells) {
+		const EdgeId *eid = cells[cell_id];
+		double dist = graph(*eid).distanceSq(pos);
+		if(dist < min_dist) {
+			out = cell_id;
+			min_dist = dist;
+		}
+	}
+	return out;
+}
+
 Maybe<RectSide> sideId(const DRect &rect, const double2 &point) {
 	if(point.x == rect.ex())
 		return RectSide::right;
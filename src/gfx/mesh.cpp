@@ -93,6 +93,19 @@ vector<Triangle3F> Mesh::tris() const {
 	return out;
 }
 
+vector<Triangle3F> Mesh::tris(const AnimatedData &anim_data) const {
+	if(anim_data.empty())
+		return tris();
+	DASSERT(valid(anim_data));
+
+	vector<Triangle3F> out;
+	out.reserve(triangleCount());
+	const auto &verts = anim_data.positions;
+	for(const auto &inds : trisIndices())
+		out.emplace_back(verts[inds[0]], verts[inds[1]], verts[inds[2]]);
+	return out;
+}
+
 vector<ColoredTriangle> Mesh::coloredTris(CSpan<IColor> colors) const {
 	vector<ColoredTriangle> out;
 	out.reserve(triangleCount());
@@ -315,7 +328,7 @@ float Mesh::intersect(const Segment3<float> &segment, const AnimatedData &anim_d
 
 	float min_isect = inf;
 	if(segment.isectParam(anim_data.bounding_box))
-		for(const auto &tri : tris())
+		for(const auto &tri : tris(anim_data))
 			min_isect = min(min_isect, segment.isectParam(tri).first.closest());
 	return min_isect;
 }
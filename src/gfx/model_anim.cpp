@@ -91,7 +91,7 @@ Ex<ModelAnim> ModelAnim::load(CXmlNode node, const Pose &default_pose) {
 
 	auto channel_node = node.child("channel");
 	while(channel_node) {
-		out.m_node_names.emplace_back(channel_node("name"));
+		out.m_node_names.emplace_back(channel_node.attrib("name"));
 		channel_node.next();
 	}
 
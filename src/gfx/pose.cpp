@@ -5,39 +5,43 @@
 
 namespace fwk {
 
-static auto makeNameMap(const vector<string> &names) {
-	vector<Pair<string, int>> out(names.size());
+static auto makeNameMap(CSpan<Atom> names) {
+	vector<Pair<Atom, int>> out(names.size());
 	for(int n = 0; n < names.size(); n++)
 		out[n] = {names[n], n};
 	std::sort(begin(out), end(out));
 	return out;
 }
 
+static auto makeAtoms(const vector<string> &names) {
+	return transform(names, [](const string &name) { return Atom(name); });
+}
+
 Pose::Pose(vector<Matrix4> transforms, NameMap name_map)
 	: m_name_map(std::move(name_map)), m_transforms(std::move(transforms)) {
 	DASSERT(m_transforms.size() == m_name_map.size());
 }
-Pose::Pose(vector<Matrix4> transforms, const vector<string> &names)
+Pose::Pose(vector<Matrix4> transforms, CSpan<Atom> names)
 	: Pose(std::move(transforms), makeNameMap(names)) {}
+Pose::Pose(vector<Matrix4> transforms, const vector<string> &names)
+	: Pose(std::move(transforms), makeAtoms(names)) {}
 
-vector<int> Pose::mapNames(const vector<string> &names) const {
-	auto dst_map = makeNameMap(names);
-	int src_index = 0;
+vector<int> Pose::mapNames(CSpan<Atom> names) const {
 	vector<int> out(names.size());
-
-	for(int n = 0; n < dst_map.size(); n++) {
-		const string &name = dst_map[n].first;
-		while(m_name_map[src_index].first != name) {
-			src_index++;
-			if(src_index == m_name_map.size())
-				FWK_FATAL("Cannot find node in pose: %s", name.c_str());
-		}
-
-		out[dst_map[n].second] = m_name_map[src_index++].second;
+	auto compare = [](const Pair<Atom, int> &pair, Atom name) { return pair.first < name; };
+	for(int n = 0; n < names.size(); n++) {
+		auto it = std::lower_bound(begin(m_name_map), end(m_name_map), names[n], compare);
+		if(it == end(m_name_map) || it->first != names[n])
+			FWK_FATAL("Cannot find node in pose: %s", names[n].c_str());
+		out[n] = it->second;
 	}
 	return out;
 }
 
+vector<int> Pose::mapNames(const vector<string> &names) const {
+	return mapNames(makeAtoms(names));
+}
+
 vector<Matrix4> Pose::mapTransforms(const vector<int> &mapping) const {
 	vector<Matrix4> out;
 	out.reserve(mapping.size());
@@ -62,7 +62,7 @@ struct ShaderCompiler::Impl {
 	vector<Error> include_errors;
 	vector<FilePath> current_paths;
 
-	HashMap<string, ShaderDefId> shader_def_map;
+	HashMap<string, ShaderDefId, StrHashPolicy> shader_def_map;
 	SparseVector<ShaderDefinitionEx> shader_defs;
 	vector<Pair<ShaderDefId, string>> messages;
 
@@ -11,7 +11,7 @@ namespace fwk {
 
 HashMapStats::HashMapStats() = default;
 
-HashMapStats::HashMapStats(CSpan<u32> hashes) {
+HashMapStats::HashMapStats(CSpan<u32> hashes, HashMapProbing probing, int group_size) {
 	constexpr u32 unused_hash = ~0u, deleted_hash = ~1u;
 
 	vector<u32> hash_set;
@@ -21,6 +21,9 @@ HashMapStats::HashMapStats(CSpan<u32> hashes) {
 	uint capacity_mask = capacity - 1;
 	vector<int> lengths(hashes.size(), 0);
 
+	// With robin hood probing hit length is simply the distance from home bucket
+	bool robin_hood = probing == HashMapProbing::robin_hood;
+
 	for(int n = 0; n < hashes.size(); n++) {
 		if(hashes[n] == unused_hash) {
 			num_unused++;
@@ -31,6 +34,27 @@ HashMapStats::HashMapStats(CSpan<u32> hashes) {
 		else
 			num_deleted++;
 
+		if(robin_hood) {
+			int length = ((n - hashes[n]) & capacity_mask) + 1;
+			lengths[n] = length;
+			max_hit_sequence_length = max(max_hit_sequence_length, length);
+			continue;
+		}
+
+		if(group_size > 1) {
+			// Number of groups visited until we get to n-th bucket
+			if(hashes[n] == deleted_hash)
+				continue;
+			uint group_mask = capacity_mask / group_size;
+			uint group = (hashes[n] & capacity_mask) / group_size;
+			int length = 1;
+			while(group != uint(n / group_size))
+				group = (group + length++) & group_mask;
+			lengths[n] = length;
+			max_hit_sequence_length = max(max_hit_sequence_length, length);
+			continue;
+		}
+
 		int idx = n;
 		int num_probes = 1;
 		int length = 1;
@@ -45,9 +69,9 @@ HashMapStats::HashMapStats(CSpan<u32> hashes) {
 	}
 
 	double avg_len = 0.0;
-	for(auto hash : hashes)
-		if(hash < deleted_hash) {
-			int start_idx = hash & capacity_mask;
+	for(int n = 0; n < hashes.size(); n++)
+		if(hashes[n] < deleted_hash) {
+			int start_idx = robin_hood || group_size > 1 ? n : hashes[n] & capacity_mask;
 			avg_len += lengths[start_idx];
 		}
 	avg_hit_sequence_length = avg_len / numUsed();
@@ -73,6 +97,7 @@ void HashMapStats::print(bool print_occ_map) const {
 		   numOccupied(), occupied_percent, num_deleted, num_unused);
 	printf("            distinct hashes: %d (%.2f%%)\n", num_distinct_hashes, distinct_percent);
 	printf("  average hit search length: %.2f\n", avg_hit_sequence_length);
+	printf("      max hit search length: %d\n", max_hit_sequence_length);
 	if(used_memory)
 		printf("                used memory: %lld KB\n", used_memory / 1024);
 
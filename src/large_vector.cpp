@@ -0,0 +1,195 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/large_vector.h"
+
+#include "fwk/sys/memory.h"
+
+namespace fwk {
+
+static constexpr i64 huge_page_size = 2 * 1024 * 1024;
+
+i64 largeVectorGrowCapacity(i64 capacity, int obj_size) {
+	if(capacity == 0)
+		return obj_size > 64 ? 1 : 64 / obj_size;
+	i64 num_bytes = capacity * obj_size;
+	i64 new_capacity = num_bytes < 64 * 1024 * 1024 ? capacity * 2 : capacity + capacity / 2;
+	if(new_capacity * obj_size >= huge_page_size) {
+		i64 new_bytes = (new_capacity * obj_size + huge_page_size - 1) & ~(huge_page_size - 1);
+		new_capacity = new_bytes / obj_size;
+	}
+	return new_capacity;
+}
+
+i64 largeVectorInsertCapacity(i64 capacity, int obj_size, i64 min_size) {
+	i64 cap = largeVectorGrowCapacity(capacity, obj_size);
+	return cap > min_size ? cap : min_size;
+}
+
+void LargeBaseVector::alloc(VectorElem elem, i64 size_, i64 capacity_) {
+	size = size_;
+	capacity = capacity_;
+	size_t num_bytes = size_t(capacity) * elem.size;
+	if(num_bytes >= detail::g_large_alloc_threshold.load(std::memory_order_relaxed))
+		if((data = (char *)allocateLarge(num_bytes)))
+			return;
+	data = (char *)(elem.alignment ? fwk::allocate(num_bytes, elem.alignment)
+								   : fwk::allocate(num_bytes));
+}
+
+static bool growLarge(LargeBaseVector &vec, VectorElem elem, i64 new_capacity) {
+	if(!maybeLargeAllocation(vec.data, size_t(vec.capacity) * elem.size))
+		return false;
+	auto *new_data = (char *)reallocateLarge(vec.data, size_t(new_capacity) * elem.size);
+	if(!new_data)
+		return false;
+	vec.data = new_data;
+	vec.capacity = new_capacity;
+	return true;
+}
+
+void LargeBaseVector::grow(VectorElem elem, MoveDestroyFunc func) {
+	reallocate(elem, func, largeVectorGrowCapacity(capacity, elem.size));
+}
+void LargeBaseVector::growPod(VectorElem elem) {
+	reallocatePod(elem, largeVectorGrowCapacity(capacity, elem.size));
+}
+
+void LargeBaseVector::reallocate(VectorElem elem, MoveDestroyFunc move_destroy_func,
+								 i64 new_capacity) {
+	if(new_capacity <= capacity)
+		return;
+
+	LargeBaseVector temp;
+	temp.alloc(elem, size, new_capacity);
+	move_destroy_func(temp.data, data, size);
+	swap(temp);
+	temp.free(elem);
+}
+
+void LargeBaseVector::resizePartial(VectorElem elem, DestroyFunc destroy_func,
+									MoveDestroyFunc move_destroy_func, i64 new_size) {
+	PASSERT(new_size >= 0);
+	if(new_size > capacity)
+		reallocate(elem, move_destroy_func,
+				   largeVectorInsertCapacity(capacity, elem.size, new_size));
+
+	if(size > new_size)
+		destroy_func(data + size_t(elem.size) * new_size, size - new_size);
+	size = new_size;
+}
+
+void LargeBaseVector::assignPartial(VectorElem elem, DestroyFunc destroy_func, i64 new_size) {
+	clear(destroy_func);
+	if(new_size > capacity) {
+		LargeBaseVector temp;
+		temp.alloc(elem, new_size, largeVectorInsertCapacity(capacity, elem.size, new_size));
+		swap(temp);
+		temp.free(elem);
+		return;
+	}
+	size = new_size;
+}
+
+void LargeBaseVector::insertPartial(VectorElem elem, MoveDestroyFunc move_destroy_func, i64 index,
+									i64 count) {
+	DASSERT(index >= 0 && index <= size);
+	i64 new_size = size + count;
+	if(new_size > capacity)
+		reallocate(elem, move_destroy_func,
+				   largeVectorInsertCapacity(capacity, elem.size, new_size));
+
+	i64 move_count = size - index;
+	if(move_count > 0)
+		move_destroy_func(data + size_t(elem.size) * (index + count),
+						  data + size_t(elem.size) * index, move_count);
+	size = new_size;
+}
+
+void LargeBaseVector::clear(DestroyFunc destroy_func) {
+	destroy_func(data, size);
+	size = 0;
+}
+
+void LargeBaseVector::erase(VectorElem elem, DestroyFunc destroy_func,
+							MoveDestroyFunc move_destroy_func, i64 index, i64 count) {
+	DASSERT(index >= 0 && count >= 0 && index + count <= size);
+	if(!count)
+		return;
+
+	i64 move_count = size - index - count;
+	destroy_func(data + size_t(elem.size) * index, count);
+	move_destroy_func(data + size_t(elem.size) * index, data + size_t(elem.size) * (index + count),
+					  move_count);
+	size -= count;
+}
+
+void LargeBaseVector::reallocatePod(VectorElem elem, i64 new_capacity) {
+	if(new_capacity <= capacity || growLarge(*this, elem, new_capacity))
+		return;
+
+	LargeBaseVector temp;
+	temp.alloc(elem, size, new_capacity);
+	if(size)
+		memcpy(temp.data, data, size_t(elem.size) * size);
+	swap(temp);
+	temp.free(elem);
+}
+
+void LargeBaseVector::reservePod(VectorElem elem, i64 desired_capacity) {
+	if(desired_capacity > capacity)
+		reallocatePod(elem, largeVectorInsertCapacity(capacity, elem.size, desired_capacity));
+}
+
+void LargeBaseVector::reserve(VectorElem elem, MoveDestroyFunc func, i64 desired_capacity) {
+	if(desired_capacity > capacity)
+		reallocate(elem, func, largeVectorInsertCapacity(capacity, elem.size, desired_capacity));
+}
+
+void LargeBaseVector::resizePodPartial(VectorElem elem, i64 new_size) {
+	PASSERT(new_size >= 0);
+	if(new_size > capacity)
+		reallocatePod(elem, largeVectorInsertCapacity(capacity, elem.size, new_size));
+	size = new_size;
+}
+
+void LargeBaseVector::assignPartialPod(VectorElem elem, i64 new_size) {
+	size = 0;
+	if(new_size > capacity) {
+		LargeBaseVector temp;
+		temp.alloc(elem, new_size, largeVectorInsertCapacity(capacity, elem.size, new_size));
+		swap(temp);
+		temp.free(elem);
+		return;
+	}
+	size = new_size;
+}
+
+void LargeBaseVector::insertPodPartial(VectorElem elem, i64 index, i64 count) {
+	DASSERT(index >= 0 && index <= size);
+	i64 new_size = size + count;
+	if(new_size > capacity)
+		reallocatePod(elem, largeVectorInsertCapacity(capacity, elem.size, new_size));
+
+	i64 move_count = size - index;
+	if(move_count > 0)
+		memmove(data + size_t(elem.size) * (index + count), data + size_t(elem.size) * index,
+				size_t(elem.size) * move_count);
+	size = new_size;
+}
+
+void LargeBaseVector::erasePod(VectorElem elem, i64 index, i64 count) {
+	DASSERT(index >= 0 && count >= 0 && index + count <= size);
+	i64 move_count = size - index - count;
+	if(move_count > 0)
+		memmove(data + size_t(elem.size) * index, data + size_t(elem.size) * (index + count),
+				size_t(elem.size) * move_count);
+	size -= count;
+}
+
+void LargeBaseVector::invalidIndex(i64 index) const {
+	FWK_FATAL("Index %lld out of range: <%d; %lld)", index, 0, size);
+}
+
+void LargeBaseVector::invalidEmpty() const { FWK_FATAL("Accessing empty vector"); }
+}
@@ -11,8 +11,6 @@
 
 namespace fwk {
 
-static constexpr RealConstant<NumberType::rational> isect_epsilon = 0.000000001;
-
 /*
 Ray::Ray(const Matrix4 &screen_to_world, const float2 &screen_pos) {
 	float3 p1 = mulPoint(screen_to_world, float3(screen_pos.x, screen_pos.y, 0.0f));
@@ -116,7 +114,7 @@ IsectParam<T> Ray<T, N>::isectParam(const Triangle<T, N> &tri) const {
 	T det = dot(e1, vp);
 
 	// if determinant is near zero, ray lies in plane of triangle
-	if(!(det < T(-isect_epsilon) || det > T(isect_epsilon))) {
+	if(!(det < T(-ray_isect_epsilon) || det > T(ray_isect_epsilon))) {
 		// TODO: fix this...
 		return {};
 	}
@@ -0,0 +1,307 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/math/ray_packet.h"
+
+#include "fwk/math/box.h"
+#include "fwk/math/ray.h"
+#include "fwk/math/triangle.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace fwk {
+
+namespace {
+	// All lane types have the same interface, so kernels can be written only once.
+	// min & max have the same semantics as fwk::min & fwk::max (also for NaNs).
+	struct Float1 {
+		using Mask = bool;
+		static constexpr int width = 1;
+
+		Float1(float v) : v(v) {}
+		static Float1 load(const float *ptr) { return *ptr; }
+		void store(float *ptr) const { *ptr = v; }
+		static int bits(bool mask) { return mask ? 1 : 0; }
+
+		Float1 operator+(Float1 rhs) const { return v + rhs.v; }
+		Float1 operator-(Float1 rhs) const { return v - rhs.v; }
+		Float1 operator*(Float1 rhs) const { return v * rhs.v; }
+		Float1 operator/(Float1 rhs) const { return v / rhs.v; }
+		bool operator<(Float1 rhs) const { return v < rhs.v; }
+		bool operator>(Float1 rhs) const { return v > rhs.v; }
+		bool operator<=(Float1 rhs) const { return v <= rhs.v; }
+		bool operator>=(Float1 rhs) const { return v >= rhs.v; }
+		friend Float1 min(Float1 a, Float1 b) { return a.v < b.v ? a : b; }
+		friend Float1 max(Float1 a, Float1 b) { return b.v < a.v ? a : b; }
+
+		float v;
+	};
+
+#if defined(__SSE2__)
+	struct Float4 {
+		struct Mask {
+			Mask operator&(Mask rhs) const { return {_mm_and_ps(v, rhs.v)}; }
+			Mask operator|(Mask rhs) const { return {_mm_or_ps(v, rhs.v)}; }
+			__m128 v;
+		};
+		static constexpr int width = 4;
+
+		Float4(__m128 v) : v(v) {}
+		Float4(float f) : v(_mm_set1_ps(f)) {}
+		static Float4 load(const float *ptr) { return _mm_load_ps(ptr); }
+		void store(float *ptr) const { _mm_store_ps(ptr, v); }
+		static int bits(Mask mask) { return _mm_movemask_ps(mask.v); }
+
+		Float4 operator+(Float4 rhs) const { return _mm_add_ps(v, rhs.v); }
+		Float4 operator-(Float4 rhs) const { return _mm_sub_ps(v, rhs.v); }
+		Float4 operator*(Float4 rhs) const { return _mm_mul_ps(v, rhs.v); }
+		Float4 operator/(Float4 rhs) const { return _mm_div_ps(v, rhs.v); }
+		Mask operator<(Float4 rhs) const { return {_mm_cmplt_ps(v, rhs.v)}; }
+		Mask operator>(Float4 rhs) const { return {_mm_cmpgt_ps(v, rhs.v)}; }
+		Mask operator<=(Float4 rhs) const { return {_mm_cmple_ps(v, rhs.v)}; }
+		Mask operator>=(Float4 rhs) const { return {_mm_cmpge_ps(v, rhs.v)}; }
+		// minps returns second operand if any of them is NaN
+		friend Float4 min(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+		friend Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+
+		__m128 v;
+	};
+#endif
+
+#if defined(__AVX__)
+	struct Float8 {
+		struct Mask {
+			Mask operator&(Mask rhs) const { return {_mm256_and_ps(v, rhs.v)}; }
+			Mask operator|(Mask rhs) const { return {_mm256_or_ps(v, rhs.v)}; }
+			__m256 v;
+		};
+		static constexpr int width = 8;
+
+		Float8(__m256 v) : v(v) {}
+		Float8(float f) : v(_mm256_set1_ps(f)) {}
+		static Float8 load(const float *ptr) { return _mm256_load_ps(ptr); }
+		void store(float *ptr) const { _mm256_store_ps(ptr, v); }
+		static int bits(Mask mask) { return _mm256_movemask_ps(mask.v); }
+
+		Float8 operator+(Float8 rhs) const { return _mm256_add_ps(v, rhs.v); }
+		Float8 operator-(Float8 rhs) const { return _mm256_sub_ps(v, rhs.v); }
+		Float8 operator*(Float8 rhs) const { return _mm256_mul_ps(v, rhs.v); }
+		Float8 operator/(Float8 rhs) const { return _mm256_div_ps(v, rhs.v); }
+		Mask operator<(Float8 rhs) const { return {_mm256_cmp_ps(v, rhs.v, _CMP_LT_OQ)}; }
+		Mask operator>(Float8 rhs) const { return {_mm256_cmp_ps(v, rhs.v, _CMP_GT_OQ)}; }
+		Mask operator<=(Float8 rhs) const { return {_mm256_cmp_ps(v, rhs.v, _CMP_LE_OQ)}; }
+		Mask operator>=(Float8 rhs) const { return {_mm256_cmp_ps(v, rhs.v, _CMP_GE_OQ)}; }
+		friend Float8 min(Float8 a, Float8 b) { return _mm256_min_ps(a.v, b.v); }
+		friend Float8 max(Float8 a, Float8 b) { return _mm256_max_ps(a.v, b.v); }
+
+		__m256 v;
+	};
+#endif
+
+	// Widest lane type which can process N elements at once
+#if defined(__AVX__)
+	template <int N> using Lanes = If<N == 8, Float8, Float4>;
+#elif defined(__SSE2__)
+	template <int N> using Lanes = Float4;
+#else
+	template <int N> using Lanes = Float1;
+#endif
+
+	// Vector of lanes; components are either loaded from a packet or broadcasted
+	template <class F> struct Vec3 {
+		Vec3(F x, F y, F z) : x(x), y(y), z(z) {}
+		template <int N> static Vec3 load(const float (&comps)[3][N], int offset) {
+			return {F::load(comps[0] + offset), F::load(comps[1] + offset),
+					F::load(comps[2] + offset)};
+		}
+		static Vec3 broadcast(const float3 &vec) { return {F(vec.x), F(vec.y), F(vec.z)}; }
+
+		Vec3 operator-(const Vec3 &rhs) const { return {x - rhs.x, y - rhs.y, z - rhs.z}; }
+
+		F x, y, z;
+	};
+
+	// Same order of operations as in fwk::dot & fwk::cross
+	template <class F> F dot(const Vec3<F> &a, const Vec3<F> &b) {
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+	template <class F> Vec3<F> cross(const Vec3<F> &a, const Vec3<F> &b) {
+		return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	}
+
+	// Moller-Trumbore; follows Ray::isectParam(const Triangle &) step by step
+	template <class F>
+	int isectTriangles(const Vec3<F> &origin, const Vec3<F> &dir, const Vec3<F> &v0,
+					   const Vec3<F> &e1, const Vec3<F> &e2, float *out_params) {
+		auto vp = cross(dir, e2);
+		F det = dot(e1, vp);
+		auto valid = (det < F(float(-ray_isect_epsilon))) | (det > F(float(ray_isect_epsilon)));
+		F inv_det = F(1.0f) / det;
+
+		auto vt = origin - v0;
+		F tu = dot(vt, vp) * inv_det;
+		valid = valid & (tu >= F(0.0f)) & (tu <= F(1.0f));
+
+		auto vq = cross(vt, e1);
+		F tv = dot(dir, vq) * inv_det;
+		valid = valid & (tv >= F(0.0f)) & (tu + tv <= F(1.0f));
+
+		F t = dot(e2, vq) * inv_det;
+		valid = valid & (t > F(epsilon<float>));
+		t.store(out_params);
+		return F::bits(valid);
+	}
+
+	// Slab test; follows Ray::isectParam(const Box &) step by step
+	template <class F>
+	int isectBoxes(const Vec3<F> &origin, const Vec3<F> &inv_dir, const Vec3<F> &bmin,
+				   const Vec3<F> &bmax, float *out_min, float *out_max) {
+		F l1 = inv_dir.x * (bmin.x - origin.x);
+		F l2 = inv_dir.x * (bmax.x - origin.x);
+		F lmin = min(l1, l2);
+		F lmax = max(l1, l2);
+
+		l1 = inv_dir.y * (bmin.y - origin.y);
+		l2 = inv_dir.y * (bmax.y - origin.y);
+		lmin = max(lmin, min(l1, l2));
+		lmax = min(lmax, max(l1, l2));
+
+		l1 = inv_dir.z * (bmin.z - origin.z);
+		l2 = inv_dir.z * (bmax.z - origin.z);
+		lmin = max(lmin, min(l1, l2));
+		lmax = min(lmax, max(l1, l2));
+
+		lmin.store(out_min);
+		lmax.store(out_max);
+		return F::bits(lmin <= lmax);
+	}
+
+	template <int N> PacketIsectParams<N> makeParams(const float *params, int mask) {
+		PacketIsectParams<N> out;
+		for(int n = 0; n < N; n++)
+			out[n] = mask & (1 << n) ? IsectParam<float>(params[n]) : IsectParam<float>();
+		return out;
+	}
+
+	template <int N>
+	PacketIsectParams<N> makeParams(const float *mins, const float *maxs, int mask) {
+		PacketIsectParams<N> out;
+		for(int n = 0; n < N; n++)
+			out[n] = mask & (1 << n) ? IsectParam<float>(mins[n], maxs[n]) : IsectParam<float>();
+		return out;
+	}
+
+	template <class T, int N, class Func> void fillLanes(CSpan<T> elems, Func func) {
+		DASSERT(elems.size() >= 1 && elems.size() <= N);
+		for(int n = 0; n < N; n++)
+			func(n, elems[min(n, elems.size() - 1)]);
+	}
+}
+
+template <int N> RayPacket<N>::RayPacket(CSpan<Ray3F> rays) {
+	fillLanes<Ray3F, N>(rays, [&](int lane, const Ray3F &ray) {
+		auto inv = ray.invDir();
+		for(int c = 0; c < 3; c++) {
+			origin[c][lane] = ray.origin()[c];
+			dir[c][lane] = ray.dir()[c];
+			inv_dir[c][lane] = inv[c];
+		}
+	});
+}
+
+template <int N> TrianglePacket<N>::TrianglePacket(CSpan<Triangle3F> tris) {
+	fillLanes<Triangle3F, N>(tris, [&](int lane, const Triangle3F &tri) {
+		float3 e1 = tri[1] - tri[0], e2 = tri[2] - tri[0];
+		for(int c = 0; c < 3; c++) {
+			v0[c][lane] = tri[0][c];
+			edge1[c][lane] = e1[c];
+			edge2[c][lane] = e2[c];
+		}
+	});
+}
+
+template <int N> BoxPacket<N>::BoxPacket(CSpan<FBox> boxes) {
+	fillLanes<FBox, N>(boxes, [&](int lane, const FBox &box) {
+		for(int c = 0; c < 3; c++) {
+			min[c][lane] = box.min(c);
+			max[c][lane] = box.max(c);
+		}
+	});
+}
+
+template <int N>
+PacketIsectParams<N> isectParam(const RayPacket<N> &rays, const Triangle3F &tri) {
+	using F = Lanes<N>;
+	using V = Vec3<F>;
+	alignas(32) float params[N];
+	auto v0 = V::broadcast(tri[0]);
+	auto e1 = V::broadcast(tri[1] - tri[0]), e2 = V::broadcast(tri[2] - tri[0]);
+
+	int mask = 0;
+	for(int off = 0; off < N; off += F::width) {
+		auto origin = V::load(rays.origin, off), dir = V::load(rays.dir, off);
+		mask |= isectTriangles(origin, dir, v0, e1, e2, params + off) << off;
+	}
+	return makeParams<N>(params, mask);
+}
+
+template <int N> PacketIsectParams<N> isectParam(const RayPacket<N> &rays, const FBox &box) {
+	using F = Lanes<N>;
+	using V = Vec3<F>;
+	alignas(32) float mins[N], maxs[N];
+	auto bmin = V::broadcast(box.min()), bmax = V::broadcast(box.max());
+
+	int mask = 0;
+	for(int off = 0; off < N; off += F::width) {
+		auto origin = V::load(rays.origin, off), inv_dir = V::load(rays.inv_dir, off);
+		mask |= isectBoxes(origin, inv_dir, bmin, bmax, mins + off, maxs + off) << off;
+	}
+	return makeParams<N>(mins, maxs, mask);
+}
+
+template <int N>
+PacketIsectParams<N> isectParam(const Ray3F &ray, const TrianglePacket<N> &tris) {
+	using F = Lanes<N>;
+	using V = Vec3<F>;
+	alignas(32) float params[N];
+	auto origin = V::broadcast(ray.origin()), dir = V::broadcast(ray.dir());
+
+	int mask = 0;
+	for(int off = 0; off < N; off += F::width) {
+		auto v0 = V::load(tris.v0, off);
+		auto e1 = V::load(tris.edge1, off), e2 = V::load(tris.edge2, off);
+		mask |= isectTriangles(origin, dir, v0, e1, e2, params + off) << off;
+	}
+	return makeParams<N>(params, mask);
+}
+
+template <int N> PacketIsectParams<N> isectParam(const Ray3F &ray, const BoxPacket<N> &boxes) {
+	using F = Lanes<N>;
+	using V = Vec3<F>;
+	alignas(32) float mins[N], maxs[N];
+	auto origin = V::broadcast(ray.origin()), inv_dir = V::broadcast(ray.invDir());
+
+	int mask = 0;
+	for(int off = 0; off < N; off += F::width) {
+		auto bmin = V::load(boxes.min, off), bmax = V::load(boxes.max, off);
+		mask |= isectBoxes(origin, inv_dir, bmin, bmax, mins + off, maxs + off) << off;
+	}
+	return makeParams<N>(mins, maxs, mask);
+}
+
+#define INSTANTIATE(N)                                                                            \
+	template struct RayPacket<N>;                                                                 \
+	template struct TrianglePacket<N>;                                                            \
+	template struct BoxPacket<N>;                                                                 \
+	template PacketIsectParams<N> isectParam(const RayPacket<N> &, const Triangle3F &);          \
+	template PacketIsectParams<N> isectParam(const RayPacket<N> &, const FBox &);                \
+	template PacketIsectParams<N> isectParam(const Ray3F &, const TrianglePacket<N> &);          \
+	template PacketIsectParams<N> isectParam(const Ray3F &, const BoxPacket<N> &);
+
+INSTANTIATE(4)
+INSTANTIATE(8)
+
+#undef INSTANTIATE
+}
@@ -6,13 +6,24 @@
 #include "fwk/format.h"
 #include "fwk/perf/analyzer.h"
 #include "fwk/perf/exec_tree.h"
-#include "fwk/sys/thread.h"
+#include "fwk/sys/ring_queue.h"
 
 namespace perf {
 
+struct PendingFrame {
+	vector<PSample> samples;
+	double begin, end, cpu_time_scale;
+	int frame_id, thread_id;
+};
+
+struct Manager::FrameQueue {
+	FrameQueue() : frames(max_pending_frames) {}
+
+	MpmcQueue<PendingFrame> frames;
+	std::atomic<int> num_dropped = 0;
+};
+
 Manager *Manager::s_instance = nullptr;
-static Mutex s_mutex;
-static vector<Frame> s_new_frames;
 
 Manager::Manager() {
 	ASSERT(!s_instance && "Only single perf::Manager is allowed");
@@ -22,6 +33,7 @@ Manager::Manager() {
 
 	s_instance = this;
 	m_tree.emplace();
+	m_queue.emplace();
 }
 
 Manager::~Manager() {
@@ -29,22 +41,28 @@ Manager::~Manager() {
 	s_instance = nullptr;
 }
 
+// ExecTree is only modified here, so it doesn't have to be synchronized
 void Manager::getNewFrames() {
-	MutexLocker lock(s_mutex);
-	for(auto &frame : s_new_frames)
-		m_frames.emplace_back(std::move(frame));
-	s_new_frames.clear();
+	PendingFrame frame;
+	while(m_queue->frames.tryPop(frame)) {
+		auto esamples = m_tree->makeExecSamples(std::move(frame.samples));
+		m_tree->scaleCpuTimes(esamples, frame.cpu_time_scale);
+		m_frames.emplace_back(std::move(esamples), frame.begin, frame.end, frame.frame_id,
+							  frame.thread_id);
+	}
 }
 
 void Manager::addFrame(int frame_id, double begin, double end, CSpan<PSample> psamples,
 					   double cpu_time_scale) {
 	DASSERT(s_instance);
-	auto &tree = s_instance->m_tree;
-	auto esamples = tree->makeExecSamples(psamples);
-	tree->scaleCpuTimes(esamples, cpu_time_scale);
+	auto &queue = *s_instance->m_queue;
+	if(!queue.frames.tryPush(
+		   {psamples, begin, end, cpu_time_scale, frame_id, threadId()}))
+		queue.num_dropped.fetch_add(1, std::memory_order_relaxed);
+}
 
-	MutexLocker lock(s_mutex);
-	s_new_frames.emplace_back(std::move(esamples), begin, end, frame_id, threadId());
+int Manager::numDroppedFrames() const {
+	return m_queue->num_dropped.load(std::memory_order_relaxed);
 }
 
 i64 Manager::usedMemory() const {
@@ -11,9 +11,6 @@
 
 // TODO: best fit when selecting zones?
 // TODO: add optional logging about allocated/freed chunks/slabs
-// TODO: free unused chunks to slabs; but we want to avoid constantly
-// allocating/deallocating whole chunk groups when a single element is being
-// constantly allocated/deallocated ? Several frame timeout for chunk free?
 
 namespace fwk {
 
@@ -84,6 +81,7 @@ auto SlabAllocator::alloc(u64 size) -> Pair<Identifier, Allocation> {
 		if(zone_id == -1)
 			return {};
 
+		m_zones[zone_id].slab_allocs[slab_id] = u16(num_slabs);
 		u64 offset = slab_id * slab_size;
 		u64 size = num_slabs * slab_size;
 		return {Identifier(slab_id, num_slabs, zone_id), Allocation{uint(zone_id), offset, size}};
@@ -96,11 +94,19 @@ auto SlabAllocator::alloc(u64 size) -> Pair<Identifier, Allocation> {
 		auto [zone_id, slab_id] = allocSlabs(level.slabs_per_group);
 		if(zone_id == -1)
 			return {};
+		ChunkGroup new_group{.zone_id = u16(zone_id),
+							 .slab_offset = u16(slab_id),
+							 .num_free_chunks = level.chunks_per_group};
 		int group_index = level.groups.size();
-		level.groups.emplace_back(ChunkGroup{.zone_id = u16(zone_id),
-											 .slab_offset = u16(slab_id),
-											 .num_free_chunks = level.chunks_per_group});
-		level.chunks.resize(level.groups.size() * level.bits_64_per_group, 0ull);
+		if(level.freed_groups) {
+			// Chunk bits of freed groups are already cleared
+			group_index = level.freed_groups.back();
+			level.freed_groups.pop_back();
+			level.groups[group_index] = new_group;
+		} else {
+			level.groups.emplace_back(new_group);
+			level.chunks.resize(level.groups.size() * level.bits_64_per_group, 0ull);
+		}
 		listInsert(GROUP_ACCESSOR, level.not_full_groups, group_index);
 	}
 
@@ -141,17 +147,201 @@ void SlabAllocator::free(Identifier ident) {
 		DASSERT_LT(group_id, level.groups.size());
 		auto &group = level.groups[group_id];
 
-		if(++group.num_free_chunks == 1)
+		if(++group.num_free_chunks == 1 && !group.is_draining)
 			listInsert(GROUP_ACCESSOR, level.not_full_groups, group_id);
 		uint bits_idx = group_id * level.bits_64_per_group + (chunk_id >> 6);
 		level.chunks[bits_idx] &= ~(1ull << (chunk_id & 63));
 	} else {
 		int slab_id = ident.slabId(), zone_id = ident.slabZoneId();
 		int num_slabs = ident.slabCount();
+		auto &slab_alloc = m_zones[zone_id].slab_allocs[slab_id];
+		DASSERT_EQ(slab_alloc, num_slabs);
+		slab_alloc = 0;
 		clearSlabs(zone_id, slab_id, num_slabs);
 	}
+}
 
-	// TODO: free unused groups
+void SlabAllocator::drainGroup(int level_id, int group_id) {
+	auto &level = m_levels[level_id];
+	auto &group = level.groups[group_id];
+	if(group.is_draining)
+		return;
+	// Groups with free chunks are always on the list
+	if(group.num_free_chunks > 0)
+		listRemove(GROUP_ACCESSOR, level.not_full_groups, group_id);
+	group.is_draining = true;
+}
+
+u64 SlabAllocator::collectGarbage() {
+	for(int l : intRange(num_chunk_levels)) {
+		auto &level = m_levels[l];
+		for(int g : intRange(level.groups)) {
+			auto &group = level.groups[g];
+			if(group.isFreed())
+				continue;
+			if(group.num_free_chunks == level.chunks_per_group) {
+				if(!group.is_draining)
+					listRemove(GROUP_ACCESSOR, level.not_full_groups, g);
+				clearSlabs(group.zone_id, group.slab_offset, level.slabs_per_group);
+				group = {.num_free_chunks = -1};
+				level.freed_groups.emplace_back(g);
+			} else if(group.is_draining) {
+				group.is_draining = false;
+				if(group.num_free_chunks > 0)
+					listInsert(GROUP_ACCESSOR, level.not_full_groups, g);
+			}
+		}
+	}
+
+	u64 freed_memory = 0;
+	for(int z : intRange(m_zones)) {
+		auto &zone = m_zones[z];
+		if(zone.isFreed())
+			continue;
+		zone.is_draining = false;
+		if(zone.num_free_slabs == zone.num_slabs) {
+			if(m_zone_allocator.free_func)
+				m_zone_allocator.free_func(z, m_zone_allocator.param);
+			freed_memory += u64(zone.num_slabs) * slab_size;
+			zone = {};
+		}
+	}
+	return freed_memory;
+}
+
+auto SlabAllocator::planDefragmentation(u64 max_bytes) -> vector<Relocation> {
+	// In every level chunks are compacted into the fullest groups; All other groups are drained
+	vector<int> num_kept_slabs(m_zones.size());
+	for(int z : intRange(m_zones))
+		num_kept_slabs[z] = m_zones[z].num_slabs - m_zones[z].num_free_slabs;
+	vector<Pair<int>> group_usage;
+	for(int l : intRange(num_chunk_levels)) {
+		auto &level = m_levels[l];
+		int num_used_chunks = 0;
+		group_usage.clear();
+		for(int g : intRange(level.groups)) {
+			auto &group = level.groups[g];
+			if(group.isFreed())
+				continue;
+			int num_used = level.chunks_per_group - group.num_free_chunks;
+			num_used_chunks += num_used;
+			group_usage.emplace_back(num_used, g);
+		}
+
+		int num_kept = (num_used_chunks + level.chunks_per_group - 1) / level.chunks_per_group;
+		std::sort(group_usage.begin(), group_usage.end(),
+				  [](auto a, auto b) { return a.first > b.first; });
+		for(int i = num_kept; i < group_usage.size(); i++) {
+			int group_id = group_usage[i].second;
+			drainGroup(l, group_id);
+			num_kept_slabs[level.groups[group_id].zone_id] -= level.slabs_per_group;
+		}
+	}
+
+	// Sparsely used zones (at most half of slabs are kept after compaction) are evacuated,
+	// starting from the emptiest one, as long as other zones have enough free slabs (slabs of
+	// drained groups cannot be reused until collectGarbage). The fullest zone is always kept.
+	vector<int> zone_ids;
+	int num_free_slabs = 0;
+	for(int z : intRange(m_zones))
+		if(!m_zones[z].isFreed()) {
+			zone_ids.emplace_back(z);
+			num_free_slabs += m_zones[z].num_free_slabs;
+		}
+	std::sort(zone_ids.begin(), zone_ids.end(),
+			  [&](int a, int b) { return num_kept_slabs[a] < num_kept_slabs[b]; });
+
+	for(int i = 0; i + 1 < zone_ids.size(); i++) {
+		auto &zone = m_zones[zone_ids[i]];
+		int num_kept = num_kept_slabs[zone_ids[i]];
+		if(num_kept * 2 > zone.num_slabs)
+			break;
+		num_free_slabs -= zone.num_free_slabs;
+		if(num_free_slabs < num_kept)
+			break;
+		num_free_slabs -= num_kept;
+		zone.is_draining = true;
+	}
+
+	for(int l : intRange(num_chunk_levels)) {
+		auto &level = m_levels[l];
+		for(int g : intRange(level.groups))
+			if(!level.groups[g].isFreed() && m_zones[level.groups[g].zone_id].is_draining)
+				drainGroup(l, g);
+	}
+
+	vector<Relocation> out;
+	u64 num_moved_bytes = 0;
+	m_disable_zone_alloc = true;
+
+	for(int l = 0; l < num_chunk_levels && num_moved_bytes < max_bytes; l++) {
+		auto &level = m_levels[l];
+		// Groups may be added during allocation, so they are accessed by index
+		for(int g = 0; g < level.groups.size() && num_moved_bytes < max_bytes; g++) {
+			ChunkGroup group = level.groups[g];
+			if(group.isFreed() || !group.is_draining)
+				continue;
+			for(int i = 0; i < level.bits_64_per_group && num_moved_bytes < max_bytes; i++) {
+				u64 bits = level.chunks[g * level.bits_64_per_group + i];
+				while(bits && num_moved_bytes < max_bytes) {
+					int chunk_id = (i << 6) + findFirstBit(bits);
+					bits &= bits - 1;
+
+					auto [ident, alloc] = this->alloc(level.chunk_size);
+					if(!ident.isValid())
+						continue;
+					u64 offset = u64(group.slab_offset) * slab_size +
+								 u64(chunk_id) * level.chunk_size;
+					out.emplace_back(Identifier(chunk_id, g, l, 0), ident,
+									 Allocation{group.zone_id, offset, level.chunk_size}, alloc);
+					num_moved_bytes += level.chunk_size;
+				}
+			}
+		}
+	}
+
+	for(int z = 0; z < m_zones.size() && num_moved_bytes < max_bytes; z++) {
+		if(!m_zones[z].is_draining)
+			continue;
+		for(int s = 0; s < m_zones[z].num_slabs && num_moved_bytes < max_bytes; s++) {
+			int num_slabs = m_zones[z].slab_allocs[s];
+			if(!num_slabs)
+				continue;
+			auto [ident, alloc] = this->alloc(num_slabs * slab_size);
+			if(!ident.isValid())
+				continue;
+			out.emplace_back(Identifier(s, num_slabs, z), ident,
+							 Allocation{uint(z), s * slab_size, num_slabs * slab_size}, alloc);
+			num_moved_bytes += num_slabs * slab_size;
+		}
+	}
+
+	m_disable_zone_alloc = false;
+	return out;
+}
+
+auto SlabAllocator::stats() const -> Stats {
+	Stats out;
+	for(auto &zone : m_zones) {
+		if(zone.isFreed())
+			continue;
+		out.num_zones++;
+		out.num_empty_zones += zone.num_free_slabs == zone.num_slabs;
+		out.zone_memory += u64(zone.num_slabs) * slab_size;
+		out.slab_memory += u64(zone.num_slabs - zone.num_free_slabs) * slab_size;
+		for(auto num_slabs : zone.slab_allocs)
+			out.used_memory += num_slabs * slab_size;
+	}
+	for(auto &level : m_levels)
+		for(auto &group : level.groups) {
+			if(group.isFreed())
+				continue;
+			int num_used = level.chunks_per_group - group.num_free_chunks;
+			out.num_chunk_groups++;
+			out.num_empty_chunk_groups += num_used == 0;
+			out.used_memory += u64(num_used) * level.chunk_size;
+		}
+	return out;
 }
 
 #undef GROUP_ACCESSOR
@@ -175,7 +365,7 @@ Pair<int, int> SlabAllocator::allocSlabs(int num_slabs) {
 	int target_zone = -1, target_offset = -1;
 	for(int i : intRange(m_zones)) {
 		auto &zone = m_zones[i];
-		if(zone.num_free_slabs < num_slabs)
+		if(zone.num_free_slabs < num_slabs || zone.is_draining)
 			continue;
 
 		int num_groups = zone.groups.size();
@@ -231,12 +421,13 @@ Pair<int, int> SlabAllocator::allocSlabs(int num_slabs) {
 	}
 
 	if(target_offset == -1) {
-		target_offset = 0;
-		target_zone = m_zones.size();
-
+		if(m_disable_zone_alloc)
+			return {-1, -1};
 		u64 min_size =
 			((num_slabs * slab_size + min_zone_size - 1) / min_zone_size) * min_zone_size;
-		if(!allocZone(max(m_default_zone_size, min_size)))
+		target_offset = 0;
+		target_zone = allocNewZone(max(m_default_zone_size, min_size));
+		if(target_zone == -1)
 			return {-1, -1};
 	}
 
@@ -244,16 +435,28 @@ Pair<int, int> SlabAllocator::allocSlabs(int num_slabs) {
 	return {target_zone, target_offset};
 }
 
-bool SlabAllocator::allocZone(u64 zone_size) {
+bool SlabAllocator::allocZone(u64 zone_size) { return allocNewZone(zone_size) != -1; }
+
+int SlabAllocator::allocNewZone(u64 zone_size) {
 	DASSERT(validZoneSize(zone_size));
-	DASSERT_LT(m_zones.size(), max_zones);
 
-	zone_size = m_zone_allocator.func(zone_size, m_zones.size(), m_zone_allocator.param);
+	// Indices of freed zones are reused
+	int zone_id = m_zones.size();
+	for(int z : intRange(m_zones))
+		if(m_zones[z].isFreed()) {
+			zone_id = z;
+			break;
+		}
+	DASSERT_LT(zone_id, max_zones);
+
+	zone_size = m_zone_allocator.func(zone_size, zone_id, m_zone_allocator.param);
 	if(zone_size == 0)
-		return false;
+		return -1;
 	DASSERT(validZoneSize(zone_size));
 
-	Zone &zone = m_zones.emplace_back();
+	if(zone_id == m_zones.size())
+		m_zones.emplace_back();
+	Zone &zone = m_zones[zone_id];
 	zone.num_slabs = int(zone_size / slab_size);
 	zone.num_free_slabs = zone.num_slabs;
 	zone.num_slab_groups = zone.num_slabs / slab_group_size;
@@ -262,7 +465,8 @@ bool SlabAllocator::allocZone(u64 zone_size) {
 	zone.full_groups = 0;
 	PASSERT(zone.num_slab_groups <= 64);
 	zone.groups.resize(zone.num_slab_groups, 0);
-	return true;
+	zone.slab_allocs.resize(zone.num_slabs, 0);
+	return zone_id;
 }
 
 void SlabAllocator::fillSlabs(int zone_id, int offset, int num_slabs) {
@@ -359,6 +563,8 @@ string formatBits(Unsigned bits, int num_bits = sizeof(Unsigned) * 8, int group_
 void SlabAllocator::visualizeSlabs() const {
 	for(int s : intRange(m_zones)) {
 		auto &zone = m_zones[s];
+		if(zone.isFreed())
+			continue;
 		print("Zone %: num_slabs:% num_free:% empty_groups:% full_groups:%\n", s, zone.num_slabs,
 			  zone.num_free_slabs, formatBits(zone.empty_groups, zone.groups.size()),
 			  formatBits(zone.full_groups, zone.groups.size()));
@@ -396,6 +602,20 @@ Ex<void> SlabAllocator::verifySlabs() const {
 							 zone.num_free_slabs, num_free_slabs, s);
 	}
 
+	for(int l : intRange(num_chunk_levels)) {
+		auto &level = m_levels[l];
+		for(int g : intRange(level.groups)) {
+			auto &group = level.groups[g];
+			int num_used = 0;
+			for(int i : intRange(level.bits_64_per_group))
+				num_used += countBits(level.chunks[g * level.bits_64_per_group + i]);
+			if(group.isFreed() ? num_used != 0
+							   : num_used != level.chunks_per_group - group.num_free_chunks)
+				return FWK_ERROR("Invalid number of used chunks: % (level_id:% group_id:%)",
+								 num_used, l, g);
+		}
+	}
+
 	return {};
 }
 
@@ -0,0 +1,19 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/small_string.h"
+
+namespace fwk {
+
+char *detail::smallStringRealloc(const char *data, int size, Str append, int new_capacity) {
+	int new_size = size + append.size();
+	DASSERT(new_size <= new_capacity);
+	char *new_data = (char *)allocate(new_capacity + 1);
+	memcpy(new_data, data, size);
+	if(append.size())
+		memcpy(new_data + size, append.data(), append.size());
+	new_data[new_size] = 0;
+	return new_data;
+}
+
+}
@@ -0,0 +1,330 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/sys/job_system.h"
+
+#include "fwk/perf/thread_context.h"
+#include "fwk/sys/assert.h"
+
+namespace fwk {
+
+using detail::Job;
+
+namespace {
+	// Chase-Lev deque with fixed capacity: owner pushes & pops at the bottom,
+	// other threads steal from the top.
+	struct WorkDeque {
+		static constexpr int capacity = 4096;
+
+		// Returns false if deque is full
+		bool push(Job *job) {
+			i64 bottom = m_bottom.load(std::memory_order_relaxed);
+			i64 top = m_top.load(std::memory_order_acquire);
+			if(bottom - top >= capacity)
+				return false;
+			m_jobs[bottom & (capacity - 1)].store(job, std::memory_order_relaxed);
+			m_bottom.store(bottom + 1, std::memory_order_release);
+			return true;
+		}
+
+		Job *pop() {
+			i64 bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+			m_bottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			i64 top = m_top.load(std::memory_order_relaxed);
+
+			if(top > bottom) {
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			Job *job = m_jobs[bottom & (capacity - 1)].load(std::memory_order_relaxed);
+			if(top == bottom) {
+				// Last job: competing with thieves
+				if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+												  std::memory_order_relaxed))
+					job = nullptr;
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job *steal() {
+			i64 top = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			i64 bottom = m_bottom.load(std::memory_order_acquire);
+			if(top >= bottom)
+				return nullptr;
+			Job *job = m_jobs[top & (capacity - 1)].load(std::memory_order_relaxed);
+			if(!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+											  std::memory_order_relaxed))
+				return nullptr;
+			return job;
+		}
+
+	  private:
+		alignas(64) std::atomic<i64> m_top = 0;
+		alignas(64) std::atomic<i64> m_bottom = 0;
+		std::atomic<Job *> m_jobs[capacity];
+	};
+
+	struct WorkerId {
+		JobSystem *system = nullptr;
+		int index = -1;
+	};
+	FWK_THREAD_LOCAL WorkerId t_worker;
+}
+
+struct JobSystem::Impl {
+	struct Worker {
+		Impl *impl;
+		int index;
+		u32 random_state;
+		WorkDeque deque;
+		Dynamic<Thread> thread;
+	};
+
+	void execute(Job *);
+	void schedule(Job *);
+	void finishJob(JobCounter *);
+	void wakeWorkers(bool all);
+	// worker_index can be -1 for threads which are not part of the JobSystem
+	Job *findJob(int worker_index);
+	int currentWorker() const { return t_worker.system == system ? t_worker.index : -1; }
+	static void *workerThread(void *);
+
+	JobSystem *system = nullptr;
+	// Index 0: thread which created the JobSystem
+	vector<Dynamic<Worker>> workers;
+
+	// Jobs submitted by threads which are not part of the JobSystem
+	Mutex queue_mutex;
+	vector<Job *> queue;
+	std::atomic<int> queue_size = 0;
+
+	// Approximate number of jobs waiting in queues; sleeping workers are woken when it's > 0
+	std::atomic<int> num_pending = 0;
+	std::atomic<int> num_sleeping = 0;
+	std::atomic<int> frame_id = 0;
+	std::atomic<bool> quit = false;
+	bool perf_contexts = false;
+
+#ifndef FWK_THREADS_DISABLED
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cond;
+#endif
+};
+
+void JobSystem::Impl::wakeWorkers(bool all) {
+#ifndef FWK_THREADS_DISABLED
+	if(all || num_sleeping.load(std::memory_order_seq_cst) > 0) {
+		// Locking guarantees that worker which is about to sleep will get the notification
+		{ std::lock_guard<std::mutex> lock(sleep_mutex); }
+		if(all)
+			sleep_cond.notify_all();
+		else
+			sleep_cond.notify_one();
+	}
+#endif
+}
+
+void JobSystem::Impl::execute(Job *job) {
+	auto *counter = job->counter;
+	{
+		PERF_SCOPE();
+		job->func(job);
+	}
+	if(counter)
+		finishJob(counter);
+}
+
+void JobSystem::Impl::schedule(Job *job) {
+#ifdef FWK_THREADS_DISABLED
+	execute(job);
+#else
+	int worker_index = currentWorker();
+	if(worker_index >= 0) {
+		if(!workers[worker_index]->deque.push(job)) {
+			execute(job);
+			return;
+		}
+	} else {
+		MutexLocker lock(queue_mutex);
+		queue.emplace_back(job);
+		queue_size.fetch_add(1, std::memory_order_release);
+	}
+	num_pending.fetch_add(1, std::memory_order_seq_cst);
+	wakeWorkers(false);
+#endif
+}
+
+static u32 nextRandom(u32 &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+auto JobSystem::Impl::findJob(int worker_index) -> Job * {
+	Job *job = nullptr;
+	if(worker_index >= 0)
+		job = workers[worker_index]->deque.pop();
+
+	if(!job && queue_size.load(std::memory_order_acquire) > 0) {
+		MutexLocker lock(queue_mutex);
+		if(queue) {
+			job = queue.back();
+			queue.pop_back();
+			queue_size.fetch_sub(1, std::memory_order_relaxed);
+		}
+	}
+
+	if(!job) {
+		int num_workers = workers.size();
+		u32 random_state =
+			worker_index >= 0 ? workers[worker_index]->random_state : (u32)threadId() | 1;
+		int victim = nextRandom(random_state) % num_workers;
+		if(worker_index >= 0)
+			workers[worker_index]->random_state = random_state;
+		for(int n = 0; n < num_workers && !job; n++) {
+			if(victim != worker_index)
+				job = workers[victim]->deque.steal();
+			victim = victim + 1 == num_workers ? 0 : victim + 1;
+		}
+	}
+
+	if(job)
+		num_pending.fetch_sub(1, std::memory_order_relaxed);
+	return job;
+}
+
+// Only the last job of given counter takes the lock; This way counter can be safely
+// destroyed after wait() returns
+void JobSystem::Impl::finishJob(JobCounter *counter) {
+	auto &count = counter->m_count;
+	int value = count.load(std::memory_order_relaxed);
+	while(value > 1)
+		if(count.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel))
+			return;
+
+	vector<Job *> dependent_jobs;
+	{
+		MutexLocker lock(counter->m_mutex);
+		if(count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			dependent_jobs.swap(counter->m_dependent_jobs);
+	}
+	for(auto *job : dependent_jobs)
+		schedule(job);
+}
+
+void *JobSystem::Impl::workerThread(void *arg) {
+	auto &worker = *(Worker *)arg;
+	auto &impl = *worker.impl;
+	t_worker = {impl.system, worker.index};
+
+	Dynamic<perf::ThreadContext> perf_context;
+	if(impl.perf_contexts)
+		perf_context.emplace();
+	int frame_id = impl.frame_id.load(std::memory_order_relaxed);
+
+	while(true) {
+		int cur_frame_id = impl.frame_id.load(std::memory_order_relaxed);
+		if(cur_frame_id != frame_id) {
+			frame_id = cur_frame_id;
+			if(perf_context)
+				perf_context->nextFrame();
+		}
+
+		if(auto *job = impl.findJob(worker.index)) {
+			impl.execute(job);
+			continue;
+		}
+
+#ifndef FWK_THREADS_DISABLED
+		std::unique_lock<std::mutex> lock(impl.sleep_mutex);
+		impl.num_sleeping.fetch_add(1, std::memory_order_seq_cst);
+		while(!impl.quit.load() && impl.num_pending.load(std::memory_order_seq_cst) <= 0 &&
+			  impl.frame_id.load(std::memory_order_relaxed) == frame_id)
+			impl.sleep_cond.wait(lock);
+		impl.num_sleeping.fetch_sub(1, std::memory_order_relaxed);
+		if(impl.quit.load() && impl.num_pending.load() <= 0)
+			break;
+#endif
+	}
+
+	t_worker = {};
+	return nullptr;
+}
+
+JobSystem::JobSystem(JobSystemConfig config) {
+	DASSERT("Only one JobSystem can exist at a time" && !s_instance);
+	s_instance = this;
+
+#ifdef FWK_THREADS_DISABLED
+	config.num_workers = 0;
+#endif
+	if(config.num_workers < 0)
+		config.num_workers = max(0, Thread::hardwareConcurrency() - 1);
+	m_num_workers = config.num_workers;
+	m_impl.emplace();
+	m_impl->system = this;
+	m_impl->perf_contexts = config.perf_contexts;
+
+	auto &workers = m_impl->workers;
+	workers.reserve(m_num_workers + 1);
+	for(int n = 0; n <= m_num_workers; n++) {
+		workers.emplace_back();
+		workers.back().emplace();
+		auto &worker = *workers.back();
+		worker.impl = m_impl.get();
+		worker.index = n;
+		worker.random_state = 0x9e3779b9u * (n + 1);
+	}
+	t_worker = {this, 0};
+	for(int n = 1; n <= m_num_workers; n++)
+		workers[n]->thread.emplace(Impl::workerThread, workers[n].get());
+}
+
+JobSystem::~JobSystem() {
+	// Remaining jobs are finished by the workers before they quit
+	m_impl->quit = true;
+	m_impl->wakeWorkers(true);
+	for(int n = 1; n <= m_num_workers; n++)
+		m_impl->workers[n]->thread->join();
+	while(auto *job = m_impl->findJob(0))
+		m_impl->execute(job);
+
+	if(t_worker.system == this)
+		t_worker = {};
+	s_instance = nullptr;
+}
+
+void JobSystem::submit(Job *job, JobCounter *dependency) {
+	if(dependency && !dependency->done()) {
+		MutexLocker lock(dependency->m_mutex);
+		if(!dependency->done()) {
+			dependency->m_dependent_jobs.emplace_back(job);
+			return;
+		}
+	}
+	m_impl->schedule(job);
+}
+
+void JobSystem::wait(const JobCounter &counter) {
+	int worker_index = m_impl->currentWorker();
+	while(!counter.done()) {
+		if(auto *job = m_impl->findJob(worker_index))
+			m_impl->execute(job);
+#ifndef FWK_THREADS_DISABLED
+		else
+			std::this_thread::yield();
+#endif
+	}
+	// Last job releases the lock after it stops using the counter
+	MutexLocker lock(counter.m_mutex);
+}
+
+void JobSystem::nextFrame() {
+	m_impl->frame_id.fetch_add(1, std::memory_order_relaxed);
+	m_impl->wakeWorkers(true);
+}
+}
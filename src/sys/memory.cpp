@@ -5,9 +5,26 @@
 
 #include "fwk/math_base.h"
 #include "fwk/sys_base.h"
+#include <cstdio>
 #include <cstdlib>
 #include <new>
 
+#if defined(FWK_POOL_ALLOCATOR) && (defined(FWK_PLATFORM_LINUX) || defined(FWK_PLATFORM_WINDOWS))
+#define FWK_POOL_ALLOCATOR_ENABLED
+#include <atomic>
+#ifdef FWK_PLATFORM_WINDOWS
+#include "sys/windows.h"
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#ifdef FWK_PLATFORM_LINUX
+#define FWK_LARGE_ALLOC_ENABLED
+#include <atomic>
+#include <sys/mman.h>
+#endif
+
 #ifdef FWK_PLATFORM_HTML5
 void *aligned_alloc(size_t alignment, size_t size) {
 	// TODO: do this properly; although it shouldnt matter on thiis platform
@@ -17,7 +34,277 @@ void *aligned_alloc(size_t alignment, size_t size) {
 
 namespace fwk {
 
+#ifdef FWK_POOL_ALLOCATOR_ENABLED
+namespace {
+
+	// Thread-caching pool allocator for small allocations.
+	//
+	// Address space for the pool is reserved once and divided into 64KB pages. Each page is
+	// assigned to a single size class and a single thread cache (owner); page header is kept
+	// at the beginning of the page, so it can be found by masking the pointer.
+	//
+	// Blocks freed by the owner go straight to its free list. Blocks freed by other threads are
+	// pushed onto lock-free remote list of the owner, which takes them back when it runs out of
+	// free blocks. Thread caches are never destroyed: when a thread exits, its cache is passed
+	// to the next thread which starts using the pool. Pages are never returned to the system.
+
+	constexpr int page_shift = 16, page_size = 1 << page_shift, page_header_size = 64;
+	constexpr size_t pool_reserve_size = size_t(32) << 30;
+	constexpr int max_small_size = 4096, num_size_classes = 28;
+	static_assert(num_size_classes <= PoolAllocatorStats::max_size_classes);
+
+	// 16-byte steps up to 128 bytes, then 4 classes for every power of two
+	struct SizeClassTable {
+		constexpr SizeClassTable() {
+			int count = 0;
+			for(int size = 16; size <= 128; size += 16)
+				block_sizes[count++] = size;
+			for(int base = 128; base < max_small_size; base *= 2)
+				for(int n = 1; n <= 4; n++)
+					block_sizes[count++] = base + base / 4 * n;
+			for(int n = 0, size_class = 0; n <= max_small_size / 16; n++) {
+				while(block_sizes[size_class] < n * 16)
+					size_class++;
+				classes[n] = size_class;
+			}
+		}
+
+		int block_sizes[num_size_classes] = {};
+		u8 classes[max_small_size / 16 + 1] = {};
+	};
+	constexpr SizeClassTable size_class_table;
+
+	struct ThreadCache;
+
+	struct PageHeader {
+		ThreadCache *owner;
+		int size_class;
+	};
+	static_assert(sizeof(PageHeader) <= page_header_size);
+
+	struct FreeBlock {
+		FreeBlock *next;
+	};
+
+	// Counters are only modified by the owner (except num_remote_deallocations)
+	struct SizeClassCache {
+		FreeBlock *free_list = nullptr;
+		char *bump = nullptr, *bump_end = nullptr;
+		std::atomic<long long> num_allocations = 0, num_deallocations = 0;
+		std::atomic<long long> num_remote_deallocations = 0;
+	};
+
+	struct ThreadCache {
+		SizeClassCache classes[num_size_classes];
+		std::atomic<FreeBlock *> remote_list = nullptr;
+		std::atomic<long long> num_large_allocations = 0;
+		ThreadCache *next_cache = nullptr;
+		ThreadCache *next_free_cache = nullptr;
+	};
+
+	std::atomic<char *> g_pool_begin = nullptr, g_pool_end = nullptr;
+	std::atomic<size_t> g_num_pages = 0;
+	std::atomic<long long> g_class_pages[num_size_classes] = {};
+	std::atomic<ThreadCache *> g_all_caches = nullptr;
+
+	// Protected by g_lock:
+	std::atomic_flag g_lock;
+	ThreadCache *g_free_caches = nullptr;
+	bool g_pool_failed = false;
+
+	FWK_THREAD_LOCAL ThreadCache *t_cache = nullptr;
+	FWK_THREAD_LOCAL bool t_cache_released = false;
+
+	struct SpinLocker {
+		SpinLocker() {
+			while(g_lock.test_and_set(std::memory_order_acquire))
+				;
+		}
+		~SpinLocker() { g_lock.clear(std::memory_order_release); }
+	};
+
+	FWK_ALWAYS_INLINE void increment(std::atomic<long long> &counter) {
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// Address space is only reserved; pages are committed when they're assigned to size classes
+	bool reservePool() {
+		size_t size = pool_reserve_size + page_size;
+#ifdef FWK_PLATFORM_WINDOWS
+		void *ptr = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+		void *ptr = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+						 -1, 0);
+		if(ptr == MAP_FAILED)
+			ptr = nullptr;
+#endif
+		if(!ptr)
+			return false;
+		auto *begin = (char *)(((size_t)ptr + page_size - 1) & ~size_t(page_size - 1));
+		g_pool_end.store(begin + pool_reserve_size, std::memory_order_relaxed);
+		g_pool_begin.store(begin, std::memory_order_relaxed);
+		return true;
+	}
+
+	bool commitPage(char *page) {
+#ifdef FWK_PLATFORM_WINDOWS
+		return VirtualAlloc(page, page_size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+		return mprotect(page, page_size, PROT_READ | PROT_WRITE) == 0;
+#endif
+	}
+
+	bool inPool(const void *ptr) {
+		auto *cptr = (const char *)ptr;
+		return cptr >= g_pool_begin.load(std::memory_order_relaxed) &&
+			   cptr < g_pool_end.load(std::memory_order_relaxed);
+	}
+
+	PageHeader *pageHeader(void *ptr) {
+		return (PageHeader *)(size_t(ptr) & ~size_t(page_size - 1));
+	}
+
+	struct ThreadCacheReleaser {
+		~ThreadCacheReleaser() {
+			if(!t_cache)
+				return;
+			SpinLocker lock;
+			t_cache->next_free_cache = g_free_caches;
+			g_free_caches = t_cache;
+			t_cache = nullptr;
+			t_cache_released = true;
+		}
+		bool active = false;
+	};
+	thread_local ThreadCacheReleaser t_cache_releaser;
+
+	// Returns null if pool is not available; After thread's cache is released (during thread
+	// exit) all allocations from this thread are passed to malloc.
+	FWK_NO_INLINE ThreadCache *acquireThreadCache() {
+		if(t_cache_released)
+			return nullptr;
+
+		ThreadCache *cache = nullptr;
+		{
+			SpinLocker lock;
+			if(!g_pool_failed && !g_pool_begin.load(std::memory_order_relaxed))
+				g_pool_failed = !reservePool();
+			if(g_pool_failed)
+				return nullptr;
+
+			if(g_free_caches) {
+				cache = g_free_caches;
+				g_free_caches = cache->next_free_cache;
+			} else {
+				void *memory = calloc(1, sizeof(ThreadCache));
+				if(!memory)
+					FWK_FATAL("Allocation error: failed to allocate thread cache");
+				cache = new(memory) ThreadCache;
+				cache->next_cache = g_all_caches.load(std::memory_order_relaxed);
+				g_all_caches.store(cache, std::memory_order_release);
+			}
+		}
+
+		t_cache = cache;
+		t_cache_releaser.active = true;
+		return cache;
+	}
+
+	void drainRemoteList(ThreadCache &cache) {
+		auto *block = cache.remote_list.exchange(nullptr, std::memory_order_acquire);
+		while(block) {
+			auto *next = block->next;
+			auto &size_class = cache.classes[pageHeader(block)->size_class];
+			block->next = size_class.free_list;
+			size_class.free_list = block;
+			block = next;
+		}
+	}
+
+	bool allocatePage(ThreadCache &cache, int size_class) {
+		size_t page_idx = g_num_pages.fetch_add(1, std::memory_order_relaxed);
+		if(page_idx >= pool_reserve_size / page_size)
+			return false;
+		char *page = g_pool_begin.load(std::memory_order_relaxed) + page_idx * page_size;
+		if(!commitPage(page))
+			return false;
+		new(page) PageHeader{&cache, size_class};
+		g_class_pages[size_class].fetch_add(1, std::memory_order_relaxed);
+
+		int block_size = size_class_table.block_sizes[size_class];
+		int num_blocks = (page_size - page_header_size) / block_size;
+		auto &cache_class = cache.classes[size_class];
+		cache_class.bump = page + page_header_size;
+		cache_class.bump_end = cache_class.bump + num_blocks * block_size;
+		return true;
+	}
+
+	FWK_NO_INLINE bool refill(ThreadCache &cache, int size_class) {
+		auto &cache_class = cache.classes[size_class];
+		if(cache.remote_list.load(std::memory_order_relaxed)) {
+			drainRemoteList(cache);
+			if(cache_class.free_list)
+				return true;
+		}
+		return allocatePage(cache, size_class);
+	}
+
+	FWK_ALWAYS_INLINE void *allocateSmall(ThreadCache &cache, int size_class) {
+		auto &cache_class = cache.classes[size_class];
+		if(!cache_class.free_list && cache_class.bump == cache_class.bump_end)
+			if(!refill(cache, size_class))
+				return nullptr;
+
+		void *out;
+		if(cache_class.free_list) {
+			out = cache_class.free_list;
+			cache_class.free_list = cache_class.free_list->next;
+		} else {
+			out = cache_class.bump;
+			cache_class.bump += size_class_table.block_sizes[size_class];
+		}
+		increment(cache_class.num_allocations);
+		return out;
+	}
+
+	FWK_ALWAYS_INLINE void deallocateSmall(void *ptr) {
+		auto *header = pageHeader(ptr);
+		auto *block = (FreeBlock *)ptr;
+		auto *owner = header->owner;
+
+		if(owner == t_cache) {
+			auto &cache_class = owner->classes[header->size_class];
+			block->next = cache_class.free_list;
+			cache_class.free_list = block;
+			increment(cache_class.num_deallocations);
+			return;
+		}
+
+		auto *head = owner->remote_list.load(std::memory_order_relaxed);
+		do {
+			block->next = head;
+		} while(!owner->remote_list.compare_exchange_weak(
+			head, block, std::memory_order_release, std::memory_order_relaxed));
+		owner->classes[header->size_class].num_remote_deallocations.fetch_add(
+			1, std::memory_order_relaxed);
+	}
+}
+#endif
+
 void *allocate(size_t size) {
+#ifdef FWK_POOL_ALLOCATOR_ENABLED
+	if(size <= max_small_size) {
+		auto *cache = t_cache;
+		if(!cache)
+			cache = acquireThreadCache();
+		if(cache)
+			if(auto *ptr = allocateSmall(*cache, size_class_table.classes[(size + 15) / 16]))
+				return ptr;
+	} else if(t_cache) {
+		increment(t_cache->num_large_allocations);
+	}
+#endif
+
 	auto ptr = malloc(size);
 	if(!ptr)
 		FWK_FATAL("Allocation error: failed to allocate %llu bytes", (unsigned long long)size);
@@ -26,6 +313,11 @@ void *allocate(size_t size) {
 
 void *allocate(size_t size, size_t alignment) {
 	DASSERT(isPowerOfTwo(alignment));
+	if(alignment <= default_alignment)
+		return allocate(size);
+
+	// aligned_alloc requires size to be a multiple of alignment
+	size = (size + alignment - 1) & ~(alignment - 1);
 #if defined(FWK_PLATFORM_MINGW) || defined(FWK_PLATFORM_MSVC)
 	auto ptr = _aligned_malloc(size, alignment);
 #else
@@ -37,7 +329,221 @@ void *allocate(size_t size, size_t alignment) {
 	return ptr;
 }
 
-void deallocate(void *ptr) { return ::free(ptr); }
+void deallocate(void *ptr) {
+#ifdef FWK_POOL_ALLOCATOR_ENABLED
+	if(inPool(ptr))
+		return deallocateSmall(ptr);
+#endif
+	::free(ptr);
+}
+
+void deallocate(void *ptr, size_t alignment) {
+	if(alignment <= default_alignment)
+		return deallocate(ptr);
+#if defined(FWK_PLATFORM_MINGW) || defined(FWK_PLATFORM_MSVC)
+	_aligned_free(ptr);
+#else
+	::free(ptr);
+#endif
+}
+
+bool poolAllocatorEnabled() {
+#ifdef FWK_POOL_ALLOCATOR_ENABLED
+	SpinLocker lock;
+	return !g_pool_failed;
+#else
+	return false;
+#endif
+}
+
+PoolAllocatorStats poolAllocatorStats() {
+	PoolAllocatorStats out;
+#ifdef FWK_POOL_ALLOCATOR_ENABLED
+	out.num_size_classes = num_size_classes;
+	out.page_size = page_size;
+	for(int n = 0; n < num_size_classes; n++) {
+		out.size_classes[n].block_size = size_class_table.block_sizes[n];
+		out.size_classes[n].num_pages = g_class_pages[n].load(std::memory_order_relaxed);
+	}
+
+	auto relaxed = std::memory_order_relaxed;
+	for(auto *cache = g_all_caches.load(std::memory_order_acquire); cache;
+		cache = cache->next_cache) {
+		for(int n = 0; n < num_size_classes; n++) {
+			auto &cache_class = cache->classes[n];
+			auto &out_class = out.size_classes[n];
+			out_class.num_allocations += cache_class.num_allocations.load(relaxed);
+			out_class.num_deallocations += cache_class.num_deallocations.load(relaxed) +
+										   cache_class.num_remote_deallocations.load(relaxed);
+		}
+		out.num_large_allocations += cache->num_large_allocations.load(relaxed);
+		out.num_thread_caches++;
+	}
+#endif
+	return out;
+}
+
+PoolAllocatorStats PoolAllocatorStats::operator-(const PoolAllocatorStats &rhs) const {
+	auto out = *this;
+	for(int n = 0; n < num_size_classes && n < rhs.num_size_classes; n++) {
+		auto &out_class = out.size_classes[n];
+		auto &rhs_class = rhs.size_classes[n];
+		out_class.num_allocations -= rhs_class.num_allocations;
+		out_class.num_deallocations -= rhs_class.num_deallocations;
+		out_class.num_pages -= rhs_class.num_pages;
+	}
+	out.num_large_allocations -= rhs.num_large_allocations;
+	return out;
+}
+
+void PoolAllocatorStats::print() const {
+	if(num_size_classes == 0) {
+		printf("Pool allocator disabled\n");
+		return;
+	}
+
+	printf("Pool allocator stats (thread caches: %d, large allocations: %lld):\n",
+		   num_thread_caches, num_large_allocations);
+	printf("  size      allocs       frees     live   pages   usage\n");
+	for(int n = 0; n < num_size_classes; n++) {
+		auto &size_class = size_classes[n];
+		if(size_class.num_allocations == 0 && size_class.num_pages == 0)
+			continue;
+		double capacity = double(size_class.num_pages) * page_size;
+		double usage = capacity > 0 ? size_class.numLive() * size_class.block_size / capacity : 0;
+		printf("  %4d %11lld %11lld %8lld %7lld %6.2f%%\n", size_class.block_size,
+			   size_class.num_allocations, size_class.num_deallocations, size_class.numLive(),
+			   size_class.num_pages, usage * 100.0);
+	}
+}
+
+namespace detail {
+	std::atomic<size_t> g_large_alloc_threshold = LargeAllocConfig().min_size;
+}
+
+#ifdef FWK_LARGE_ALLOC_ENABLED
+namespace {
+	// Registry of live large allocations; Slot is owned by the allocation (only its owner
+	// modifies it), other threads only compare pointers.
+	constexpr int max_large_allocs = 256;
+	constexpr size_t system_page_size = 4096, huge_page_size = size_t(2) << 20;
+
+	struct LargeAllocSlot {
+		std::atomic<void *> ptr = nullptr;
+		size_t size = 0;
+	};
+
+	LargeAllocSlot g_large_slots[max_large_allocs];
+	std::atomic<size_t> g_large_min_size = LargeAllocConfig().min_size;
+	std::atomic<bool> g_large_huge_pages = false;
+
+	LargeAllocSlot *findLargeSlot(const void *ptr) {
+		if(!ptr || (size_t(ptr) & (system_page_size - 1)))
+			return nullptr;
+		for(auto &slot : g_large_slots)
+			if(slot.ptr.load(std::memory_order_relaxed) == ptr)
+				return &slot;
+		return nullptr;
+	}
+
+	size_t mappedSize(size_t size) {
+		size_t page_size = g_large_huge_pages ? huge_page_size : system_page_size;
+		return (size + page_size - 1) & ~(page_size - 1);
+	}
+
+	void adviseHugePages(void *ptr, size_t size) {
+#ifdef MADV_HUGEPAGE
+		if(g_large_huge_pages.load(std::memory_order_relaxed))
+			madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+	}
+}
+#endif
+
+void setLargeAllocConfig(const LargeAllocConfig &config) {
+	auto &threshold = detail::g_large_alloc_threshold;
+	size_t cur_threshold = threshold.load(std::memory_order_relaxed);
+	while(config.min_size < cur_threshold &&
+		  !threshold.compare_exchange_weak(cur_threshold, config.min_size, std::memory_order_relaxed))
+		;
+#ifdef FWK_LARGE_ALLOC_ENABLED
+	g_large_min_size = config.min_size;
+	g_large_huge_pages = config.huge_pages;
+#endif
+}
+
+LargeAllocConfig largeAllocConfig() {
+	LargeAllocConfig out;
+#ifdef FWK_LARGE_ALLOC_ENABLED
+	out.min_size = g_large_min_size;
+	out.huge_pages = g_large_huge_pages;
+#endif
+	return out;
+}
+
+void *allocateLarge(size_t size) {
+#ifdef FWK_LARGE_ALLOC_ENABLED
+	if(size < g_large_min_size.load(std::memory_order_relaxed))
+		return nullptr;
+	size_t mapped_size = mappedSize(size);
+	void *ptr =
+		mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(ptr == MAP_FAILED)
+		return nullptr;
+
+	for(auto &slot : g_large_slots) {
+		void *expected = nullptr;
+		if(slot.ptr.load(std::memory_order_relaxed) == nullptr &&
+		   slot.ptr.compare_exchange_strong(expected, ptr, std::memory_order_relaxed)) {
+			slot.size = mapped_size;
+			adviseHugePages(ptr, mapped_size);
+			return ptr;
+		}
+	}
+	munmap(ptr, mapped_size);
+#endif
+	return nullptr;
+}
+
+void *reallocateLarge(void *ptr, size_t new_size) {
+#ifdef FWK_LARGE_ALLOC_ENABLED
+	auto *slot = findLargeSlot(ptr);
+	if(!slot)
+		return nullptr;
+	size_t new_mapped_size = mappedSize(new_size);
+	if(new_mapped_size == slot->size)
+		return ptr;
+	void *new_ptr = mremap(ptr, slot->size, new_mapped_size, MREMAP_MAYMOVE);
+	if(new_ptr == MAP_FAILED)
+		return nullptr;
+	slot->size = new_mapped_size;
+	slot->ptr.store(new_ptr, std::memory_order_relaxed);
+	adviseHugePages(new_ptr, new_mapped_size);
+	return new_ptr;
+#else
+	return nullptr;
+#endif
+}
+
+void deallocateLarge(void *ptr) {
+#ifdef FWK_LARGE_ALLOC_ENABLED
+	auto *slot = findLargeSlot(ptr);
+	PASSERT("Not a large allocation" && slot);
+	if(!slot)
+		return;
+	size_t size = slot->size;
+	slot->ptr.store(nullptr, std::memory_order_relaxed);
+	munmap(ptr, size);
+#endif
+}
+
+bool isLargeAllocation(const void *ptr) {
+#ifdef FWK_LARGE_ALLOC_ENABLED
+	return findLargeSlot(ptr) != nullptr;
+#else
+	return false;
+#endif
+}
 
 void *SimpleAllocatorBase::allocateBytes(size_t count) { return allocate(count); }
 void SimpleAllocatorBase::deallocateBytes(void *ptr) { deallocate(ptr); }
@@ -52,17 +558,20 @@ void operator delete[](void *ptr) noexcept { fwk::deallocate(ptr); }
 void operator delete(void *ptr, std::size_t sz) noexcept { fwk::deallocate(ptr); }
 void operator delete[](void *ptr, std::size_t sz) noexcept { fwk::deallocate(ptr); }
 
-// TODO: C++17 alignment versions
-/*
 void *operator new(std::size_t count, std::align_val_t al) {
-	return fwk::detail::g_aligned_alloc(count, al);
+	return fwk::allocate(count, size_t(al));
 }
 void *operator new[](std::size_t count, std::align_val_t al) {
-	return fwk::detail::g_aligned_alloc(count, al);
+	return fwk::allocate(count, size_t(al));
 }
 
-void operator delete(void *ptr, std::align_val_t al) { fwk::detail::g_free(ptr); }
-void operator delete[](void *ptr, std::align_val_t al) { fwk::detail::g_free(ptr); }
-void operator delete(void *ptr, std::size_t sz, std::align_val_t al) { fwk::detail::g_free(ptr); }
-void operator delete[](void *ptr, std::size_t sz, std::align_val_t al) { fwk::detail::g_free(ptr); }
-*/
+void operator delete(void *ptr, std::align_val_t al) noexcept { fwk::deallocate(ptr, size_t(al)); }
+void operator delete[](void *ptr, std::align_val_t al) noexcept {
+	fwk::deallocate(ptr, size_t(al));
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t al) noexcept {
+	fwk::deallocate(ptr, size_t(al));
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t al) noexcept {
+	fwk::deallocate(ptr, size_t(al));
+}
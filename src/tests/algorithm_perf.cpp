@@ -0,0 +1,115 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/math/random.h"
+#include "fwk/parallel_algorithm.h"
+#include "fwk/pod_vector.h"
+#include "fwk/sys/job_system.h"
+#include "fwk/vector.h"
+#include "testing.h"
+#include "timer.h"
+
+using fwk::TestTimer;
+
+struct Item {
+	bool operator<(const Item &rhs) const { return key < rhs.key; }
+
+	float key;
+	int index;
+};
+
+template <class T> void testSort(const char *name, const vector<T> &values) {
+	auto serial = values, parallel = values;
+	{
+		TestTimer t(format("% serial sort", name));
+		std::stable_sort(serial.begin(), serial.end());
+	}
+	{
+		TestTimer t(format("% parallel sort", name));
+		parallelSort(parallel);
+	}
+	for(int n : intRange(values))
+		ASSERT(!(serial[n] < parallel[n]) && !(parallel[n] < serial[n]));
+}
+
+void testAlgorithms(int size) {
+	Random random(123);
+	vector<u32> ints(size);
+	PodVector<int> signed_ints(size);
+	vector<Item> items(size);
+	for(int n : intRange(size)) {
+		ints[n] = random.uniform(0, 1 << 30);
+		signed_ints[n] = random.uniform(-1000000, 1000000);
+		items[n] = {random.uniform(-100.0f, 100.0f), n};
+	}
+
+	auto func = [](u32 value) { return double(value) * 0.5 + 1.0; };
+	vector<double> transformed, parallel_transformed;
+	{
+		TestTimer t("transform serial");
+		transformed = transform(ints, func);
+	}
+	{
+		TestTimer t("transform parallel");
+		parallel_transformed = parallelTransform(ints, func);
+	}
+	ASSERT(parallel_transformed == transformed);
+
+	auto pred = [](u32 value) { return (value & 7) < 3; };
+	vector<u32> filtered, parallel_filtered;
+	{
+		TestTimer t("filter serial");
+		filtered = filter(ints, pred);
+	}
+	{
+		TestTimer t("filter parallel");
+		parallel_filtered = parallelFilter(ints, pred);
+	}
+	ASSERT(parallel_filtered == filtered);
+
+	int count = 0, parallel_count = 0;
+	{
+		TestTimer t("countIf serial");
+		count = countIf(ints, pred);
+	}
+	{
+		TestTimer t("countIf parallel");
+		parallel_count = parallelCountIf(ints, pred);
+	}
+	ASSERT_EQ(parallel_count, count);
+
+	u64 sum = 0, parallel_sum = 0;
+	{
+		TestTimer t("accumulate serial");
+		sum = accumulate(ints, u64(0));
+	}
+	{
+		TestTimer t("accumulate parallel");
+		parallel_sum = parallelAccumulate(ints, u64(0));
+	}
+	ASSERT_EQ(parallel_sum, sum);
+
+	testSort("u32", ints);
+	testSort("int", vector<int>(signed_ints));
+	testSort("Item", items);
+}
+
+void testMain() {
+	vector<int> worker_counts = {0};
+	if(Thread::hardwareConcurrency() > 1)
+		worker_counts.emplace_back(Thread::hardwareConcurrency() - 1);
+
+	for(int num_workers : worker_counts) {
+		JobSystem jobs({.num_workers = num_workers});
+		print("Parallel algorithms test: % threads\n", jobs.numThreads());
+		testAlgorithms(4 * 1024 * 1024);
+		print("\n");
+	}
+
+	// Small inputs are processed serially
+	JobSystem jobs;
+	vector<int> small = transform<int>(intRange(100));
+	ASSERT_EQ(parallelFilter(small, [](int i) { return i % 3 == 0; }).size(), 34);
+	parallelSort(small, GreaterCompare());
+	ASSERT_EQ(small[0], 99);
+}
@@ -5,16 +5,23 @@
 
 #ifndef FWK_GEOM_DISABLED
 
+#include "fwk/geom/bvh.h"
 #include "fwk/geom/contour.h"
 #include "fwk/geom/delaunay.h"
 #include "fwk/geom/geom_graph.h"
+#include "fwk/geom/kd_tree.h"
+#include "fwk/geom/procgen.h"
 #include "fwk/geom/regular_grid.h"
 #include "fwk/geom/segment_grid.h"
+#include "fwk/geom/voronoi.h"
 #include "fwk/gfx/canvas_2d.h"
 #include "fwk/gfx/canvas_3d.h"
 #include "fwk/gfx/investigate.h"
+#include "fwk/heap.h"
 #include "fwk/math/random.h"
 #include "fwk/math/rotation.h"
+#include "fwk/sys/job_system.h"
+#include "geom_testing.h"
 
 static void orderByDirectionTest() {
 	vector<double2> vecs{{1.1, 0.0},  {3.0, 3.0},	 {1.0, 5.0},  {-2.0, 4.0},
@@ -34,6 +41,296 @@ static void orderByDirectionTest() {
 	}
 }
 
+static void testHeaps() {
+	Random rand(42);
+	vector<int> values = transform(intRange(1000), [&](int) { return rand.uniform(0, 500); });
+
+	Heap<int> heap(CSpan<int>{values});
+	ASSERT(heap.invariant());
+	for(int n = 0; n < 200; n++) {
+		int key = rand.uniform(values.size());
+		if(heap.value(key) > 0) {
+			values[key] = rand.uniform(0, heap.value(key));
+			heap.decreaseKey(key, values[key]);
+		}
+	}
+	ASSERT(heap.invariant());
+
+	auto sorted = values;
+	std::sort(sorted.begin(), sorted.end());
+	for(int n = 0; n < 1000; n++) {
+		auto [value, key] = heap.extractMin();
+		ASSERT_EQ(value, sorted[n]);
+		ASSERT_EQ(values[key], value);
+	}
+	ASSERT(heap.empty());
+
+	RadixHeap<u32> radix_heap;
+	for(int n : intRange(values))
+		radix_heap.insert(values[n], n);
+	for(int n = 0; n < 1000; n++) {
+		auto [value, key] = radix_heap.extractMin();
+		ASSERT_EQ(value, u32(sorted[n]));
+		if(n % 10 == 0)
+			radix_heap.insert(value + 1000, key);
+	}
+	ASSERT_EQ(radix_heap.size(), 100);
+}
+
+static void testBvh() {
+	Random rand(1234);
+	auto tris = randomTriangles(rand, 4000, 5.0f);
+	auto segments = transform(intRange(500), [&](int) {
+		return Segment3F(rand.sampleBox(float3(-120), float3(120)),
+						 rand.sampleBox(float3(-120), float3(120)));
+	});
+
+	auto checkQueries = [&](const Bvh &bvh) {
+		for(auto &segment : segments) {
+			float expected = inf;
+			for(auto &tri : tris)
+				expected = min(expected, segment.isectParam(tri).first.closest());
+			auto hit = bvh.closestHit(segment);
+			ASSERT_EQ(!!hit, expected < inf);
+			ASSERT_EQ(bvh.anyHit(segment), expected < inf);
+			if(hit) {
+				ASSERT_EQ(hit->param, expected);
+				ASSERT_EQ(segment.isectParam(tris[hit->index]).first.closest(), expected);
+			}
+		}
+
+		for(int n = 0; n < 100; n++) {
+			auto center = rand.sampleBox(float3(-100), float3(100));
+			FBox box(center - float3(10), center + float3(10));
+			vector<int> expected;
+			for(int i : intRange(tris)) {
+				auto tri_box = enclose(tris[i]);
+				bool touches = true;
+				for(int axis = 0; axis < 3; axis++)
+					touches &= box.min(axis) <= tri_box.max(axis) &&
+							   tri_box.min(axis) <= box.max(axis);
+				if(touches)
+					expected.emplace_back(i);
+			}
+			auto result = bvh.overlapping(box);
+			std::sort(result.begin(), result.end());
+			ASSERT_EQ(result, expected);
+		}
+	};
+
+	Bvh bvh(tris);
+	ASSERT_EQ(bvh.size(), tris.size());
+	checkQueries(bvh);
+
+	// Refitting after all triangles are moved
+	for(auto &tri : tris)
+		tri = tri + rand.sampleBox(float3(-3), float3(3));
+	bvh.refit(tris);
+	checkQueries(bvh);
+
+	Bvh box_bvh(transform(tris, [](auto &tri) { return enclose(tri); }));
+	ASSERT_EQ(box_bvh.overlapping(box_bvh.boundingBox()).size(), tris.size());
+	ASSERT(!Bvh().closestHit(segments[0]));
+}
+
+template <class T> static void testKdTree(CSpan<T> points, CSpan<bool> valids, Scalar<T> radius) {
+	using DistSq = typename KdTree<T>::DistSq;
+	using PT = PromoteIntegral<T>;
+	Random rand(1000 + points.size());
+	SparseSpan<T> span(points.data(), valids, countIf(valids));
+	KdTree<T> tree(span, 4);
+	ASSERT_EQ(tree.size(), span.size());
+	auto bbox = enclose(span);
+
+	for(int n = 0; n < 200; n++) {
+		auto point = rand.sampleBox(bbox.min() - T(5), bbox.max() + T(5));
+		vector<Pair<DistSq, int>> dists;
+		for(int i : span.indices())
+			dists.emplace_back(distanceSq<PT>(point, points[i]), i);
+		std::sort(dists.begin(), dists.end());
+		auto radius_sq = DistSq(radius) * DistSq(radius);
+
+		ASSERT_EQ(tree.closest(point), dists[0].second);
+		ASSERT_EQ(tree.closest(point, none, dists[0].second), dists[1].second);
+		ASSERT(!tree.closest(point, radius) || dists[0].first < radius_sq);
+
+		vector<int> expected, within_radius;
+		for(auto [dist, idx] : dists)
+			if(dist < radius_sq && expected.size() < 5)
+				expected.emplace_back(idx);
+		ASSERT_EQ(tree.kClosest(point, 5, radius), expected);
+		for(auto [dist, idx] : dists)
+			if(dist <= radius_sq)
+				within_radius.emplace_back(idx);
+		makeSorted(within_radius);
+		auto result = tree.withinRadius(point, radius);
+		makeSorted(result);
+		ASSERT_EQ(result, within_radius);
+
+		Box<T> box(vmin(point, points[dists[3].second]), vmax(point, points[dists[3].second]));
+		vector<int> inside;
+		for(int i : span.indices()) {
+			bool is_inside = true;
+			for(int a = 0; a < dim<T>; a++)
+				is_inside &= points[i][a] >= box.min(a) && points[i][a] <= box.max(a);
+			if(is_inside)
+				inside.emplace_back(i);
+		}
+		result = tree.inside(box);
+		makeSorted(result);
+		ASSERT_EQ(result, inside);
+	}
+}
+
+static void testKdTree() {
+	Random rand(4321);
+	// Lots of duplicates
+	auto ipoints = transform(intRange(2000), [&](int) { return rand.sampleBox(int2(-30), int2(30)); });
+	auto fpoints =
+		transform(intRange(3000), [&](int) { return rand.sampleBox(float3(-100), float3(100)); });
+	auto dpoints =
+		transform(intRange(3000), [&](int) { return rand.sampleBox(double2(-100), double2(100)); });
+	auto valids = transform(intRange(3000), [&](int) { return rand.uniform(0, 4) != 0; });
+	testKdTree<int2>(ipoints, vector<bool>(ipoints.size(), true), 5);
+	testKdTree<float3>(fpoints, valids, 20.0f);
+	testKdTree<double2>(dpoints, valids, 10.0);
+	ASSERT(!KdTree<float2>().closest(float2()));
+
+	// Poisson-disk sampling: no two points can be closer than min_dist
+	auto samples = randomPoints(rand, FRect(0, 0, 500, 500), 4.0);
+	KdTree<float2> sample_tree(samples);
+	for(int n : intRange(samples))
+		ASSERT(!sample_tree.closest(samples[n], 4.0f, n));
+
+	// Closest Voronoi cells
+	GeomGraph<double2> graph;
+	vector<VoronoiCell> cells;
+	for(int n = 0; n < 500; n++) {
+		auto vid = graph.fixVertex(dpoints[n]).id;
+		if(n % 5 == 4) {
+			auto eid = graph.fixEdge(VertexId(vid - 1), vid).id;
+			cells.back() = eid;
+		} else {
+			cells.emplace_back(vid);
+		}
+	}
+	auto kd_tree = graph.makeKdTree();
+	ASSERT_EQ(kd_tree.closest(dpoints[123]), 123);
+
+	Voronoi voronoi(graph, cells);
+	VoronoiCellIndex cell_index(voronoi);
+	for(int n = 0; n < 200; n++) {
+		auto pos = rand.sampleBox(double2(-100), double2(100));
+		double min_dist = inf;
+		for(auto &cell : cells) {
+			if(const VertexId *vid = cell)
+				min_dist = min(min_dist, distanceSq(pos, graph(*vid)));
+			else if(const EdgeId *eid = cell)
+				min_dist = min(min_dist, graph(*eid).distanceSq(pos));
+		}
+		auto cell_id = cell_index.findClosestCell(pos);
+		ASSERT(cell_id);
+		ASSERT_EQ(cell_id, voronoi.findClosestCell(pos));
+		auto &cell = cells[*cell_id];
+		double dist = cell.is<VertexId>() ? distanceSq(pos, graph(cell.get<VertexId>()))
+										  : graph(cell.get<EdgeId>()).distanceSq(pos);
+		ASSERT_EQ(dist, min_dist);
+	}
+}
+
+static void testSegmentGrid() {
+	Random rand(777);
+	vector<double2> points;
+	vector<Pair<VertexId>> edges;
+	randomLatticeGraph(rand, 60, points, edges);
+	points.emplace_back(-200.0, 300.0); // added later; outside of initial grid
+
+	// Half of the elements is inserted later, some are removed;
+	// Valid edges always have valid endpoints
+	vector<bool> point_valids(points.size()), edge_valids(edges.size());
+	for(int n : intRange(points))
+		point_valids[n] = n + 1 < points.size() && rand.uniform(0, 2) == 0;
+	for(int n : intRange(edges)) {
+		auto [v1, v2] = edges[n];
+		edge_valids[n] = point_valids[v1] && point_valids[v2] && rand.uniform(0, 2) == 0;
+	}
+	auto point_span = [&] {
+		return SparseSpan<double2>(points.data(), point_valids, countIf(point_valids));
+	};
+	auto edge_span = [&] {
+		return SparseSpan<Pair<VertexId>>(edges.data(), edge_valids, countIf(edge_valids));
+	};
+
+	auto checkQueries = [&](const SegmentGrid<double2> &grid) {
+		for(int n = 0; n < 200; n++) {
+			auto point = rand.sampleBox(double2(-50), double2(650));
+			double vert_dist = inf, edge_dist = inf;
+			for(int i : intRange(points))
+				if(point_valids[i])
+					vert_dist = min(vert_dist, distanceSq(point, points[i]));
+			for(int i : intRange(edges))
+				if(edge_valids[i]) {
+					auto [v1, v2] = edges[i];
+					edge_dist = min(edge_dist, Segment2D(points[v1], points[v2]).distanceSq(point));
+				}
+
+			auto vert = grid.closestVertex(point);
+			auto edge = grid.closestEdge(point);
+			ASSERT(vert && edge);
+			ASSERT_EQ(distanceSq(point, points[*vert]), vert_dist);
+			auto [v1, v2] = edges[*edge];
+			ASSERT_EQ(Segment2D(points[v1], points[v2]).distanceSq(point), edge_dist);
+			ASSERT(!grid.closestVertex(point, std::sqrt(vert_dist) * 0.99));
+		}
+	};
+
+	SegmentGrid<double2> grid(edge_span(), point_span(), {.cell_slack = 1});
+	checkQueries(grid);
+
+	for(int n : intRange(points))
+		if(!point_valids[n]) {
+			point_valids[n] = true;
+			grid.setSources(edge_span(), point_span());
+			grid.insert(VertexId(n));
+		}
+	for(int n : intRange(edges))
+		if(!edge_valids[n]) {
+			edge_valids[n] = true;
+			grid.setSources(edge_span(), point_span());
+			grid.insert(EdgeId(n));
+		}
+	ASSERT(grid.inRange(grid.toCell(points.back())));
+	checkQueries(grid);
+
+	for(int n : intRange(edges))
+		if(rand.uniform(0, 3) == 0) {
+			grid.remove(EdgeId(n));
+			edge_valids[n] = false;
+		}
+	vector<bool> used_points(points.size());
+	for(int n : intRange(edges))
+		if(edge_valids[n])
+			used_points[edges[n].first] = used_points[edges[n].second] = true;
+	for(int n : intRange(points))
+		if(!used_points[n] && rand.uniform(0, 3) == 0) {
+			grid.remove(VertexId(n));
+			point_valids[n] = false;
+		}
+	grid.setSources(edge_span(), point_span());
+	checkQueries(grid);
+
+	// Parallel build gives the same results as serial build
+	randomLatticeGraph(rand, 300, points, edges);
+	SegmentGrid<double2> serial_grid(edges, points, {.parallel = false});
+	JobSystem jobs({.num_workers = 3});
+	SegmentGrid<double2> parallel_grid(edges, points);
+	ASSERT_EQ(serial_grid.size(), parallel_grid.size());
+	for(auto cell : serial_grid) {
+		ASSERT(serial_grid.cellVerts(cell) == parallel_grid.cellVerts(cell));
+		ASSERT(serial_grid.cellEdges(cell) == parallel_grid.cellEdges(cell));
+	}
+}
+
 static void testGraph() {
 	// Testing hasCycles, reversed
 	auto pairs1 = vector<Pair<int>>{{0, 1}, {1, 2}, {2, 0}}.reinterpret<VertexIdPair>();
@@ -165,6 +462,98 @@ void testDelaunayFuncs() {
 	ASSERT_EQ(polygonArea(points), 100);
 }
 
+static vector<VertexIdPair> sortedPairs(CSpan<VertexIdPair> pairs) {
+	auto out = transform(pairs, [](auto pair) {
+		return pair.first < pair.second ? pair : VertexIdPair(pair.second, pair.first);
+	});
+	makeSorted(out);
+	return out;
+}
+
+// Checks Delaunay property (with brute force) & consistency of edges & triangles
+static void testDelaunayTriangulation(CSpan<int2> points) {
+	auto result = delaunayTriangulation(points);
+	vector<int2> unique_points = points;
+	makeSortedUnique(unique_points);
+	int num_points = unique_points.size();
+
+	vector<VertexIdPair> tri_edges;
+	for(auto &tri : result.tris) {
+		int2 corners[3] = {points[tri[0]], points[tri[1]], points[tri[2]]};
+		ASSERT(cross<llint2>(corners[1] - corners[0], corners[2] - corners[0]) > 0);
+		for(auto &point : points)
+			ASSERT(!insideCircumcircle(corners[0], corners[1], corners[2], point));
+		for(auto [i, j] : wrappedPairsRange(3))
+			tri_edges.emplace_back(VertexId(tri[i]), VertexId(tri[j]));
+	}
+	auto edges = sortedPairs(result.edges);
+	auto unique_edges = edges;
+	makeSortedUnique(unique_edges);
+	ASSERT_EQ(edges, unique_edges);
+
+	if(result.tris.empty()) {
+		// All points are collinear
+		ASSERT_EQ(edges.size(), max(num_points - 1, 0));
+		return;
+	}
+
+	// Hull edges belong to a single triangle; Euler formula has to be satisfied
+	tri_edges = sortedPairs(tri_edges);
+	int num_hull_edges = 0;
+	for(int n = 0; n < tri_edges.size(); n++) {
+		bool shared = (n > 0 && tri_edges[n - 1] == tri_edges[n]) ||
+					  (n + 1 < tri_edges.size() && tri_edges[n + 1] == tri_edges[n]);
+		num_hull_edges += !shared;
+	}
+	makeSortedUnique(tri_edges);
+	ASSERT_EQ(edges, tri_edges);
+	ASSERT_EQ(result.tris.size(), num_points * 2 - 2 - num_hull_edges);
+	ASSERT_EQ(edges.size(), num_points * 3 - 3 - num_hull_edges);
+}
+
+static void testDelaunayTriangulation() {
+	Random rand(1001);
+
+	// Small grids: lots of duplicated, collinear & cocircular points
+	for(int n = 0; n < 200; n++) {
+		int size = rand.uniform(1, 8), count = rand.uniform(0, 60);
+		auto points = transform(intRange(count), [&](int) {
+			return int2(rand.uniform(-size, size), rand.uniform(-size, size));
+		});
+		testDelaunayTriangulation(points);
+	}
+
+	vector<int2> line;
+	for(int n = 0; n < 20; n++)
+		line.emplace_back(int2(n * 3, -n * 2) * (n % 2 ? 1 : -1));
+	testDelaunayTriangulation(line);
+	ASSERT_EQ(delaunayTriangulation(line).edges.size(), line.size() - 1);
+
+	// From duplicated points only the one with lowest index is used
+	vector<int2> dup_line = {{4, 0}, {0, 0}, {2, 0}, {0, 0}, {4, 0}, {2, 0}};
+	ASSERT_EQ(sortedPairs(delaunayTriangulation(dup_line).edges),
+			  (vector<VertexIdPair>{{VertexId(0), VertexId(2)}, {VertexId(1), VertexId(2)}}));
+	auto dup_tri = dup_line;
+	insertBack(dup_tri, {int2(1, 3), int2(1, 3)});
+	for(auto [v0, v1] : delaunayTriangulation(dup_tri).edges)
+		for(int v : {v0, v1})
+			ASSERT(v < 3 || v == 6);
+
+	// Random float points are in general position, so triangulation is unique
+	for(int n = 0; n < 20; n++) {
+		auto points = transform(intRange(rand.uniform(3, 1000)), [&](int) {
+			return rand.sampleBox(float2(-100), float2(100));
+		});
+		auto ipoints = toIntegral<float2>(points, delaunayIntegralScale<float2>(points)).get();
+		testDelaunayTriangulation(ipoints);
+		ASSERT_EQ(sortedPairs(delaunay<float2>(points).get()),
+				  sortedPairs(Voronoi::delaunay(ipoints)));
+	}
+
+	auto duplicates = transform(intRange(10), [](int) { return float2(1, 2); });
+	ASSERT(!delaunayTriangulation<float2>(duplicates));
+}
+
 static void testGeomGraph() {
 	GeomGraph<float2> graph;
 	float2 points[] = {float2(-1, 0), float2(0, 0),	  float2(1, 0),
@@ -257,8 +646,13 @@ void testMain() {
 	//testPlaneGraph();
 	orderByDirectionTest();
 	testGraph();
+	testHeaps();
+	testBvh();
+	testSegmentGrid();
+	testKdTree();
 	testGeomGraph();
 	testDelaunayFuncs();
+	testDelaunayTriangulation();
 	testSquareBorder();
 	testInvestigators();
 }
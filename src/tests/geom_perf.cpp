@@ -0,0 +1,264 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "testing.h"
+
+#ifndef FWK_GEOM_DISABLED
+
+#include "fwk/geom/bvh.h"
+#include "fwk/geom/delaunay.h"
+#include "fwk/geom/graph.h"
+#include "fwk/geom/kd_tree.h"
+#include "fwk/geom/segment_grid.h"
+#include "fwk/geom/voronoi.h"
+#include "fwk/heap.h"
+#include "fwk/math/random.h"
+#include "fwk/sys/job_system.h"
+#include "geom_testing.h"
+
+// Distances from vertex 0; Graph is given in CSR format
+template <class THeap>
+vector<u32> dijkstra(CSpan<int> offsets, CSpan<Pair<int, u32>> edges, int num_verts) {
+	vector<u32> dists(num_verts, ~0u);
+	dists[0] = 0;
+	if constexpr(is_same<THeap, RadixHeap<u32>>) {
+		RadixHeap<u32> heap;
+		heap.insert(0, 0);
+		while(!heap.empty()) {
+			auto [dist, vert] = heap.extractMin();
+			if(dist != dists[vert])
+				continue;
+			for(int n = offsets[vert]; n < offsets[vert + 1]; n++) {
+				auto [target, weight] = edges[n];
+				if(dist + weight < dists[target]) {
+					dists[target] = dist + weight;
+					heap.insert(dist + weight, target);
+				}
+			}
+		}
+	} else {
+		THeap heap(num_verts);
+		heap.insert(0, 0);
+		while(!heap.empty()) {
+			auto [dist, vert] = heap.extractMin();
+			for(int n = offsets[vert]; n < offsets[vert + 1]; n++) {
+				auto [target, weight] = edges[n];
+				if(dist + weight < dists[target]) {
+					dists[target] = dist + weight;
+					heap.update(target, dist + weight);
+				}
+			}
+		}
+	}
+	return dists;
+}
+
+// Dijkstra on a big grid graph with random weights
+static void testDijkstraPerf() {
+	int grid_size = 512, num_verts = grid_size * grid_size;
+	Random rand(11);
+	vector<Pair<VertexId>> pairs;
+	for(int y = 0; y < grid_size; y++)
+		for(int x = 0; x < grid_size; x++) {
+			int idx = x + y * grid_size;
+			if(x + 1 < grid_size) {
+				pairs.emplace_back(VertexId(idx), VertexId(idx + 1));
+				pairs.emplace_back(VertexId(idx + 1), VertexId(idx));
+			}
+			if(y + 1 < grid_size) {
+				pairs.emplace_back(VertexId(idx), VertexId(idx + grid_size));
+				pairs.emplace_back(VertexId(idx + grid_size), VertexId(idx));
+			}
+		}
+	Graph graph(pairs, num_verts);
+	vector<double> weights =
+		transform(intRange(pairs), [&](int) -> double { return rand.uniform(1, 100); });
+
+	vector<int> offsets(num_verts + 1, 0);
+	for(auto [from, to] : pairs)
+		offsets[from + 1]++;
+	for(int n = 0; n < num_verts; n++)
+		offsets[n + 1] += offsets[n];
+	vector<Pair<int, u32>> edges(pairs.size());
+	auto positions = offsets;
+	for(int n : intRange(pairs))
+		edges[positions[pairs[n].first]++] = {pairs[n].second, u32(weights[n])};
+
+	auto time = getTime();
+	auto dists2 = dijkstra<Heap<u32, 2>>(offsets, edges, num_verts);
+	auto time2 = getTime();
+	auto dists4 = dijkstra<Heap<u32, 4>>(offsets, edges, num_verts);
+	auto time4 = getTime();
+	auto dists_radix = dijkstra<RadixHeap<u32>>(offsets, edges, num_verts);
+	auto time_radix = getTime();
+	auto spt = graph.shortestPathTree({VertexId(0)}, weights);
+	auto time_spt = getTime();
+
+	ASSERT(dists2 == dists4 && dists2 == dists_radix);
+	ASSERT_EQ(spt.numEdges(), num_verts - 1);
+	print("Dijkstra on % verts: binary heap: % ms; 4-ary heap: % ms; radix heap: % ms\n"
+		  "Graph::shortestPathTree: % ms\n",
+		  num_verts, (time2 - time) * 1000, (time4 - time2) * 1000, (time_radix - time4) * 1000,
+		  (time_spt - time_radix) * 1000);
+}
+
+// Performance of closest-hit queries against testing every triangle
+static void testBvhPerf() {
+	Random rand(1234);
+	auto tris = randomTriangles(rand, 100000, 2.0f);
+	auto segments = transform(intRange(500), [&](int) {
+		return Segment3F(rand.sampleBox(float3(-120), float3(120)),
+						 rand.sampleBox(float3(-120), float3(120)));
+	});
+
+	auto time = getTime();
+	Bvh bvh(tris);
+	auto build_time = getTime() - time;
+
+	vector<float> params(segments.size(), inf);
+	time = getTime();
+	for(int n : intRange(segments))
+		if(auto hit = bvh.closestHit(segments[n]))
+			params[n] = hit->param;
+	auto bvh_time = getTime() - time;
+
+	vector<float> brute_params(50, inf);
+	time = getTime();
+	for(int n : intRange(brute_params))
+		for(auto &tri : tris)
+			brute_params[n] = min(brute_params[n], segments[n].isectParam(tri).first.closest());
+	auto brute_time = (getTime() - time) * segments.size() / brute_params.size();
+	for(int n : intRange(brute_params))
+		ASSERT_EQ(params[n], brute_params[n]);
+	int num_hits = countIf(params, [](float param) { return param < inf; });
+
+	print("BVH over % triangles (depth: %): build: % ms; % segment queries (% hits): % ms "
+		  "(testing all triangles: % ms)\n",
+		  tris.size(), bvh.depth(), build_time * 1000, segments.size(), num_hits,
+		  bvh_time * 1000, brute_time * 1000);
+}
+
+static void testSegmentGridPerf() {
+	Random rand(99);
+	vector<double2> points;
+	vector<Pair<VertexId>> edges;
+	randomLatticeGraph(rand, 1000, points, edges);
+	auto queries = transform(intRange(100000),
+							 [&](int) { return rand.sampleBox(double2(0), double2(10000)); });
+
+	auto time = getTime();
+	SegmentGrid<double2> grid(edges, points, {.parallel = false});
+	auto serial_time = getTime() - time;
+	double parallel_time = 0.0;
+	int num_threads = 1;
+	{
+		JobSystem jobs;
+		num_threads = jobs.numThreads();
+		time = getTime();
+		SegmentGrid<double2> parallel_grid(edges, points);
+		parallel_time = getTime() - time;
+	}
+
+	int num_found = 0;
+	time = getTime();
+	for(auto &point : queries)
+		num_found += !!grid.closestEdge(point);
+	auto edge_time = getTime() - time;
+	time = getTime();
+	for(auto &point : queries)
+		num_found += !!grid.closestVertex(point);
+	auto vert_time = getTime() - time;
+	ASSERT_EQ(num_found, queries.size() * 2);
+
+	// Removing & inserting back 1% of edges
+	int num_updates = edges.size() / 100;
+	time = getTime();
+	for(int n = 0; n < num_updates; n++)
+		grid.remove(EdgeId(n * 100));
+	for(int n = 0; n < num_updates; n++)
+		grid.insert(EdgeId(n * 100));
+	auto update_time = getTime() - time;
+
+	print("SegmentGrid with % verts & % edges: build: % ms; parallel build (% threads): % ms\n"
+		  "  % queries: closestEdge: % ms; closestVertex: % ms\n"
+		  "  % edge removals & insertions: % ms\n",
+		  points.size(), edges.size(), serial_time * 1000, num_threads, parallel_time * 1000,
+		  queries.size(), edge_time * 1000, vert_time * 1000, num_updates * 2,
+		  update_time * 1000);
+}
+
+static void testKdTreePerf() {
+	Random rand(555);
+	auto points =
+		transform(intRange(1000000), [&](int) { return rand.sampleBox(float2(0), float2(1000)); });
+	auto queries =
+		transform(intRange(100000), [&](int) { return rand.sampleBox(float2(0), float2(1000)); });
+
+	auto time = getTime();
+	KdTree<float2> tree(points);
+	auto build_time = getTime() - time;
+
+	int num_found = 0;
+	time = getTime();
+	for(auto &point : queries)
+		num_found += !!tree.closest(point);
+	auto closest_time = getTime() - time;
+	ASSERT_EQ(num_found, queries.size());
+	time = getTime();
+	for(auto &point : queries)
+		num_found += tree.kClosest(point, 8).size();
+	auto knn_time = getTime() - time;
+	time = getTime();
+	for(auto &point : queries)
+		num_found += tree.withinRadius(point, 2.0f).size();
+	auto radius_time = getTime() - time;
+
+	vector<float> brute_dists(20, inf);
+	time = getTime();
+	for(int n : intRange(brute_dists))
+		for(auto &point : points)
+			brute_dists[n] = min(brute_dists[n], distanceSq(point, queries[n]));
+	auto brute_time = (getTime() - time) * queries.size() / brute_dists.size();
+	for(int n : intRange(brute_dists))
+		ASSERT_EQ(distanceSq(points[*tree.closest(queries[n])], queries[n]), brute_dists[n]);
+
+	print("KdTree over % points (depth: %): build: % ms; % queries:\n"
+		  "  closest: % ms (testing all points: % ms); 8 closest: % ms; radius: % ms\n",
+		  points.size(), tree.depth(), build_time * 1000, queries.size(), closest_time * 1000,
+		  brute_time * 1000, knn_time * 1000, radius_time * 1000);
+}
+
+static void testDelaunayPerf() {
+	Random rand(2002);
+	auto points =
+		transform(intRange(1000000), [&](int) { return rand.sampleBox(float2(0), float2(1000)); });
+
+	auto time = getTime();
+	auto result = delaunayTriangulation<float2>(points).get();
+	auto native_time = getTime() - time;
+
+	time = getTime();
+	auto ipoints = toIntegral<float2>(points, delaunayIntegralScale<float2>(points)).get();
+	auto voronoi_edges = Voronoi::delaunay(ipoints);
+	auto voronoi_time = getTime() - time;
+
+	ASSERT_EQ(result.edges.size(), voronoi_edges.size());
+	print("Delaunay triangulation of % points (% edges, % triangles):\n"
+		  "  native: % ms; through Voronoi diagram: % ms\n",
+		  points.size(), result.edges.size(), result.tris.size(), native_time * 1000,
+		  voronoi_time * 1000);
+}
+
+void testMain() {
+	testDijkstraPerf();
+	testBvhPerf();
+	testSegmentGridPerf();
+	testKdTreePerf();
+	testDelaunayPerf();
+}
+
+#else
+
+void testMain() { printf("FWK_GEOM disabled\n"); }
+
+#endif
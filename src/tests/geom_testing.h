@@ -0,0 +1,36 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#pragma once
+
+// Test data generators shared by geom & geom_perf
+
+#include "fwk/geom_base.h"
+#include "fwk/math/random.h"
+#include "fwk/math/triangle.h"
+#include "testing.h"
+
+inline vector<Triangle3F> randomTriangles(Random &rand, int count, float scale) {
+	return transform(intRange(count), [&](int) {
+		auto center = rand.sampleBox(float3(-100), float3(100));
+		return Triangle3F(center + rand.sampleBox(float3(-scale), float3(scale)),
+						  center + rand.sampleBox(float3(-scale), float3(scale)),
+						  center + rand.sampleBox(float3(-scale), float3(scale)));
+	});
+}
+
+// Jittered lattice of points; edges connect some of the neighbouring points
+inline void randomLatticeGraph(Random &rand, int side, vector<double2> &points,
+							   vector<Pair<VertexId>> &edges) {
+	points.clear();
+	edges.clear();
+	for(int y = 0; y < side; y++)
+		for(int x = 0; x < side; x++) {
+			points.emplace_back(double2(x, y) * 10.0 + rand.sampleBox(double2(0), double2(8)));
+			int idx = x + y * side;
+			if(x + 1 < side && rand.uniform(0, 2) != 0)
+				edges.emplace_back(VertexId(idx), VertexId(idx + 1));
+			if(y + 1 < side && rand.uniform(0, 2) != 0)
+				edges.emplace_back(VertexId(idx), VertexId(idx + side));
+		}
+}
@@ -1,9 +1,13 @@
 // Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
 // This file is part of libfwk. See license.txt for details.
 
+#include "fwk/concurrent_hash_map.h"
 #include "fwk/hash_map.h"
 #include "fwk/hash_map_stats.h"
+#include "fwk/hash_set.h"
 #include "fwk/math/random.h"
+#include "fwk/str.h"
+#include "fwk/sys/thread.h"
 #include "fwk/tag_id.h"
 #include "testing.h"
 #include <unordered_map>
@@ -127,7 +131,487 @@ void miniTest() {
 	ASSERT_EQ(check1, check2);
 }
 
+struct RobinHoodPolicy {
+	static constexpr auto probing() { return HashMapProbing::robin_hood; }
+};
+
+void robinHoodTest() {
+	struct TagPolicy {
+		static constexpr auto storage() { return HashMapStorage::separated; }
+		static constexpr auto probing() { return HashMapProbing::robin_hood; }
+		static u32 hash(MyTag tag) { return u32(tag) ^ (u32(tag) << 10); }
+	};
+
+	print("HashMap test #3 (Robin hood probing)\n");
+	HashMap<const char *, const char *, RobinHoodPolicy> map1_fwk;
+	std::unordered_map<const char *, const char *> map1_std;
+	HashMap<MyTag, const char *, TagPolicy> map2_fwk;
+	std::unordered_map<u16, const char *> map2_std;
+
+	int check1, check2;
+	auto result1_fwk = testMap1(map1_fwk, "fwk::HashMap", 2048, check1);
+	auto result1_std = testMap1(map1_std, "std::unordered_map", 2048, check2);
+	makeSorted(result1_fwk);
+	makeSorted(result1_std);
+	ASSERT_EQ(result1_fwk, result1_std);
+	ASSERT_EQ(check1, check2);
+
+	auto result2_fwk = testMap2(map2_fwk, "fwk::HashMap", 2048 * 32, check1);
+	auto result2_std = testMap2(map2_std, "std::unordered_map", 2048 * 32, check2);
+	HashMapStats(map2_fwk).print(false);
+	makeSorted(result2_fwk);
+	makeSorted(result2_std);
+	ASSERT_EQ(result2_fwk, result2_std);
+	ASSERT_EQ(check1, check2);
+
+	// Erasing ranges
+	HashMap<int, int, RobinHoodPolicy> map3;
+	HashSet<int, RobinHoodPolicy> set3;
+	for(int n = 0; n < 1000; n++) {
+		map3.emplace(n * 7, n);
+		set3.emplace(n * 7);
+	}
+	auto it1 = map3.begin(), it2 = map3.begin();
+	auto sit1 = set3.begin(), sit2 = set3.begin();
+	for(int n = 0; n < 100; n++)
+		++it1, ++sit1;
+	for(int n = 0; n < 800; n++)
+		++it2, ++sit2;
+	map3.erase(it1, it2);
+	set3.erase(sit1, sit2);
+	ASSERT_EQ(map3.size(), 300);
+	ASSERT_EQ(set3.size(), 300);
+	int num_found = 0;
+	for(int n = 0; n < 1000; n++) {
+		auto it = map3.find(n * 7);
+		ASSERT_EQ(!!it, set3.contains(n * 7));
+		if(it) {
+			ASSERT_EQ(it->value, n);
+			num_found++;
+		}
+	}
+	ASSERT_EQ(num_found, 300);
+}
+
+// Size of the map stays constant, but keys are constantly erased & inserted.
+// With quadratic probing deleted markers accumulate and force periodic rehashes.
+template <class Map> void churnTest(const char *name, int num_keys, int num_cycles) {
+	Map map;
+	Random rand;
+	vector<int> keys;
+	while(keys.size() < num_keys) {
+		int key = rand.uniform(1 << 30);
+		if(map.emplace(key, 0).second)
+			keys.emplace_back(key);
+	}
+
+	print("HashMap churn test (%): % keys, % cycles\n", name, num_keys, num_cycles);
+	int num_steps = 4, step_size = num_cycles / num_steps;
+	for(int step = 0; step < num_steps; step++) {
+		auto time = getTime();
+		for(int n = 0; n < step_size; n++) {
+			int idx = rand.uniform(keys.size());
+			ASSERT(map.erase(keys[idx]));
+			int key = rand.uniform(1 << 30);
+			while(!map.emplace(key, n).second)
+				key = rand.uniform(1 << 30);
+			keys[idx] = key;
+		}
+		time = getTime() - time;
+
+		HashMapStats stats(map);
+		printf("  %9d cycles: %7.2f ns / cycle; capacity: %7d deleted: %7d avg hit: %5.2f "
+			   "max hit: %3d memory: %lld KB\n",
+			   (step + 1) * step_size, time * 1000000000.0 / step_size, stats.capacity,
+			   stats.num_deleted, stats.avg_hit_sequence_length, stats.max_hit_sequence_length,
+			   stats.used_memory / 1024);
+	}
+
+	ASSERT_EQ(map.size(), keys.size());
+	for(auto key : keys)
+		ASSERT(map.find(key) != map.end());
+}
+
+template <HashMapStorage storage_type> struct StoragePolicy {
+	static constexpr auto storage() { return storage_type; }
+};
+
+void groupedStorageTest() {
+	using Policy = StoragePolicy<HashMapStorage::grouped>;
+	print("HashMap test #4 (Grouped storage)\n");
+
+	HashMap<const char *, const char *, Policy> map1_fwk;
+	std::unordered_map<const char *, const char *> map1_std;
+	int check1, check2;
+	auto result1_fwk = testMap1(map1_fwk, "fwk::HashMap", 2048, check1);
+	auto result1_std = testMap1(map1_std, "std::unordered_map", 2048, check2);
+	makeSorted(result1_fwk);
+	makeSorted(result1_std);
+	ASSERT_EQ(result1_fwk, result1_std);
+	ASSERT_EQ(check1, check2);
+
+	HashMap<MyTag, const char *, Policy> map2_fwk;
+	std::unordered_map<u16, const char *> map2_std;
+	auto result2_fwk = testMap2(map2_fwk, "fwk::HashMap", 2048 * 32, check1);
+	auto result2_std = testMap2(map2_std, "std::unordered_map", 2048 * 32, check2);
+	HashMapStats(map2_fwk).print(false);
+	makeSorted(result2_fwk);
+	makeSorted(result2_std);
+	ASSERT_EQ(result2_fwk, result2_std);
+	ASSERT_EQ(check1, check2);
+}
+
+// Lookups (half of them hits, half misses) in a map with string keys
+template <class Map>
+void stringLookupTest(const char *name, CSpan<string> keys, CSpan<string> queries) {
+	Map map;
+	for(int n = 0; n < keys.size(); n++)
+		map[keys[n]] = n;
+
+	auto time = getTime();
+	int num_found = 0;
+	for(auto &query : queries)
+		num_found += map.find(query) != map.end();
+	time = getTime() - time;
+
+	ASSERT_EQ(num_found, queries.size() / 2);
+	printf("%32s lookup test[%d]: %f ns / lookup\n", name, queries.size(),
+		   time * 1000000000.0 / queries.size());
+}
+
+void stringLookupTests() {
+	print("HashMap test #5 (String lookups)\n");
+	Random rand;
+	vector<string> keys, queries;
+	int num_keys = 100000, num_queries = 2000000;
+	for(int n = 0; n < num_keys; n++)
+		keys.emplace_back(format("some_node_name_%", n));
+	for(int n = 0; n < num_queries; n++) {
+		int idx = rand.uniform(num_keys);
+		queries.emplace_back(format(n & 1 ? "some_node_name_%" : "other_node_name_%", idx));
+	}
+
+	using ST = HashMapStorage;
+	stringLookupTest<HashMap<string, int, StoragePolicy<ST::paired_with_hashes>>>(
+		"fwk::HashMap (paired_with_hashes)", keys, queries);
+	stringLookupTest<HashMap<string, int, StoragePolicy<ST::grouped>>>("fwk::HashMap (grouped)",
+																		 keys, queries);
+	stringLookupTest<std::unordered_map<string, int>>("std::unordered_map", keys, queries);
+}
+
+void transparentLookupTest() {
+	print("HashMap test #6 (Transparent lookups)\n");
+
+	HashMap<string, int, StrHashPolicy> map;
+	map["abc"] = 1;
+	map[Str("def")] = 2;
+	map[string("ghi")] = 3;
+	ASSERT(map.contains(Str("abc")));
+	ASSERT(map.contains(ZStr("ghi")));
+	ASSERT(!map.contains("xyz"));
+	ASSERT_EQ(map.maybeFind(Str("def")), 2);
+	ASSERT(map.erase(Str("ghi")));
+	ASSERT_EQ(map.size(), 2);
+
+	HashSet<string, StrHashPolicy> set;
+	set.emplace("abc");
+	ASSERT(set.contains(Str("abc")));
+	ASSERT(set.find("abc") != set.end());
+	ASSERT(!set.contains(Str("xyz")));
+	ASSERT(set.erase(Str("abc")));
+
+	// Lookups with Str: with regular policy temporary string has to be constructed
+	Random rand;
+	vector<string> keys, query_strings;
+	int num_keys = 10000, num_queries = 1000000;
+	for(int n = 0; n < num_keys; n++)
+		keys.emplace_back(format("some_node_name_%", n));
+	for(int n = 0; n < num_queries; n++)
+		query_strings.emplace_back(keys[rand.uniform(num_keys)]);
+	auto queries = transform(query_strings, [](const string &str) { return Str(str); });
+
+	HashMap<string, int> map1;
+	HashMap<string, int, StrHashPolicy> map2;
+	for(int n = 0; n < num_keys; n++)
+		map1[keys[n]] = map2[keys[n]] = n;
+
+	auto time = getTime();
+	int num_found = 0;
+	for(auto query : queries)
+		num_found += map1.contains(string(query));
+	auto time1 = getTime() - time;
+	ASSERT_EQ(num_found, num_queries);
+
+	time = getTime();
+	num_found = 0;
+	for(auto query : queries)
+		num_found += map2.contains(query);
+	auto time2 = getTime() - time;
+	ASSERT_EQ(num_found, num_queries);
+
+	printf("%32s lookup test[%d]: %f ns / lookup\n", "Str -> string", num_queries,
+		   time1 * 1000000000.0 / num_queries);
+	printf("%32s lookup test[%d]: %f ns / lookup\n", "Str (StrHashPolicy)", num_queries,
+		   time2 * 1000000000.0 / num_queries);
+}
+
+// Shared map accessed by multiple threads: 90% lookups, 10% inserts / erases
+template <class Map> struct ConcurrentTest {
+	static constexpr int num_keys = 1 << 16;
+
+	struct Worker {
+		Map *map;
+		int seed, num_ops;
+		int num_found = 0;
+	};
+
+	static void *runWorker(void *arg) {
+		auto &worker = *(Worker *)arg;
+		Random rand(worker.seed);
+		for(int n = 0; n < worker.num_ops; n++) {
+			int key = rand.uniform(num_keys), op = rand.uniform(20);
+			if(op == 0)
+				worker.map->insert(key, n);
+			else if(op == 1)
+				worker.map->erase(key);
+			else
+				worker.num_found += worker.map->contains(key);
+		}
+		return nullptr;
+	}
+
+	static void run(const char *name, int num_threads, int num_ops) {
+		Map map;
+		for(int n = 0; n < num_keys; n += 2)
+			map.insert(n, n);
+
+		vector<Worker> workers(num_threads, Worker{&map, 0, num_ops / num_threads});
+		for(int n = 0; n < num_threads; n++)
+			workers[n].seed = 123 + n;
+		vector<Dynamic<Thread>> threads;
+
+		auto time = getTime();
+		for(auto &worker : workers)
+			threads.emplace_back(runWorker, &worker);
+		for(auto &thread : threads)
+			thread->join();
+		time = getTime() - time;
+
+		printf("%32s threads: %2d %8.2f Mops / sec\n", name, num_threads,
+			   num_ops / time * 0.000001);
+	}
+};
+
+struct LockedHashMap {
+	void insert(int key, int value) {
+		MutexLocker lock(mutex);
+		map.emplace(key, value);
+	}
+	void erase(int key) {
+		MutexLocker lock(mutex);
+		map.erase(key);
+	}
+	bool contains(int key) {
+		MutexLocker lock(mutex);
+		return map.find(key) != map.end();
+	}
+
+	Mutex mutex;
+	HashMap<int, int> map;
+};
+
+struct ConcurrentMap {
+	void insert(int key, int value) { map.emplace(key, value); }
+	void erase(int key) { map.erase(key); }
+	bool contains(int key) { return map.contains(key); }
+
+	ConcurrentHashMap<int, int> map;
+};
+
+// Compares ConcurrentHashMap with std::unordered_map on a random sequence of operations
+template <class V, class Func> void concurrentModelTest(const Func &make_value) {
+	ConcurrentHashMap<int, V> map1(4);
+	std::unordered_map<int, V> map2;
+	Random rand;
+	for(int n = 0; n < 100000; n++) {
+		int key = rand.uniform(2000), op = rand.uniform(4);
+		if(op == 0)
+			ASSERT_EQ(map1.emplace(key, make_value(n)), map2.emplace(key, make_value(n)).second);
+		else if(op == 1) {
+			ASSERT_EQ(map1.assign(key, make_value(n)), !map2.contains(key));
+			map2[key] = make_value(n);
+		} else if(op == 2)
+			ASSERT_EQ(map1.erase(key), map2.erase(key) > 0);
+		else {
+			auto value = map1.maybeFind(key);
+			auto it = map2.find(key);
+			ASSERT_EQ(!!value, it != map2.end());
+			if(value)
+				ASSERT_EQ(*value, it->second);
+		}
+	}
+	ASSERT_EQ(map1.size(), int(map2.size()));
+}
+
+// Writers insert & erase keys from their own ranges (so the map grows a lot in the meantime),
+// readers verify that every value they find matches its key
+struct ConcurrentVerifyTest {
+	static constexpr int num_keys_per_writer = 1 << 15;
+	static int valueOf(int key) { return key * 7 + 3; }
+
+	struct Worker {
+		ConcurrentHashMap<int, int> *map;
+		std::atomic<int> *num_active_writers;
+		int id, num_writers;
+		int num_found = 0;
+	};
+
+	static void *runWriter(void *arg) {
+		auto &worker = *(Worker *)arg;
+		auto &map = *worker.map;
+		int first = worker.id * num_keys_per_writer;
+		for(int n = 0; n < num_keys_per_writer; n++) {
+			int key = first + n;
+			ASSERT(map.emplace(key, valueOf(key)));
+			ASSERT_EQ(map.maybeFind(key), Maybe<int>(valueOf(key)));
+			// Every third key is erased shortly afterwards
+			if(n % 3 == 2) {
+				int erased_key = key - 1;
+				ASSERT(map.erase(erased_key));
+				ASSERT(!map.contains(erased_key));
+			}
+		}
+		worker.num_active_writers->fetch_sub(1);
+		return nullptr;
+	}
+
+	static void *runReader(void *arg) {
+		auto &worker = *(Worker *)arg;
+		Random rand(worker.id);
+		int max_key = worker.num_writers * num_keys_per_writer;
+		while(worker.num_active_writers->load() > 0) {
+			int key = rand.uniform(max_key);
+			if(auto value = worker.map->maybeFind(key)) {
+				ASSERT_EQ(*value, valueOf(key));
+				worker.num_found++;
+			}
+		}
+		return nullptr;
+	}
+
+	static void run(int num_writers, int num_readers) {
+		ConcurrentHashMap<int, int> map(4);
+		std::atomic<int> num_active_writers = num_writers;
+		vector<Worker> workers;
+		for(int n = 0; n < num_writers + num_readers; n++)
+			workers.emplace_back(Worker{&map, &num_active_writers, n, num_writers});
+
+		vector<Dynamic<Thread>> threads;
+		for(int n = 0; n < workers.size(); n++)
+			threads.emplace_back(n < num_writers ? runWriter : runReader, &workers[n]);
+		for(auto &thread : threads)
+			thread->join();
+
+		int expected_size = 0;
+		for(int key = 0; key < num_writers * num_keys_per_writer; key++) {
+			int n = key % num_keys_per_writer;
+			bool erased = n % 3 == 1 && n + 1 < num_keys_per_writer;
+			expected_size += !erased;
+			ASSERT_EQ(map.maybeFind(key), erased ? Maybe<int>() : Maybe<int>(valueOf(key)));
+		}
+		ASSERT_EQ(map.size(), expected_size);
+	}
+};
+
+void concurrentTest() {
+	print("HashMap test #7 (Concurrent access)\n");
+
+	// Basic correctness tests (with locked & optimistic reads)
+	concurrentModelTest<string>([](int n) { return toString(n); });
+	concurrentModelTest<int>([](int n) { return n; });
+	ConcurrentVerifyTest::run(2, 2);
+
+	int max_threads = max(1, Thread::hardwareConcurrency());
+	vector<int> thread_counts;
+	for(int n = 1; n < max_threads; n *= 2)
+		thread_counts.emplace_back(n);
+	thread_counts.emplace_back(max_threads);
+
+	int num_ops = 4000000;
+	for(int num_threads : thread_counts)
+		ConcurrentTest<LockedHashMap>::run("HashMap + Mutex", num_threads, num_ops);
+	for(int num_threads : thread_counts)
+		ConcurrentTest<ConcurrentMap>::run("ConcurrentHashMap", num_threads, num_ops);
+}
+
+// Compares build() with emplace() in a loop and findMany() with find() in a loop;
+// Map is big enough to not fit in cache
+template <class Map> void bulkTest(const char *name, int num_keys, int num_queries) {
+	Random rand;
+	vector<Pair<int, int>> pairs;
+	pairs.reserve(num_keys);
+	for(int n = 0; n < num_keys; n++)
+		pairs.emplace_back(rand.uniform(0, 1 << 30), n);
+	vector<int> queries;
+	queries.reserve(num_queries);
+	for(int n = 0; n < num_queries; n++)
+		queries.emplace_back(n & 1 ? pairs[rand.uniform(num_keys)].first : -n);
+
+	auto time = getTime();
+	Map map1;
+	for(auto &pair : pairs)
+		map1.emplace(pair);
+	auto emplace_time = getTime() - time;
+
+	time = getTime();
+	Map map2;
+	map2.build(pairs);
+	auto build_time = getTime() - time;
+	ASSERT_EQ(map1.size(), map2.size());
+
+	time = getTime();
+	vector<typename Map::Iter> iters1;
+	iters1.reserve(num_queries);
+	for(auto query : queries)
+		iters1.emplace_back(map1.find(query));
+	auto find_time = getTime() - time;
+
+	time = getTime();
+	vector<typename Map::Iter> iters2(num_queries, map2.end());
+	map2.findMany(queries, iters2);
+	auto find_many_time = getTime() - time;
+
+	for(int n = 0; n < num_queries; n++) {
+		ASSERT_EQ(!iters1[n], !iters2[n]);
+		if(iters1[n])
+			ASSERT_EQ(iters1[n]->value, iters2[n]->value);
+	}
+
+	auto ns = [](double time, int count) { return time * 1000000000.0 / count; };
+	printf("%20s: emplace: %6.2f ns / key   build: %6.2f ns / key\n", name,
+		   ns(emplace_time, num_keys), ns(build_time, num_keys));
+	printf("%20s:    find: %6.2f ns / key findMany: %6.2f ns / key\n", "",
+		   ns(find_time, num_queries), ns(find_many_time, num_queries));
+}
+
+void bulkTests() {
+	print("HashMap test #8 (Bulk build & batched lookups)\n");
+	int num_keys = 1000000, num_queries = 4000000;
+	using ST = HashMapStorage;
+	bulkTest<HashMap<int, int>>("quadratic", num_keys, num_queries);
+	bulkTest<HashMap<int, int, RobinHoodPolicy>>("robin hood", num_keys, num_queries);
+	bulkTest<HashMap<int, int, StoragePolicy<ST::grouped>>>("grouped", num_keys, num_queries);
+}
+
 void testMain() {
 	microTest();
 	miniTest();
+	robinHoodTest();
+	churnTest<HashMap<int, int>>("quadratic", 100000, 2000000);
+	churnTest<HashMap<int, int, RobinHoodPolicy>>("robin hood", 100000, 2000000);
+	groupedStorageTest();
+	stringLookupTests();
+	transparentLookupTest();
+	concurrentTest();
+	bulkTests();
 }
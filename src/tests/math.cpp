@@ -17,6 +17,7 @@
 #include "fwk/math/rational.h"
 #include "fwk/math/rational_angle.h"
 #include "fwk/math/ray.h"
+#include "fwk/math/ray_packet.h"
 #include "fwk/math/rotation.h"
 #include "fwk/math/segment.h"
 #include "fwk/math/tetrahedron.h"
@@ -675,6 +676,155 @@ void testNans() {
 	ASSERT(!seg2.isectParam(broken_tri).first);
 }
 
+struct PacketTestData {
+	PacketTestData(int count) {
+		Random rand(321);
+		for(int n = 0; n < count; n++) {
+			auto origin = rand.sampleBox(float3(-20), float3(20));
+			auto target = rand.sampleBox(float3(-10), float3(10));
+			rays.emplace_back(origin, normalize(target - origin));
+			auto center = rand.sampleBox(float3(-10), float3(10));
+			tris.emplace_back(center + rand.sampleBox(float3(-4), float3(4)),
+							  center + rand.sampleBox(float3(-4), float3(4)),
+							  center + rand.sampleBox(float3(-4), float3(4)));
+			auto size = rand.sampleBox(float3(0), float3(5));
+			boxes.emplace_back(center - size, center + size);
+		}
+		// Special cases: axis-aligned rays & rays starting on box faces
+		rays.emplace_back(float3(0, 0, -20), float3(0, 0, 1));
+		rays.emplace_back(float3(-5, -5, -20), float3(1, 0, 0));
+		boxes.emplace_back(float3(-5, -5, -5), float3(5, 5, 5));
+		tris.emplace_back(float3(-5, 0, 0), float3(5, 0, 0), float3(0, 5, 0));
+	}
+
+	vector<Ray3F> rays;
+	vector<Triangle3F> tris;
+	vector<FBox> boxes;
+};
+
+// Results have to be exactly the same as in scalar functions
+template <int N> void testRayPackets(const PacketTestData &data) {
+	auto &rays = data.rays;
+	auto &tris = data.tris;
+	auto &boxes = data.boxes;
+
+	for(int r = 0; r + N <= rays.size(); r += N) {
+		RayPacket<N> packet(cspan(&rays[r], N));
+		for(int n = 0; n < tris.size(); n += 7) {
+			auto tri_params = isectParam(packet, tris[n]);
+			auto box_params = isectParam(packet, boxes[n]);
+			for(int i = 0; i < N; i++) {
+				ASSERT_EQ(tri_params[i], rays[r + i].isectParam(tris[n]));
+				ASSERT_EQ(box_params[i], rays[r + i].isectParam(boxes[n]));
+			}
+		}
+	}
+
+	for(int n = 0; n + N <= tris.size(); n += N) {
+		TrianglePacket<N> tri_packet(cspan(&tris[n], N));
+		BoxPacket<N> box_packet(cspan(&boxes[n], N));
+		for(int r = 0; r < rays.size(); r += 7) {
+			auto tri_params = isectParam(rays[r], tri_packet);
+			auto box_params = isectParam(rays[r], box_packet);
+			for(int i = 0; i < N; i++) {
+				ASSERT_EQ(tri_params[i], rays[r].isectParam(tris[n + i]));
+				ASSERT_EQ(box_params[i], rays[r].isectParam(boxes[n + i]));
+			}
+		}
+	}
+
+	// Partially filled packets
+	RayPacket<N> partial(cspan(rays.data(), 3));
+	auto params = isectParam(partial, tris[0]);
+	for(int i = 0; i < N; i++)
+		ASSERT_EQ(params[i], rays[min(i, 2)].isectParam(tris[0]));
+}
+
+// Reports millions of ray-primitive tests per second
+template <int N> void testRayPacketsPerf(const PacketTestData &data) {
+	auto &rays = data.rays;
+	int num_rays = rays.size() / N * N, num_prims = 256;
+	vector<RayPacket<N>> ray_packets;
+	for(int r = 0; r < num_rays; r += N)
+		ray_packets.emplace_back(cspan(&rays[r], N));
+	vector<TrianglePacket<N>> tri_packets;
+	vector<BoxPacket<N>> box_packets;
+	for(int n = 0; n < num_prims; n += N) {
+		tri_packets.emplace_back(cspan(&data.tris[n], N));
+		box_packets.emplace_back(cspan(&data.boxes[n], N));
+	}
+
+	double num_tests = double(num_rays) * num_prims / 1000000.0;
+	auto measure = [&](const char *name, auto func) {
+		auto time = getTime();
+		int num_hits = func();
+		time = getTime() - time;
+		printf("  %-28s %8.2f M tests / sec  (hits: %d)\n", name, num_tests / time, num_hits);
+	};
+
+	if constexpr(N == 4) {
+		measure("scalar ray x triangle", [&] {
+			int hits = 0;
+			for(int r = 0; r < num_rays; r++)
+				for(int n = 0; n < num_prims; n++)
+					hits += !!rays[r].isectParam(data.tris[n]);
+			return hits;
+		});
+		measure("scalar ray x box", [&] {
+			int hits = 0;
+			for(int r = 0; r < num_rays; r++)
+				for(int n = 0; n < num_prims; n++)
+					hits += !!rays[r].isectParam(data.boxes[n]);
+			return hits;
+		});
+	}
+
+	auto countHits = [](const PacketIsectParams<N> &params) {
+		int hits = 0;
+		for(auto &param : params)
+			hits += !!param;
+		return hits;
+	};
+	measure(format("% rays x triangle", N).c_str(), [&] {
+		int hits = 0;
+		for(auto &packet : ray_packets)
+			for(int n = 0; n < num_prims; n++)
+				hits += countHits(isectParam(packet, data.tris[n]));
+		return hits;
+	});
+	measure(format("% rays x box", N).c_str(), [&] {
+		int hits = 0;
+		for(auto &packet : ray_packets)
+			for(int n = 0; n < num_prims; n++)
+				hits += countHits(isectParam(packet, data.boxes[n]));
+		return hits;
+	});
+	measure(format("ray x % triangles", N).c_str(), [&] {
+		int hits = 0;
+		for(int r = 0; r < num_rays; r++)
+			for(auto &packet : tri_packets)
+				hits += countHits(isectParam(rays[r], packet));
+		return hits;
+	});
+	measure(format("ray x % boxes", N).c_str(), [&] {
+		int hits = 0;
+		for(int r = 0; r < num_rays; r++)
+			for(auto &packet : box_packets)
+				hits += countHits(isectParam(rays[r], packet));
+		return hits;
+	});
+}
+
+void testRayPackets() {
+	PacketTestData data(2000);
+	testRayPackets<4>(data);
+	testRayPackets<8>(data);
+
+	print("Ray packet kernels:\n");
+	testRayPacketsPerf<4>(data);
+	testRayPacketsPerf<8>(data);
+}
+
 void testMain() {
 	testConsts();
 	testRational();
@@ -693,6 +843,7 @@ void testMain() {
 	testRationalAngles();
 	testDirections();
 	testNans();
+	testRayPackets();
 
 	float3 vec(0, 0, 1);
 	for(auto &s : vec.values())
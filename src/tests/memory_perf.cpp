@@ -0,0 +1,443 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/algorithm.h"
+#include "fwk/concurrent_slab_allocator.h"
+#include "fwk/dynamic.h"
+#include "fwk/hash_map.h"
+#include "fwk/math/random.h"
+#include "fwk/pod_vector.h"
+#include "fwk/slab_allocator.h"
+#include "fwk/sys/memory.h"
+#include "fwk/sys/thread.h"
+#include "fwk/vector.h"
+#include "testing.h"
+
+struct Block {
+	u8 *data;
+	int size;
+};
+
+void fillBlock(Block block, int seed) {
+	for(int n = 0; n < block.size; n++)
+		block.data[n] = u8(seed + n);
+}
+
+void checkBlock(Block block, int seed) {
+	for(int n = 0; n < block.size; n++)
+		ASSERT_EQ(block.data[n], u8(seed + n));
+}
+
+// Simulates typical frame loop: lots of short-lived small allocations of different sizes
+// with a window of live objects; Returns ns per allocation + deallocation
+template <class Alloc, class Free>
+double frameLoopTest(int num_frames, int allocs_per_frame, Alloc alloc, Free free) {
+	Random rand(123);
+	vector<Block> live;
+	live.reserve(allocs_per_frame * 2);
+
+	auto time = getTime();
+	for(int frame = 0; frame < num_frames; frame++) {
+		for(int n = 0; n < allocs_per_frame; n++) {
+			int size = rand.uniform(100) < 90 ? rand.uniform(8, 256) : rand.uniform(256, 4096);
+			live.emplace_back((u8 *)alloc(size), size);
+			live.back().data[0] = u8(n);
+		}
+		// Some objects survive until the next frame
+		int num_kept = 0;
+		for(int n = 0; n < live.size(); n++) {
+			if(rand.uniform(4) == 0)
+				live[num_kept++] = live[n];
+			else
+				free(live[n].data);
+		}
+		live.resize(num_kept);
+	}
+	for(auto &block : live)
+		free(block.data);
+	time = getTime() - time;
+	return time * 1000000000.0 / (double(num_frames) * allocs_per_frame);
+}
+
+void frameLoopTests() {
+	print("Memory test #1 (frame loop)\n");
+	auto stats_before = poolAllocatorStats();
+	int num_frames = 200, allocs_per_frame = 10000;
+	auto fwk_time = frameLoopTest(
+		num_frames, allocs_per_frame, [](int size) { return fwk::allocate(size); },
+		[](void *ptr) { fwk::deallocate(ptr); });
+	auto frame_stats = poolAllocatorStats() - stats_before;
+	auto malloc_time = frameLoopTest(
+		num_frames, allocs_per_frame, [](int size) { return malloc(size); },
+		[](void *ptr) { ::free(ptr); });
+
+	printf("  fwk::allocate: %.2f ns / allocation\n", fwk_time);
+	printf("         malloc: %.2f ns / allocation\n", malloc_time);
+	frame_stats.print();
+}
+
+// Blocks are allocated by producers and freed by consumers (on different threads);
+// Threads are started multiple times, so thread caches are reused.
+struct CrossThreadTest {
+	struct Queue {
+		Mutex mutex;
+		vector<Pair<Block, int>> blocks;
+		int num_producers_left = 0;
+	};
+
+	struct Worker {
+		Queue *queue;
+		int seed, num_blocks;
+		long long num_received = 0;
+	};
+
+	static void *runProducer(void *arg) {
+		auto &worker = *(Worker *)arg;
+		Random rand(worker.seed);
+		vector<Pair<Block, int>> batch;
+		for(int n = 0; n < worker.num_blocks; n++) {
+			int size = rand.uniform(1, 600);
+			Block block{(u8 *)fwk::allocate(size), size};
+			fillBlock(block, worker.seed + n);
+			batch.emplace_back(block, worker.seed + n);
+			if(batch.size() == 64 || n + 1 == worker.num_blocks) {
+				MutexLocker lock(worker.queue->mutex);
+				insertBack(worker.queue->blocks, batch);
+				batch.clear();
+			}
+		}
+		MutexLocker lock(worker.queue->mutex);
+		worker.queue->num_producers_left--;
+		return nullptr;
+	}
+
+	static void *runConsumer(void *arg) {
+		auto &worker = *(Worker *)arg;
+		vector<Pair<Block, int>> batch;
+		while(true) {
+			bool finished;
+			{
+				MutexLocker lock(worker.queue->mutex);
+				batch.swap(worker.queue->blocks);
+				finished = worker.queue->num_producers_left == 0;
+			}
+			for(auto [block, seed] : batch) {
+				checkBlock(block, seed);
+				fwk::deallocate(block.data);
+			}
+			worker.num_received += batch.size();
+			if(finished && batch.empty())
+				break;
+			batch.clear();
+		}
+		return nullptr;
+	}
+
+	static void run(int num_rounds, int num_producers, int num_blocks) {
+		long long total_received = 0;
+		for(int round = 0; round < num_rounds; round++) {
+			Queue queue;
+			queue.num_producers_left = num_producers;
+			vector<Worker> workers(num_producers + 1, Worker{&queue, 0, num_blocks});
+			for(int n = 0; n < num_producers; n++)
+				workers[n].seed = round * 1000 + n * 17;
+
+			vector<Dynamic<Thread>> threads;
+			for(int n = 0; n < num_producers; n++)
+				threads.emplace_back(runProducer, &workers[n]);
+			threads.emplace_back(runConsumer, &workers.back());
+			for(auto &thread : threads)
+				thread->join();
+			total_received += workers.back().num_received;
+		}
+		ASSERT_EQ(total_received, (long long)num_rounds * num_producers * num_blocks);
+	}
+};
+
+void crossThreadTest() {
+	print("Memory test #2 (cross-thread deallocations)\n");
+	auto stats_before = poolAllocatorStats();
+	int num_threads = max(2, Thread::hardwareConcurrency());
+	auto time = getTime();
+	int num_rounds = 8, num_blocks = 50000;
+	CrossThreadTest::run(num_rounds, num_threads - 1, num_blocks);
+	time = getTime() - time;
+	printf("  %d producers: %.2f ns / block\n", num_threads - 1,
+		   time * 1000000000.0 / (double(num_rounds) * (num_threads - 1) * num_blocks));
+
+	auto stats = poolAllocatorStats() - stats_before;
+	if(poolAllocatorEnabled()) {
+		// Thread caches of finished threads should be reused
+		ASSERT(stats.num_thread_caches <= stats_before.num_thread_caches + num_threads);
+		for(int n = 0; n < stats.num_size_classes; n++) {
+			auto &size_class = stats.size_classes[n];
+			if(size_class.block_size <= 600)
+				ASSERT_EQ(size_class.num_allocations, size_class.num_deallocations);
+		}
+	}
+	stats.print();
+}
+
+// Makes sure that blocks don't overlap and keep their contents
+void overlapTest() {
+	Random rand;
+	vector<Block> blocks;
+	for(int n = 0; n < 20000; n++) {
+		int size = rand.uniform(0, 5000);
+		blocks.emplace_back((u8 *)fwk::allocate(size), size);
+		fillBlock(blocks.back(), n);
+	}
+	for(int n = 0; n < blocks.size(); n++) {
+		checkBlock(blocks[n], n);
+		ASSERT(size_t(blocks[n].data) % 16 == 0);
+		fwk::deallocate(blocks[n].data);
+	}
+}
+
+// Zones are kept in CPU memory, so that relocations can be verified
+struct FakeZoneAllocator {
+	static u64 alloc(u64 size, uint zone_id, void *ptr) {
+		auto &self = *reinterpret_cast<FakeZoneAllocator *>(ptr);
+		if(zone_id >= uint(self.zones.size()))
+			self.zones.resize(zone_id + 1);
+		ASSERT(self.zones[zone_id].empty());
+		self.zones[zone_id].resize(size);
+		self.num_live++;
+		return size;
+	}
+	static void free(uint zone_id, void *ptr) {
+		auto &self = *reinterpret_cast<FakeZoneAllocator *>(ptr);
+		ASSERT(!self.zones[zone_id].empty());
+		self.zones[zone_id].free();
+		self.num_live--;
+	}
+
+	SlabAllocator::ZoneAllocator get() { return {alloc, this, free}; }
+	char *data(const SlabAllocator::Allocation &alloc) {
+		return zones[alloc.zone_id].data() + alloc.offset;
+	}
+
+	vector<PodVector<char>> zones;
+	int num_live = 0;
+};
+
+// Long-running workload with allocations of varying sizes & lifetimes; Every few rounds memory
+// is defragmented and garbage-collected
+void slabFragmentationTest() {
+	print("Memory test #3 (slab allocator fragmentation)\n");
+	using Ident = SlabAllocator::Identifier;
+	struct LiveAlloc {
+		Ident ident;
+		SlabAllocator::Allocation alloc;
+		u32 tag;
+	};
+
+	FakeZoneAllocator zones;
+	SlabAllocator slabs(SlabAllocator::min_zone_size, zones.get());
+	vector<LiveAlloc> live;
+	Random rand(123);
+	u32 next_tag = 0;
+
+	auto write = [&](LiveAlloc &alloc) {
+		char *data = zones.data(alloc.alloc);
+		memcpy(data, &alloc.tag, sizeof(u32));
+		memcpy(data + alloc.alloc.size - sizeof(u32), &alloc.tag, sizeof(u32));
+	};
+	auto check = [&](const LiveAlloc &alloc) {
+		u32 first, last;
+		const char *data = zones.data(alloc.alloc);
+		memcpy(&first, data, sizeof(u32));
+		memcpy(&last, data + alloc.alloc.size - sizeof(u32), sizeof(u32));
+		ASSERT(first == alloc.tag && last == alloc.tag);
+	};
+
+	double time = 0.0;
+	int num_relocations = 0;
+	for(int round = 0; round < 40; round++) {
+		// Long-lived data grows slowly, most of the rest is freed
+		int num_allocs = round < 20 ? 3000 : 500;
+		for(int n = 0; n < num_allocs; n++) {
+			int kind = rand.uniform(100);
+			u64 size = kind < 80   ? rand.uniform(200, 8 * 1024)
+					   : kind < 98 ? rand.uniform(8 * 1024, 256 * 1024)
+								   : rand.uniform(256 * 1024, 2 * 1024 * 1024);
+			auto [ident, alloc] = slabs.alloc(size);
+			ASSERT(ident.isValid());
+			live.emplace_back(ident, alloc, next_tag++);
+			write(live.back());
+		}
+		for(int n = 0; n < live.size(); n++)
+			if(rand.uniform(100) < (round < 20 ? 40 : 60)) {
+				slabs.free(live[n].ident);
+				live[n--] = live.back();
+				live.pop_back();
+			}
+
+		if(round % 10 != 9)
+			continue;
+		auto before = slabs.stats();
+		auto start = getTime();
+		auto relocs = slabs.planDefragmentation();
+
+		HashMap<u64, int> live_map;
+		for(int n = 0; n < live.size(); n++)
+			live_map.emplace(live[n].ident.value, n);
+		for(auto &reloc : relocs) {
+			memcpy(zones.data(reloc.dst), zones.data(reloc.src), reloc.src.size);
+			auto &alloc = live[live_map[reloc.src_ident.value]];
+			alloc.ident = reloc.dst_ident;
+			alloc.alloc = reloc.dst;
+			slabs.free(reloc.src_ident);
+		}
+		slabs.collectGarbage();
+		time += getTime() - start;
+		num_relocations += relocs.size();
+		slabs.verifySlabs().check();
+		for(auto &alloc : live)
+			check(alloc);
+
+		auto after = slabs.stats();
+		ASSERT_EQ(before.used_memory, after.used_memory);
+		ASSERT(after.zone_memory <= before.zone_memory);
+		ASSERT_EQ(after.num_empty_chunk_groups, 0);
+		ASSERT_EQ(zones.num_live, after.num_zones);
+		printf("  round %2d: fragmentation: %5.2f%% -> %5.2f%%  zones: %2d -> %2d  "
+			   "relocations: %d\n",
+			   round, before.fragmentation() * 100.0, after.fragmentation() * 100.0,
+			   before.num_zones, after.num_zones, int(relocs.size()));
+	}
+	printf("  defragmentation: %.2f ms (%d relocations)\n", time * 1000.0, num_relocations);
+
+	for(auto &alloc : live)
+		slabs.free(alloc.ident);
+	slabs.collectGarbage();
+	ASSERT_EQ(zones.num_live, 0);
+	ASSERT_EQ(slabs.stats().num_zones, 0);
+
+	// Indices of released zones are reused
+	auto [ident, alloc] = slabs.alloc(1024);
+	ASSERT(ident.isValid() && alloc.zone_id == 0);
+}
+
+struct LockedSlabAllocator {
+	auto alloc(u64 size) {
+		MutexLocker lock(mutex);
+		return slabs.alloc(size);
+	}
+	void free(SlabAllocator::Identifier ident) {
+		MutexLocker lock(mutex);
+		slabs.free(ident);
+	}
+
+	Mutex mutex;
+	SlabAllocator slabs;
+};
+
+// Each thread allocates chunks (freeing some of them immediately); Remaining chunks are freed
+// by a different thread
+template <class Allocator> struct SlabScalingTest {
+	using Ident = SlabAllocator::Identifier;
+	using Allocation = SlabAllocator::Allocation;
+
+	struct Worker {
+		Allocator *slabs;
+		Worker *neighbour;
+		vector<Pair<Ident, Allocation>> allocs;
+		vector<int> sizes;
+	};
+
+	static constexpr int num_rounds = 200, allocs_per_round = 64;
+
+	static void *runAlloc(void *ptr) {
+		auto &worker = *(Worker *)ptr;
+		worker.allocs.reserve(worker.sizes.size());
+		for(int round = 0; round < num_rounds; round++) {
+			for(int n = 0; n < allocs_per_round; n++) {
+				auto result = worker.slabs->alloc(worker.sizes[round * allocs_per_round + n]);
+				ASSERT(result.first.isValid());
+				worker.allocs.emplace_back(result);
+			}
+			for(int n = 0; n < allocs_per_round / 2; n++) {
+				worker.slabs->free(worker.allocs.back().first);
+				worker.allocs.pop_back();
+			}
+		}
+		return nullptr;
+	}
+
+	static void *runFree(void *ptr) {
+		auto &worker = *(Worker *)ptr;
+		for(auto &alloc : worker.neighbour->allocs)
+			worker.slabs->free(alloc.first);
+		return nullptr;
+	}
+
+	template <class Func> static void runThreads(vector<Worker> &workers, Func func) {
+		vector<Dynamic<Thread>> threads;
+		for(auto &worker : workers)
+			threads.emplace_back(func, &worker);
+		for(auto &thread : threads)
+			thread->join();
+	}
+
+	// Returns ns per alloc + free pair
+	static double run(Allocator &slabs, int num_threads, bool check_overlaps) {
+		vector<Worker> workers(num_threads);
+		for(int n = 0; n < num_threads; n++) {
+			Random rand(n);
+			workers[n].slabs = &slabs;
+			workers[n].neighbour = &workers[(n + 1) % num_threads];
+			for(int i = 0; i < num_rounds * allocs_per_round; i++)
+				workers[n].sizes.emplace_back(rand.uniform(256, 16 * 1024));
+		}
+
+		auto time = getTime();
+		runThreads(workers, runAlloc);
+		auto alloc_time = getTime() - time;
+
+		if(check_overlaps) {
+			vector<Allocation> allocs;
+			for(auto &worker : workers)
+				for(auto &alloc : worker.allocs)
+					allocs.emplace_back(alloc.second);
+			auto key = [](const Allocation &alloc) { return Pair(alloc.zone_id, alloc.offset); };
+			std::sort(allocs.begin(), allocs.end(),
+					  [&](auto &a, auto &b) { return key(a) < key(b); });
+			for(int n = 1; n < allocs.size(); n++)
+				ASSERT(allocs[n - 1].zone_id != allocs[n].zone_id ||
+					   allocs[n - 1].offset + allocs[n - 1].size <= allocs[n].offset);
+		}
+
+		time = getTime();
+		runThreads(workers, runFree);
+		time = getTime() - time + alloc_time;
+		return time * 1000000000.0 / (double(num_threads) * num_rounds * allocs_per_round);
+	}
+};
+
+void slabScalingTest() {
+	print("Memory test #4 (slab allocator thread scaling)\n");
+	for(int num_threads = 1; num_threads <= 32; num_threads *= 2) {
+		LockedSlabAllocator locked;
+		double locked_time = SlabScalingTest<LockedSlabAllocator>::run(locked, num_threads, false);
+
+		ConcurrentSlabAllocator concurrent;
+		double concurrent_time =
+			SlabScalingTest<ConcurrentSlabAllocator>::run(concurrent, num_threads, true);
+		concurrent.flush();
+		auto &backend = concurrent.backend();
+		backend.verifySlabs().check();
+		ASSERT_EQ(backend.stats().used_memory, 0);
+
+		printf("  %2d threads: SlabAllocator + Mutex: %7.2f ns  ConcurrentSlabAllocator: %7.2f ns\n",
+			   num_threads, locked_time, concurrent_time);
+	}
+}
+
+void testMain() {
+	overlapTest();
+	frameLoopTests();
+	crossThreadTest();
+	slabFragmentationTest();
+	slabScalingTest();
+}
@@ -0,0 +1,116 @@
+// Copyright (C) Krzysztof Jakubowski <nadult@fastmail.fm>
+// This file is part of libfwk. See license.txt for details.
+
+#include "fwk/dynamic.h"
+#include "fwk/sys/ring_queue.h"
+#include "fwk/sys/thread.h"
+#include "fwk/vector.h"
+#include "testing.h"
+
+// Reference queue: ring buffer protected with a mutex
+struct LockedQueue {
+	LockedQueue(int capacity) : values(capacity) {}
+
+	bool tryPush(int value) {
+		MutexLocker lock(mutex);
+		if(tail - head == values.size())
+			return false;
+		values[tail++ % values.size()] = value;
+		return true;
+	}
+	bool tryPop(int &out) {
+		MutexLocker lock(mutex);
+		if(head == tail)
+			return false;
+		out = values[head++ % values.size()];
+		return true;
+	}
+
+	Mutex mutex;
+	vector<int> values;
+	long long head = 0, tail = 0;
+};
+
+// Every producer pushes num_items values; consumers pop until all values are received.
+// Failed try* operations are counted (and followed by a yield), so that contention is visible.
+template <class Queue> struct ContentionTest {
+	struct Context {
+		Queue *queue;
+		int num_items, num_producers;
+		std::atomic<int> num_received = 0;
+		std::atomic<long long> num_failed = 0, sum = 0;
+	};
+
+	static void *runProducer(void *arg) {
+		auto &ctx = *(Context *)arg;
+		long long num_failed = 0;
+		for(int n = 0; n < ctx.num_items; n++)
+			while(!ctx.queue->tryPush(n)) {
+				num_failed++;
+				std::this_thread::yield();
+			}
+		ctx.num_failed += num_failed;
+		return nullptr;
+	}
+
+	static void *runConsumer(void *arg) {
+		auto &ctx = *(Context *)arg;
+		long long num_failed = 0, sum = 0;
+		int total = ctx.num_items * ctx.num_producers, value;
+		while(ctx.num_received.load(std::memory_order_relaxed) < total) {
+			if(ctx.queue->tryPop(value)) {
+				sum += value;
+				ctx.num_received.fetch_add(1, std::memory_order_relaxed);
+			} else {
+				num_failed++;
+				std::this_thread::yield();
+			}
+		}
+		ctx.sum += sum;
+		ctx.num_failed += num_failed;
+		return nullptr;
+	}
+
+	static void run(const char *name, int num_producers, int num_consumers, int num_items) {
+		Queue queue(1024);
+		Context ctx;
+		ctx.queue = &queue;
+		ctx.num_items = num_items;
+		ctx.num_producers = num_producers;
+
+		vector<Dynamic<Thread>> threads;
+		auto time = getTime();
+		for(int n = 0; n < num_producers; n++)
+			threads.emplace_back(runProducer, &ctx);
+		for(int n = 0; n < num_consumers; n++)
+			threads.emplace_back(runConsumer, &ctx);
+		for(auto &thread : threads)
+			thread->join();
+		time = getTime() - time;
+
+		long long total = (long long)num_items * num_producers;
+		ASSERT(ctx.sum.load() == num_producers * ((long long)num_items * (num_items - 1) / 2));
+		printf("%8s %2d -> %2d threads: %8.2f Mops / sec  failed ops: %5.2f%%\n", name,
+			   num_producers, num_consumers, total / time * 0.000001,
+			   double(ctx.num_failed.load()) * 100.0 / double(total + ctx.num_failed.load()));
+	}
+};
+
+void testMain() {
+	int num_items = 2000000;
+	print("Ring queues (capacity: 1024)\n");
+	ContentionTest<SpscQueue<int>>::run("spsc", 1, 1, num_items);
+	ContentionTest<MpmcQueue<int>>::run("mpmc", 1, 1, num_items);
+	ContentionTest<LockedQueue>::run("locked", 1, 1, num_items);
+
+	int max_threads = max(Thread::hardwareConcurrency() / 2, 2);
+	for(int num_threads = 2; num_threads <= max_threads; num_threads *= 2) {
+		ContentionTest<MpmcQueue<int>>::run("mpmc", num_threads, num_threads,
+											num_items / num_threads);
+		ContentionTest<LockedQueue>::run("locked", num_threads, num_threads,
+										 num_items / num_threads);
+	}
+	// Many producers & single consumer (like frames submitted to perf::Manager)
+	ContentionTest<MpmcQueue<int>>::run("mpmc", max_threads, 1, num_items / max_threads);
+	ContentionTest<LockedQueue>::run("locked", max_threads, 1, num_items / max_threads);
+}
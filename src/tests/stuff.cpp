@@ -2,7 +2,10 @@
 // This file is part of libfwk. See license.txt for details.
 
 #include "fwk/any.h"
+#include "fwk/arena.h"
 #include "fwk/array.h"
+#include "fwk/atom.h"
+#include "fwk/bit_vector.h"
 #include "fwk/enum_flags.h"
 #include "fwk/enum_map.h"
 #include "fwk/fwd_member.h"
@@ -11,13 +14,22 @@
 #include "fwk/io/file_system.h"
 #include "fwk/io/gzip_stream.h"
 #include "fwk/io/memory_stream.h"
+#include "fwk/large_vector.h"
 #include "fwk/math/box.h"
 #include "fwk/math/matrix4.h"
 #include "fwk/math/random.h"
+#include "fwk/pod_vector.h"
+#include "fwk/small_string.h"
+#include "fwk/sparse_vector.h"
+#include "fwk/sys/job_system.h"
+#include "fwk/sys/memory.h"
 #include "fwk/sys/on_fail.h"
+#include "fwk/sys/ring_queue.h"
+#include "fwk/sys/thread.h"
 #include "fwk/tag_id.h"
 #include "fwk/type_info_gen.h"
 #include "fwk/variant.h"
+#include "fwk/vector_map.h"
 #include "testing.h"
 
 DEFINE_ENUM(SomeTag, foo, bar);
@@ -94,6 +106,47 @@ struct BigType {
 	int num_copies;
 };
 
+void testSmallString() {
+	SmallString<> str = "short";
+	ASSERT(str.isSmall());
+	ASSERT_EQ(ZStr(str), "short");
+	str += " string which doesn't fit";
+	ASSERT(!str.isSmall());
+	ASSERT_EQ(str, Str("short string which doesn't fit"));
+	ASSERT_EQ(zstrLength(str.c_str()), str.size());
+	ASSERT_EQ(format("%", str), "short string which doesn't fit");
+
+	auto moved = std::move(str);
+	ASSERT(str.empty() && !moved.isSmall());
+	SmallString<15> copy = Str(moved).substr(0, 5);
+	ASSERT(copy.isSmall());
+	ASSERT(copy < moved);
+	static_assert(sizeof(SmallString<>) == 32);
+
+	// Appending to itself, also when memory has to be reallocated
+	SmallString<> self = "0123456789";
+	self.append(self);
+	ASSERT_EQ(self, Str("01234567890123456789"));
+	self += self.str();
+	ASSERT_EQ(self.size(), 40);
+	ASSERT_EQ(Str(self).substr(20), Str("01234567890123456789"));
+	self.append(Str(self).substr(35));
+	ASSERT(Str(self).endsWith("5678956789"));
+
+	Atom atom1("node_name"), atom2(string("node_name")), atom3("other");
+	ASSERT(atom1 == atom2 && atom1 != atom3);
+	ASSERT_EQ(atom1.c_str(), atom2.c_str());
+	ASSERT_EQ(atom1.str(), "node_name");
+	ASSERT_EQ(format("%", atom1), "node_name");
+	ASSERT(Atom::find("node_name") == atom1);
+	ASSERT(!Atom::find("missing name"));
+	ASSERT(Atom().empty() && Atom("") == Atom());
+
+	HashMap<Atom, int> atom_map;
+	atom_map[atom1] = 10;
+	ASSERT_EQ(atom_map[atom2], 10);
+}
+
 void testVariant() {
 	using Var1 = Variant<string, FBox>;
 	Var1 var = string("woohoo");
@@ -287,6 +340,254 @@ void testVector() {
 	ASSERT(toString(sortedUnique(vecs)) == "abc xxx yyy zzz");
 }
 
+struct alignas(64) CacheLineCounter {
+	int value = 0;
+};
+struct alignas(32) AlignedVec8 {
+	float values[8];
+};
+
+template <class T> bool isAligned(const T *ptr) { return size_t(ptr) % alignof(T) == 0; }
+
+void testAlignedAllocations() {
+	vector<CacheLineCounter> counters;
+	for(int n = 0; n < 100; n++) {
+		counters.emplace_back(n);
+		ASSERT(isAligned(counters.data()));
+	}
+	counters.erase(counters.begin() + 10, counters.begin() + 20);
+	counters.insert(counters.begin() + 5, CacheLineCounter{-1});
+	ASSERT_EQ(counters[5].value, -1);
+	ASSERT_EQ(counters.back().value, 99);
+	ASSERT(isAligned(counters.data()));
+
+	vector<CacheLineCounter> pooled(pool_alloc);
+	pooled.resize(3);
+	ASSERT(isAligned(pooled.data()));
+
+	PodVector<AlignedVec8> vectors(5);
+	vectors.resize(1000);
+	ASSERT(isAligned(vectors.data()));
+
+	auto *counter = new CacheLineCounter{10};
+	auto *many_counters = new CacheLineCounter[7];
+	ASSERT(isAligned(counter) && isAligned(many_counters));
+	delete counter;
+	delete[] many_counters;
+}
+
+void testArena() {
+	Arena arena(64 * 1024);
+	{
+		Arena::Scope scope(arena);
+		vector<int> ints(arena);
+		for(int n = 0; n < 1000; n++)
+			ints.emplace_back(n);
+		ASSERT(arena.contains(ints.data()));
+		ASSERT_EQ(ints[999], 999);
+
+		vector<int> copy = ints;
+		ASSERT(!arena.contains(copy.data()));
+		ASSERT(detail::findArena(ints.data()) == &arena && !detail::findArena(copy.data()));
+		ints.insert(ints.begin(), copy.begin(), copy.begin() + 10);
+		ASSERT(arena.contains(ints.data()));
+		ASSERT_EQ(ints[1009], 999);
+
+		vector<CacheLineCounter> counters(arena);
+		counters.resize(10);
+		ASSERT(arena.contains(counters.data()) && isAligned(counters.data()));
+
+		HashMap<int, int> map(arena);
+		for(int n = 0; n < 500; n++)
+			map[n] = n * 2;
+		ASSERT(arena.contains(&map[123]));
+		ASSERT_EQ(map[123], 246);
+		ASSERT_EQ(arena.numFallbacks(), 0);
+
+		auto marker = arena.marker();
+		{
+			PodVector<u8> bytes(arena);
+			bytes.resize(1000);
+			ASSERT(arena.contains(bytes.data()));
+			// Doesn't fit, allocated on the heap
+			bytes.resize(100 * 1024);
+			ASSERT(!arena.contains(bytes.data()));
+			ASSERT_EQ(arena.numFallbacks(), 1);
+		}
+		arena.reset(marker);
+		ASSERT_EQ(arena.usedMemory(), marker.offset);
+
+		{
+			// Last allocation grows in place & is released when freed
+			vector<int> last(arena);
+			last.reserve(16);
+			auto *ptr = last.data();
+			last.resize(1000);
+			ASSERT_EQ(last.data(), ptr);
+		}
+		ASSERT_EQ(arena.usedMemory(), marker.offset);
+	}
+	ASSERT_EQ(arena.usedMemory(), 0);
+	ASSERT(arena.peakUsedMemory() > 0);
+}
+
+void testLargeVector() {
+	LargeVector<string> strings = {"a", "b"};
+	for(int n = 0; n < 1000; n++)
+		strings.emplace_back(toString(n));
+	strings.erase(strings.begin(), strings.begin() + 2);
+	ASSERT_EQ(strings.size(), 1000);
+	ASSERT_EQ(strings[999], "999");
+	string extra = "x";
+	strings.insert(strings.begin(), extra);
+	ASSERT_EQ(strings.front(), "x");
+	ASSERT_EQ(strings.span(1, 3), CSpan<string>({"0", "1"}));
+
+	LargePodVector<int> ints(CSpan<int>({1, 2, 3}));
+	ints.push_back(4);
+	ints.resize(5000);
+	ASSERT_EQ(ints[3], 4);
+	CLargeSpan<int> large_span = ints;
+	ASSERT_EQ(large_span.subSpan(1, 4).span(), CSpan<int>({2, 3, 4}));
+	static_assert(!is_span<LargePodVector<int>> && !is_span<LargeSpan<int>>);
+
+	// Capacity of huge vectors can go beyond 2^31
+	i64 capacity = 1;
+	while(capacity < (i64(1) << 33))
+		capacity = largeVectorGrowCapacity(capacity, 1);
+	ASSERT_EQ(capacity % (2 * 1024 * 1024), 0);
+}
+
+void testVectorMap() {
+	VectorMap<int, string> map;
+	ASSERT(map.insert({5, "five"}).second);
+	ASSERT(!map.insert({5, "other"}).second);
+	map[3] = "three";
+	map.insertMany({{10, "ten"}, {1, "one"}, {3, "x"}, {7, "seven"}, {1, "y"}});
+	ASSERT_EQ(map.size(), 5);
+	ASSERT_EQ(map.keys(), CSpan<int>({1, 3, 5, 7, 10}));
+	ASSERT_EQ(map.find(1, ""), "one");
+	ASSERT_EQ(map.find(3)->second, "three");
+	ASSERT(map.find(4) == map.end());
+	ASSERT_EQ(map.lower_bound(6).key(), 7);
+	ASSERT_EQ(map.upper_bound(7).key(), 10);
+	map.erase(5);
+	map.erase_if([](const auto &pair) { return pair.first == 10; });
+	ASSERT_EQ(map.keys(), CSpan<int>({1, 3, 7}));
+	ASSERT_EQ(map.atIndex(2).second, "seven");
+
+	// Branchless search with linear scan at the end
+	VectorMap<int, int> big;
+	vector<pair<int, int>> pairs;
+	for(int n = 0; n < 1000; n++)
+		pairs.emplace_back(n * 3, n);
+	big.insertMany(pairs);
+	for(int n = -1; n < 3001; n++) {
+		int idx = big.lowerBoundIndex(n);
+		ASSERT_EQ(idx, std::lower_bound(big.keys().begin(), big.keys().end(), n) -
+						   big.keys().begin());
+		ASSERT_EQ(big.maybeFind(n), n % 3 == 0 && n < 3000 ? Maybe<int>(n / 3) : none);
+	}
+}
+
+void testBitVector() {
+	BitVector bits(1000), other(1000);
+	ASSERT_EQ(bits.count(), 0);
+	ASSERT_EQ(bits.findFirst(), -1);
+	vector<int> indices;
+	for(int n = 3; n < 1000; n += 7) {
+		bits[n] = true;
+		indices.emplace_back(n);
+	}
+	ASSERT_EQ(bits.count(), indices.size());
+	ASSERT_EQ(bits.findFirst(), 3);
+	ASSERT_EQ(bits.findNext(3), 10);
+	ASSERT_EQ(bits.findNext(997), -1);
+	vector<int> set_bits;
+	for(int idx : bits.setBits())
+		set_bits.emplace_back(idx);
+	ASSERT_EQ(set_bits, indices);
+
+	BitVectorRank rank(bits);
+	ASSERT_EQ(rank.rank(0), 0);
+	ASSERT_EQ(rank.rank(4), 1);
+	ASSERT_EQ(rank.rank(1000), indices.size());
+	for(int n : intRange(indices))
+		ASSERT_EQ(rank.select(n), indices[n]);
+	ASSERT_EQ(rank.select(indices.size()), -1);
+
+	other.fill(true);
+	ASSERT_EQ(other.count(), 1000);
+	other.andNot(bits);
+	ASSERT_EQ(other.count(), 1000 - indices.size());
+	other |= bits;
+	ASSERT_EQ(other.count(), 1000);
+	other ^= bits;
+	other &= bits;
+	ASSERT_EQ(other.count(), 0);
+
+	bits.resize(1100, true);
+	ASSERT_EQ(bits.count(), indices.size() + 100);
+	bits.resize(500);
+	ASSERT_EQ(bits.findNext(499), -1);
+	ASSERT(BitVector(130) == BitVector(130));
+}
+
+template <class TVec> void testSparseVector() {
+	TVec vec;
+	for(int n = 0; n < 300; n++)
+		vec.emplace(n);
+	for(int n = 0; n < 300; n++)
+		if(n % 7 != 3)
+			vec.erase(n);
+	ASSERT_EQ(vec.size(), 43);
+	ASSERT_EQ(vec.firstIndex(), 3);
+	ASSERT_EQ(vec.lastIndex(), 297);
+	ASSERT_EQ(vec.nextIndex(3), 10);
+	ASSERT_EQ(vec.nextIndex(297), vec.spread());
+	ASSERT_EQ(transform(vec.indices(), [](int i) { return i; }).size(), 43);
+
+	auto copy = vec;
+	ASSERT(copy == vec);
+	auto mapping = vec.compact();
+	ASSERT_EQ(vec.spread(), 43);
+	ASSERT_EQ(mapping[3], 0);
+	ASSERT_EQ(mapping[4], -1);
+	ASSERT_EQ(mapping[297], 42);
+	for(int n : copy.indices())
+		ASSERT_EQ(vec[mapping[n]], copy[n]);
+	ASSERT_EQ(vec.emplace(1000), 43);
+
+	vec.clear();
+	ASSERT_EQ(vec.firstIndex(), 0);
+	vec.emplaceAt(130, 5);
+	ASSERT_EQ(vec.firstIndex(), 130);
+	ASSERT_EQ(vec.lastIndex(), 130);
+}
+
+void testLargeAllocations() {
+	auto old_config = largeAllocConfig();
+	setLargeAllocConfig({.min_size = 1024 * 1024});
+
+	vector<int> ints;
+	for(int n = 0; n < 1024 * 1024; n++)
+		ints.emplace_back(n);
+#ifdef FWK_PLATFORM_LINUX
+	ASSERT(isLargeAllocation(ints.data()));
+#endif
+	for(int n = 0; n < ints.size(); n++)
+		ASSERT_EQ(ints[n], n);
+	ints.free();
+
+	LargePodVector<u64> values;
+	for(int n = 0; n < 500000; n++)
+		values.push_back(u64(n) * 3);
+	ASSERT_EQ(values[499999], u64(499999) * 3);
+	ASSERT(!isLargeAllocation(&values[1]));
+
+	setLargeAllocConfig(old_config);
+}
+
 void testHashMap() {
 	HashMap<string, int> map;
 	// TODO: separate hash function for strings
@@ -400,9 +701,142 @@ void testEnums() {
 	ASSERT_EQ(countBits(EnumFlags<BigEnum>(all<BigEnum>)), count<BigEnum>);
 }
 
+// Runs a functor on a separate Thread; Functor has to outlive the thread
+template <class Func> void *runFunctor(void *arg) {
+	(*(Func *)arg)();
+	return nullptr;
+}
+
+void testJobSystem() {
+	JobSystem jobs({.num_workers = 3});
+	ASSERT_EQ(JobSystem::instance(), &jobs);
+
+	vector<int> values(10000);
+	jobs.parallelFor(intRange(values), 0, [&](int idx) { values[idx] = idx * 2; });
+	for(int n : intRange(values))
+		ASSERT_EQ(values[n], n * 2);
+
+	// Nested parallelFor & sum
+	std::atomic<long long> sum = 0;
+	jobs.parallelFor(intRange(16), 1, [&](int outer) {
+		jobs.parallelChunks(intRange(1000), 64, [&](int begin, int end) {
+			long long partial = 0;
+			for(int n = begin; n < end; n++)
+				partial += n + outer;
+			sum += partial;
+		});
+	});
+	ASSERT_EQ(sum.load(), 16ll * (999 * 1000 / 2) + 1000ll * (15 * 16 / 2));
+
+	// Dependencies: second stage starts after all jobs from the first stage are finished
+	JobCounter first, second;
+	std::atomic<int> num_first = 0;
+	std::atomic<bool> order_ok = true;
+	for(int n = 0; n < 100; n++)
+		jobs.run([&] { num_first++; }, &first);
+	for(int n = 0; n < 10; n++)
+		jobs.run(
+			[&] {
+				if(num_first.load() != 100)
+					order_ok = false;
+			},
+			&second, &first);
+	jobs.wait(second);
+	ASSERT(first.done() && second.done());
+	ASSERT(order_ok.load());
+
+	// Jobs submitted from a thread which isn't part of JobSystem
+	JobCounter external;
+	std::atomic<int> num_external = 0;
+	auto submit = [&] {
+		for(int n = 0; n < 50; n++)
+			jobs.run([&] { num_external++; }, &external);
+	};
+	Thread thread(runFunctor<decltype(submit)>, &submit);
+	thread.join();
+	jobs.wait(external);
+	ASSERT_EQ(num_external.load(), 50);
+}
+
+void testRingQueues() {
+	SpscQueue<string> spsc(5);
+	ASSERT_EQ(spsc.capacity(), 8);
+	ASSERT(!spsc.tryPop());
+	for(int n = 0; n < 8; n++)
+		ASSERT(spsc.tryPush(toString(n)));
+	ASSERT(!spsc.tryPush("x"));
+	ASSERT_EQ(spsc.size(), 8);
+	for(int n = 0; n < 8; n++)
+		ASSERT_EQ(spsc.pop(), toString(n));
+	ASSERT(spsc.empty());
+
+	// Wrapping around & destroying elements which are left in the queue
+	auto ptr = make_shared<int>(7);
+	{
+		MpmcQueue<shared_ptr<int>> mpmc(4);
+		for(int n = 0; n < 6; n++) {
+			ASSERT(mpmc.tryPush(ptr));
+			ASSERT(mpmc.tryPop());
+		}
+		for(int n = 0; n < 4; n++)
+			mpmc.push(ptr);
+		ASSERT(!mpmc.tryPush(ptr));
+		ASSERT_EQ(ptr.use_count(), 5);
+	}
+	ASSERT_EQ(ptr.use_count(), 1);
+
+	// Producers & consumers running concurrently; every element has to be received once
+	int num_producers = 3, num_consumers = 3, num_items = 20000;
+	MpmcQueue<int> queue(64);
+	std::atomic<long long> sum = 0;
+	std::atomic<int> num_received = 0;
+	// Threads with ids lower than num_producers are producers, the rest are consumers
+	auto work = [&](int id) {
+		if(id < num_producers) {
+			for(int n = 0; n < num_items; n++)
+				queue.push(id * num_items + n);
+			return;
+		}
+		int value;
+		while(num_received.load() < num_producers * num_items)
+			if(queue.tryPop(value)) {
+				sum += value;
+				num_received++;
+			} else {
+				std::this_thread::yield();
+			}
+	};
+	struct Task {
+		void operator()() const { (*func)(id); }
+		decltype(work) *func;
+		int id;
+	};
+	vector<Task> tasks;
+	for(int n = 0; n < num_producers + num_consumers; n++)
+		tasks.emplace_back(Task{&work, n});
+	vector<Dynamic<Thread>> threads;
+	for(auto &task : tasks)
+		threads.emplace_back(runFunctor<Task>, &task);
+	for(auto &thread : threads)
+		thread->join();
+	long long total = num_producers * num_items;
+	ASSERT_EQ(sum.load(), total * (total - 1) / 2);
+
+	SpscQueue<int> ordered(16);
+	auto produce_ordered = [&] {
+		for(int n = 0; n < num_items; n++)
+			ordered.push(n);
+	};
+	Thread producer(runFunctor<decltype(produce_ordered)>, &produce_ordered);
+	for(int n = 0; n < num_items; n++)
+		ASSERT_EQ(ordered.pop(), n);
+	producer.join();
+}
+
 void testMain() {
 	testHashMap();
 	testString();
+	testSmallString();
 	testAny();
 	testTextFormatter();
 	testXMLConverters();
@@ -414,6 +848,16 @@ void testMain() {
 	testTypes();
 	testExceptions();
 	testVector();
+	testLargeVector();
+	testBitVector();
+	testVectorMap();
+	testSparseVector<SparseVector<int>>();
+	testSparseVector<PackedSparseVector<int>>();
+	testLargeAllocations();
+	testAlignedAllocations();
+	testArena();
+	testJobSystem();
+	testRingQueues();
 	testStreams();
 	testFileSystem();
 	testEnums();
@@ -6,11 +6,14 @@
 #include <string>
 #include <vector>
 
+#include "fwk/arena.h"
+#include "fwk/hash_map.h"
 #include "fwk/math/random.h"
 #include "fwk/math_base.h"
 #include "fwk/sparse_vector.h"
 #include "fwk/sys/memory.h"
 #include "fwk/vector.h"
+#include "fwk/vector_map.h"
 #include "timer.h"
 
 using fwk::TestTimer;
@@ -27,6 +30,11 @@ template <class T> struct PoolInitializedVec : public fwk::vector<T> {
 	PoolInitializedVec() : fwk::vector<T>(fwk::pool_alloc) {}
 };
 
+fwk::Arena *g_frame_arena = nullptr;
+template <class T> struct ArenaInitializedVec : public fwk::vector<T> {
+	ArenaInitializedVec() : fwk::vector<T>(*g_frame_arena) {}
+};
+
 template <template <typename> class Vec> void testVector(const char *name) {
 	TestTimer t(name);
 
@@ -122,6 +130,54 @@ template <template <typename> class Vec> void testVectorInsert(const char *name)
 	}
 }
 
+// Lots of short-lived temporaries of different sizes created every frame;
+// Arena is reset at the end of each frame.
+template <template <typename> class Vec> void testFrameTemporaries(const char *name) {
+	TestTimer t(name);
+	fwk::Random rand(123);
+	int sum = 0;
+
+	for(int frame = 0; frame < 100; frame++) {
+		for(int n = 0; n < 1000; n++) {
+			Vec<fwk::int3> points;
+			Vec<int> indices;
+			int count = rand.uniform(100) < 90 ? rand.uniform(1, 32) : rand.uniform(32, 1024);
+			for(int i = 0; i < count; i++) {
+				points.emplace_back(i, i * 2, i * 3);
+				if(i & 1)
+					indices.emplace_back(i);
+			}
+			for(int idx : indices)
+				sum += points[idx][1];
+		}
+		if(g_frame_arena)
+			g_frame_arena->reset();
+	}
+	if(sum == 1234)
+		printf("\n");
+}
+
+void testFrameHashMaps(const char *name, fwk::Arena *arena) {
+	TestTimer t(name);
+	fwk::Random rand(123);
+	int sum = 0;
+
+	for(int frame = 0; frame < 100; frame++) {
+		for(int n = 0; n < 100; n++) {
+			auto map = arena ? fwk::HashMap<int, int>(*arena) : fwk::HashMap<int, int>();
+			int count = rand.uniform(16, 512);
+			for(int i = 0; i < count; i++)
+				map[i * 7] = i;
+			for(int i = 0; i < count; i += 3)
+				sum += map[i * 7];
+		}
+		if(arena)
+			arena->reset();
+	}
+	if(sum == 1234)
+		printf("\n");
+}
+
 // ------------- SparseVector tests ----------------------------------------
 
 template <class T> using stdvec = std::vector<T, fwk::SimpleAllocator<T>>;
@@ -130,7 +186,7 @@ struct Struct {
 	fwk::float2 f2;
 };
 
-FWK_NO_INLINE int iterationLoop(fwk::SparseVector<Struct> &ivec, int n) {
+template <class TVec> FWK_NO_INLINE int iterationLoop(TVec &ivec, int n) {
 	int val = 0;
 	for(auto i : ivec.indices())
 		val += ivec[i].i4[n & 3];
@@ -139,16 +195,16 @@ FWK_NO_INLINE int iterationLoop(fwk::SparseVector<Struct> &ivec, int n) {
 	return val;
 }
 
-FWK_NO_INLINE int testSparseVector() {
+template <class TVec> FWK_NO_INLINE int testSparseVector(const char *name) {
 	using namespace fwk;
-	SparseVector<Struct> ivec;
+	TVec ivec;
 
 	Struct s1{{1, 2, 3, 4}, {2, 3}};
 	Struct s2{{1, 2, 5, 4}, {2, 3}};
 
 	{
 		Random rand;
-		TestTimer t("SparseVector modification");
+		TestTimer t(std::string(name) + " modification");
 		for(int t = 0; t < 1000; t++) {
 			for(int n = 0; n < 1000; n++)
 				ivec.emplace(s1);
@@ -173,13 +229,89 @@ FWK_NO_INLINE int testSparseVector() {
 		total_time = getTime() - time;
 		val_time = total_time / num_iters;
 	}
+	if(val == 1234)
+		printf("\n");
 
-	printf("SparseVector iteration completed in %.4f msec\n", total_time * 1000.0);
+	printf("%s iteration completed in %.4f msec\n", name, total_time * 1000.0);
 	printf("Values: %.2f %%; %f ns / value\n", double(num_values) * 100.0 / double(num_iters),
 		   total_time * 1000000000.0 / num_values);
 	return val;
 }
 
+// Iteration over vectors with randomly placed holes; density: fraction of valid elements
+template <class TVec> FWK_NO_INLINE int testSparseIteration(const char *name, double density) {
+	using namespace fwk;
+	constexpr int spread = 1024 * 1024, num_iters = 50;
+	TVec ivec;
+	Struct s1{{1, 2, 3, 4}, {2, 3}};
+	for(int n = 0; n < spread; n++)
+		ivec.emplace(s1);
+	Random rand(123);
+	for(int n = 0; n < spread; n++)
+		if(rand.uniform(0.0, 1.0) >= density)
+			ivec.erase(n);
+
+	int val = 0;
+	auto time = getTime();
+	for(int n = 0; n < num_iters; n++)
+		val += iterationLoop(ivec, n);
+	double total_time = getTime() - time;
+	if(val == 1234)
+		printf("\n");
+
+	printf("%s iteration (density: %5.1f %%): %7.3f ns / element; valids: %.1f KB\n", name,
+		   density * 100.0, total_time * 1000000000.0 / (double(spread) * num_iters),
+		   double(ivec.usedMemory() - ivec.capacity() * (i64)sizeof(Struct)) / 1024.0);
+	return val;
+}
+
+// ------------- VectorMap tests -------------------------------------------
+
+FWK_NO_INLINE void testVectorMap(int size) {
+	using namespace fwk;
+	Random rand(7);
+	vector<pair<int, int>> pairs;
+	for(int n = 0; n < size; n++)
+		pairs.emplace_back(rand.uniform(0, size * 4), n);
+
+	VectorMap<int, int> map1, map2;
+	{
+		TestTimer t("VectorMap insert");
+		for(auto pair : pairs)
+			map1.insert(std::move(pair));
+	}
+	{
+		TestTimer t("VectorMap insertMany");
+		map2.insertMany(pairs);
+	}
+	ASSERT(map1.keys() == map2.keys());
+
+	vector<pair<int, int>> sorted_pairs;
+	for(auto [key, value] : map2)
+		sorted_pairs.emplace_back(key, value);
+	auto compare = [](const pair<int, int> &pair, int key) { return pair.first < key; };
+	vector<int> queries;
+	for(int n = 0; n < 1000000; n++)
+		queries.emplace_back(rand.uniform(0, size * 4));
+
+	int sum1 = 0, sum2 = 0;
+	{
+		TestTimer t("std::lower_bound on pairs lookup");
+		for(int n = 0; n < 1000000; n++) {
+			auto it = std::lower_bound(sorted_pairs.begin(), sorted_pairs.end(), queries[n], compare);
+			sum1 += it == sorted_pairs.end() ? 0 : it->second;
+		}
+	}
+	{
+		TestTimer t("VectorMap lookup");
+		for(int n = 0; n < 1000000; n++) {
+			int idx = map2.lowerBoundIndex(queries[n]);
+			sum2 += idx == map2.size() ? 0 : map2.values()[idx];
+		}
+	}
+	ASSERT(sum1 == sum2);
+}
+
 // ------------- Main function --------------------------------------------------
 
 int main() {
@@ -209,8 +341,32 @@ int main() {
 	testVectorInsert<stdvec>("std::vector insert");
 	printf("\n");
 
+	{
+		fwk::Arena arena(4 * 1024 * 1024);
+		g_frame_arena = &arena;
+		testFrameTemporaries<fwk::vector>("fwk::Vector frame temporaries");
+		testFrameTemporaries<PoolInitializedVec>("fwk::Vector(Pooled) frame temporaries");
+		testFrameTemporaries<ArenaInitializedVec>("fwk::Vector(Arena) frame temporaries");
+		testFrameTemporaries<stdvec>("std::vector frame temporaries");
+		testFrameHashMaps("fwk::HashMap frame temporaries", nullptr);
+		testFrameHashMaps("fwk::HashMap(Arena) frame temporaries", &arena);
+		printf("Arena peak usage: %.2f KB\n", double(arena.peakUsedMemory()) / 1024.0);
+		g_frame_arena = nullptr;
+		printf("\n");
+	}
+
 	// TODO: special test showing performance of PoolVector
 
-	testSparseVector();
+	testVectorMap(100000);
+	printf("\n");
+
+	testSparseVector<fwk::SparseVector<Struct>>("SparseVector");
+	testSparseVector<fwk::PackedSparseVector<Struct>>("PackedSparseVector");
+	printf("\n");
+
+	for(double density : {0.01, 0.1, 0.5, 0.9, 1.0}) {
+		testSparseIteration<fwk::SparseVector<Struct>>("SparseVector      ", density);
+		testSparseIteration<fwk::PackedSparseVector<Struct>>("PackedSparseVector", density);
+	}
 	return 0;
 }
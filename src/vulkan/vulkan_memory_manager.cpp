@@ -124,7 +124,7 @@ void VulkanMemoryManager::addSlabAllocator(VMemoryDomain domain, u32 zone_size)
 	auto &info = m_domains[domain];
 	info.slab_zone_size = zone_size;
 	if(!info.slab_alloc) {
-		SlabAllocator::ZoneAllocator zone_alloc{&slabAlloc, &info};
+		SlabAllocator::ZoneAllocator zone_alloc{&slabAlloc, &info, &slabFree};
 		info.slab_alloc.emplace(zone_size, zone_alloc);
 	}
 }
@@ -324,12 +324,33 @@ u64 VulkanMemoryManager::slabAlloc(u64 size, uint zone_index, void *domain_ptr)
 		allocDeviceMemory(domain.device_handle, size, domain.type_index, domain.device_address);
 	if(!result)
 		return 0;
-	DASSERT(zone_index == uint(domain.slab_memory.size()));
-	domain.slab_memory.emplace_back(*result, nullptr, u32(size));
+	// Indices of released zones are reused
+	DASSERT(zone_index <= uint(domain.slab_memory.size()));
+	if(zone_index == uint(domain.slab_memory.size()))
+		domain.slab_memory.emplace_back();
+	DASSERT(!domain.slab_memory[zone_index].handle);
+	domain.slab_memory[zone_index] = {*result, nullptr, u32(size)};
 
 	return size;
 }
 
+void VulkanMemoryManager::slabFree(uint zone_index, void *domain_ptr) {
+	DomainInfo &domain = *reinterpret_cast<DomainInfo *>(domain_ptr);
+	auto &memory = domain.slab_memory[zone_index];
+	freeDeviceMemory(domain.device_handle, memory.handle);
+	memory = {};
+}
+
+u64 VulkanMemoryManager::releaseUnusedMemory() {
+	// Pending ranges may refer to memory which will be released
+	flushMappedRanges();
+	u64 released = 0;
+	for(auto &domain : m_domains)
+		if(domain.slab_alloc)
+			released += domain.slab_alloc->collectGarbage();
+	return released;
+}
+
 bool VulkanMemoryManager::DomainInfo::validDomain(u32 type_mask) const {
 	return (type_mask & (1u << type_index)) != 0;
 }